@@ -0,0 +1,475 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Non-blocking console appender (POSIX).
+ */
+
+#if !defined(_POSIX_C_SOURCE)
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "plog_console.h"
+
+#include <errno.h>     // errno, EAGAIN, EINTR
+#include <fcntl.h>     // open, O_*
+#include <poll.h>      // poll
+#include <pthread.h>   // pthread_*
+#include <stdio.h>     // snprintf
+#include <stdlib.h>    // malloc, free
+#include <string.h>    // memcpy, strlen
+#include <sys/stat.h>  // fstat, S_ISFIFO, S_ISCHR
+#include <time.h>      // clock_gettime
+#include <unistd.h>    // write, dup, close, isatty
+
+#define PLOG_CONSOLE_POLL_MS  100  // Helper thread poll interval
+#define PLOG_CONSOLE_CLOSE_MS 1000 // Maximum time spent draining on close
+
+struct plog_console_s
+{
+    int                   fd;             // Output (owned)
+    bool                  b_nonblock;     // True if fd is non-blocking
+    int                   colors;         // Resolved color setting
+    plog_console_policy_t policy;
+    unsigned              block_us;
+    char*                 p_buf;          // Ring buffer
+    size_t                size;
+    size_t                head;           // Bytes ever written to p_buf
+    size_t                tail;           // Bytes ever drained from p_buf
+    uint64_t              drops;
+    uint64_t              drops_reported; // Drops already noted in output
+    uint64_t              flush_req;      // Flush requests made
+    uint64_t              flush_done;     // Flush requests completed
+    bool                  b_stop;
+    pthread_t             thread;
+    pthread_mutex_t       mutex;
+    pthread_cond_t        data;           // Signalled when entries arrive
+    pthread_cond_t        space;          // Signalled when space is freed
+    pthread_cond_t        idle;           // Signalled when a flush completes
+};
+
+/*
+ * Returns the absolute CLOCK_REALTIME time `us` microseconds from now.
+ */
+static struct timespec
+deadline_us (unsigned long us)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    ts.tv_sec  += (time_t)(us / 1000000u);
+    ts.tv_nsec += (long)(us % 1000000u) * 1000L;
+
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec  += 1;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    return ts;
+}
+
+static bool
+deadline_passed (const struct timespec* p_deadline)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return now.tv_sec > p_deadline->tv_sec ||
+           (now.tv_sec == p_deadline->tv_sec &&
+            now.tv_nsec >= p_deadline->tv_nsec);
+}
+
+/*
+ * Opens a private, non-blocking file description for pipes and terminals so
+ * that O_NONBLOCK does not leak to other users of the descriptor. Anything
+ * else (regular files, sockets) is duplicated and written blocking from the
+ * helper thread.
+ */
+static int
+console_open_fd (int fd, bool* p_nonblock)
+{
+    struct stat st;
+
+    if (0 == fstat(fd, &st) && (S_ISFIFO(st.st_mode) || S_ISCHR(st.st_mode)))
+    {
+        char path[32];
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+
+        int private_fd = open(path, O_WRONLY | O_NONBLOCK | O_CLOEXEC | O_NOCTTY);
+
+        if (private_fd >= 0)
+        {
+            *p_nonblock = true;
+            return private_fd;
+        }
+    }
+
+    *p_nonblock = false;
+    return dup(fd);
+}
+
+/*
+ * Writes `len` bytes, waiting for the output to accept them. Gives up once
+ * stopping and past the close deadline. Returns the number of bytes written.
+ */
+static size_t
+console_write (plog_console_t* p_console, const char* p_data, size_t len,
+               const struct timespec* p_deadline)
+{
+    size_t done = 0;
+
+    while (done < len)
+    {
+        ssize_t ret = write(p_console->fd, p_data + done, len - done);
+
+        if (ret > 0)
+        {
+            done += (size_t)ret;
+            continue;
+        }
+
+        if (ret < 0 && EINTR == errno)
+        {
+            continue;
+        }
+
+        if (ret < 0 && (EAGAIN == errno || EWOULDBLOCK == errno))
+        {
+            if (NULL != p_deadline && deadline_passed(p_deadline))
+            {
+                break;
+            }
+
+            struct pollfd pfd = { p_console->fd, POLLOUT, 0 };
+            poll(&pfd, 1, PLOG_CONSOLE_POLL_MS);
+            continue;
+        }
+
+        // The output is gone; discard
+        done = len;
+    }
+
+    return done;
+}
+
+static void*
+console_thread (void* p_arg)
+{
+    plog_console_t* p_console = (plog_console_t*)p_arg;
+    struct timespec close_deadline;
+    bool            b_closing = false;
+
+    pthread_mutex_lock(&p_console->mutex);
+
+    for (;;)
+    {
+        // Everything accepted so far has been written out
+        if (p_console->head == p_console->tail &&
+            p_console->drops == p_console->drops_reported &&
+            p_console->flush_done != p_console->flush_req)
+        {
+            p_console->flush_done = p_console->flush_req;
+            pthread_cond_broadcast(&p_console->idle);
+        }
+
+        while (p_console->head == p_console->tail &&
+               p_console->drops == p_console->drops_reported &&
+               p_console->flush_req == p_console->flush_done &&
+               !p_console->b_stop)
+        {
+            pthread_cond_wait(&p_console->data, &p_console->mutex);
+        }
+
+        if (p_console->b_stop && !b_closing)
+        {
+            close_deadline = deadline_us(PLOG_CONSOLE_CLOSE_MS * 1000u);
+            b_closing      = true;
+        }
+
+        uint64_t drops = p_console->drops;
+
+        // Take the contiguous part of the pending data
+        size_t used   = p_console->head - p_console->tail;
+        size_t offset = p_console->tail % p_console->size;
+        size_t len    = p_console->size - offset;
+
+        if (len > used)
+        {
+            len = used;
+        }
+
+        if (0 == len && drops == p_console->drops_reported && b_closing)
+        {
+            break;
+        }
+
+        pthread_mutex_unlock(&p_console->mutex);
+
+        const struct timespec* p_deadline = b_closing ? &close_deadline : NULL;
+
+        size_t written = console_write(p_console, p_console->p_buf + offset,
+                                       len, p_deadline);
+
+        // Note dropped entries in the output once the backlog is gone
+        if (written == used && drops != p_console->drops_reported)
+        {
+            char note[64];
+            int  note_len = snprintf(note, sizeof(note),
+                                     "plog: %llu entries dropped\n",
+                                     (unsigned long long)(drops -
+                                         p_console->drops_reported));
+
+            console_write(p_console, note, (size_t)note_len, p_deadline);
+            p_console->drops_reported = drops;
+        }
+
+        pthread_mutex_lock(&p_console->mutex);
+
+        p_console->tail += written;
+        pthread_cond_broadcast(&p_console->space);
+
+        // Output stuck past the close deadline: discard the rest
+        if (b_closing && written < len)
+        {
+            break;
+        }
+    }
+
+    pthread_mutex_unlock(&p_console->mutex);
+
+    return NULL;
+}
+
+/*
+ * Copies the entry into the ring buffer. Never performs I/O.
+ */
+static void
+console_appender (const char* p_entry, void* p_udata)
+{
+    plog_console_t* p_console  = (plog_console_t*)p_udata;
+    size_t          len        = strlen(p_entry);
+    bool            b_deadline = false;
+    struct timespec deadline;
+
+    pthread_mutex_lock(&p_console->mutex);
+
+    while (p_console->size - (p_console->head - p_console->tail) < len)
+    {
+        if (PLOG_CONSOLE_DROP == p_console->policy || len > p_console->size ||
+            (b_deadline && deadline_passed(&deadline)))
+        {
+            p_console->drops++;
+            pthread_mutex_unlock(&p_console->mutex);
+            return;
+        }
+
+        // One deadline for the whole call: every partial write by the
+        // writer wakes us, and must not extend the wait
+        if (!b_deadline)
+        {
+            deadline   = deadline_us(p_console->block_us);
+            b_deadline = true;
+        }
+
+        pthread_cond_timedwait(&p_console->space, &p_console->mutex, &deadline);
+    }
+
+    bool   b_empty = (p_console->head == p_console->tail);
+    size_t offset  = p_console->head % p_console->size;
+    size_t first   = p_console->size - offset;
+
+    if (first > len)
+    {
+        first = len;
+    }
+
+    memcpy(p_console->p_buf + offset, p_entry, first);
+    memcpy(p_console->p_buf, p_entry + first, len - first);
+
+    p_console->head += len;
+
+    if (b_empty)
+    {
+        pthread_cond_signal(&p_console->data);
+    }
+
+    pthread_mutex_unlock(&p_console->mutex);
+}
+
+void
+plog_console_defaults (plog_console_cfg_t* p_cfg)
+{
+    PLOG_ASSERT(NULL != p_cfg);
+
+    p_cfg->fd          = STDERR_FILENO;
+    p_cfg->buffer_size = PLOG_CONSOLE_BUFFER_SIZE;
+    p_cfg->policy      = PLOG_CONSOLE_DROP;
+    p_cfg->block_us    = 0;
+    p_cfg->colors      = -1;
+}
+
+plog_console_t*
+plog_console_open (const plog_console_cfg_t* p_cfg)
+{
+    PLOG_ASSERT(NULL != p_cfg);
+    PLOG_ASSERT(p_cfg->buffer_size > 0);
+
+    plog_console_t* p_console = (plog_console_t*)PLOG_MALLOC(sizeof(plog_console_t));
+
+    if (NULL == p_console)
+    {
+        return NULL;
+    }
+
+    memset(p_console, 0, sizeof(plog_console_t));
+
+    p_console->policy   = p_cfg->policy;
+    p_console->block_us = p_cfg->block_us;
+    p_console->size     = p_cfg->buffer_size;
+    p_console->colors   = (p_cfg->colors < 0) ? isatty(p_cfg->fd)
+                                              : p_cfg->colors;
+    p_console->p_buf    = (char*)PLOG_MALLOC(p_cfg->buffer_size);
+    p_console->fd       = console_open_fd(p_cfg->fd, &p_console->b_nonblock);
+
+    if (NULL == p_console->p_buf || p_console->fd < 0)
+    {
+        goto fail;
+    }
+
+    pthread_mutex_init(&p_console->mutex, NULL);
+    pthread_cond_init(&p_console->data, NULL);
+    pthread_cond_init(&p_console->space, NULL);
+    pthread_cond_init(&p_console->idle, NULL);
+
+    if (0 != pthread_create(&p_console->thread, NULL, console_thread, p_console))
+    {
+        pthread_cond_destroy(&p_console->idle);
+        pthread_cond_destroy(&p_console->space);
+        pthread_cond_destroy(&p_console->data);
+        pthread_mutex_destroy(&p_console->mutex);
+        goto fail;
+    }
+
+    return p_console;
+
+fail:
+    if (p_console->fd >= 0)
+    {
+        close(p_console->fd);
+    }
+
+    if (NULL != p_console->p_buf)
+    {
+        PLOG_FREE(p_console->p_buf);
+    }
+
+    PLOG_FREE(p_console);
+
+    return NULL;
+}
+
+/*
+ * plog_flush hook.
+ */
+static void
+console_flush (void* p_udata)
+{
+    plog_console_flush((plog_console_t*)p_udata);
+}
+
+plog_id_t
+plog_add_console (plog_console_t* p_console, plog_level_t level)
+{
+    // Console must not be NULL
+    PLOG_ASSERT(NULL != p_console);
+
+    plog_id_t id = plog_add_appender(console_appender, level, p_console);
+
+    plog_set_flush(id, console_flush);
+
+    if (p_console->colors)
+    {
+        plog_colors_on(id);
+    }
+
+    return id;
+}
+
+uint64_t
+plog_console_drops (plog_console_t* p_console)
+{
+    pthread_mutex_lock(&p_console->mutex);
+    uint64_t drops = p_console->drops;
+    pthread_mutex_unlock(&p_console->mutex);
+
+    return drops;
+}
+
+void
+plog_console_flush (plog_console_t* p_console)
+{
+    PLOG_ASSERT(NULL != p_console);
+
+    pthread_mutex_lock(&p_console->mutex);
+
+    uint64_t req = ++p_console->flush_req;
+
+    pthread_cond_signal(&p_console->data);
+
+    while (p_console->flush_done < req)
+    {
+        pthread_cond_wait(&p_console->idle, &p_console->mutex);
+    }
+
+    pthread_mutex_unlock(&p_console->mutex);
+}
+
+void
+plog_console_close (plog_console_t* p_console)
+{
+    if (NULL == p_console)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&p_console->mutex);
+    p_console->b_stop = true;
+    pthread_cond_signal(&p_console->data);
+    pthread_mutex_unlock(&p_console->mutex);
+
+    pthread_join(p_console->thread, NULL);
+
+    pthread_cond_destroy(&p_console->idle);
+    pthread_cond_destroy(&p_console->space);
+    pthread_cond_destroy(&p_console->data);
+    pthread_mutex_destroy(&p_console->mutex);
+
+    close(p_console->fd);
+
+    PLOG_FREE(p_console->p_buf);
+    PLOG_FREE(p_console);
+}
+
+/* EoF */
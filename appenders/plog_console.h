@@ -0,0 +1,133 @@
+/** @file plog_console.h
+ * Non-blocking console appender for picolog.
+ */
+
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+#ifndef PLOG_CONSOLE_H
+#define PLOG_CONSOLE_H
+
+#include "../picolog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Default ring buffer size.
+ */
+#ifndef PLOG_CONSOLE_BUFFER_SIZE
+#define PLOG_CONSOLE_BUFFER_SIZE (64 * 1024)
+#endif
+
+/**
+ * What to do with an entry when the console buffer is full.
+ */
+typedef enum
+{
+    PLOG_CONSOLE_DROP = 0, // Drop the entry and count it
+    PLOG_CONSOLE_BLOCK     // Wait up to `block_us` for space, then drop
+} plog_console_policy_t;
+
+/**
+ * Console appender configuration. Use `plog_console_defaults` to initialize.
+ */
+typedef struct
+{
+    int                   fd;          // Output file descriptor
+    size_t                buffer_size; // Ring buffer size in bytes
+    plog_console_policy_t policy;      // Full buffer policy
+    unsigned              block_us;    // Maximum wait (PLOG_CONSOLE_BLOCK)
+    int                   colors;      // -1 if the fd is a TTY, 0 off, 1 on
+} plog_console_cfg_t;
+
+/**
+ * Console appender handle.
+ */
+typedef struct plog_console_s plog_console_t;
+
+/**
+ * Fills in the default configuration: stderr, PLOG_CONSOLE_BUFFER_SIZE bytes,
+ * drop when full, colors if stderr is a TTY.
+ *
+ * @param p_cfg The configuration to initialize
+ */
+void plog_console_defaults(plog_console_cfg_t* p_cfg);
+
+/**
+ * Creates a console appender. Logging threads only copy entries into a
+ * bounded buffer; a helper thread drains it to the file descriptor, so a slow
+ * terminal or pipe never stalls the caller. Pipes and terminals are written
+ * through a private non-blocking file description where the platform allows.
+ *
+ * @param p_cfg The configuration
+ *
+ * @return The console, or NULL if it could not be created
+ */
+plog_console_t* plog_console_open(const plog_console_cfg_t* p_cfg);
+
+/**
+ * Registers the console as an appender, with plog_console_flush as its flush
+ * function. Colors are turned on according to the configuration.
+ *
+ * @param p_console The console
+ * @param level     The appender's log level
+ *
+ * @return An identifier for the appender
+ */
+plog_id_t plog_add_console(plog_console_t* p_console, plog_level_t level);
+
+/**
+ * Returns the number of entries dropped because the buffer was full.
+ *
+ * @param p_console The console
+ */
+uint64_t plog_console_drops(plog_console_t* p_console);
+
+/**
+ * Waits until every entry in the buffer has been written to the file
+ * descriptor. plog_flush (and a FATAL entry with plog_set_fatal_flush) calls
+ * this for appenders added with plog_add_console.
+ *
+ * @param p_console The console
+ */
+void plog_console_flush(plog_console_t* p_console);
+
+/**
+ * Writes out the buffered entries (waiting at most one second for the output
+ * to accept them), stops the helper thread and frees the console. The
+ * appender must be removed first.
+ *
+ * @param p_console The console
+ */
+void plog_console_close(plog_console_t* p_console);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PLOG_CONSOLE_H */
+
+/* EoF */
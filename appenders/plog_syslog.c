@@ -0,0 +1,690 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * RFC 5424 syslog appender over a Unix datagram or UDP socket (Linux).
+ */
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // sendmmsg
+#endif
+
+#include "plog_syslog.h"
+
+#include <arpa/inet.h>  // inet_pton, htons
+#include <errno.h>      // errno, EINTR, ECONNREFUSED, ENOTCONN
+#include <netinet/in.h> // struct sockaddr_in
+#include <pthread.h>    // pthread_*
+#include <stdio.h>      // snprintf
+#include <stdlib.h>     // malloc, free
+#include <string.h>     // memcpy, memset, strlen
+#include <sys/socket.h> // socket, connect, sendmmsg
+#include <sys/un.h>     // struct sockaddr_un
+#include <time.h>       // gmtime_r, clock_gettime
+#include <unistd.h>     // close, getpid, gethostname
+
+#define PLOG_SYSLOG_HEADER_LEN   384  // HOSTNAME (255) + APP-NAME (48) + PROCID
+#define PLOG_SYSLOG_RECONNECT_MS 1000 // Least time between reconnect attempts
+
+struct plog_syslog_s
+{
+    int              fd;            // Helper thread only, -1 if disconnected
+    struct sockaddr_storage addr;   // Destination, kept for reconnecting
+    socklen_t        addr_len;
+    uint64_t         reconnect_ns;  // Last reconnect attempt (monotonic)
+    plog_syslog_facility_t facility;
+    char             p_header[PLOG_SYSLOG_HEADER_LEN]; // After TIMESTAMP
+    char             p_sd_id[33];   // SD-NAME is at most 32 characters
+    char*            p_mem;         // Frame slots
+    size_t*          p_lens;        // Frame lengths
+    unsigned         slots;
+    size_t           max_frame;
+    unsigned         batch;
+    unsigned         flush_ms;
+    struct mmsghdr*  p_msgs;        // Helper thread only
+    struct iovec*    p_iovs;
+    size_t           head;          // Frames ever queued
+    size_t           tail;          // Frames ever sent
+    uint64_t         drops;
+    uint64_t         flush_req;     // Flush requests made
+    uint64_t         flush_done;    // Flush requests completed
+    bool             b_stop;
+    pthread_t        thread;
+    pthread_mutex_t  mutex;
+    pthread_cond_t   data;          // Signalled when frames are queued
+    pthread_cond_t   idle;          // Signalled when a flush completes
+};
+
+/*
+ * Severity of each level, indexed by plog_level_t.
+ */
+static const int severities[] =
+{
+    7, // TRACE -> debug
+    7, // DEBUG -> debug
+    6, // INFO  -> informational
+    4, // WARN  -> warning
+    3, // ERROR -> error
+    2  // FATAL -> critical
+};
+
+/*
+ * Returns the absolute CLOCK_REALTIME time `ms` milliseconds from now.
+ */
+static struct timespec
+deadline_ms (unsigned ms)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    ts.tv_sec  += (time_t)(ms / 1000u);
+    ts.tv_nsec += (long)(ms % 1000u) * 1000000L;
+
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec  += 1;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    return ts;
+}
+
+/*
+ * Copies a header field, substituting the nil value for empty fields and
+ * '_' for characters RFC 5424 does not allow (anything but printable ASCII
+ * without spaces). Returns the number of characters written.
+ */
+static size_t
+syslog_field (char* p_dst, const char* p_src, size_t max_len)
+{
+    size_t len = 0;
+
+    for (; NULL != p_src && '\0' != p_src[len] && len < max_len; len++)
+    {
+        char c = p_src[len];
+        p_dst[len] = (c > ' ' && c < 127) ? c : '_';
+    }
+
+    if (0 == len)
+    {
+        p_dst[len++] = '-';
+    }
+
+    return len;
+}
+
+/*
+ * Appends to a frame, escaping '"', '\\' and ']' if `b_escape` is set (as
+ * PARAM-VALUE requires). Stops at the end of the frame.
+ */
+static size_t
+syslog_append (char* p_frame, size_t len, size_t max_len, const char* p_str,
+               bool b_escape)
+{
+    for (; '\0' != *p_str && len < max_len; p_str++)
+    {
+        if (b_escape && ('"' == *p_str || '\\' == *p_str || ']' == *p_str))
+        {
+            if (len + 2 > max_len)
+            {
+                break;
+            }
+
+            p_frame[len++] = '\\';
+        }
+
+        p_frame[len++] = *p_str;
+    }
+
+    return len;
+}
+
+/*
+ * Appends STRUCTURED-DATA and the separating space: the context fields as
+ * `[sd_id key="value" ...]`, or the nil value if there are none. The element
+ * is always closed: a value that does not fit is truncated, and fields with no
+ * room left for their name are left out.
+ */
+static size_t
+syslog_sd (plog_syslog_t* p_syslog, char* p_frame, size_t len,
+           const plog_entry_t* p_entry)
+{
+    size_t max_len = p_syslog->max_frame;
+    size_t id_len  = strlen(p_syslog->p_sd_id);
+
+    // "[" SD-ID and, reserved throughout, "] "
+    if (0 == p_entry->field_count || len + 1 + id_len + 2 > max_len)
+    {
+        return syslog_append(p_frame, len, max_len, "- ", false);
+    }
+
+    len = syslog_append(p_frame, len, max_len, "[", false);
+    len = syslog_append(p_frame, len, max_len, p_syslog->p_sd_id, false);
+
+    for (size_t i = 0; i < p_entry->field_count; i++)
+    {
+        char p_name[33];
+
+        // PARAM-NAME: printable, no spaces, '=', ']' or '"'
+        size_t name_len = syslog_field(p_name, p_entry->fields[i].key, 32);
+
+        for (size_t c = 0; c < name_len; c++)
+        {
+            if ('=' == p_name[c] || ']' == p_name[c] || '"' == p_name[c])
+            {
+                p_name[c] = '_';
+            }
+        }
+
+        p_name[name_len] = '\0';
+
+        // ' ' PARAM-NAME '="' and the closing '"', then "] "
+        if (len + name_len + 3 + 1 + 2 > max_len)
+        {
+            break;
+        }
+
+        len = syslog_append(p_frame, len, max_len, " ", false);
+        len = syslog_append(p_frame, len, max_len, p_name, false);
+        len = syslog_append(p_frame, len, max_len, "=\"", false);
+        len = syslog_append(p_frame, len, max_len - 3,
+                            p_entry->fields[i].value, true);
+        len = syslog_append(p_frame, len, max_len, "\"", false);
+    }
+
+    return syslog_append(p_frame, len, max_len, "] ", false);
+}
+
+/*
+ * Creates a datagram socket connected to the destination. Returns -1 on
+ * failure.
+ */
+static int
+syslog_connect (const plog_syslog_t* p_syslog)
+{
+    int fd = socket(p_syslog->addr.ss_family, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+
+    if (fd >= 0 && 0 != connect(fd, (const struct sockaddr*)&p_syslog->addr,
+                                p_syslog->addr_len))
+    {
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+/*
+ * Replaces the socket after the receiver went away (a restarted syslog
+ * daemon binds a new socket at the same path). Attempts are at least
+ * PLOG_SYSLOG_RECONNECT_MS apart, so a missing daemon costs one failed
+ * connect per interval rather than one per frame. Returns true if the new
+ * socket is connected.
+ */
+static bool
+syslog_reconnect (plog_syslog_t* p_syslog)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    uint64_t now = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+
+    if (0 != p_syslog->reconnect_ns &&
+        now - p_syslog->reconnect_ns < PLOG_SYSLOG_RECONNECT_MS * 1000000ull)
+    {
+        return false;
+    }
+
+    p_syslog->reconnect_ns = now;
+
+    if (p_syslog->fd >= 0)
+    {
+        close(p_syslog->fd);
+    }
+
+    p_syslog->fd = syslog_connect(p_syslog);
+
+    return p_syslog->fd >= 0;
+}
+
+/*
+ * Sends frames [tail, tail + count). If the receiver has gone away the
+ * socket is reconnected and the rest of the batch retried once; frames the
+ * socket still refuses are dropped.
+ */
+static void
+syslog_send (plog_syslog_t* p_syslog, size_t tail, unsigned count)
+{
+    for (unsigned i = 0; i < count; i++)
+    {
+        size_t slot = (tail + i) % p_syslog->slots;
+
+        p_syslog->p_iovs[i].iov_base = p_syslog->p_mem + slot * p_syslog->max_frame;
+        p_syslog->p_iovs[i].iov_len  = p_syslog->p_lens[slot];
+
+        memset(&p_syslog->p_msgs[i], 0, sizeof(struct mmsghdr));
+
+        p_syslog->p_msgs[i].msg_hdr.msg_iov    = &p_syslog->p_iovs[i];
+        p_syslog->p_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    unsigned sent      = 0;
+    uint64_t dropped   = 0;
+    bool     b_retried = false;
+
+    while (sent < count)
+    {
+        int ret = sendmmsg(p_syslog->fd, p_syslog->p_msgs + sent, count - sent, 0);
+
+        if (ret > 0)
+        {
+            sent += (unsigned)ret;
+        }
+        else if (ret < 0 && EINTR == errno)
+        {
+            continue;
+        }
+        else if (ret < 0 && !b_retried &&
+                 (p_syslog->fd < 0 || ECONNREFUSED == errno || ENOTCONN == errno))
+        {
+            b_retried = true;
+
+            if (!syslog_reconnect(p_syslog))
+            {
+                // Drop the rest rather than fail frame by frame
+                dropped += count - sent;
+                break;
+            }
+        }
+        else
+        {
+            // Skip the frame that failed
+            sent++;
+            dropped++;
+        }
+    }
+
+    if (dropped > 0)
+    {
+        pthread_mutex_lock(&p_syslog->mutex);
+        p_syslog->drops += dropped;
+        pthread_mutex_unlock(&p_syslog->mutex);
+    }
+}
+
+static void*
+syslog_thread (void* p_arg)
+{
+    plog_syslog_t* p_syslog = (plog_syslog_t*)p_arg;
+
+    pthread_mutex_lock(&p_syslog->mutex);
+
+    for (;;)
+    {
+        while (p_syslog->head == p_syslog->tail &&
+               p_syslog->flush_req == p_syslog->flush_done &&
+               !p_syslog->b_stop)
+        {
+            pthread_cond_wait(&p_syslog->data, &p_syslog->mutex);
+        }
+
+        // Give a partial batch time to fill
+        if (p_syslog->head - p_syslog->tail < p_syslog->batch &&
+            p_syslog->head != p_syslog->tail &&
+            p_syslog->flush_req == p_syslog->flush_done && !p_syslog->b_stop)
+        {
+            struct timespec deadline = deadline_ms(p_syslog->flush_ms);
+
+            pthread_cond_timedwait(&p_syslog->data, &p_syslog->mutex, &deadline);
+        }
+
+        size_t used = p_syslog->head - p_syslog->tail;
+
+        if (0 == used)
+        {
+            p_syslog->flush_done = p_syslog->flush_req;
+            pthread_cond_broadcast(&p_syslog->idle);
+
+            if (p_syslog->b_stop)
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        size_t   tail  = p_syslog->tail;
+        unsigned count = (used < p_syslog->batch) ? (unsigned)used
+                                                  : p_syslog->batch;
+
+        pthread_mutex_unlock(&p_syslog->mutex);
+
+        syslog_send(p_syslog, tail, count);
+
+        pthread_mutex_lock(&p_syslog->mutex);
+
+        p_syslog->tail += count;
+    }
+
+    pthread_mutex_unlock(&p_syslog->mutex);
+
+    return NULL;
+}
+
+/*
+ * Formats the entry as an RFC 5424 frame into a free slot.
+ */
+static void
+syslog_appender (const plog_entry_t* p_entry, void* p_udata)
+{
+    plog_syslog_t* p_syslog = (plog_syslog_t*)p_udata;
+
+    char timestamp[32] = "-";
+    struct tm tm;
+
+    if (0 != p_entry->time && NULL != gmtime_r(&p_entry->time, &tm))
+    {
+        strftime(timestamp, sizeof(timestamp), "%Y-%m-%dT%H:%M:%SZ", &tm);
+    }
+
+    int pri = (int)p_syslog->facility * 8 + severities[p_entry->level];
+
+    pthread_mutex_lock(&p_syslog->mutex);
+
+    if (p_syslog->head - p_syslog->tail == p_syslog->slots)
+    {
+        p_syslog->drops++;
+        pthread_mutex_unlock(&p_syslog->mutex);
+        return;
+    }
+
+    size_t slot  = p_syslog->head % p_syslog->slots;
+    char*  p_buf = p_syslog->p_mem + slot * p_syslog->max_frame;
+
+    // Frames are short; format in place rather than copying
+    int len = snprintf(p_buf, p_syslog->max_frame, "<%d>1 %s%s", pri,
+                       timestamp, p_syslog->p_header);
+
+    size_t frame_len = (len < 0) ? 0 : (size_t)len;
+
+    if (frame_len >= p_syslog->max_frame)
+    {
+        frame_len = p_syslog->max_frame - 1;
+    }
+
+    frame_len = syslog_sd(p_syslog, p_buf, frame_len, p_entry);
+
+    size_t msg_len = p_syslog->max_frame - frame_len;
+
+    if (msg_len > p_entry->msg_len)
+    {
+        msg_len = p_entry->msg_len;
+    }
+
+    memcpy(p_buf + frame_len, p_entry->msg, msg_len);
+
+    p_syslog->p_lens[slot] = frame_len + msg_len;
+
+    size_t used = ++p_syslog->head - p_syslog->tail;
+
+    // Wake the helper to start the flush timer or send a full batch
+    if (1 == used || p_syslog->batch == used)
+    {
+        pthread_cond_signal(&p_syslog->data);
+    }
+
+    pthread_mutex_unlock(&p_syslog->mutex);
+}
+
+void
+plog_syslog_defaults (plog_syslog_cfg_t* p_cfg)
+{
+    PLOG_ASSERT(NULL != p_cfg);
+
+    p_cfg->path      = "/dev/log";
+    p_cfg->host      = "127.0.0.1";
+    p_cfg->port      = 514;
+    p_cfg->facility  = PLOG_SYSLOG_USER;
+    p_cfg->app_name  = NULL;
+    p_cfg->hostname  = NULL;
+    p_cfg->sd_id     = "ctx@32473";
+    p_cfg->batch     = PLOG_SYSLOG_BATCH;
+    p_cfg->slots     = PLOG_SYSLOG_SLOTS;
+    p_cfg->max_frame = PLOG_SYSLOG_MAX_FRAME;
+    p_cfg->flush_ms  = 100;
+}
+
+/*
+ * Resolves the configured destination into `p_syslog->addr`. Returns false
+ * if the path is too long or the host is not an IPv4 address.
+ */
+static bool
+syslog_addr (plog_syslog_t* p_syslog, const plog_syslog_cfg_t* p_cfg)
+{
+    if (NULL != p_cfg->path)
+    {
+        struct sockaddr_un* p_addr = (struct sockaddr_un*)&p_syslog->addr;
+
+        if (strlen(p_cfg->path) >= sizeof(p_addr->sun_path))
+        {
+            return false;
+        }
+
+        p_addr->sun_family = AF_UNIX;
+        strcpy(p_addr->sun_path, p_cfg->path);
+
+        p_syslog->addr_len = sizeof(struct sockaddr_un);
+    }
+    else
+    {
+        struct sockaddr_in* p_addr = (struct sockaddr_in*)&p_syslog->addr;
+
+        p_addr->sin_family = AF_INET;
+        p_addr->sin_port   = htons(p_cfg->port);
+
+        if (NULL == p_cfg->host || 1 != inet_pton(AF_INET, p_cfg->host, &p_addr->sin_addr))
+        {
+            return false;
+        }
+
+        p_syslog->addr_len = sizeof(struct sockaddr_in);
+    }
+
+    return true;
+}
+
+plog_syslog_t*
+plog_syslog_open (const plog_syslog_cfg_t* p_cfg)
+{
+    PLOG_ASSERT(NULL != p_cfg);
+    PLOG_ASSERT(p_cfg->batch > 0 && p_cfg->slots >= p_cfg->batch);
+    PLOG_ASSERT(p_cfg->max_frame >= PLOG_SYSLOG_HEADER_LEN);
+
+    plog_syslog_t* p_syslog = (plog_syslog_t*)PLOG_MALLOC(sizeof(plog_syslog_t));
+
+    if (NULL == p_syslog)
+    {
+        return NULL;
+    }
+
+    memset(p_syslog, 0, sizeof(plog_syslog_t));
+
+    p_syslog->facility  = p_cfg->facility;
+    p_syslog->slots     = p_cfg->slots;
+    p_syslog->max_frame = p_cfg->max_frame;
+    p_syslog->batch     = p_cfg->batch;
+    p_syslog->flush_ms  = p_cfg->flush_ms;
+    p_syslog->p_mem     = (char*)PLOG_MALLOC(p_cfg->slots * p_cfg->max_frame);
+    p_syslog->p_lens    = (size_t*)PLOG_MALLOC(p_cfg->slots * sizeof(size_t));
+    p_syslog->p_msgs    = (struct mmsghdr*)PLOG_MALLOC(p_cfg->batch *
+                                                       sizeof(struct mmsghdr));
+    p_syslog->p_iovs    = (struct iovec*)PLOG_MALLOC(p_cfg->batch *
+                                                     sizeof(struct iovec));
+    p_syslog->fd        = syslog_addr(p_syslog, p_cfg) ? syslog_connect(p_syslog)
+                                                       : -1;
+
+    if (NULL == p_syslog->p_mem || NULL == p_syslog->p_lens ||
+        NULL == p_syslog->p_msgs || NULL == p_syslog->p_iovs ||
+        p_syslog->fd < 0)
+    {
+        goto fail;
+    }
+
+    // HOSTNAME APP-NAME PROCID MSGID never change
+    char hostname[256] = "";
+
+    if (NULL == p_cfg->hostname && 0 == gethostname(hostname, sizeof(hostname)))
+    {
+        hostname[sizeof(hostname) - 1] = '\0';
+    }
+
+    char*  p_header = p_syslog->p_header;
+    size_t len      = 0;
+
+    p_header[len++] = ' ';
+    len += syslog_field(p_header + len,
+                        p_cfg->hostname ? p_cfg->hostname : hostname, 255);
+    p_header[len++] = ' ';
+    len += syslog_field(p_header + len, p_cfg->app_name, 48);
+
+    snprintf(p_header + len, PLOG_SYSLOG_HEADER_LEN - len, " %ld - ",
+             (long)getpid());
+
+    // STRUCTURED-DATA follows, per frame
+    p_syslog->p_sd_id[syslog_field(p_syslog->p_sd_id, p_cfg->sd_id, 32)] = '\0';
+
+    pthread_mutex_init(&p_syslog->mutex, NULL);
+    pthread_cond_init(&p_syslog->data, NULL);
+    pthread_cond_init(&p_syslog->idle, NULL);
+
+    if (0 != pthread_create(&p_syslog->thread, NULL, syslog_thread, p_syslog))
+    {
+        pthread_cond_destroy(&p_syslog->idle);
+        pthread_cond_destroy(&p_syslog->data);
+        pthread_mutex_destroy(&p_syslog->mutex);
+        goto fail;
+    }
+
+    return p_syslog;
+
+fail:
+    if (p_syslog->fd >= 0)
+    {
+        close(p_syslog->fd);
+    }
+
+    PLOG_FREE(p_syslog->p_iovs);
+    PLOG_FREE(p_syslog->p_msgs);
+    PLOG_FREE(p_syslog->p_lens);
+    PLOG_FREE(p_syslog->p_mem);
+    PLOG_FREE(p_syslog);
+
+    return NULL;
+}
+
+/*
+ * plog_flush hook.
+ */
+static void
+syslog_flush (void* p_udata)
+{
+    plog_syslog_flush((plog_syslog_t*)p_udata);
+}
+
+plog_id_t
+plog_add_syslog (plog_syslog_t* p_syslog, plog_level_t level)
+{
+    // Appender must not be NULL
+    PLOG_ASSERT(NULL != p_syslog);
+
+    plog_id_t id = plog_add_entry_appender(syslog_appender, level, p_syslog);
+
+    plog_set_flush(id, syslog_flush);
+
+    return id;
+}
+
+uint64_t
+plog_syslog_drops (plog_syslog_t* p_syslog)
+{
+    PLOG_ASSERT(NULL != p_syslog);
+
+    pthread_mutex_lock(&p_syslog->mutex);
+    uint64_t drops = p_syslog->drops;
+    pthread_mutex_unlock(&p_syslog->mutex);
+
+    return drops;
+}
+
+void
+plog_syslog_flush (plog_syslog_t* p_syslog)
+{
+    PLOG_ASSERT(NULL != p_syslog);
+
+    pthread_mutex_lock(&p_syslog->mutex);
+
+    uint64_t req = ++p_syslog->flush_req;
+
+    pthread_cond_signal(&p_syslog->data);
+
+    while (p_syslog->flush_done < req)
+    {
+        pthread_cond_wait(&p_syslog->idle, &p_syslog->mutex);
+    }
+
+    pthread_mutex_unlock(&p_syslog->mutex);
+}
+
+void
+plog_syslog_close (plog_syslog_t* p_syslog)
+{
+    if (NULL == p_syslog)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&p_syslog->mutex);
+    p_syslog->b_stop = true;
+    pthread_cond_signal(&p_syslog->data);
+    pthread_mutex_unlock(&p_syslog->mutex);
+
+    pthread_join(p_syslog->thread, NULL);
+
+    pthread_cond_destroy(&p_syslog->idle);
+    pthread_cond_destroy(&p_syslog->data);
+    pthread_mutex_destroy(&p_syslog->mutex);
+
+    if (p_syslog->fd >= 0)
+    {
+        close(p_syslog->fd);
+    }
+
+    PLOG_FREE(p_syslog->p_iovs);
+    PLOG_FREE(p_syslog->p_msgs);
+    PLOG_FREE(p_syslog->p_lens);
+    PLOG_FREE(p_syslog->p_mem);
+    PLOG_FREE(p_syslog);
+}
+
+/* EoF */
@@ -0,0 +1,167 @@
+/** @file plog_syslog.h
+ * Batching syslog (RFC 5424) appender for picolog.
+ */
+
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+
+#ifndef PLOG_SYSLOG_H
+#define PLOG_SYSLOG_H
+
+#include "../picolog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Defaults: frames per sendmmsg call, frame slots and maximum frame size.
+ */
+#ifndef PLOG_SYSLOG_BATCH
+#define PLOG_SYSLOG_BATCH 32
+#endif
+
+#ifndef PLOG_SYSLOG_SLOTS
+#define PLOG_SYSLOG_SLOTS 256
+#endif
+
+#ifndef PLOG_SYSLOG_MAX_FRAME
+#define PLOG_SYSLOG_MAX_FRAME 2048
+#endif
+
+/**
+ * Syslog facilities (RFC 5424 section 6.2.1).
+ */
+typedef enum
+{
+    PLOG_SYSLOG_KERN = 0,
+    PLOG_SYSLOG_USER = 1,
+    PLOG_SYSLOG_DAEMON = 3,
+    PLOG_SYSLOG_LOCAL0 = 16,
+    PLOG_SYSLOG_LOCAL1,
+    PLOG_SYSLOG_LOCAL2,
+    PLOG_SYSLOG_LOCAL3,
+    PLOG_SYSLOG_LOCAL4,
+    PLOG_SYSLOG_LOCAL5,
+    PLOG_SYSLOG_LOCAL6,
+    PLOG_SYSLOG_LOCAL7
+} plog_syslog_facility_t;
+
+/**
+ * Syslog appender configuration. Use `plog_syslog_defaults` to initialize.
+ * If `path` is set, frames go to that Unix datagram socket, otherwise to UDP
+ * `host`:`port`.
+ */
+typedef struct
+{
+    const char*            path;      // Unix datagram socket, e.g. "/dev/log"
+    const char*            host;      // Numeric IPv4 address (UDP)
+    unsigned short         port;      // UDP port
+    plog_syslog_facility_t facility;
+    const char*            app_name;  // NULL for the nil value "-"
+    const char*            hostname;  // NULL for gethostname()
+    const char*            sd_id;     // SD-ID of the context element
+    unsigned               batch;     // Maximum frames per sendmmsg call
+    unsigned               slots;     // Frames buffered before dropping
+    size_t                 max_frame; // Longer frames are truncated
+    unsigned               flush_ms;  // Maximum time a frame waits
+} plog_syslog_cfg_t;
+
+/**
+ * Syslog appender handle.
+ */
+typedef struct plog_syslog_s plog_syslog_t;
+
+/**
+ * Fills in the default configuration: "/dev/log", facility USER, no
+ * app name, SD-ID "ctx@32473", PLOG_SYSLOG_BATCH frames per call,
+ * PLOG_SYSLOG_SLOTS slots of PLOG_SYSLOG_MAX_FRAME bytes, 100 ms flush
+ * interval.
+ *
+ * @param p_cfg The configuration to initialize
+ */
+void plog_syslog_defaults(plog_syslog_cfg_t* p_cfg);
+
+/**
+ * Connects to a local syslog daemon. Logging threads format each entry as an
+ * RFC 5424 frame into a slot; a helper thread sends pending frames in batches
+ * with `sendmmsg`. When every slot is pending, entries are dropped and
+ * counted. If the daemon goes away (the socket refuses frames or is no longer
+ * connected), the helper thread reconnects, at most once a second, and
+ * retries the batch once.
+ *
+ * Levels map to severities as follows: TRACE and DEBUG to debug (7), INFO to
+ * informational (6), WARN to warning (4), ERROR to error (3) and FATAL to
+ * critical (2). The message is sent without the appender's layout; the
+ * writing thread's context (see `plog_ctx_push`) is sent as the parameters of
+ * a STRUCTURED-DATA element named `sd_id`.
+ *
+ * @param p_cfg The configuration
+ *
+ * @return The appender, or NULL if the socket could not be set up
+ */
+plog_syslog_t* plog_syslog_open(const plog_syslog_cfg_t* p_cfg);
+
+/**
+ * Registers the syslog appender.
+ *
+ * @param p_syslog The appender
+ * @param level    The appender's log level
+ *
+ * @return An identifier for the appender
+ */
+plog_id_t plog_add_syslog(plog_syslog_t* p_syslog, plog_level_t level);
+
+/**
+ * Returns the number of entries dropped, because every slot was pending or
+ * the socket refused the frame.
+ *
+ * @param p_syslog The appender
+ */
+uint64_t plog_syslog_drops(plog_syslog_t* p_syslog);
+
+/**
+ * Sends every pending frame and waits until done. plog_flush calls this for
+ * appenders added with plog_add_syslog.
+ *
+ * @param p_syslog The appender
+ */
+void plog_syslog_flush(plog_syslog_t* p_syslog);
+
+/**
+ * Flushes, stops the helper thread, closes the socket and frees the
+ * appender. The appender must be removed first.
+ *
+ * @param p_syslog The appender
+ */
+void plog_syslog_close(plog_syslog_t* p_syslog);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PLOG_SYSLOG_H */
+
+/* EoF */
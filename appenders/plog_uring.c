@@ -0,0 +1,884 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * io_uring file appender (Linux), with a writev fallback. The ring is driven
+ * through the raw system calls so that liburing is not required.
+ */
+
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE // syscall
+#endif
+
+#include "plog_uring.h"
+
+#include <errno.h>          // errno, EAGAIN, EINTR
+#include <fcntl.h>          // open, O_*
+#include <limits.h>         // IOV_MAX
+#include <pthread.h>        // pthread_*
+#include <stdlib.h>         // malloc, free
+#include <string.h>         // memcpy, memset, strlen
+#include <sys/mman.h>       // mmap, munmap
+#include <sys/syscall.h>    // __NR_io_uring_*
+#include <sys/uio.h>        // struct iovec, writev
+#include <time.h>           // clock_gettime
+#include <unistd.h>         // syscall, lseek, close
+
+#if defined(__linux__) && defined(__NR_io_uring_setup)
+#include <linux/io_uring.h>
+#define PLOG_URING_SUPPORTED
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+/*
+ * A fixed buffer. It is on exactly one of the free list, the ready queue,
+ * the fill slot or in flight.
+ */
+typedef struct uring_buf_s
+{
+    struct uring_buf_s* p_next;
+    char*               p_data;
+    size_t              len;    // Bytes filled
+    size_t              done;   // Bytes written (short writes)
+    uint64_t            offset; // File offset of p_data[0]
+    unsigned            index;  // Registered buffer index
+    struct iovec        iov;    // Used when buffers are not registered
+} uring_buf_t;
+
+#ifdef PLOG_URING_SUPPORTED
+
+/*
+ * Mapped submission and completion rings.
+ */
+typedef struct
+{
+    int                  fd;
+    bool                 b_fixed;     // Buffers are registered
+    unsigned*            p_sq_tail;
+    unsigned*            p_sq_mask;
+    unsigned*            p_sq_array;
+    struct io_uring_sqe* p_sqes;
+    unsigned*            p_cq_head;
+    unsigned*            p_cq_tail;
+    unsigned*            p_cq_mask;
+    struct io_uring_cqe* p_cqes;
+    void*                p_sq_map;
+    size_t               sq_map_len;
+    void*                p_cq_map;
+    size_t               cq_map_len;
+    size_t               sqes_len;
+} uring_t;
+
+#endif
+
+struct plog_uring_s
+{
+    int             fd;
+    bool            b_uring;      // io_uring in use
+#ifdef PLOG_URING_SUPPORTED
+    uring_t         ring;
+#endif
+    char*           p_mem;        // Backing memory of all buffers
+    uring_buf_t*    p_bufs;
+    unsigned        count;
+    size_t          size;
+    unsigned        flush_ms;
+    uring_buf_t*    p_free;       // Free buffers
+    uring_buf_t*    p_fill;       // Buffer being filled, may be NULL
+    uring_buf_t*    p_ready_head; // Full buffers waiting for the writer
+    uring_buf_t*    p_ready_tail;
+    uint64_t        offset;       // Next file offset (writer only)
+    bool            b_spanning;   // An entry is being split across buffers
+    uint64_t        errors;
+    uint64_t        flush_req;    // Flush requests made
+    uint64_t        flush_done;   // Flush requests completed
+    bool            b_stop;
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  data;         // Signalled when a buffer becomes ready
+    pthread_cond_t  space;        // Signalled when buffers are recycled
+    pthread_cond_t  idle;         // Signalled when a flush completes
+};
+
+/*
+ * Returns the absolute CLOCK_REALTIME time `ms` milliseconds from now.
+ */
+static struct timespec
+deadline_ms (unsigned ms)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    ts.tv_sec  += (time_t)(ms / 1000u);
+    ts.tv_nsec += (long)(ms % 1000u) * 1000000L;
+
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec  += 1;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    return ts;
+}
+
+/*
+ * Moves the fill buffer (if it has data) to the ready queue. Called with the
+ * mutex held.
+ */
+static void
+uring_ready_fill (plog_uring_t* p_uring)
+{
+    uring_buf_t* p_buf = p_uring->p_fill;
+
+    if (NULL == p_buf || 0 == p_buf->len)
+    {
+        return;
+    }
+
+    p_buf->p_next = NULL;
+
+    if (NULL == p_uring->p_ready_tail)
+    {
+        p_uring->p_ready_head = p_buf;
+    }
+    else
+    {
+        p_uring->p_ready_tail->p_next = p_buf;
+    }
+
+    p_uring->p_ready_tail = p_buf;
+    p_uring->p_fill       = NULL;
+}
+
+#ifdef PLOG_URING_SUPPORTED
+
+static int
+uring_setup (unsigned entries, struct io_uring_params* p_params)
+{
+    return (int)syscall(__NR_io_uring_setup, entries, p_params);
+}
+
+static int
+uring_enter (int fd, unsigned to_submit, unsigned min_complete, unsigned flags)
+{
+    return (int)syscall(__NR_io_uring_enter, fd, to_submit, min_complete,
+                        flags, NULL, 0);
+}
+
+static int
+uring_register (int fd, unsigned opcode, const void* p_arg, unsigned nr_args)
+{
+    return (int)syscall(__NR_io_uring_register, fd, opcode, p_arg, nr_args);
+}
+
+static void
+uring_unmap (uring_t* p_ring)
+{
+    if (NULL != p_ring->p_sqes)
+    {
+        munmap(p_ring->p_sqes, p_ring->sqes_len);
+    }
+
+    if (NULL != p_ring->p_cq_map && p_ring->p_cq_map != p_ring->p_sq_map)
+    {
+        munmap(p_ring->p_cq_map, p_ring->cq_map_len);
+    }
+
+    if (NULL != p_ring->p_sq_map)
+    {
+        munmap(p_ring->p_sq_map, p_ring->sq_map_len);
+    }
+
+    close(p_ring->fd);
+}
+
+/*
+ * Creates the ring and registers the buffers. Falls back to unregistered
+ * buffers if registration fails (e.g. RLIMIT_MEMLOCK).
+ */
+static bool
+uring_init (plog_uring_t* p_uring)
+{
+    uring_t*               p_ring = &p_uring->ring;
+    struct io_uring_params params;
+
+    memset(p_ring, 0, sizeof(uring_t));
+    memset(&params, 0, sizeof(params));
+
+    p_ring->fd = uring_setup(p_uring->count, &params);
+
+    if (p_ring->fd < 0)
+    {
+        return false;
+    }
+
+    p_ring->sq_map_len = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    p_ring->cq_map_len = params.cq_off.cqes +
+                         params.cq_entries * sizeof(struct io_uring_cqe);
+    p_ring->sqes_len   = params.sq_entries * sizeof(struct io_uring_sqe);
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        if (p_ring->cq_map_len > p_ring->sq_map_len)
+        {
+            p_ring->sq_map_len = p_ring->cq_map_len;
+        }
+
+        p_ring->cq_map_len = p_ring->sq_map_len;
+    }
+
+    p_ring->p_sq_map = mmap(NULL, p_ring->sq_map_len, PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, p_ring->fd,
+                            IORING_OFF_SQ_RING);
+
+    if (MAP_FAILED == p_ring->p_sq_map)
+    {
+        p_ring->p_sq_map = NULL;
+        uring_unmap(p_ring);
+        return false;
+    }
+
+    if (params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        p_ring->p_cq_map = p_ring->p_sq_map;
+    }
+    else
+    {
+        p_ring->p_cq_map = mmap(NULL, p_ring->cq_map_len, PROT_READ | PROT_WRITE,
+                                MAP_SHARED | MAP_POPULATE, p_ring->fd,
+                                IORING_OFF_CQ_RING);
+
+        if (MAP_FAILED == p_ring->p_cq_map)
+        {
+            p_ring->p_cq_map = NULL;
+            uring_unmap(p_ring);
+            return false;
+        }
+    }
+
+    p_ring->p_sqes = (struct io_uring_sqe*)mmap(NULL, p_ring->sqes_len,
+                                                PROT_READ | PROT_WRITE,
+                                                MAP_SHARED | MAP_POPULATE,
+                                                p_ring->fd, IORING_OFF_SQES);
+
+    if (MAP_FAILED == p_ring->p_sqes)
+    {
+        p_ring->p_sqes = NULL;
+        uring_unmap(p_ring);
+        return false;
+    }
+
+    char* p_sq = (char*)p_ring->p_sq_map;
+    char* p_cq = (char*)p_ring->p_cq_map;
+
+    p_ring->p_sq_tail  = (unsigned*)(p_sq + params.sq_off.tail);
+    p_ring->p_sq_mask  = (unsigned*)(p_sq + params.sq_off.ring_mask);
+    p_ring->p_sq_array = (unsigned*)(p_sq + params.sq_off.array);
+    p_ring->p_cq_head  = (unsigned*)(p_cq + params.cq_off.head);
+    p_ring->p_cq_tail  = (unsigned*)(p_cq + params.cq_off.tail);
+    p_ring->p_cq_mask  = (unsigned*)(p_cq + params.cq_off.ring_mask);
+    p_ring->p_cqes     = (struct io_uring_cqe*)(p_cq + params.cq_off.cqes);
+
+    // Register the buffers so the kernel does not map them on every write
+    struct iovec* p_iovs = (struct iovec*)PLOG_MALLOC(p_uring->count *
+                                                      sizeof(struct iovec));
+
+    if (NULL != p_iovs)
+    {
+        for (unsigned i = 0; i < p_uring->count; i++)
+        {
+            p_iovs[i].iov_base = p_uring->p_bufs[i].p_data;
+            p_iovs[i].iov_len  = p_uring->size;
+        }
+
+        p_ring->b_fixed = (0 == uring_register(p_ring->fd,
+                                               IORING_REGISTER_BUFFERS,
+                                               p_iovs, p_uring->count));
+        PLOG_FREE(p_iovs);
+    }
+
+    return true;
+}
+
+/*
+ * Queues a write of the unwritten part of the buffer. The ring has at least
+ * as many entries as there are buffers, so it never overflows.
+ */
+static void
+uring_prep_write (plog_uring_t* p_uring, uring_buf_t* p_buf)
+{
+    uring_t* p_ring = &p_uring->ring;
+
+    unsigned tail = *p_ring->p_sq_tail;
+    unsigned idx  = tail & *p_ring->p_sq_mask;
+
+    struct io_uring_sqe* p_sqe = &p_ring->p_sqes[idx];
+
+    memset(p_sqe, 0, sizeof(struct io_uring_sqe));
+
+    p_sqe->fd        = p_uring->fd;
+    p_sqe->off       = p_buf->offset + p_buf->done;
+    p_sqe->user_data = (uint64_t)(uintptr_t)p_buf;
+
+    if (p_ring->b_fixed)
+    {
+        p_sqe->opcode    = IORING_OP_WRITE_FIXED;
+        p_sqe->addr      = (uint64_t)(uintptr_t)(p_buf->p_data + p_buf->done);
+        p_sqe->len       = (unsigned)(p_buf->len - p_buf->done);
+        p_sqe->buf_index = (uint16_t)p_buf->index;
+    }
+    else
+    {
+        p_buf->iov.iov_base = p_buf->p_data + p_buf->done;
+        p_buf->iov.iov_len  = p_buf->len - p_buf->done;
+
+        p_sqe->opcode = IORING_OP_WRITEV;
+        p_sqe->addr   = (uint64_t)(uintptr_t)&p_buf->iov;
+        p_sqe->len    = 1;
+    }
+
+    p_ring->p_sq_array[idx] = idx;
+
+    __atomic_store_n(p_ring->p_sq_tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+/*
+ * Submits `count` queued writes and, if `wait` is set, waits for at least one
+ * completion. Completed buffers are appended to `pp_done`; short writes are
+ * resubmitted. Returns the number of writes still in flight.
+ */
+static unsigned
+uring_submit (plog_uring_t* p_uring, unsigned to_submit, unsigned in_flight,
+              bool wait, uring_buf_t** pp_done)
+{
+    uring_t* p_ring = &p_uring->ring;
+
+    while (to_submit > 0 || wait)
+    {
+        int ret = uring_enter(p_ring->fd, to_submit, wait ? 1 : 0,
+                              wait ? IORING_ENTER_GETEVENTS : 0);
+
+        if (ret < 0)
+        {
+            if (EINTR == errno || EAGAIN == errno || EBUSY == errno)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        to_submit -= ((unsigned)ret < to_submit) ? (unsigned)ret : to_submit;
+        wait       = false;
+    }
+
+    // Reap completions
+    unsigned head = *p_ring->p_cq_head;
+    unsigned tail = __atomic_load_n(p_ring->p_cq_tail, __ATOMIC_ACQUIRE);
+    unsigned resubmit = 0;
+
+    while (head != tail)
+    {
+        struct io_uring_cqe* p_cqe = &p_ring->p_cqes[head & *p_ring->p_cq_mask];
+        uring_buf_t*         p_buf = (uring_buf_t*)(uintptr_t)p_cqe->user_data;
+
+        head++;
+
+        if (p_cqe->res > 0)
+        {
+            p_buf->done += (size_t)p_cqe->res;
+        }
+        else if (-EINTR != p_cqe->res && -EAGAIN != p_cqe->res)
+        {
+            pthread_mutex_lock(&p_uring->mutex);
+            p_uring->errors += p_buf->len - p_buf->done;
+            pthread_mutex_unlock(&p_uring->mutex);
+
+            p_buf->done = p_buf->len;
+        }
+
+        if (p_buf->done < p_buf->len)
+        {
+            uring_prep_write(p_uring, p_buf);
+            resubmit++;
+            continue;
+        }
+
+        p_buf->p_next = *pp_done;
+        *pp_done      = p_buf;
+        in_flight--;
+    }
+
+    __atomic_store_n(p_ring->p_cq_head, head, __ATOMIC_RELEASE);
+
+    if (resubmit > 0)
+    {
+        return uring_submit(p_uring, resubmit, in_flight, false, pp_done);
+    }
+
+    return in_flight;
+}
+
+#endif // PLOG_URING_SUPPORTED
+
+/*
+ * Writes a batch of buffers with as few writev calls as possible.
+ */
+static void
+uring_writev (plog_uring_t* p_uring, uring_buf_t* p_batch)
+{
+    while (NULL != p_batch)
+    {
+        struct iovec iovs[16];
+        int          iov_count = 0;
+        size_t       total     = 0;
+
+        for (uring_buf_t* p_buf = p_batch;
+             NULL != p_buf && iov_count < 16 && iov_count < IOV_MAX;
+             p_buf = p_buf->p_next)
+        {
+            iovs[iov_count].iov_base = p_buf->p_data + p_buf->done;
+            iovs[iov_count].iov_len  = p_buf->len - p_buf->done;
+
+            total += iovs[iov_count].iov_len;
+            iov_count++;
+        }
+
+        ssize_t ret = writev(p_uring->fd, iovs, iov_count);
+
+        if (ret < 0 && EINTR == errno)
+        {
+            continue;
+        }
+
+        size_t written = (ret > 0) ? (size_t)ret : 0;
+
+        if (ret < 0)
+        {
+            pthread_mutex_lock(&p_uring->mutex);
+            p_uring->errors += total;
+            pthread_mutex_unlock(&p_uring->mutex);
+
+            written = total;
+        }
+
+        // Advance past the written bytes; a short write retries the rest
+        while (NULL != p_batch && written >= p_batch->len - p_batch->done)
+        {
+            written -= p_batch->len - p_batch->done;
+            p_batch->done = p_batch->len;
+            p_batch = p_batch->p_next;
+        }
+
+        if (NULL != p_batch)
+        {
+            p_batch->done += written;
+        }
+    }
+}
+
+static void*
+uring_thread (void* p_arg)
+{
+    plog_uring_t* p_uring   = (plog_uring_t*)p_arg;
+    uring_buf_t*  p_done    = NULL;
+    unsigned      in_flight = 0;
+
+    pthread_mutex_lock(&p_uring->mutex);
+
+    for (;;)
+    {
+        // Recycle completed buffers
+        if (NULL != p_done)
+        {
+            while (NULL != p_done)
+            {
+                uring_buf_t* p_next = p_done->p_next;
+
+                p_done->p_next  = p_uring->p_free;
+                p_uring->p_free = p_done;
+                p_done          = p_next;
+            }
+
+            pthread_cond_broadcast(&p_uring->space);
+        }
+
+        while (NULL == p_uring->p_ready_head && 0 == in_flight &&
+               p_uring->flush_req == p_uring->flush_done && !p_uring->b_stop)
+        {
+            struct timespec deadline = deadline_ms(p_uring->flush_ms);
+
+            if (ETIMEDOUT == pthread_cond_timedwait(&p_uring->data,
+                                                    &p_uring->mutex,
+                                                    &deadline))
+            {
+                uring_ready_fill(p_uring);
+            }
+        }
+
+        if (p_uring->flush_req != p_uring->flush_done || p_uring->b_stop)
+        {
+            uring_ready_fill(p_uring);
+        }
+
+        uring_buf_t* p_batch = p_uring->p_ready_head;
+
+        p_uring->p_ready_head = NULL;
+        p_uring->p_ready_tail = NULL;
+
+        if (NULL == p_batch && 0 == in_flight)
+        {
+            p_uring->flush_done = p_uring->flush_req;
+            pthread_cond_broadcast(&p_uring->idle);
+
+            if (p_uring->b_stop)
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        pthread_mutex_unlock(&p_uring->mutex);
+
+        // Assign file offsets in queue order so entries stay ordered even if
+        // writes complete out of order
+        unsigned to_submit = 0;
+
+        for (uring_buf_t* p_buf = p_batch; NULL != p_buf; p_buf = p_buf->p_next)
+        {
+            p_buf->offset = p_uring->offset;
+            p_buf->done   = 0;
+
+            p_uring->offset += p_buf->len;
+            to_submit++;
+        }
+
+#ifdef PLOG_URING_SUPPORTED
+        if (p_uring->b_uring)
+        {
+            for (uring_buf_t* p_buf = p_batch; NULL != p_buf; )
+            {
+                uring_buf_t* p_next = p_buf->p_next;
+                uring_prep_write(p_uring, p_buf);
+                p_buf = p_next;
+            }
+
+            in_flight += to_submit;
+
+            // Block for a completion only when there is nothing new to submit
+            in_flight = uring_submit(p_uring, to_submit, in_flight,
+                                     0 == to_submit, &p_done);
+        }
+        else
+#endif
+        {
+            uring_writev(p_uring, p_batch);
+            p_done = p_batch;
+        }
+
+        pthread_mutex_lock(&p_uring->mutex);
+    }
+
+    pthread_mutex_unlock(&p_uring->mutex);
+
+    return NULL;
+}
+
+/*
+ * Copies the entry into the fill buffer, handing full buffers to the writer.
+ * Entries larger than a buffer span several.
+ */
+static void
+uring_appender (const char* p_entry, void* p_udata)
+{
+    plog_uring_t* p_uring = (plog_uring_t*)p_udata;
+    size_t        len     = strlen(p_entry);
+    bool          b_span  = false;
+
+    pthread_mutex_lock(&p_uring->mutex);
+
+    while (len > 0)
+    {
+        // Waiting releases the mutex; keep other entries out of the middle of
+        // one that spans buffers
+        while ((p_uring->b_spanning && !b_span) ||
+               (NULL == p_uring->p_fill && NULL == p_uring->p_free))
+        {
+            pthread_cond_wait(&p_uring->space, &p_uring->mutex);
+        }
+
+        if (NULL == p_uring->p_fill)
+        {
+            p_uring->p_fill      = p_uring->p_free;
+            p_uring->p_free      = p_uring->p_free->p_next;
+            p_uring->p_fill->len = 0;
+        }
+
+        uring_buf_t* p_buf = p_uring->p_fill;
+        size_t       n     = p_uring->size - p_buf->len;
+
+        if (n > len)
+        {
+            n = len;
+        }
+
+        memcpy(p_buf->p_data + p_buf->len, p_entry, n);
+
+        p_buf->len += n;
+        p_entry    += n;
+        len        -= n;
+
+        if (p_buf->len == p_uring->size)
+        {
+            uring_ready_fill(p_uring);
+            pthread_cond_signal(&p_uring->data);
+
+            if (len > 0)
+            {
+                p_uring->b_spanning = true;
+                b_span              = true;
+            }
+        }
+    }
+
+    if (b_span)
+    {
+        p_uring->b_spanning = false;
+        pthread_cond_broadcast(&p_uring->space);
+    }
+
+    pthread_mutex_unlock(&p_uring->mutex);
+}
+
+void
+plog_uring_defaults (plog_uring_cfg_t* p_cfg)
+{
+    PLOG_ASSERT(NULL != p_cfg);
+
+    p_cfg->buffer_size  = PLOG_URING_BUFFER_SIZE;
+    p_cfg->buffer_count = PLOG_URING_BUFFERS;
+    p_cfg->flush_ms     = 100;
+    p_cfg->b_use_uring  = true;
+}
+
+plog_uring_t*
+plog_uring_open (const char* path, const plog_uring_cfg_t* p_cfg)
+{
+    PLOG_ASSERT(NULL != path);
+    PLOG_ASSERT(NULL != p_cfg);
+    PLOG_ASSERT(p_cfg->buffer_size > 0);
+    PLOG_ASSERT(p_cfg->buffer_count >= 2);
+
+    plog_uring_t* p_uring = (plog_uring_t*)PLOG_MALLOC(sizeof(plog_uring_t));
+
+    if (NULL == p_uring)
+    {
+        return NULL;
+    }
+
+    memset(p_uring, 0, sizeof(plog_uring_t));
+
+    p_uring->count    = p_cfg->buffer_count;
+    p_uring->size     = p_cfg->buffer_size;
+    p_uring->flush_ms = p_cfg->flush_ms;
+    p_uring->p_mem    = (char*)PLOG_MALLOC(p_uring->count * p_uring->size);
+    p_uring->p_bufs   = (uring_buf_t*)PLOG_MALLOC(p_uring->count *
+                                                  sizeof(uring_buf_t));
+    p_uring->fd       = open(path, O_WRONLY | O_CREAT | O_CLOEXEC, 0644);
+
+    if (NULL == p_uring->p_mem || NULL == p_uring->p_bufs || p_uring->fd < 0)
+    {
+        goto fail;
+    }
+
+    // Writes use explicit offsets, starting at the current end of the file
+    off_t end = lseek(p_uring->fd, 0, SEEK_END);
+
+    if (end < 0)
+    {
+        goto fail;
+    }
+
+    p_uring->offset = (uint64_t)end;
+
+    for (unsigned i = 0; i < p_uring->count; i++)
+    {
+        uring_buf_t* p_buf = &p_uring->p_bufs[i];
+
+        memset(p_buf, 0, sizeof(uring_buf_t));
+
+        p_buf->p_data   = p_uring->p_mem + i * p_uring->size;
+        p_buf->index    = i;
+        p_buf->p_next   = p_uring->p_free;
+        p_uring->p_free = p_buf;
+    }
+
+#ifdef PLOG_URING_SUPPORTED
+    p_uring->b_uring = p_cfg->b_use_uring && uring_init(p_uring);
+#endif
+
+    pthread_mutex_init(&p_uring->mutex, NULL);
+    pthread_cond_init(&p_uring->data, NULL);
+    pthread_cond_init(&p_uring->space, NULL);
+    pthread_cond_init(&p_uring->idle, NULL);
+
+    if (0 != pthread_create(&p_uring->thread, NULL, uring_thread, p_uring))
+    {
+        pthread_cond_destroy(&p_uring->idle);
+        pthread_cond_destroy(&p_uring->space);
+        pthread_cond_destroy(&p_uring->data);
+        pthread_mutex_destroy(&p_uring->mutex);
+
+#ifdef PLOG_URING_SUPPORTED
+        if (p_uring->b_uring)
+        {
+            uring_unmap(&p_uring->ring);
+        }
+#endif
+        goto fail;
+    }
+
+    return p_uring;
+
+fail:
+    if (p_uring->fd >= 0)
+    {
+        close(p_uring->fd);
+    }
+
+    if (NULL != p_uring->p_bufs)
+    {
+        PLOG_FREE(p_uring->p_bufs);
+    }
+
+    if (NULL != p_uring->p_mem)
+    {
+        PLOG_FREE(p_uring->p_mem);
+    }
+
+    PLOG_FREE(p_uring);
+
+    return NULL;
+}
+
+/*
+ * plog_flush hook.
+ */
+static void
+uring_flush (void* p_udata)
+{
+    plog_uring_flush((plog_uring_t*)p_udata);
+}
+
+plog_id_t
+plog_add_uring (plog_uring_t* p_uring, plog_level_t level)
+{
+    // Appender must not be NULL
+    PLOG_ASSERT(NULL != p_uring);
+
+    plog_id_t id = plog_add_appender(uring_appender, level, p_uring);
+
+    plog_set_flush(id, uring_flush);
+
+    return id;
+}
+
+bool
+plog_uring_active (plog_uring_t* p_uring)
+{
+    PLOG_ASSERT(NULL != p_uring);
+
+    return p_uring->b_uring;
+}
+
+uint64_t
+plog_uring_errors (plog_uring_t* p_uring)
+{
+    PLOG_ASSERT(NULL != p_uring);
+
+    pthread_mutex_lock(&p_uring->mutex);
+    uint64_t errors = p_uring->errors;
+    pthread_mutex_unlock(&p_uring->mutex);
+
+    return errors;
+}
+
+void
+plog_uring_flush (plog_uring_t* p_uring)
+{
+    PLOG_ASSERT(NULL != p_uring);
+
+    pthread_mutex_lock(&p_uring->mutex);
+
+    uint64_t req = ++p_uring->flush_req;
+
+    pthread_cond_signal(&p_uring->data);
+
+    while (p_uring->flush_done < req)
+    {
+        pthread_cond_wait(&p_uring->idle, &p_uring->mutex);
+    }
+
+    pthread_mutex_unlock(&p_uring->mutex);
+}
+
+void
+plog_uring_close (plog_uring_t* p_uring)
+{
+    if (NULL == p_uring)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&p_uring->mutex);
+    p_uring->b_stop = true;
+    pthread_cond_signal(&p_uring->data);
+    pthread_mutex_unlock(&p_uring->mutex);
+
+    pthread_join(p_uring->thread, NULL);
+
+#ifdef PLOG_URING_SUPPORTED
+    if (p_uring->b_uring)
+    {
+        uring_unmap(&p_uring->ring);
+    }
+#endif
+
+    pthread_cond_destroy(&p_uring->idle);
+    pthread_cond_destroy(&p_uring->space);
+    pthread_cond_destroy(&p_uring->data);
+    pthread_mutex_destroy(&p_uring->mutex);
+
+    close(p_uring->fd);
+
+    PLOG_FREE(p_uring->p_bufs);
+    PLOG_FREE(p_uring->p_mem);
+    PLOG_FREE(p_uring);
+}
+
+/* EoF */
@@ -0,0 +1,140 @@
+/** @file plog_uring.h
+ * io_uring file appender for picolog.
+ */
+
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+
+#ifndef PLOG_URING_H
+#define PLOG_URING_H
+
+#include "../picolog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Default buffer size and count. At most `count - 1` buffers are in flight
+ * while one is being filled.
+ */
+#ifndef PLOG_URING_BUFFER_SIZE
+#define PLOG_URING_BUFFER_SIZE (64 * 1024)
+#endif
+
+#ifndef PLOG_URING_BUFFERS
+#define PLOG_URING_BUFFERS 8
+#endif
+
+/**
+ * File appender configuration. Use `plog_uring_defaults` to initialize.
+ */
+typedef struct
+{
+    size_t   buffer_size;  // Size of each buffer in bytes
+    unsigned buffer_count; // Number of buffers (at least 2)
+    unsigned flush_ms;     // Maximum time a partly filled buffer waits
+    bool     b_use_uring;  // False forces the writev fallback
+} plog_uring_cfg_t;
+
+/**
+ * io_uring file appender handle.
+ */
+typedef struct plog_uring_s plog_uring_t;
+
+/**
+ * Fills in the default configuration: PLOG_URING_BUFFERS buffers of
+ * PLOG_URING_BUFFER_SIZE bytes, flushed at least every 100 ms, io_uring
+ * enabled.
+ *
+ * @param p_cfg The configuration to initialize
+ */
+void plog_uring_defaults(plog_uring_cfg_t* p_cfg);
+
+/**
+ * Opens (or creates) a file for appending. Logging threads copy entries into
+ * fixed buffers; a writer thread submits full buffers as io_uring writes from
+ * registered buffers, keeping several in flight, and recycles them as they
+ * complete. When io_uring is unavailable, the writer batches buffers into a
+ * single `writev` instead. When every buffer is in flight, logging threads
+ * wait for one to complete.
+ *
+ * @param path  The file path
+ * @param p_cfg The configuration
+ *
+ * @return The appender, or NULL if the file or writer could not be set up
+ */
+plog_uring_t* plog_uring_open(const char* path, const plog_uring_cfg_t* p_cfg);
+
+/**
+ * Registers the file as an appender.
+ *
+ * @param p_uring The appender
+ * @param level   The appender's log level
+ *
+ * @return An identifier for the appender
+ */
+plog_id_t plog_add_uring(plog_uring_t* p_uring, plog_level_t level);
+
+/**
+ * Returns true if writes go through io_uring, false if the writev fallback
+ * is in use.
+ *
+ * @param p_uring The appender
+ */
+bool plog_uring_active(plog_uring_t* p_uring);
+
+/**
+ * Returns the number of bytes that could not be written because of I/O
+ * errors.
+ *
+ * @param p_uring The appender
+ */
+uint64_t plog_uring_errors(plog_uring_t* p_uring);
+
+/**
+ * Submits the partly filled buffer and waits until every buffered entry has
+ * been written. plog_flush calls this for appenders added with
+ * plog_add_uring.
+ *
+ * @param p_uring The appender
+ */
+void plog_uring_flush(plog_uring_t* p_uring);
+
+/**
+ * Flushes, stops the writer thread, closes the file and frees the appender.
+ * The appender must be removed first.
+ *
+ * @param p_uring The appender
+ */
+void plog_uring_close(plog_uring_t* p_uring);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PLOG_URING_H */
+
+/* EoF */
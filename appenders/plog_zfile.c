@@ -0,0 +1,988 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Compressing file appender. Entries are copied into frame buffers; a writer
+ * thread compresses complete frames and appends them to the file.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "plog_zfile.h"
+
+#include <errno.h>          // errno, EINTR, ETIMEDOUT
+#include <fcntl.h>          // open, O_*
+#include <pthread.h>        // pthread_*
+#include <string.h>         // memcpy, memset, memcmp, strlen
+#include <sys/uio.h>        // struct iovec, writev
+#include <time.h>           // clock_gettime
+#include <unistd.h>         // pread, close
+
+#ifndef PLOG_ZFILE_NO_ZLIB
+#include <zlib.h>           // compress2, uncompress, compressBound
+#endif
+
+/*
+ * Largest frame the reader accepts, to reject damaged headers.
+ */
+#define PLOG_ZREAD_MAX_LEN (1u << 30)
+
+/*
+ * Bytes read at a time while looking for the next frame.
+ */
+#define PLOG_ZREAD_SCAN_LEN 4096
+
+/*
+ * A frame buffer. It is on exactly one of the free list, the ready queue or
+ * the fill slot, or being compressed.
+ */
+typedef struct zfile_frame_s
+{
+    struct zfile_frame_s* p_next;
+    char*                 p_data;
+    size_t                len; // Bytes filled
+} zfile_frame_t;
+
+struct plog_zfile_s
+{
+    int                 fd;
+    const plog_codec_t* p_codec;
+    int                 level;
+    char*               p_mem;        // Backing memory of all frames
+    zfile_frame_t*      p_frames;
+    unsigned            count;
+    size_t              size;
+    unsigned            flush_ms;
+    char*               p_out;        // Header and compressed data (writer)
+    size_t              out_cap;
+    zfile_frame_t*      p_free;       // Free frames
+    zfile_frame_t*      p_fill;       // Frame being filled, may be NULL
+    zfile_frame_t*      p_ready_head; // Full frames waiting for the writer
+    zfile_frame_t*      p_ready_tail;
+    bool                b_spanning;   // An entry is being split across frames
+    uint64_t            raw;          // Uncompressed bytes written
+    uint64_t            written;      // File bytes written
+    uint64_t            errors;
+    uint64_t            flush_req;    // Flush requests made
+    uint64_t            flush_done;   // Flush requests completed
+    bool                b_stop;
+    pthread_t           thread;
+    pthread_mutex_t     mutex;
+    pthread_cond_t      data;         // Signalled when a frame becomes ready
+    pthread_cond_t      space;        // Signalled when frames are recycled
+    pthread_cond_t      idle;         // Signalled when a flush completes
+};
+
+struct plog_zread_s
+{
+    int      fd;
+    uint64_t offset;  // Next frame
+    char*    p_in;    // Compressed data
+    size_t   in_cap;
+    char*    p_raw;   // Uncompressed data
+    size_t   raw_cap;
+};
+
+/*
+ * Codecs added with plog_codec_register.
+ */
+static const plog_codec_t* gp_codecs[PLOG_ZFILE_MAX_CODECS];
+static size_t              g_codec_count = 0;
+
+static size_t
+none_bound (size_t len)
+{
+    return len;
+}
+
+static size_t
+none_compress (void* p_dst, size_t cap, const void* p_src, size_t len,
+               int level)
+{
+    (void)level;
+
+    if (len > cap)
+    {
+        return 0;
+    }
+
+    memcpy(p_dst, p_src, len);
+
+    return len;
+}
+
+static bool
+none_decompress (void* p_dst, size_t len, const void* p_src, size_t src_len)
+{
+    if (len != src_len)
+    {
+        return false;
+    }
+
+    memcpy(p_dst, p_src, len);
+
+    return true;
+}
+
+static const plog_codec_t g_codec_none =
+{
+    PLOG_CODEC_NONE, "none", none_bound, none_compress, none_decompress
+};
+
+#ifndef PLOG_ZFILE_NO_ZLIB
+
+static size_t
+zlib_bound (size_t len)
+{
+    return (size_t)compressBound((uLong)len);
+}
+
+/*
+ * Level 0 selects level 1: log text is repetitive enough that higher levels
+ * gain little for their cost.
+ */
+static size_t
+zlib_compress (void* p_dst, size_t cap, const void* p_src, size_t len,
+               int level)
+{
+    uLongf dst_len = (uLongf)cap;
+
+    if (Z_OK != compress2((Bytef*)p_dst, &dst_len, (const Bytef*)p_src,
+                          (uLong)len, (0 == level) ? 1 : level))
+    {
+        return 0;
+    }
+
+    return (size_t)dst_len;
+}
+
+static bool
+zlib_decompress (void* p_dst, size_t len, const void* p_src, size_t src_len)
+{
+    uLongf dst_len = (uLongf)len;
+
+    return Z_OK == uncompress((Bytef*)p_dst, &dst_len, (const Bytef*)p_src,
+                              (uLong)src_len) && dst_len == len;
+}
+
+static const plog_codec_t g_codec_zlib =
+{
+    PLOG_CODEC_ZLIB, "zlib", zlib_bound, zlib_compress, zlib_decompress
+};
+
+#endif
+
+bool
+plog_codec_register (const plog_codec_t* p_codec)
+{
+    PLOG_ASSERT(NULL != p_codec);
+    PLOG_ASSERT(p_codec->id <= 255);
+
+    if (NULL != plog_codec_find(p_codec->id) ||
+        g_codec_count == PLOG_ZFILE_MAX_CODECS)
+    {
+        return false;
+    }
+
+    gp_codecs[g_codec_count++] = p_codec;
+
+    return true;
+}
+
+const plog_codec_t*
+plog_codec_find (unsigned id)
+{
+    if (PLOG_CODEC_NONE == id)
+    {
+        return &g_codec_none;
+    }
+
+#ifndef PLOG_ZFILE_NO_ZLIB
+    if (PLOG_CODEC_ZLIB == id)
+    {
+        return &g_codec_zlib;
+    }
+#endif
+
+    for (size_t i = 0; i < g_codec_count; i++)
+    {
+        if (gp_codecs[i]->id == id)
+        {
+            return gp_codecs[i];
+        }
+    }
+
+    return NULL;
+}
+
+static uint32_t
+zfile_hash (uint32_t hash, const char* p_data, size_t len)
+{
+    for (size_t i = 0; i < len; i++)
+    {
+        hash ^= (uint8_t)p_data[i];
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+static void
+zfile_put32 (char* p_dst, uint32_t value)
+{
+    for (int i = 0; i < 4; i++)
+    {
+        p_dst[i] = (char)(value >> (8 * i));
+    }
+}
+
+static uint32_t
+zfile_get32 (const char* p_src)
+{
+    uint32_t value = 0;
+
+    for (int i = 0; i < 4; i++)
+    {
+        value |= (uint32_t)(uint8_t)p_src[i] << (8 * i);
+    }
+
+    return value;
+}
+
+/*
+ * Returns the absolute CLOCK_REALTIME time `ms` milliseconds from now.
+ */
+static struct timespec
+deadline_ms (unsigned ms)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    ts.tv_sec  += (time_t)(ms / 1000u);
+    ts.tv_nsec += (long)(ms % 1000u) * 1000000L;
+
+    if (ts.tv_nsec >= 1000000000L)
+    {
+        ts.tv_sec  += 1;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    return ts;
+}
+
+/*
+ * Moves the fill frame (if it has data) to the ready queue. Called with the
+ * mutex held.
+ */
+static void
+zfile_ready_fill (plog_zfile_t* p_zfile)
+{
+    zfile_frame_t* p_frame = p_zfile->p_fill;
+
+    if (NULL == p_frame || 0 == p_frame->len)
+    {
+        return;
+    }
+
+    p_frame->p_next = NULL;
+
+    if (NULL == p_zfile->p_ready_tail)
+    {
+        p_zfile->p_ready_head = p_frame;
+    }
+    else
+    {
+        p_zfile->p_ready_tail->p_next = p_frame;
+    }
+
+    p_zfile->p_ready_tail = p_frame;
+    p_zfile->p_fill       = NULL;
+}
+
+/*
+ * Compresses a frame and appends it to the file. Frames that do not shrink
+ * (or fail to compress) are stored as is. Called by the writer thread only.
+ */
+static void
+zfile_write_frame (plog_zfile_t* p_zfile, const zfile_frame_t* p_frame)
+{
+    const plog_codec_t* p_codec = p_zfile->p_codec;
+    char*               p_out   = p_zfile->p_out;
+
+    size_t data_len = p_codec->compress(p_out + PLOG_ZFILE_HEADER_LEN,
+                                        p_zfile->out_cap - PLOG_ZFILE_HEADER_LEN,
+                                        p_frame->p_data, p_frame->len,
+                                        p_zfile->level);
+
+    if (0 == data_len || data_len >= p_frame->len)
+    {
+        p_codec  = &g_codec_none;
+        data_len = p_frame->len;
+        memcpy(p_out + PLOG_ZFILE_HEADER_LEN, p_frame->p_data, data_len);
+    }
+
+    memcpy(p_out, PLOG_ZFILE_MAGIC, 4);
+    p_out[4] = (char)p_codec->id;
+    p_out[5] = p_out[6] = p_out[7] = '\0';
+    zfile_put32(p_out + 8, (uint32_t)p_frame->len);
+    zfile_put32(p_out + 12, (uint32_t)data_len);
+
+    uint32_t hash = zfile_hash(2166136261u, p_out, 16);
+
+    hash = zfile_hash(hash, p_out + PLOG_ZFILE_HEADER_LEN, data_len);
+    zfile_put32(p_out + 16, hash);
+
+    // The whole frame goes out in one call where possible, so a reader sees
+    // either nothing or a prefix of it
+    size_t total = PLOG_ZFILE_HEADER_LEN + data_len;
+    size_t done  = 0;
+
+    while (done < total)
+    {
+        ssize_t ret = write(p_zfile->fd, p_out + done, total - done);
+
+        if (ret < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        done += (size_t)ret;
+    }
+
+    pthread_mutex_lock(&p_zfile->mutex);
+
+    if (done < total)
+    {
+        p_zfile->errors += p_frame->len;
+    }
+    else
+    {
+        p_zfile->raw += p_frame->len;
+    }
+
+    p_zfile->written += done;
+
+    pthread_mutex_unlock(&p_zfile->mutex);
+}
+
+static void*
+zfile_thread (void* p_arg)
+{
+    plog_zfile_t* p_zfile = (plog_zfile_t*)p_arg;
+
+    pthread_mutex_lock(&p_zfile->mutex);
+
+    for (;;)
+    {
+        while (NULL == p_zfile->p_ready_head &&
+               p_zfile->flush_req == p_zfile->flush_done && !p_zfile->b_stop)
+        {
+            struct timespec deadline = deadline_ms(p_zfile->flush_ms);
+
+            if (ETIMEDOUT == pthread_cond_timedwait(&p_zfile->data,
+                                                    &p_zfile->mutex,
+                                                    &deadline))
+            {
+                zfile_ready_fill(p_zfile);
+            }
+        }
+
+        if (p_zfile->flush_req != p_zfile->flush_done || p_zfile->b_stop)
+        {
+            zfile_ready_fill(p_zfile);
+        }
+
+        zfile_frame_t* p_batch = p_zfile->p_ready_head;
+
+        p_zfile->p_ready_head = NULL;
+        p_zfile->p_ready_tail = NULL;
+
+        if (NULL == p_batch)
+        {
+            p_zfile->flush_done = p_zfile->flush_req;
+            pthread_cond_broadcast(&p_zfile->idle);
+
+            if (p_zfile->b_stop)
+            {
+                break;
+            }
+
+            continue;
+        }
+
+        // Compress outside the lock so logging threads keep filling frames
+        pthread_mutex_unlock(&p_zfile->mutex);
+
+        for (zfile_frame_t* p_frame = p_batch; NULL != p_frame;
+             p_frame = p_frame->p_next)
+        {
+            zfile_write_frame(p_zfile, p_frame);
+        }
+
+        pthread_mutex_lock(&p_zfile->mutex);
+
+        while (NULL != p_batch)
+        {
+            zfile_frame_t* p_next = p_batch->p_next;
+
+            p_batch->p_next = p_zfile->p_free;
+            p_zfile->p_free = p_batch;
+            p_batch         = p_next;
+        }
+
+        pthread_cond_broadcast(&p_zfile->space);
+    }
+
+    pthread_mutex_unlock(&p_zfile->mutex);
+
+    return NULL;
+}
+
+/*
+ * Copies the entry into the fill frame, handing full frames to the writer.
+ * Entries larger than a frame span several.
+ */
+static void
+zfile_appender (const char* p_entry, void* p_udata)
+{
+    plog_zfile_t* p_zfile = (plog_zfile_t*)p_udata;
+    size_t        len     = strlen(p_entry);
+    bool          b_span  = false;
+
+    pthread_mutex_lock(&p_zfile->mutex);
+
+    while (len > 0)
+    {
+        // Waiting releases the mutex; keep other entries out of the middle of
+        // one that spans frames
+        while ((p_zfile->b_spanning && !b_span) ||
+               (NULL == p_zfile->p_fill && NULL == p_zfile->p_free))
+        {
+            pthread_cond_wait(&p_zfile->space, &p_zfile->mutex);
+        }
+
+        if (NULL == p_zfile->p_fill)
+        {
+            p_zfile->p_fill      = p_zfile->p_free;
+            p_zfile->p_free      = p_zfile->p_free->p_next;
+            p_zfile->p_fill->len = 0;
+        }
+
+        zfile_frame_t* p_frame = p_zfile->p_fill;
+        size_t         n       = p_zfile->size - p_frame->len;
+
+        if (n > len)
+        {
+            n = len;
+        }
+
+        memcpy(p_frame->p_data + p_frame->len, p_entry, n);
+
+        p_frame->len += n;
+        p_entry      += n;
+        len          -= n;
+
+        if (p_frame->len == p_zfile->size)
+        {
+            zfile_ready_fill(p_zfile);
+            pthread_cond_signal(&p_zfile->data);
+
+            if (len > 0)
+            {
+                p_zfile->b_spanning = true;
+                b_span              = true;
+            }
+        }
+    }
+
+    if (b_span)
+    {
+        p_zfile->b_spanning = false;
+        pthread_cond_broadcast(&p_zfile->space);
+    }
+
+    pthread_mutex_unlock(&p_zfile->mutex);
+}
+
+void
+plog_zfile_defaults (plog_zfile_cfg_t* p_cfg)
+{
+    PLOG_ASSERT(NULL != p_cfg);
+
+#ifndef PLOG_ZFILE_NO_ZLIB
+    p_cfg->p_codec     = &g_codec_zlib;
+#else
+    p_cfg->p_codec     = &g_codec_none;
+#endif
+    p_cfg->level       = 0;
+    p_cfg->frame_size  = PLOG_ZFILE_FRAME_SIZE;
+    p_cfg->frame_count = PLOG_ZFILE_FRAMES;
+    p_cfg->flush_ms    = 1000;
+}
+
+plog_zfile_t*
+plog_zfile_open (const char* path, const plog_zfile_cfg_t* p_cfg)
+{
+    PLOG_ASSERT(NULL != path);
+    PLOG_ASSERT(NULL != p_cfg);
+    PLOG_ASSERT(NULL != p_cfg->p_codec);
+    PLOG_ASSERT(p_cfg->frame_size > 0);
+    PLOG_ASSERT(p_cfg->frame_size <= PLOG_ZREAD_MAX_LEN);
+    PLOG_ASSERT(p_cfg->frame_count >= 2);
+
+    plog_zfile_t* p_zfile = (plog_zfile_t*)PLOG_MALLOC(sizeof(plog_zfile_t));
+
+    if (NULL == p_zfile)
+    {
+        return NULL;
+    }
+
+    memset(p_zfile, 0, sizeof(plog_zfile_t));
+
+    size_t bound = p_cfg->p_codec->bound(p_cfg->frame_size);
+
+    p_zfile->p_codec  = p_cfg->p_codec;
+    p_zfile->level    = p_cfg->level;
+    p_zfile->count    = p_cfg->frame_count;
+    p_zfile->size     = p_cfg->frame_size;
+    p_zfile->flush_ms = p_cfg->flush_ms;
+    p_zfile->out_cap  = PLOG_ZFILE_HEADER_LEN +
+                        ((bound > p_zfile->size) ? bound : p_zfile->size);
+    p_zfile->p_out    = (char*)PLOG_MALLOC(p_zfile->out_cap);
+    p_zfile->p_mem    = (char*)PLOG_MALLOC(p_zfile->count * p_zfile->size);
+    p_zfile->p_frames = (zfile_frame_t*)PLOG_MALLOC(p_zfile->count *
+                                                    sizeof(zfile_frame_t));
+    p_zfile->fd       = open(path, O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC,
+                             0644);
+
+    if (NULL == p_zfile->p_out || NULL == p_zfile->p_mem ||
+        NULL == p_zfile->p_frames || p_zfile->fd < 0)
+    {
+        goto fail;
+    }
+
+    for (unsigned i = 0; i < p_zfile->count; i++)
+    {
+        zfile_frame_t* p_frame = &p_zfile->p_frames[i];
+
+        p_frame->p_data = p_zfile->p_mem + i * p_zfile->size;
+        p_frame->len    = 0;
+        p_frame->p_next = p_zfile->p_free;
+        p_zfile->p_free = p_frame;
+    }
+
+    pthread_mutex_init(&p_zfile->mutex, NULL);
+    pthread_cond_init(&p_zfile->data, NULL);
+    pthread_cond_init(&p_zfile->space, NULL);
+    pthread_cond_init(&p_zfile->idle, NULL);
+
+    if (0 != pthread_create(&p_zfile->thread, NULL, zfile_thread, p_zfile))
+    {
+        pthread_cond_destroy(&p_zfile->idle);
+        pthread_cond_destroy(&p_zfile->space);
+        pthread_cond_destroy(&p_zfile->data);
+        pthread_mutex_destroy(&p_zfile->mutex);
+        goto fail;
+    }
+
+    return p_zfile;
+
+fail:
+    if (p_zfile->fd >= 0)
+    {
+        close(p_zfile->fd);
+    }
+
+    if (NULL != p_zfile->p_frames)
+    {
+        PLOG_FREE(p_zfile->p_frames);
+    }
+
+    if (NULL != p_zfile->p_mem)
+    {
+        PLOG_FREE(p_zfile->p_mem);
+    }
+
+    if (NULL != p_zfile->p_out)
+    {
+        PLOG_FREE(p_zfile->p_out);
+    }
+
+    PLOG_FREE(p_zfile);
+
+    return NULL;
+}
+
+/*
+ * plog_flush hook.
+ */
+static void
+zfile_flush (void* p_udata)
+{
+    plog_zfile_flush((plog_zfile_t*)p_udata);
+}
+
+plog_id_t
+plog_add_zfile (plog_zfile_t* p_zfile, plog_level_t level)
+{
+    // Appender must not be NULL
+    PLOG_ASSERT(NULL != p_zfile);
+
+    plog_id_t id = plog_add_appender(zfile_appender, level, p_zfile);
+
+    plog_set_flush(id, zfile_flush);
+
+    return id;
+}
+
+void
+plog_zfile_totals (plog_zfile_t* p_zfile, uint64_t* p_raw, uint64_t* p_written)
+{
+    PLOG_ASSERT(NULL != p_zfile);
+
+    pthread_mutex_lock(&p_zfile->mutex);
+    *p_raw     = p_zfile->raw;
+    *p_written = p_zfile->written;
+    pthread_mutex_unlock(&p_zfile->mutex);
+}
+
+uint64_t
+plog_zfile_errors (plog_zfile_t* p_zfile)
+{
+    PLOG_ASSERT(NULL != p_zfile);
+
+    pthread_mutex_lock(&p_zfile->mutex);
+    uint64_t errors = p_zfile->errors;
+    pthread_mutex_unlock(&p_zfile->mutex);
+
+    return errors;
+}
+
+void
+plog_zfile_flush (plog_zfile_t* p_zfile)
+{
+    PLOG_ASSERT(NULL != p_zfile);
+
+    pthread_mutex_lock(&p_zfile->mutex);
+
+    uint64_t req = ++p_zfile->flush_req;
+
+    pthread_cond_signal(&p_zfile->data);
+
+    while (p_zfile->flush_done < req)
+    {
+        pthread_cond_wait(&p_zfile->idle, &p_zfile->mutex);
+    }
+
+    pthread_mutex_unlock(&p_zfile->mutex);
+}
+
+void
+plog_zfile_close (plog_zfile_t* p_zfile)
+{
+    if (NULL == p_zfile)
+    {
+        return;
+    }
+
+    pthread_mutex_lock(&p_zfile->mutex);
+    p_zfile->b_stop = true;
+    pthread_cond_signal(&p_zfile->data);
+    pthread_mutex_unlock(&p_zfile->mutex);
+
+    pthread_join(p_zfile->thread, NULL);
+
+    pthread_cond_destroy(&p_zfile->idle);
+    pthread_cond_destroy(&p_zfile->space);
+    pthread_cond_destroy(&p_zfile->data);
+    pthread_mutex_destroy(&p_zfile->mutex);
+
+    close(p_zfile->fd);
+
+    PLOG_FREE(p_zfile->p_frames);
+    PLOG_FREE(p_zfile->p_mem);
+    PLOG_FREE(p_zfile->p_out);
+    PLOG_FREE(p_zfile);
+}
+
+/*
+ * Reads up to `len` bytes at `offset`. Returns the number of bytes read,
+ * which is short only at the end of the file, or -1 on error.
+ */
+static ssize_t
+zread_at (int fd, char* p_buf, size_t len, uint64_t offset)
+{
+    size_t done = 0;
+
+    while (done < len)
+    {
+        ssize_t ret = pread(fd, p_buf + done, len - done,
+                            (off_t)(offset + done));
+
+        if (ret < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+
+            return -1;
+        }
+
+        if (0 == ret)
+        {
+            break;
+        }
+
+        done += (size_t)ret;
+    }
+
+    return (ssize_t)done;
+}
+
+/*
+ * Ensures a reader buffer holds at least `len` bytes.
+ */
+static bool
+zread_reserve (char** pp_buf, size_t* p_cap, size_t len)
+{
+    if (len <= *p_cap)
+    {
+        return true;
+    }
+
+    char* p_buf = (char*)PLOG_MALLOC(len);
+
+    if (NULL == p_buf)
+    {
+        return false;
+    }
+
+    if (NULL != *pp_buf)
+    {
+        PLOG_FREE(*pp_buf);
+    }
+
+    *pp_buf = p_buf;
+    *p_cap  = len;
+
+    return true;
+}
+
+/*
+ * Moves the reader to the first frame magic at or after `offset`. If there is
+ * none yet, stops short of the end by less than the magic length, in case the
+ * magic is only partly written.
+ */
+static bool
+zread_find (plog_zread_t* p_zread, uint64_t offset)
+{
+    char buf[PLOG_ZREAD_SCAN_LEN];
+
+    for (;;)
+    {
+        ssize_t len = zread_at(p_zread->fd, buf, sizeof(buf), offset);
+
+        if (len < 0)
+        {
+            return false;
+        }
+
+        size_t i = 0;
+
+        for (; i + 4 <= (size_t)len; i++)
+        {
+            if (PLOG_ZFILE_MAGIC[0] == buf[i] &&
+                0 == memcmp(buf + i, PLOG_ZFILE_MAGIC, 4))
+            {
+                p_zread->offset = offset + i;
+                return true;
+            }
+        }
+
+        if ((size_t)len < sizeof(buf))
+        {
+            p_zread->offset = offset + i;
+            return true;
+        }
+
+        offset += i;
+    }
+}
+
+plog_zread_t*
+plog_zread_open (const char* path)
+{
+    PLOG_ASSERT(NULL != path);
+
+    plog_zread_t* p_zread = (plog_zread_t*)PLOG_MALLOC(sizeof(plog_zread_t));
+
+    if (NULL == p_zread)
+    {
+        return NULL;
+    }
+
+    memset(p_zread, 0, sizeof(plog_zread_t));
+
+    p_zread->fd = open(path, O_RDONLY | O_CLOEXEC);
+
+    if (p_zread->fd < 0)
+    {
+        PLOG_FREE(p_zread);
+        return NULL;
+    }
+
+    return p_zread;
+}
+
+void
+plog_zread_seek (plog_zread_t* p_zread, uint64_t offset)
+{
+    PLOG_ASSERT(NULL != p_zread);
+
+    if (!zread_find(p_zread, offset))
+    {
+        p_zread->offset = offset;
+    }
+}
+
+uint64_t
+plog_zread_offset (plog_zread_t* p_zread)
+{
+    PLOG_ASSERT(NULL != p_zread);
+
+    return p_zread->offset;
+}
+
+plog_zread_result_t
+plog_zread_next (plog_zread_t* p_zread, const char** pp_data, size_t* p_len)
+{
+    PLOG_ASSERT(NULL != p_zread);
+
+    char    header[PLOG_ZFILE_HEADER_LEN];
+    ssize_t len = zread_at(p_zread->fd, header, sizeof(header),
+                           p_zread->offset);
+
+    if (len < 0)
+    {
+        return PLOG_ZREAD_ERROR;
+    }
+
+    if (len < PLOG_ZFILE_HEADER_LEN)
+    {
+        // A frame being written, or the tail of a damaged one
+        if (len >= 4 && 0 != memcmp(header, PLOG_ZFILE_MAGIC, 4))
+        {
+            return zread_find(p_zread, p_zread->offset + 1)
+                   ? PLOG_ZREAD_SKIPPED : PLOG_ZREAD_ERROR;
+        }
+
+        return PLOG_ZREAD_END;
+    }
+
+    uint32_t raw_len  = zfile_get32(header + 8);
+    uint32_t data_len = zfile_get32(header + 12);
+
+    if (0 != memcmp(header, PLOG_ZFILE_MAGIC, 4) ||
+        raw_len > PLOG_ZREAD_MAX_LEN || data_len > PLOG_ZREAD_MAX_LEN)
+    {
+        return zread_find(p_zread, p_zread->offset + 1)
+               ? PLOG_ZREAD_SKIPPED : PLOG_ZREAD_ERROR;
+    }
+
+    if (!zread_reserve(&p_zread->p_in, &p_zread->in_cap, data_len) ||
+        !zread_reserve(&p_zread->p_raw, &p_zread->raw_cap, raw_len))
+    {
+        return PLOG_ZREAD_ERROR;
+    }
+
+    len = zread_at(p_zread->fd, p_zread->p_in, data_len,
+                   p_zread->offset + PLOG_ZFILE_HEADER_LEN);
+
+    if (len < 0)
+    {
+        return PLOG_ZREAD_ERROR;
+    }
+
+    if ((size_t)len < data_len)
+    {
+        return PLOG_ZREAD_END;
+    }
+
+    uint32_t hash = zfile_hash(2166136261u, header, 16);
+
+    hash = zfile_hash(hash, p_zread->p_in, data_len);
+
+    if (hash != zfile_get32(header + 16))
+    {
+        return zread_find(p_zread, p_zread->offset + 1)
+               ? PLOG_ZREAD_SKIPPED : PLOG_ZREAD_ERROR;
+    }
+
+    // The frame is intact, so an unknown codec is not damage
+    const plog_codec_t* p_codec = plog_codec_find((uint8_t)header[4]);
+
+    if (NULL == p_codec ||
+        !p_codec->decompress(p_zread->p_raw, raw_len, p_zread->p_in, data_len))
+    {
+        return PLOG_ZREAD_ERROR;
+    }
+
+    p_zread->offset += PLOG_ZFILE_HEADER_LEN + data_len;
+
+    *pp_data = p_zread->p_raw;
+    *p_len   = raw_len;
+
+    return PLOG_ZREAD_FRAME;
+}
+
+void
+plog_zread_close (plog_zread_t* p_zread)
+{
+    if (NULL == p_zread)
+    {
+        return;
+    }
+
+    close(p_zread->fd);
+
+    if (NULL != p_zread->p_in)
+    {
+        PLOG_FREE(p_zread->p_in);
+    }
+
+    if (NULL != p_zread->p_raw)
+    {
+        PLOG_FREE(p_zread->p_raw);
+    }
+
+    PLOG_FREE(p_zread);
+}
+
+/* EoF */
@@ -0,0 +1,278 @@
+/** @file plog_zfile.h
+ * Compressing file appender for picolog.
+ */
+
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+#ifndef PLOG_ZFILE_H
+#define PLOG_ZFILE_H
+
+#include "../picolog.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * Default uncompressed frame size and number of frame buffers. At most
+ * `count - 1` frames wait for compression while one is being filled.
+ */
+#ifndef PLOG_ZFILE_FRAME_SIZE
+#define PLOG_ZFILE_FRAME_SIZE (64 * 1024)
+#endif
+
+#ifndef PLOG_ZFILE_FRAMES
+#define PLOG_ZFILE_FRAMES 4
+#endif
+
+/*
+ * Maximum number of codecs added with plog_codec_register.
+ */
+#ifndef PLOG_ZFILE_MAX_CODECS
+#define PLOG_ZFILE_MAX_CODECS 4
+#endif
+
+/*
+ * Frame layout. Every frame is a header followed by `data_len` bytes of
+ * compressed data, and decodes on its own:
+ *
+ *   0   "PLZ1"
+ *   4   Codec ID (1 byte), then 3 zero bytes
+ *   8   Uncompressed length (32 bits, little endian)
+ *   12  Compressed length (32 bits, little endian)
+ *   16  FNV-1a hash of bytes 0-15 and the compressed data (32 bits, little
+ *       endian)
+ */
+#define PLOG_ZFILE_MAGIC      "PLZ1"
+#define PLOG_ZFILE_HEADER_LEN 20
+
+/**
+ * Codec IDs recorded in frame headers.
+ */
+typedef enum
+{
+    PLOG_CODEC_NONE = 0, // Stored as is
+    PLOG_CODEC_ZLIB = 1, // zlib stream (compress2/uncompress)
+    PLOG_CODEC_LZ4  = 2, // Reserved
+    PLOG_CODEC_ZSTD = 3  // Reserved
+} plog_codec_id_t;
+
+/**
+ * Compression codec. The built-in codecs are returned by `plog_codec_find`;
+ * others (LZ4, zstd, ...) are added with `plog_codec_register`.
+ */
+typedef struct
+{
+    unsigned    id;   // Recorded in each frame header (0-255)
+    const char* name;
+
+    /* Largest compressed size of `len` bytes. */
+    size_t (*bound)(size_t len);
+
+    /* Compresses `len` bytes into `p_dst`, which holds `bound(len)` bytes.
+       `level` is the configured level, 0 for the codec's default. Returns
+       the compressed size, or 0 on failure. */
+    size_t (*compress)(void* p_dst, size_t cap, const void* p_src, size_t len,
+                       int level);
+
+    /* Decompresses a frame into `p_dst`, which holds exactly the
+       uncompressed length. Returns false if the data is corrupt. */
+    bool (*decompress)(void* p_dst, size_t len, const void* p_src,
+                       size_t src_len);
+} plog_codec_t;
+
+/**
+ * Makes a codec available to `plog_codec_find` and the reader. Call before
+ * any file using it is opened; registering is not thread safe.
+ *
+ * @param p_codec The codec, in static storage
+ *
+ * @return False if the ID is taken or PLOG_ZFILE_MAX_CODECS are registered
+ */
+bool plog_codec_register(const plog_codec_t* p_codec);
+
+/**
+ * Returns a codec: PLOG_CODEC_NONE, PLOG_CODEC_ZLIB unless built with
+ * PLOG_ZFILE_NO_ZLIB, or a registered codec.
+ *
+ * @param id The codec ID
+ *
+ * @return The codec, or NULL if it is unknown
+ */
+const plog_codec_t* plog_codec_find(unsigned id);
+
+/**
+ * Compressing file appender configuration. Use `plog_zfile_defaults` to
+ * initialize.
+ */
+typedef struct
+{
+    const plog_codec_t* p_codec;     // Codec used for every frame
+    int                 level;       // Compression level, 0 for the default
+    size_t              frame_size;  // Uncompressed bytes per frame
+    unsigned            frame_count; // Number of frame buffers (at least 2)
+    unsigned            flush_ms;    // Maximum time a partly filled frame waits
+} plog_zfile_cfg_t;
+
+/**
+ * Compressing file appender handle.
+ */
+typedef struct plog_zfile_s plog_zfile_t;
+
+/**
+ * Fills in the default configuration: zlib (or no compression if built
+ * without it) at its fastest level, PLOG_ZFILE_FRAMES frames of
+ * PLOG_ZFILE_FRAME_SIZE bytes, written at least every second.
+ *
+ * @param p_cfg The configuration to initialize
+ */
+void plog_zfile_defaults(plog_zfile_cfg_t* p_cfg);
+
+/**
+ * Opens (or creates) a file for appending compressed frames. Logging threads
+ * only copy entries into a frame buffer; a writer thread compresses each
+ * frame once it is full or `flush_ms` have passed, and appends it to the
+ * file. A crash therefore loses at most the frames not written yet. When
+ * every frame buffer is waiting, logging threads wait for the writer.
+ *
+ * @param path  The file path
+ * @param p_cfg The configuration
+ *
+ * @return The appender, or NULL if the file or writer could not be set up
+ */
+plog_zfile_t* plog_zfile_open(const char* path, const plog_zfile_cfg_t* p_cfg);
+
+/**
+ * Registers the file as an appender.
+ *
+ * @param p_zfile The appender
+ * @param level   The appender's log level
+ *
+ * @return An identifier for the appender
+ */
+plog_id_t plog_add_zfile(plog_zfile_t* p_zfile, plog_level_t level);
+
+/**
+ * Retrieves the number of uncompressed bytes logged and of bytes written to
+ * the file (headers included) so far.
+ *
+ * @param p_zfile   The appender
+ * @param p_raw     Receives the uncompressed byte count
+ * @param p_written Receives the file byte count
+ */
+void plog_zfile_totals(plog_zfile_t* p_zfile, uint64_t* p_raw,
+                       uint64_t* p_written);
+
+/**
+ * Returns the number of uncompressed bytes lost to compression or I/O errors.
+ *
+ * @param p_zfile The appender
+ */
+uint64_t plog_zfile_errors(plog_zfile_t* p_zfile);
+
+/**
+ * Closes the partly filled frame and waits until every frame has been
+ * written. plog_flush calls this for appenders added with plog_add_zfile.
+ *
+ * @param p_zfile The appender
+ */
+void plog_zfile_flush(plog_zfile_t* p_zfile);
+
+/**
+ * Flushes, stops the writer thread, closes the file and frees the appender.
+ * The appender must be removed first.
+ *
+ * @param p_zfile The appender
+ */
+void plog_zfile_close(plog_zfile_t* p_zfile);
+
+/**
+ * Result of `plog_zread_next`.
+ */
+typedef enum
+{
+    PLOG_ZREAD_FRAME = 0, // A frame was decoded
+    PLOG_ZREAD_END,       // No complete frame (yet); try again later to follow
+    PLOG_ZREAD_SKIPPED,   // Damaged data was skipped (e.g. a frame cut short
+                          // by a crash, then appended to)
+    PLOG_ZREAD_ERROR      // Read error, out of memory or unknown codec
+} plog_zread_result_t;
+
+/**
+ * Compressed log file reader handle.
+ */
+typedef struct plog_zread_s plog_zread_t;
+
+/**
+ * Opens a compressed log file for reading from the start.
+ *
+ * @param path The file path
+ *
+ * @return The reader, or NULL if the file cannot be opened
+ */
+plog_zread_t* plog_zread_open(const char* path);
+
+/**
+ * Moves the reader to the first frame that starts at or after `offset`, e.g.
+ * to read only the end of a large file.
+ *
+ * @param p_zread The reader
+ * @param offset  File offset
+ */
+void plog_zread_seek(plog_zread_t* p_zread, uint64_t offset);
+
+/**
+ * Returns the file offset of the next frame to decode.
+ *
+ * @param p_zread The reader
+ */
+uint64_t plog_zread_offset(plog_zread_t* p_zread);
+
+/**
+ * Decodes the next frame. A frame that is still being written is reported as
+ * PLOG_ZREAD_END and decoded by a later call once it is complete, so a file
+ * can be followed while it grows. Built-in codecs are recognized.
+ *
+ * @param p_zread The reader
+ * @param pp_data Receives the uncompressed data, valid until the next call
+ * @param p_len   Receives its length
+ */
+plog_zread_result_t plog_zread_next(plog_zread_t* p_zread,
+                                    const char** pp_data, size_t* p_len);
+
+/**
+ * Closes the file and frees the reader.
+ *
+ * @param p_zread The reader
+ */
+void plog_zread_close(plog_zread_t* p_zread);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* PLOG_ZFILE_H */
+
+/* EoF */
@@ -0,0 +1,403 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Write path benchmarks. Each case reports the mean cost per call (ns/op),
+ * throughput (entries/s) and per-call latency percentiles.
+ *
+ * Usage: bench [-n ops] [-t max_threads] [-r]
+ *
+ *   -r  Only run the decoration cases, which measure entry rendering. Build
+ *       bench_layout (PLOG_NO_RENDER_VARIANTS) to compare the specialized
+ *       flag renderers with the layout interpreter (make compare).
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <picolog.h>
+
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define BENCH_DEFAULT_OPS     200000
+#define BENCH_DEFAULT_THREADS 8
+
+static size_t g_ops = BENCH_DEFAULT_OPS;
+
+/*
+ * Benchmark configuration applied to every registered appender.
+ */
+/*
+ * Delivery modes.
+ */
+enum
+{
+    BENCH_SYNC,
+    BENCH_ASYNC,  // Async mode with the shared queue
+    BENCH_SHARDED // Async mode with per-thread rings
+};
+
+typedef struct
+{
+    const char* name;
+    int         level;     // Level of the logged entries
+    size_t      appenders; // Number of null appenders
+    FILE*       stream;    // Stream appender instead of null appenders
+    bool        timestamp;
+    bool        file;
+    bool        func;
+    size_t      threads;
+    int         async;     // BENCH_SYNC, BENCH_ASYNC or BENCH_SHARDED
+} bench_case_t;
+
+typedef struct
+{
+    const bench_case_t* p_case;
+    uint64_t*           p_samples;
+    size_t              ops;
+    uint64_t            elapsed_ns;
+} bench_thread_t;
+
+static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_barrier_t g_barrier;
+
+static uint64_t
+now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void
+null_appender (const char* p_entry, void* p_udata)
+{
+    (void)p_entry;
+    (void)p_udata;
+}
+
+static void
+mutex_lock (bool lock, void* p_udata)
+{
+    pthread_mutex_t* p_mutex = (pthread_mutex_t*)p_udata;
+
+    if (lock)
+    {
+        pthread_mutex_lock(p_mutex);
+    }
+    else
+    {
+        pthread_mutex_unlock(p_mutex);
+    }
+}
+
+static void*
+bench_thread (void* p_arg)
+{
+    bench_thread_t*     p_thread = (bench_thread_t*)p_arg;
+    const bench_case_t* p_case   = p_thread->p_case;
+
+    pthread_barrier_wait(&g_barrier);
+
+    uint64_t start = now_ns();
+
+    for (size_t i = 0; i < p_thread->ops; i++)
+    {
+        uint64_t t0 = now_ns();
+
+        if (PLOG_LEVEL_DEBUG == p_case->level)
+        {
+            plog_debug("Benchmark message %zu: %s", i, "payload");
+        }
+        else
+        {
+            plog_info("Benchmark message %zu: %s", i, "payload");
+        }
+
+        p_thread->p_samples[i] = now_ns() - t0;
+    }
+
+    p_thread->elapsed_ns = now_ns() - start;
+
+    return NULL;
+}
+
+static int
+compare_u64 (const void* p_a, const void* p_b)
+{
+    uint64_t a = *(const uint64_t*)p_a;
+    uint64_t b = *(const uint64_t*)p_b;
+
+    return (a > b) - (a < b);
+}
+
+static uint64_t
+percentile (const uint64_t* p_sorted, size_t count, double pct)
+{
+    size_t index = (size_t)(pct / 100.0 * (double)(count - 1) + 0.5);
+    return p_sorted[index];
+}
+
+static void
+bench_run (const bench_case_t* p_case)
+{
+    plog_id_t ids[PLOG_MAX_APPENDERS];
+    size_t    count = p_case->stream ? 1 : p_case->appenders;
+
+    for (size_t i = 0; i < count; i++)
+    {
+        ids[i] = p_case->stream
+               ? plog_add_stream(p_case->stream, PLOG_LEVEL_INFO)
+               : plog_add_appender(null_appender, PLOG_LEVEL_INFO, NULL);
+
+        plog_set_level(ids[i], PLOG_LEVEL_INFO);
+
+        if (p_case->timestamp) plog_timestamp_on(ids[i]);
+        if (p_case->file)      plog_file_on(ids[i]);
+        if (p_case->func)      plog_func_on(ids[i]);
+
+        if (p_case->threads > 1)
+        {
+            plog_set_lock(ids[i], mutex_lock, &g_mutex);
+        }
+    }
+
+    if (BENCH_ASYNC == p_case->async)
+    {
+        plog_async_start();
+    }
+    else if (BENCH_SHARDED == p_case->async)
+    {
+        plog_async_start_sharded();
+    }
+
+    size_t          threads  = p_case->threads ? p_case->threads : 1;
+    size_t          total    = g_ops * threads;
+    uint64_t*       p_all    = (uint64_t*)malloc(total * sizeof(uint64_t));
+    bench_thread_t* p_thread = (bench_thread_t*)calloc(threads,
+                                                       sizeof(bench_thread_t));
+    pthread_t*      p_tid    = (pthread_t*)calloc(threads, sizeof(pthread_t));
+
+    if (NULL == p_all || NULL == p_thread || NULL == p_tid)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    pthread_barrier_init(&g_barrier, NULL, (unsigned)threads);
+
+    for (size_t i = 0; i < threads; i++)
+    {
+        p_thread[i].p_case    = p_case;
+        p_thread[i].p_samples = p_all + i * g_ops;
+        p_thread[i].ops       = g_ops;
+
+        if (i > 0)
+        {
+            pthread_create(&p_tid[i], NULL, bench_thread, &p_thread[i]);
+        }
+    }
+
+    bench_thread(&p_thread[0]);
+
+    uint64_t elapsed = p_thread[0].elapsed_ns;
+
+    for (size_t i = 1; i < threads; i++)
+    {
+        pthread_join(p_tid[i], NULL);
+
+        if (p_thread[i].elapsed_ns > elapsed)
+        {
+            elapsed = p_thread[i].elapsed_ns;
+        }
+    }
+
+    pthread_barrier_destroy(&g_barrier);
+
+    if (BENCH_SYNC != p_case->async)
+    {
+        plog_async_stop();
+    }
+
+    qsort(p_all, total, sizeof(uint64_t), compare_u64);
+
+    // Mean over the whole run (wall time across all threads)
+    double ns_per_op = (double)elapsed / (double)g_ops;
+    double per_sec   = (double)total * 1e9 / (double)elapsed;
+
+    printf("%-28s %10.1f %14.0f %8llu %8llu %8llu\n",
+           p_case->name, ns_per_op, per_sec,
+           (unsigned long long)percentile(p_all, total, 50.0),
+           (unsigned long long)percentile(p_all, total, 99.0),
+           (unsigned long long)percentile(p_all, total, 99.9));
+
+    for (size_t i = 0; i < count; i++)
+    {
+        plog_remove_appender(ids[i]);
+    }
+
+    free(p_tid);
+    free(p_thread);
+    free(p_all);
+}
+
+int
+main (int argc, char** argv)
+{
+    size_t max_threads = BENCH_DEFAULT_THREADS;
+    bool   b_render    = false;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            g_ops = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "-t") && i + 1 < argc)
+        {
+            max_threads = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "-r"))
+        {
+            b_render = true;
+        }
+    }
+
+    if (0 == g_ops || 0 == max_threads)
+    {
+        fprintf(stderr, "Usage: %s [-n ops] [-t max_threads] [-r]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    FILE* p_null = fopen("/dev/null", "w");
+    FILE* p_file = tmpfile();
+
+    if (NULL == p_null || NULL == p_file)
+    {
+        fprintf(stderr, "Unable to open output streams\n");
+        return EXIT_FAILURE;
+    }
+
+    if (b_render)
+    {
+#ifdef PLOG_NO_RENDER_VARIANTS
+        printf("renderer: layout interpreter\n");
+#else
+        printf("renderer: specialized flag variants\n");
+#endif
+    }
+
+    printf("%-28s %10s %14s %8s %8s %8s\n",
+           "case", "ns/op", "entries/s", "p50", "p99", "p99.9");
+
+    const bench_case_t cases[] =
+    {
+        // name                   level            n  stream  ts     file   func   thr async
+        { "filtered",             PLOG_LEVEL_DEBUG, 1, NULL,   false, false, false, 1, BENCH_SYNC },
+        { "format_1_appender",    PLOG_LEVEL_INFO,  1, NULL,   false, false, false, 1, BENCH_SYNC },
+        { "fanout_4_appenders",   PLOG_LEVEL_INFO,  4, NULL,   false, false, false, 1, BENCH_SYNC },
+        { "fanout_16_appenders",  PLOG_LEVEL_INFO, 16, NULL,   false, false, false, 1, BENCH_SYNC },
+        { "timestamp_off",        PLOG_LEVEL_INFO,  1, NULL,   false, false, false, 1, BENCH_SYNC },
+        { "timestamp_on",         PLOG_LEVEL_INFO,  1, NULL,   true,  false, false, 1, BENCH_SYNC },
+        { "file_func_on",         PLOG_LEVEL_INFO,  1, NULL,   false, true,  true,  1, BENCH_SYNC },
+        { "all_decorations",      PLOG_LEVEL_INFO,  1, NULL,   true,  true,  true,  1, BENCH_SYNC },
+        { "stream_dev_null",      PLOG_LEVEL_INFO,  1, p_null, false, false, false, 1, BENCH_SYNC },
+        { "stream_file",          PLOG_LEVEL_INFO,  1, p_file, false, false, false, 1, BENCH_SYNC },
+        { "async_stream_file",    PLOG_LEVEL_INFO,  1, p_file, false, false, false, 1, BENCH_ASYNC },
+        { "sharded_stream_file",  PLOG_LEVEL_INFO,  1, p_file, false, false, false, 1, BENCH_SHARDED },
+    };
+
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++)
+    {
+        const bench_case_t* p_case = &cases[i];
+
+        // Rendering cases: one null appender, formatted synchronously
+        bool b_rendering = (PLOG_LEVEL_INFO == p_case->level &&
+                            1 == p_case->appenders && NULL == p_case->stream &&
+                            BENCH_SYNC == p_case->async);
+
+        if (!b_render || b_rendering)
+        {
+            bench_run(p_case);
+        }
+    }
+
+    if (b_render)
+    {
+        fclose(p_file);
+        fclose(p_null);
+
+        return 0;
+    }
+
+    // Contention through plog_set_lock
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "contention_%zu_threads", threads);
+
+        bench_case_t contention =
+        {
+            name, PLOG_LEVEL_INFO, 1, p_null, false, false, false, threads,
+            BENCH_SYNC
+        };
+
+        bench_run(&contention);
+    }
+
+    // Producers sharing the async queue vs. one ring each
+    for (size_t threads = 1; threads <= max_threads; threads *= 2)
+    {
+        char async_name[32];
+        char sharded_name[32];
+
+        snprintf(async_name, sizeof(async_name), "async_%zu_threads", threads);
+        snprintf(sharded_name, sizeof(sharded_name), "sharded_%zu_threads",
+                 threads);
+
+        bench_case_t async =
+        {
+            async_name, PLOG_LEVEL_INFO, 1, p_null, false, false, false,
+            threads, BENCH_ASYNC
+        };
+
+        bench_case_t sharded =
+        {
+            sharded_name, PLOG_LEVEL_INFO, 1, p_null, false, false, false,
+            threads, BENCH_SHARDED
+        };
+
+        bench_run(&async);
+        bench_run(&sharded);
+    }
+
+    fclose(p_file);
+    fclose(p_null);
+
+    return 0;
+}
@@ -0,0 +1,62 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+#include <picolog.h>
+
+#include <stdio.h>
+
+int main(int argc, char** argv)
+{
+    (void)argc;
+    (void)argv;
+
+    plog_id_t id = plog_add_stream(stdout, PLOG_LEVEL_TRACE);
+
+    plog_set_level(id, PLOG_LEVEL_TRACE);
+    plog_timestamp_on(id);
+    plog_func_on(id);
+
+    // Entries are queued and written by a background thread
+    if (!plog_async_start())
+    {
+        plog_warn("Async mode unavailable, writing synchronously");
+    }
+
+    for (int i = 0; i < 10; i++)
+    {
+        plog_info("Test message: %d", i);
+    }
+
+    // Wait for the entries above to be written
+    plog_flush();
+
+    plog_stats_t stats;
+    plog_get_stats(&stats);
+
+    printf("Dropped entries: %llu\n", (unsigned long long)stats.async_drops);
+
+    plog_async_stop();
+
+    return 0;
+}
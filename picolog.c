@@ -26,13 +26,128 @@
  * Implementation
  */
 
+// Expose POSIX interfaces (localtime_r, clock_gettime, ...) in C99 mode
+#if !defined(_POSIX_C_SOURCE) && (defined(__unix__) || defined(__APPLE__))
+#define _POSIX_C_SOURCE 200809L
+#endif
+
 #include "picolog.h"
 
+#include <ctype.h>  // isspace
 #include <stdarg.h> // va_list, va_start, va_end
-#include <stdio.h>  // vsnprintf, FILE, fprintf, fflush
-#include <string.h> // strncat
+#include <stdio.h>  // vsnprintf, FILE, fprintf, fflush, fopen, fgets
+#include <stdlib.h> // strtoul
+#include <string.h> // memcpy, strlen, strncpy
 #include <time.h>   // time, strftime
 
+#ifdef __SSE2__
+#include <emmintrin.h> // _mm_srli_epi16, _mm_unpacklo_epi8, _mm_cmpgt_epi8
+#endif
+
+/*
+ * Threading support. POSIX builds get per-thread state with cleanup on thread
+ * exit. Define PLOG_NO_THREADS to build without pthreads.
+ */
+#if !defined(PLOG_NO_THREADS) && (defined(__unix__) || defined(__APPLE__))
+#define PLOG_THREADS 1
+#include <pthread.h> // pthread_create, pthread_key_create, pthread_once
+#include <sched.h>   // sched_yield
+#include <signal.h>  // sigaction, raise
+#include <sys/uio.h> // writev
+#include <unistd.h>  // write
+#endif
+
+#if defined(PLOG_THREADS) && defined(__GLIBC__)
+#include <execinfo.h> // backtrace, backtrace_symbols_fd
+#define PLOG_BACKTRACE 1
+#endif
+
+#if defined(PLOG_THREADS) && defined(__linux__)
+#include <errno.h>       // errno, EINTR
+#include <poll.h>        // poll
+#include <sys/inotify.h> // inotify_init1, inotify_add_watch
+#define PLOG_INOTIFY 1
+#endif
+
+#if defined(_MSC_VER)
+#define PLOG_TLS __declspec(thread)
+#elif defined(__GNUC__) || defined(__clang__)
+#define PLOG_TLS __thread
+#elif defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L
+#define PLOG_TLS _Thread_local
+#else
+#define PLOG_TLS
+#endif
+
+/*
+ * Atomic primitives. Fall back to plain memory accesses on compilers without
+ * the GCC builtins (single threaded use only).
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define PLOG_LOAD(p)          __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define PLOG_STORE(p, v)      __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+#define PLOG_LOAD_RELAXED(p)  __atomic_load_n((p), __ATOMIC_RELAXED)
+#define PLOG_STORE_RELAXED(p, v) \
+        __atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define PLOG_LOAD_SEQ(p)      __atomic_load_n((p), __ATOMIC_SEQ_CST)
+#define PLOG_STORE_SEQ(p, v)  __atomic_store_n((p), (v), __ATOMIC_SEQ_CST)
+#define PLOG_CAS(p, p_expected, v) \
+        __atomic_compare_exchange_n((p), (p_expected), (v), false, \
+                                    __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE)
+#define PLOG_ADD(p, v)        __atomic_add_fetch((p), (v), __ATOMIC_SEQ_CST)
+#define PLOG_XCHG(p, v)       __atomic_exchange_n((p), (v), __ATOMIC_SEQ_CST)
+#else
+#define PLOG_LOAD(p)               (*(p))
+#define PLOG_STORE(p, v)           (*(p) = (v))
+#define PLOG_LOAD_RELAXED(p)       (*(p))
+#define PLOG_STORE_RELAXED(p, v)   (*(p) = (v))
+#define PLOG_CAS(p, p_expected, v) \
+        (*(p) == *(p_expected) ? (*(p) = (v), true) \
+                               : (*(p_expected) = *(p), false))
+#define PLOG_LOAD_SEQ(p)           (*(p))
+#define PLOG_STORE_SEQ(p, v)       (*(p) = (v))
+#define PLOG_ADD(p, v)             (*(p) += (v))
+#define PLOG_XCHG(p, v)            plog_xchg_ptr((void**)(p), (v))
+
+static void*
+plog_xchg_ptr (void** pp, void* p)
+{
+    void* p_old = *pp;
+    *pp = p;
+    return p_old;
+}
+#endif
+
+/*
+ * Busy-wait hint.
+ */
+#if defined(__x86_64__) || defined(__i386__)
+#define PLOG_CPU_RELAX() __builtin_ia32_pause()
+#elif defined(__aarch64__)
+#define PLOG_CPU_RELAX() __asm__ __volatile__("yield")
+#else
+#define PLOG_CPU_RELAX() ((void)0)
+#endif
+
+/*
+ * Forces a function to be inlined, so that calls with constant arguments are
+ * specialized.
+ */
+#if defined(__GNUC__) || defined(__clang__)
+#define PLOG_ALWAYS_INLINE inline __attribute__((always_inline))
+#elif defined(_MSC_VER)
+#define PLOG_ALWAYS_INLINE __forceinline
+#else
+#define PLOG_ALWAYS_INLINE inline
+#endif
+
+/*
+ * Increments a counter owned by the calling thread. Only the owner writes, so
+ * no read-modify-write atomic is required; readers see a torn-free value.
+ */
+#define PLOG_COUNT(p, n) \
+        PLOG_STORE_RELAXED((p), PLOG_LOAD_RELAXED(p) + (n))
+
 /*
  * Log entry component maximum sizes. These have been chosen to be overly
  * generous powers of 2 for the sake of safety and simplicity.
@@ -40,28 +155,47 @@
 
 #define PLOG_TIMESTAMP_LEN 64
 #define PLOG_LEVEL_LEN     32
-#define PLOG_FILE_LEN      512
-#define PLOG_FUNC_LEN      32
-#define PLOG_MSG_LEN       PLOG_MAX_MSG_LENGTH
-#define PLOG_BREAK_LEN     1
-
-#define PLOG_ENTRY_LEN     (PLOG_TIMESTAMP_LEN  + \
-                            PLOG_LEVEL_LEN      + \
-                            PLOG_FILE_LEN       + \
-                            PLOG_FUNC_LEN       + \
-                            PLOG_MSG_LEN        + \
-                            PLOG_BREAK_LEN)
+#define PLOG_UINT_LEN      20 // Digits in UINT64_MAX
+#define PLOG_SAMPLE_ALL    (UINT64_C(1) << 32) // Threshold that keeps all
+
+/*
+ * Layout limits: pattern/literal text length and number of operations.
+ */
+#define PLOG_LAYOUT_LEN    128
+#define PLOG_LAYOUT_OPS    32
+
+/*
+ * Stack buffer sizes. Messages and entries that do not fit spill into a
+ * growable per-thread buffer. Spill buffers larger than PLOG_SPILL_RETAIN are
+ * released after use so a single large dump does not pin memory.
+ */
+#ifndef PLOG_MSG_STACK_LEN
+#define PLOG_MSG_STACK_LEN   256
+#endif
+
+#ifndef PLOG_ENTRY_STACK_LEN
+#define PLOG_ENTRY_STACK_LEN 512
+#endif
+
+#ifndef PLOG_SPILL_RETAIN
+#define PLOG_SPILL_RETAIN    (64 * 1024)
+#endif
 
 #define PLOG_TIME_FMT_LEN 32
 #define PLOG_TIME_FMT     "%d/%m/%g %H:%M:%S"
 
+/*
+ * Longest configuration file line, including the newline.
+ */
+#define PLOG_CONFIG_LINE_LEN 512
+
+#define PLOG_DEGRADE_WINDOW_NS ((uint64_t)PLOG_DEGRADE_WINDOW_MS * 1000000u)
+
 #define PLOG_TERM_CODE    0x1B
 #define PLOG_TERM_RESET   "[0m"
 #define PLOG_TERM_GRAY    "[90m"
-                                
-static bool   gb_initialized   = false; // True if logger is initialized
-static bool   gb_enabled       = true;  // True if logger is enabled
-static size_t g_appender_count = 0;         // Number of appenders
+
+static bool gb_fatal_flush = false; // Write FATAL entries synchronously
 
 /*
  * Logger level strings indexed by level ID (plog_level_t).
@@ -97,12 +231,50 @@ static const char* level_color[] =
     "[94m", "[36m", "[32m", "[33m", "[31m", "[35m", NULL
 };
 
+/*
+ * Layout operations. A layout is compiled from the decoration flags, or from
+ * a user pattern, whenever the appender configuration changes, so writing an
+ * entry is a sequence of copies.
+ */
+typedef enum
+{
+    LAYOUT_TEXT = 0, // Literal text from the text pool
+    LAYOUT_TIME,     // Timestamp
+    LAYOUT_LEVEL,    // Pre-rendered level string
+    LAYOUT_FILE,     // Filename
+    LAYOUT_LINE,     // Line number
+    LAYOUT_FUNC,     // Function name
+    LAYOUT_MSG,      // Message
+    LAYOUT_RATE,     // Sampling rate
+    LAYOUT_RATE_TAG, // "[rate] " if the entry was sampled
+    LAYOUT_CTX,      // Context fields
+    LAYOUT_CTX_TAG   // "[context] " if the context is not empty
+} layout_op_type_t;
+
+typedef struct
+{
+    uint8_t  type;   // layout_op_type_t
+    uint8_t  len;    // LAYOUT_TEXT only
+    uint16_t offset; // LAYOUT_TEXT only
+} layout_op_t;
+
+typedef struct
+{
+    layout_op_t ops[PLOG_LAYOUT_OPS];
+    size_t      n_ops;
+    char        text[PLOG_LAYOUT_LEN]; // Literal text pool
+    size_t      text_len;
+    char        levels[PLOG_LEVEL_COUNT][PLOG_LEVEL_LEN];
+    uint8_t     level_len[PLOG_LEVEL_COUNT];
+} layout_t;
+
 /*
  * Appender pointer and metadata.
  */
 typedef struct
 {
     plog_appender_fn p_appender;
+    plog_entry_fn    p_entry_fn;  // Set instead of p_appender for entry appenders
     void*            p_udata;
     bool             b_enabled;
     plog_level_t     level;
@@ -112,512 +284,5426 @@ typedef struct
     bool             b_level;
     bool             b_file;
     bool             b_func;
+    bool             b_ctx;
     plog_lock_fn     p_lock;
     void*            p_lock_udata;
+    plog_flush_fn    p_flush;                    // Called by plog_flush
+    char             p_pattern[PLOG_LAYOUT_LEN]; // Empty for flag layout
+    layout_t         layout;                     // Compiled layout
+    uint8_t          render;                     // Renderer (g_renderers)
+    uint64_t         gen;                        // Layout generation
+    uint32_t         sample_keep[PLOG_LEVEL_COUNT]; // Sampling rate per level
+    uint32_t         sample_of[PLOG_LEVEL_COUNT];
+    uint64_t         sample_threshold[PLOG_LEVEL_COUNT]; // See sample_keep()
+    plog_level_t     degrade_max;        // See plog_set_degrade
+    uint64_t         degrade_latency_ns;
+    size_t           degrade_depth;
 } appender_info_t;
 
 /*
- * Array of appenders.
+ * Logger configuration. The active configuration is an immutable snapshot:
+ * changes copy it, modify the copy and publish it with a single pointer swap,
+ * so plog_write never sees a half-applied change and never takes a lock. Old
+ * snapshots are freed once no thread can still be reading them.
  */
-static appender_info_t gp_appenders[PLOG_MAX_APPENDERS];
+typedef struct config_s
+{
+    struct config_s* p_retired;      // Retired list link
+    plog_logger_t*   p_logger;       // Owning instance (set by config_begin)
+    size_t           appender_count; // Number of appenders
+    appender_info_t  appenders[PLOG_MAX_APPENDERS];
+    char             src_root[PLOG_SRC_ROOT_LEN]; // Prefix stripped from files
+    size_t           src_root_len;
+    uint64_t         src_root_gen;   // Bumped when src_root changes
+    bool             b_degrade;      // An appender has degradation on
+} config_t;
 
 /*
- * Initializes the logger provided it has not been initialized.
+ * Lowest level accepted by an enabled appender, PLOG_LEVEL_COUNT if there is
+ * none or the logger is disabled. Updated with the config lock held, read
+ * without it by plog_write and plog_is_enabled. This is the default
+ * instance's; other instances keep theirs in plog_logger_t.
  */
-static void
-try_init ()
+int plog_threshold_ = PLOG_LEVEL_COUNT;
+
+/*
+ * Logger instance. Everything the write path reads from it is only written
+ * when the configuration changes.
+ */
+struct plog_logger_s
 {
-    if (gb_initialized)
-    {
-        return;
-    }
+    plog_logger_t*  p_next;      // Registry link
+    config_t*       p_config;    // Active snapshot
+    config_t*       p_retired;   // Snapshots awaiting release
+    bool            b_enabled;   // True if logger is enabled
+    int*            p_threshold; // Level threshold (see plog_threshold_)
+    int             threshold;   // Storage of p_threshold (created instances)
+    uint64_t        degrade_next;  // clock_ns() of the next degradation tick
+    uint64_t        degrade_drops; // Async drops seen by the previous tick
+#ifdef PLOG_THREADS
+    pthread_mutex_t mutex;       // Config lock
+#endif
+};
 
-    for (int i = 0; i < PLOG_MAX_APPENDERS; i++)
-    {
-        gp_appenders[i].p_appender = NULL;
-    }
+static config_t g_config_initial; // Never freed
 
-    gb_initialized = true;
-}
+static plog_logger_t g_logger =
+{
+    NULL, &g_config_initial, NULL, true, &plog_threshold_, PLOG_LEVEL_COUNT,
+    0, 0,
+#ifdef PLOG_THREADS
+    PTHREAD_MUTEX_INITIALIZER
+#endif
+};
+
+static plog_logger_t* gp_loggers     = &g_logger; // Registry head
+static uint64_t       g_config_epoch = 1;         // Bumped on every publish
+
+/*
+ * Instance owning each appender ID, NULL if the ID is free. IDs are claimed
+ * with a CAS and released once the appender is removed.
+ */
+static plog_logger_t* gp_owners[PLOG_MAX_APPENDERS];
 
-static bool appender_exists(plog_id_t id)
+/*
+ * Level degradation state of an appender (see plog_set_degrade). Only the
+ * thread running its instance's tick writes it, except for `shift`, which
+ * config_commit clears when degradation is turned off; the write path only
+ * reads `shift`. The whole entry is cleared when its ID is claimed.
+ */
+typedef struct
 {
-    return (id < PLOG_MAX_APPENDERS && NULL != gp_appenders[id].p_appender);
-}
+    int      shift;   // Steps the appender's level is raised by
+    int      calm;    // Windows in a row without pressure
+    uint64_t tick;    // clock_ns() of the previous tick, 0 before the first
+    uint64_t since;   // clock_ns() when the level was first raised
+    uint64_t written; // Appender counters at the previous tick
+    uint64_t busy_ns;
+    uint64_t suppressed[PLOG_LEVEL_COUNT]; // Counters when first raised
+} degrade_t;
+
+static degrade_t gp_degrade[PLOG_MAX_APPENDERS];
 
-static bool appender_enabled(plog_id_t id)
+/*
+ * Growable buffer owned by a single thread.
+ */
+typedef struct
 {
-    return appender_exists(id) && gp_appenders[id].b_enabled;
-}
+    char*  p_str;
+    size_t cap;
+} spill_buf_t;
 
-bool plog_str_level(const char* str, plog_level_t* level)
+/*
+ * A log entry before formatting.
+ */
+typedef struct
 {
-    if (!level)
-        return false;
+    plog_level_t level;
+    const char*  file;        // Source root already stripped
+    size_t       file_len;
+    unsigned     line;
+    const char*  func;
+    size_t       func_len;
+    time_t       time;        // Time the entry was written
+    const char*  p_msg;
+    size_t       msg_len;
+    bool         b_truncated; // True if the message was cut short
+    uint32_t     sample_keep; // Call site sampling rate (1/1 if none)
+    uint32_t     sample_of;
+    uint64_t     skipped;     // Appenders that sampled the entry out or
+                              // suppressed it, by ID
+    const char*  p_ctx;       // Rendered context prefix, "[k=v ...] "
+    size_t       ctx_len;     // Zero if the context is empty
+    const char*  p_ctx_pool;  // Context fields, "key\0value\0..."
+    size_t       ctx_pool_len;
+    size_t       ctx_count;
+} log_entry_t;
 
-    for (size_t i = 0; level_str[i]; i++)
-    {
-        if (0 == strcmp(str, level_str[i]))
-        {
-            *level = (plog_level_t)i;
-            return true;
-        }
-    }
+/*
+ * Async mode entry record. Records are carved out of the producing thread's
+ * arena and delivered by the writer thread.
+ */
+typedef struct record_s
+{
+    struct record_s*      p_next;   // Queue link
+    struct arena_block_s* p_block;  // Owning arena block
+    plog_logger_t*        p_logger; // Instance the entry was written to
+    log_entry_t           entry;    // Message points to p_msg
+    uint64_t              stamp;    // Monotonic time queued (sharded mode)
+    bool                  b_done;   // Set when a flush marker is reached
+    char                  p_msg[];  // Null terminated message
+} record_t;
 
-    return false;
-}
+/*
+ * Arena block. Records are allocated by bumping `used`. `refs` counts the
+ * live records plus one while the block is the producer's current block; the
+ * thread that drops it to zero recycles the whole block.
+ */
+typedef struct arena_block_s
+{
+    struct arena_block_s* p_next;  // Free/returned list link
+    struct arena_s*       p_arena; // Owning arena
+    size_t                size;    // Usable bytes
+    size_t                used;    // Bump offset (owner only)
+    int                   refs;
+} arena_block_t;
 
-void
-plog_enable (void)
+/*
+ * Per-thread record arena. Only the owner touches `p_current`/`p_free`; the
+ * writer thread pushes emptied blocks onto `p_returned`, which the owner takes
+ * in one go when it runs out of free blocks.
+ */
+typedef struct arena_s
 {
-    gb_enabled = true;
-}
+    arena_block_t* p_current;  // Block being filled
+    arena_block_t* p_free;     // Recycled blocks (owner only)
+    arena_block_t* p_returned; // Blocks emptied by the writer thread
+    size_t         n_free;     // Length of p_free
+    size_t         n_blocks;   // Blocks owned, including in-flight ones
+} arena_t;
 
-void
-plog_disable (void)
+/*
+ * Sharded async mode queue. Single producer (the owning thread), single
+ * consumer (the writer thread). `pending` holds the stamp of the record being
+ * queued so the writer never merges past it. Rings live as long as their
+ * thread state, i.e. forever.
+ */
+typedef struct
 {
-    gb_enabled = false;
-}
+    size_t    tail;       // Next slot to fill (owner)
+    uint64_t  pending;    // Stamp of the record being queued, 0 if none
+    char      pad[64];    // Keeps the writer's index off the owner's line
+    size_t    head;       // Next slot to deliver (writer)
+    record_t* slots[PLOG_RING_SIZE];
+} ring_t;
 
-plog_id_t
-plog_add_appender (plog_appender_fn p_appender,
-                   plog_level_t level,
-                   void* p_udata)
+/*
+ * Timestamp rendered by a thread for an appender, reused within the same
+ * second.
+ */
+typedef struct
 {
-    // Initialize logger if neccesary
-    try_init();
+    time_t   time;
+    uint64_t gen; // Layout generation the string was rendered for
+    size_t   len;
+    char     str[PLOG_TIMESTAMP_LEN];
+} time_cache_t;
 
-    // Check if there is space for a new appender.
-    PLOG_ASSERT(g_appender_count < PLOG_MAX_APPENDERS);
+/*
+ * Per-thread context (MDC). Fields are kept as "key\0value\0" pairs; the
+ * "[key=value ...] " prefix is rendered only when the context changes.
+ */
+typedef struct
+{
+    char     pool[PLOG_CTX_LEN];
+    size_t   pool_len;
+    size_t   offsets[PLOG_CTX_MAX_FIELDS]; // Start of each pair in pool
+    size_t   count;
+    char     prefix[PLOG_CTX_LEN + 3];      // Brackets and trailing space
+    size_t   prefix_len;
+} ctx_t;
 
-    // Ensure level is valid
-    PLOG_ASSERT(level >= 0 && level < PLOG_LEVEL_COUNT);
+/*
+ * Per-thread logger state. States are linked into a global registry that is
+ * only ever appended to, so statistics can be summed without locking. When a
+ * thread exits its state is released and may be adopted by a new thread; the
+ * counters are kept.
+ */
+typedef struct thread_state_s
+{
+    struct thread_state_s* p_next;          // Registry link
+    int                    in_use;          // Non-zero while owned
+    spill_buf_t            msg_spill;       // Long message storage
+    spill_buf_t            entry_spill;     // Long entry storage
+    uint64_t               msg_spills;      // Counters (owner writes only)
+    uint64_t               msg_truncations;
+    uint64_t               async_drops;
+    uint64_t               async_queued;    // Records queued (producer)
+    uint64_t               async_delivered; // Records delivered (writer)
+    uint64_t               filtered;
+    uint64_t               sampled;
+    uint64_t               rng;             // Sampling PRNG state
+    uint64_t               sample_hash;     // Hash of the sample key
+    bool                   b_sample_key;    // True if a sample key is set
+    ctx_t                  ctx;             // Context fields
+    uint64_t               epoch;           // Config epoch while reading
+    int                    read_depth;      // Nested read sections
+    arena_t                arena;           // Async mode records
+    ring_t*                p_ring;          // Sharded mode queue, or NULL
+    plog_appender_stats_t  appender_stats[PLOG_MAX_APPENDERS];
+    time_cache_t           time_cache[PLOG_MAX_APPENDERS];
+} thread_state_t;
 
-    // Iterate through appender array and find an empty slot.
-    for (int i = 0; i < PLOG_MAX_APPENDERS; i++)
-    {
-        if (NULL == gp_appenders[i].p_appender)
-        {
-            // Store and enable appender
-            gp_appenders[i].p_appender   = p_appender;
-            gp_appenders[i].level        = level;
-            gp_appenders[i].p_udata      = p_udata;
-            gp_appenders[i].level        = PLOG_LEVEL_INFO;
-            gp_appenders[i].b_enabled    = true;
-            gp_appenders[i].b_colors     = false;
-            gp_appenders[i].b_level      = true;
-            gp_appenders[i].b_timestamp  = false;
-            gp_appenders[i].b_file       = false;
-            gp_appenders[i].b_func       = false;
-            gp_appenders[i].p_lock       = NULL;
-            gp_appenders[i].p_lock_udata = NULL;
-
-            strncpy(gp_appenders[i].p_time_fmt, PLOG_TIME_FMT, PLOG_TIME_FMT_LEN);
-
-            g_appender_count++;
+static thread_state_t*          gp_thread_states = NULL; // Registry head
+static PLOG_TLS thread_state_t* gp_thread_state  = NULL; // Calling thread
 
-            return (plog_id_t)i;
-        }
-    }
+/*
+ * Appender counters at registration time. Per-thread counters are never
+ * reset, so these are subtracted when statistics are read. Guarded by the
+ * config lock.
+ */
+static plog_appender_stats_t gp_stats_base[PLOG_MAX_APPENDERS];
 
-    // This should never happen
-    PLOG_ASSERT(false);
-    return 0;
+static bool
+appender_exists (const config_t* p_config, plog_id_t id)
+{
+    return (id < PLOG_MAX_APPENDERS &&
+            (NULL != p_config->appenders[id].p_appender ||
+             NULL != p_config->appenders[id].p_entry_fn));
 }
 
-static void
-stream_appender (const char* p_entry, void* p_udata)
+static bool
+appender_enabled (const config_t* p_config, plog_id_t id)
 {
-    FILE* stream = (FILE*)p_udata;
-    fprintf(stream, "%s", p_entry);
-    fflush(stream);
+    return appender_exists(p_config, id) && p_config->appenders[id].b_enabled;
 }
 
-plog_id_t
-plog_add_stream (FILE* stream, plog_level_t level)
+static bool
+degrade_on (const appender_info_t* p_info)
 {
-    // Stream must not be NULL
-    PLOG_ASSERT(NULL != stream);
-
-    return plog_add_appender(stream_appender, level, stream);
+    return (p_info->degrade_max > p_info->level &&
+            (0 != p_info->degrade_latency_ns || 0 != p_info->degrade_depth));
 }
 
-void
-plog_remove_appender (plog_id_t id)
+/*
+ * Returns the level an appender currently accepts: its level, raised by
+ * degradation up to the degradation maximum.
+ */
+static plog_level_t
+appender_level (const config_t* p_config, plog_id_t id)
 {
-    // Initialize logger if neccesary
-    try_init();
+    const appender_info_t* p_info = &p_config->appenders[id];
 
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+    if (!degrade_on(p_info))
+    {
+        return p_info->level;
+    }
 
-    // Reset appender with given ID
-    gp_appenders[id].p_appender = NULL;
+    int level = (int)p_info->level + PLOG_LOAD_RELAXED(&gp_degrade[id].shift);
 
-    g_appender_count--;
+    return (level < (int)p_info->degrade_max) ? (plog_level_t)level
+                                              : p_info->degrade_max;
 }
 
-void
-plog_enable_appender (plog_id_t id)
+static void
+spill_release (spill_buf_t* p_buf)
 {
-    // Initialize logger if neccesary
-    try_init();
-
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+    if (NULL != p_buf->p_str)
+    {
+        PLOG_FREE(p_buf->p_str);
+    }
 
-    // Enable appender
-    gp_appenders[id].b_enabled = true;
+    p_buf->p_str = NULL;
+    p_buf->cap   = 0;
 }
 
-void
-plog_disable_appender (plog_id_t id)
+/*
+ * Ensures the buffer holds at least `size` bytes. Returns NULL if memory is
+ * exhausted; the previous contents remain valid in that case.
+ */
+static char*
+spill_reserve (spill_buf_t* p_buf, size_t size)
 {
-    // Initialize logger if neccesary
-    try_init();
+    if (size > p_buf->cap)
+    {
+        size_t cap = p_buf->cap ? p_buf->cap : PLOG_ENTRY_STACK_LEN;
 
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+        while (cap < size)
+        {
+            cap *= 2;
+        }
 
-    // Disable appender
-    gp_appenders[id].b_enabled = false;
-}
+        char* p_str = (char*)PLOG_MALLOC(cap);
 
-void plog_set_lock(plog_id_t id, plog_lock_fn p_lock, void* p_udata)
-{
-    // Ensure lock function is initialized
-    PLOG_ASSERT(NULL != p_lock);
+        if (NULL == p_str)
+        {
+            return NULL;
+        }
 
-    // Ensure appender is registered
-    try_init();
+        if (NULL != p_buf->p_str)
+        {
+            memcpy(p_str, p_buf->p_str, p_buf->cap);
+            PLOG_FREE(p_buf->p_str);
+        }
 
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+        p_buf->p_str = p_str;
+        p_buf->cap   = cap;
+    }
 
-    gp_appenders[id].p_lock = p_lock;
-    gp_appenders[id].p_lock_udata = p_udata;
+    return p_buf->p_str;
 }
 
-
-void
-plog_set_level (plog_id_t id, plog_level_t level)
+/*
+ * Releases a spill buffer once it grew beyond the retention limit.
+ */
+static void
+spill_trim (spill_buf_t* p_buf)
 {
-    // Initialize logger if neccesary
-    try_init();
-
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
-
-    // Ensure level is valid
-    PLOG_ASSERT(level >= 0 && level < PLOG_LEVEL_COUNT);
+    if (p_buf->cap > PLOG_SPILL_RETAIN)
+    {
+        spill_release(p_buf);
+    }
+}
 
-    // Set the level
-    gp_appenders[id].level = level;
+#ifdef PLOG_THREADS
+static void
+arena_free_list (arena_block_t* p_block)
+{
+    while (NULL != p_block)
+    {
+        arena_block_t* p_next = p_block->p_next;
+        PLOG_FREE(p_block);
+        p_block = p_next;
+    }
 }
 
-void
-plog_set_time_fmt (plog_id_t id, const char* fmt)
+/*
+ * Frees the cached blocks and drops the hold on the current block. Blocks
+ * still in flight come back through `p_returned` and are reused by the next
+ * thread that adopts this state.
+ */
+static void
+arena_release (arena_t* p_arena)
 {
-    // Initialize logger if neccesary
-    try_init();
+    arena_block_t* p_current = p_arena->p_current;
 
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+    p_arena->p_current = NULL;
 
-    // Copy the time string
-    strncpy(gp_appenders[id].p_time_fmt, fmt, PLOG_TIME_FMT_LEN);
-}
+    if (NULL != p_current && 0 == PLOG_ADD(&p_current->refs, -1))
+    {
+        p_arena->n_blocks--;
+        PLOG_FREE(p_current);
+    }
 
-void
-plog_colors_on (plog_id_t id)
-{
-    // Initialize logger if neccesary
-    try_init();
+    arena_block_t* p_returned = PLOG_XCHG(&p_arena->p_returned, NULL);
 
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+    for (arena_block_t* p = p_returned; NULL != p; p = p->p_next)
+    {
+        p_arena->n_blocks--;
+    }
 
-    // Disable appender
-    gp_appenders[id].b_colors = true;
-}
+    for (arena_block_t* p = p_arena->p_free; NULL != p; p = p->p_next)
+    {
+        p_arena->n_blocks--;
+    }
 
-void
-plog_colors_off (plog_id_t id)
-{
-    // Initialize logger if neccesary
-    try_init();
+    arena_free_list(p_returned);
+    arena_free_list(p_arena->p_free);
 
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+    p_arena->p_free = NULL;
+    p_arena->n_free = 0;
+}
 
-    // Disable appender
-    gp_appenders[id].b_colors = false;
+/*
+ * Puts an emptied block back on the owner's free list, or frees it if the
+ * owner already caches enough blocks. Owner only.
+ */
+static void
+arena_recycle (arena_t* p_arena, arena_block_t* p_block)
+{
+    if (p_arena->n_free < PLOG_ARENA_KEEP_BLOCKS &&
+        PLOG_ARENA_BLOCK_SIZE == p_block->size)
+    {
+        p_block->p_next = p_arena->p_free;
+        p_arena->p_free = p_block;
+        p_arena->n_free++;
+    }
+    else
+    {
+        p_arena->n_blocks--;
+        PLOG_FREE(p_block);
+    }
 }
 
-void
-plog_timestamp_on (plog_id_t id)
+/*
+ * Makes a block with room for `size` bytes the current block. Returns false if
+ * the arena is at its block limit or memory is exhausted.
+ */
+static bool
+arena_next_block (arena_t* p_arena, size_t size)
 {
-    // Initialize logger if neccesary
-    try_init();
+    // Retire the current block
+    arena_block_t* p_block = p_arena->p_current;
 
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+    p_arena->p_current = NULL;
 
-    // Turn timestamp on
-    gp_appenders[id].b_timestamp = true;
-}
+    if (NULL != p_block && 0 == PLOG_ADD(&p_block->refs, -1))
+    {
+        arena_recycle(p_arena, p_block);
+    }
 
-void
-plog_timestamp_off (plog_id_t id)
-{
-    // Initialize logger if neccesary
-    try_init();
+    // Collect the blocks emptied by the writer thread in one batch
+    if (NULL == p_arena->p_free)
+    {
+        arena_block_t* p_returned = PLOG_XCHG(&p_arena->p_returned, NULL);
 
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+        while (NULL != p_returned)
+        {
+            arena_block_t* p_next = p_returned->p_next;
+            arena_recycle(p_arena, p_returned);
+            p_returned = p_next;
+        }
+    }
 
-    // Turn timestamp off
-    gp_appenders[id].b_timestamp = false;
-}
+    if (NULL != p_arena->p_free && size <= PLOG_ARENA_BLOCK_SIZE)
+    {
+        p_block = p_arena->p_free;
+        p_arena->p_free = p_block->p_next;
+        p_arena->n_free--;
+    }
+    else
+    {
+        if (p_arena->n_blocks >= PLOG_ARENA_MAX_BLOCKS)
+        {
+            return false;
+        }
 
-void
-plog_level_on (plog_id_t id)
-{
-    // Initialize logger if neccesary
-    try_init();
+        size_t block_size = (size > PLOG_ARENA_BLOCK_SIZE)
+                          ? size : PLOG_ARENA_BLOCK_SIZE;
 
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+        p_block = (arena_block_t*)PLOG_MALLOC(sizeof(arena_block_t) +
+                                              block_size);
 
-    // Turn level reporting on
-    gp_appenders[id].b_level = true;
-}
+        if (NULL == p_block)
+        {
+            return false;
+        }
 
-void
-plog_level_off (plog_id_t id)
-{    // Initialize logger if neccesary
-    try_init();
+        p_block->p_arena = p_arena;
+        p_block->size    = block_size;
+        p_arena->n_blocks++;
+    }
+
+    p_block->p_next = NULL;
+    p_block->used   = 0;
+    p_block->refs   = 1;
 
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+    p_arena->p_current = p_block;
 
-    // Turn level reporting off
-    gp_appenders[id].b_level = false;
+    return true;
 }
 
-void
-plog_file_on (plog_id_t id)
+/*
+ * Allocates a record with room for a message of `msg_len` characters.
+ * Returns NULL if the arena is full.
+ */
+static record_t*
+arena_alloc (arena_t* p_arena, size_t msg_len)
 {
-    // Initialize logger if neccesary
-    try_init();
+    // Keep records pointer aligned
+    size_t align = sizeof(void*);
+    size_t size  = (sizeof(record_t) + msg_len + 1 + align - 1) & ~(align - 1);
 
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+    arena_block_t* p_block = p_arena->p_current;
 
-    // Turn file reporting on
-    gp_appenders[id].b_file = true;
+    if (NULL == p_block || p_block->used + size > p_block->size)
+    {
+        if (!arena_next_block(p_arena, size))
+        {
+            return NULL;
+        }
+
+        p_block = p_arena->p_current;
+    }
+
+    record_t* p_record = (record_t*)((char*)(p_block + 1) + p_block->used);
+
+    p_block->used += size;
+    PLOG_ADD(&p_block->refs, 1);
+
+    p_record->p_block = p_block;
+
+    return p_record;
 }
 
-void
-plog_file_off (plog_id_t id)
+/*
+ * Releases `count` records of a block. Called by the writer thread, which
+ * batches consecutive records from the same block into one release.
+ */
+static void
+arena_block_put (arena_block_t* p_block, int count)
 {
-    // Initialize logger if neccesary
-    try_init();
+    if (0 != PLOG_ADD(&p_block->refs, -count))
+    {
+        return;
+    }
+
+    arena_t* p_arena = p_block->p_arena;
 
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+    p_block->p_next = PLOG_LOAD_RELAXED(&p_arena->p_returned);
 
-    // Turn file reporting on
-    gp_appenders[id].b_file = false;
+    while (!PLOG_CAS(&p_arena->p_returned, &p_block->p_next, p_block))
+    {
+    }
 }
+#endif
 
-void
-plog_func_on (plog_id_t id)
+#ifdef PLOG_THREADS
+static pthread_key_t  g_thread_key;
+static pthread_once_t g_thread_once = PTHREAD_ONCE_INIT;
+
+/*
+ * Called on thread exit. Frees the buffers and hands the state back to the
+ * registry.
+ */
+static void
+thread_state_release (void* p_arg)
 {
-    // Initialize logger if neccesary
-    try_init();
+    thread_state_t* p_state = (thread_state_t*)p_arg;
 
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+    spill_release(&p_state->msg_spill);
+    spill_release(&p_state->entry_spill);
+    arena_release(&p_state->arena);
 
-    // Turn file reporting on
-    gp_appenders[id].b_func = true;
+    PLOG_STORE(&p_state->in_use, 0);
 }
 
-void
-plog_func_off (plog_id_t id)
+static void
+thread_key_init (void)
+{
+    pthread_key_create(&g_thread_key, thread_state_release);
+}
+#endif
+
+/*
+ * Returns the calling thread's state, creating or adopting one on first use.
+ * Returns NULL if memory is exhausted.
+ */
+static thread_state_t*
+thread_state (void)
 {
-    // Initialize logger if neccesary
-    try_init();
+    thread_state_t* p_state = gp_thread_state;
+
+    if (NULL != p_state)
+    {
+        return p_state;
+    }
+
+    // Adopt a state released by an exited thread
+    for (p_state = PLOG_LOAD(&gp_thread_states); NULL != p_state;
+         p_state = p_state->p_next)
+    {
+        int expected = 0;
+
+        if (0 == PLOG_LOAD_RELAXED(&p_state->in_use) &&
+            PLOG_CAS(&p_state->in_use, &expected, 1))
+        {
+            break;
+        }
+    }
+
+    // Otherwise create a new one and push it onto the registry
+    if (NULL == p_state)
+    {
+        p_state = (thread_state_t*)PLOG_MALLOC(sizeof(thread_state_t));
+
+        if (NULL == p_state)
+        {
+            return NULL;
+        }
 
-    // Ensure appender is registered
-    PLOG_ASSERT(appender_exists(id));
+        memset(p_state, 0, sizeof(thread_state_t));
 
-    // Turn file reporting on
-    gp_appenders[id].b_func = false;
+        p_state->in_use = 1;
+        p_state->p_next = PLOG_LOAD(&gp_thread_states);
+
+        while (!PLOG_CAS(&gp_thread_states, &p_state->p_next, p_state))
+        {
+        }
+    }
+
+#ifdef PLOG_THREADS
+    pthread_once(&g_thread_once, thread_key_init);
+    pthread_setspecific(g_thread_key, p_state);
+#endif
+
+    // An adopted state must not keep the previous owner's key or context
+    p_state->b_sample_key   = false;
+    p_state->ctx.count      = 0;
+    p_state->ctx.pool_len   = 0;
+    p_state->ctx.prefix_len = 0;
+
+    gp_thread_state = p_state;
+
+    return p_state;
 }
 
+#ifdef PLOG_THREADS
+// Guards registry changes and the statistics base
+static pthread_mutex_t g_loggers_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 /*
- * Formats the current time as as string.
+ * Enters a read section. Until the matching read_exit, no instance reachable
+ * from the registry is destroyed and no snapshot loaded is freed. Sections
+ * may nest.
  */
-static char*
-time_str (const char* p_time_fmt, char* p_str, size_t len)
+static void
+read_enter (thread_state_t* p_state)
 {
-    time_t now = time(0);
-    size_t ret = strftime(p_str, len, p_time_fmt, localtime(&now));
+    if (0 == p_state->read_depth++)
+    {
+        PLOG_STORE_SEQ(&p_state->epoch, PLOG_LOAD_SEQ(&g_config_epoch));
+    }
+}
 
-    PLOG_ASSERT(ret > 0);
+/*
+ * Enters a read section and returns the instance's active configuration,
+ * which remains valid until the matching config_exit.
+ */
+static const config_t*
+config_enter (thread_state_t* p_state, plog_logger_t* p_logger)
+{
+    read_enter(p_state);
 
-    return p_str;
+    return PLOG_LOAD_SEQ(&p_logger->p_config);
+}
+
+static void
+read_exit (thread_state_t* p_state)
+{
+    if (0 == --p_state->read_depth)
+    {
+        PLOG_STORE(&p_state->epoch, 0);
+    }
+}
+
+static void
+config_exit (thread_state_t* p_state)
+{
+    read_exit(p_state);
 }
 
+/*
+ * Waits until every other thread has left the read sections it entered
+ * before `epoch` was published.
+ */
 static void
-append_timestamp (char* p_entry_str, const char* p_time_fmt)
+config_synchronize (uint64_t epoch)
+{
+#ifdef PLOG_THREADS
+    for (thread_state_t* p_state = PLOG_LOAD(&gp_thread_states);
+         NULL != p_state; p_state = p_state->p_next)
+    {
+        if (p_state == gp_thread_state)
+        {
+            continue;
+        }
+
+        for (;;)
+        {
+            uint64_t reader = PLOG_LOAD_SEQ(&p_state->epoch);
+
+            if (0 == reader || reader >= epoch)
+            {
+                break;
+            }
+
+            sched_yield();
+        }
+    }
+#else
+    (void)epoch;
+#endif
+}
+
+/*
+ * Returns a private copy of the instance's active configuration to modify,
+ * holding its config lock. Must be followed by config_commit or config_abort.
+ */
+static config_t*
+config_begin (plog_logger_t* p_logger)
 {
-    char p_time_str[PLOG_TIMESTAMP_LEN + 1];
-    char p_tmp_str[PLOG_TIMESTAMP_LEN + 1];
+#ifdef PLOG_THREADS
+    pthread_mutex_lock(&p_logger->mutex);
+#endif
 
-    snprintf(p_time_str, PLOG_TIMESTAMP_LEN, "%s ",
-             time_str(p_time_fmt, p_tmp_str, PLOG_TIMESTAMP_LEN));
+    config_t* p_config = (config_t*)PLOG_MALLOC(sizeof(config_t));
 
-    strncat(p_entry_str, p_time_str, PLOG_TIMESTAMP_LEN);
+    // Ensure memory is available
+    PLOG_ASSERT(NULL != p_config);
+
+    if (NULL == p_config)
+    {
+#ifdef PLOG_THREADS
+        pthread_mutex_unlock(&p_logger->mutex);
+#endif
+        return NULL;
+    }
+
+    memcpy(p_config, p_logger->p_config, sizeof(config_t));
+
+    p_config->p_retired = NULL;
+    p_config->p_logger  = p_logger;
+
+    return p_config;
 }
 
 static void
-append_level (char* p_entry_str, plog_level_t level, bool b_colors)
+config_abort (config_t* p_config)
+{
+#ifdef PLOG_THREADS
+    plog_logger_t* p_logger = p_config->p_logger;
+#endif
+
+    PLOG_FREE(p_config);
+
+#ifdef PLOG_THREADS
+    pthread_mutex_unlock(&p_logger->mutex);
+#endif
+}
+
+/*
+ * Adds literal text to the layout, merging it with preceding text.
+ */
+static bool
+layout_text (layout_t* p_layout, const char* p_str, size_t len)
 {
-    char p_level_str[PLOG_LEVEL_LEN];
+    if (0 == len)
+    {
+        return true;
+    }
+
+    if (p_layout->text_len + len > PLOG_LAYOUT_LEN)
+    {
+        return false;
+    }
+
+    memcpy(p_layout->text + p_layout->text_len, p_str, len);
 
-    if (b_colors)
+    layout_op_t* p_last = p_layout->n_ops ? &p_layout->ops[p_layout->n_ops - 1]
+                                          : NULL;
+
+    if (NULL != p_last && LAYOUT_TEXT == p_last->type &&
+        p_last->offset + p_last->len == p_layout->text_len &&
+        p_last->len + len <= UINT8_MAX)
     {
-        snprintf(p_level_str, sizeof(p_level_str), "%c%s%s %c%s",
-        PLOG_TERM_CODE, level_color[level],
-        level_str_formatted[level],
-        PLOG_TERM_CODE, PLOG_TERM_RESET);
+        p_last->len = (uint8_t)(p_last->len + len);
     }
     else
     {
-        snprintf(p_level_str, sizeof(p_level_str), "%s ", level_str[level]);
+        if (p_layout->n_ops >= PLOG_LAYOUT_OPS)
+        {
+            return false;
+        }
+
+        layout_op_t* p_op = &p_layout->ops[p_layout->n_ops++];
+
+        p_op->type   = LAYOUT_TEXT;
+        p_op->len    = (uint8_t)len;
+        p_op->offset = (uint16_t)p_layout->text_len;
+    }
+
+    p_layout->text_len += len;
+
+    return true;
+}
+
+static bool
+layout_code (layout_t* p_layout, const char* p_code)
+{
+    char term_code = PLOG_TERM_CODE;
+
+    return layout_text(p_layout, &term_code, 1) &&
+           layout_text(p_layout, p_code, strlen(p_code));
+}
+
+static bool
+layout_op (layout_t* p_layout, layout_op_type_t type)
+{
+    if (p_layout->n_ops >= PLOG_LAYOUT_OPS)
+    {
+        return false;
     }
 
-    strncat(p_entry_str, p_level_str, PLOG_LEVEL_LEN);
+    layout_op_t* p_op = &p_layout->ops[p_layout->n_ops++];
+
+    p_op->type   = (uint8_t)type;
+    p_op->len    = 0;
+    p_op->offset = 0;
+
+    return true;
+}
+
+/*
+ * Pre-renders the level strings. The flag layout pads levels and appends a
+ * space (matching the historical output); patterns use the bare name.
+ */
+static void
+layout_levels (layout_t* p_layout, bool b_colors, bool b_pattern)
+{
+    for (int i = 0; i < PLOG_LEVEL_COUNT; i++)
+    {
+        int len;
+
+        if (b_colors)
+        {
+            len = snprintf(p_layout->levels[i], PLOG_LEVEL_LEN, "%c%s%s%s%c%s",
+                           PLOG_TERM_CODE, level_color[i],
+                           b_pattern ? level_str[i] : level_str_formatted[i],
+                           b_pattern ? "" : " ",
+                           PLOG_TERM_CODE, PLOG_TERM_RESET);
+        }
+        else
+        {
+            len = snprintf(p_layout->levels[i], PLOG_LEVEL_LEN, "%s%s",
+                           level_str[i], b_pattern ? "" : " ");
+        }
+
+        p_layout->level_len[i] = (uint8_t)len;
+    }
 }
 
+/*
+ * Compiles the layout implied by the decoration flags.
+ */
 static void
-append_file(char* p_entry_str, const char* file, unsigned line, bool b_colors)
+layout_compile_flags (layout_t* p_layout, const appender_info_t* p_info)
 {
-    char p_file_str[PLOG_FILE_LEN];
+    bool b_colors = p_info->b_colors;
+
+    layout_levels(p_layout, b_colors, false);
 
-    if (b_colors)
+    if (p_info->b_timestamp)
     {
-        snprintf(p_file_str, sizeof(p_file_str), "%c%s%s:%u%c%s ",
-                 PLOG_TERM_CODE, PLOG_TERM_GRAY,
-                 file, line,
-                 PLOG_TERM_CODE, PLOG_TERM_RESET);
+        layout_op(p_layout, LAYOUT_TIME);
+        layout_text(p_layout, " ", 1);
+    }
 
+    if (p_info->b_level)
+    {
+        layout_op(p_layout, LAYOUT_LEVEL);
     }
-    else
+
+    if (p_info->b_file)
+    {
+        if (b_colors)
+        {
+            layout_code(p_layout, PLOG_TERM_GRAY);
+        }
+
+        layout_op(p_layout, LAYOUT_FILE);
+        layout_text(p_layout, ":", 1);
+        layout_op(p_layout, LAYOUT_LINE);
+
+        if (b_colors)
+        {
+            layout_code(p_layout, PLOG_TERM_RESET);
+        }
+
+        layout_text(p_layout, " ", 1);
+    }
+
+    if (p_info->b_func)
+    {
+        if (b_colors)
+        {
+            layout_code(p_layout, PLOG_TERM_GRAY);
+        }
+
+        layout_text(p_layout, "[", 1);
+        layout_op(p_layout, LAYOUT_FUNC);
+        layout_text(p_layout, "] ", 2);
+
+        if (b_colors)
+        {
+            layout_code(p_layout, PLOG_TERM_RESET);
+        }
+    }
+
+    if (p_info->b_ctx)
+    {
+        layout_op(p_layout, LAYOUT_CTX_TAG);
+    }
+
+    layout_op(p_layout, LAYOUT_RATE_TAG);
+    layout_op(p_layout, LAYOUT_MSG);
+}
+
+/*
+ * Compiles a user pattern. Returns false if it exceeds the layout limits.
+ */
+static bool
+layout_compile_pattern (layout_t* p_layout, const char* p_pattern,
+                        bool b_colors)
+{
+    layout_levels(p_layout, b_colors, true);
+
+    for (const char* p = p_pattern; '\0' != *p; p++)
     {
-        snprintf(p_file_str, sizeof(p_file_str), "%s:%u ", file, line);
+        bool b_ok;
+
+        if ('%' != *p || '\0' == p[1])
+        {
+            if (!layout_text(p_layout, p, 1))
+            {
+                return false;
+            }
+
+            continue;
+        }
+
+        switch (*++p)
+        {
+            case 'T': b_ok = layout_op(p_layout, LAYOUT_TIME);  break;
+            case 'L': b_ok = layout_op(p_layout, LAYOUT_LEVEL); break;
+            case 'F': b_ok = layout_op(p_layout, LAYOUT_FILE);  break;
+            case 'l': b_ok = layout_op(p_layout, LAYOUT_LINE);  break;
+            case 'f': b_ok = layout_op(p_layout, LAYOUT_FUNC);  break;
+            case 'm': b_ok = layout_op(p_layout, LAYOUT_MSG);   break;
+            case 'r': b_ok = layout_op(p_layout, LAYOUT_RATE);  break;
+            case 'C': b_ok = layout_op(p_layout, LAYOUT_CTX);   break;
+            case '%': b_ok = layout_text(p_layout, p, 1);       break;
+            default:  b_ok = layout_text(p_layout, p - 1, 2);   break;
+        }
+
+        if (!b_ok)
+        {
+            return false;
+        }
     }
 
-    strncat(p_entry_str, p_file_str, PLOG_FILE_LEN);
+    return true;
 }
 
+/*
+ * Renderer of the flag layout for each combination of decoration flags (see
+ * PLOG_RENDER_VARIANTS), followed by the layout interpreter used for
+ * patterns.
+ */
+#define PLOG_RENDER_LAYOUT 64
+
+/*
+ * Recompiles the appender's layout from its pattern or flags and selects the
+ * renderer.
+ */
 static void
-append_func(char* p_entry_str, const char* func, bool b_colors)
+layout_compile (appender_info_t* p_info)
 {
-   char p_func_str[PLOG_FUNC_LEN];
+    layout_t* p_layout = &p_info->layout;
+
+    memset(p_layout, 0, sizeof(layout_t));
 
-    if (b_colors)
+    // Patterns are validated when set
+    if ('\0' != p_info->p_pattern[0])
     {
-        snprintf(p_func_str, sizeof(p_func_str), "%c%s[%s] %c%s",
-                 PLOG_TERM_CODE, PLOG_TERM_GRAY,
-                 func,
-                 PLOG_TERM_CODE, PLOG_TERM_RESET);
+        layout_compile_pattern(p_layout, p_info->p_pattern, p_info->b_colors);
+
+        p_info->render = PLOG_RENDER_LAYOUT;
     }
     else
     {
-        snprintf(p_func_str, sizeof(p_func_str), "[%s] ", func);
-    }
+        layout_compile_flags(p_layout, p_info);
 
-    strncat(p_entry_str, p_func_str, PLOG_FUNC_LEN);
+#ifdef PLOG_NO_RENDER_VARIANTS
+        p_info->render = PLOG_RENDER_LAYOUT;
+#else
+        p_info->render = (uint8_t)((p_info->b_timestamp ? 32 : 0) |
+                                   (p_info->b_level     ? 16 : 0) |
+                                   (p_info->b_file      ?  8 : 0) |
+                                   (p_info->b_func      ?  4 : 0) |
+                                   (p_info->b_ctx       ?  2 : 0) |
+                                   (p_info->b_colors    ?  1 : 0));
+#endif
+    }
 }
 
-void
-plog_write (plog_level_t level, const char* file, unsigned line,
-                                const char* func, const char* p_fmt, ...)
+/*
+ * Computes the level threshold of an instance's configuration (see
+ * plog_threshold_).
+ */
+static int
+config_threshold (const plog_logger_t* p_logger, const config_t* p_config)
 {
-    // Only write entry if there are registered appenders and the logger is
-    // enabled
-    if (0 == g_appender_count || !gb_enabled)
+    int threshold = PLOG_LEVEL_COUNT;
+
+    if (!PLOG_LOAD(&p_logger->b_enabled))
     {
-        return;
+        return threshold;
     }
 
-    // Ensure valid log level
-    PLOG_ASSERT(level < PLOG_LEVEL_COUNT);
-
     for (plog_id_t i = 0; i < PLOG_MAX_APPENDERS; i++)
     {
-        if (appender_enabled(i) &&
-            gp_appenders[i].level <= level)
+        if (appender_enabled(p_config, i) &&
+            (int)p_config->appenders[i].level < threshold)
         {
-            char p_entry_str[PLOG_ENTRY_LEN + 1]; // Ensure there is space for
-                                                  // null char
+            threshold = (int)p_config->appenders[i].level;
+        }
+    }
 
-            p_entry_str[0] = '\0'; // Ensure the entry is null terminated
+    return threshold;
+}
 
-            // Append a timestamp
-            if (gp_appenders[i].b_timestamp)
-            {
-                append_timestamp(p_entry_str, gp_appenders[i].p_time_fmt);
-            }
+/*
+ * Publishes the configuration and releases the config lock. Once this
+ * returns, no thread uses the previous configuration any more (and so no
+ * appender removed by it is still being called), except for the calling
+ * thread if it is inside an appender.
+ */
+static void
+config_commit (config_t* p_config)
+{
+    plog_logger_t* p_logger = p_config->p_logger;
+    config_t*      p_old    = p_logger->p_config;
 
-            // Append the logger level
-            if (gp_appenders[i].b_level)
-            {
-                append_level(p_entry_str, level, gp_appenders[i].b_colors);
-            }
+    // Bring the layouts in line with the flags
+    uint64_t gen = PLOG_LOAD(&g_config_epoch) + 1;
+
+    p_config->b_degrade = false;
+
+    for (plog_id_t i = 0; i < PLOG_MAX_APPENDERS; i++)
+    {
+        if (appender_exists(p_config, i))
+        {
+            layout_compile(&p_config->appenders[i]);
+            p_config->appenders[i].gen = gen;
 
-            // Append the filename/line number
-            if (gp_appenders[i].b_file)
+            // A raised level must not come back if degradation is turned
+            // on again later
+            if (degrade_on(&p_config->appenders[i]))
             {
-                append_file(p_entry_str, file, line, gp_appenders[i].b_colors);
+                p_config->b_degrade = true;
             }
-
-            // Append the function name
-            if (gp_appenders[i].b_func)
+            else
             {
-                append_func(p_entry_str, func, gp_appenders[i].b_colors);
+                PLOG_STORE_RELAXED(&gp_degrade[i].shift, 0);
             }
+        }
+    }
 
-            // Append the log message
-            char p_msg_str[PLOG_MSG_LEN];
+    PLOG_STORE_RELAXED(p_logger->p_threshold,
+                       config_threshold(p_logger, p_config));
+    PLOG_STORE_SEQ(&p_logger->p_config, p_config);
 
-            va_list args;
-            va_start(args, p_fmt);
-            vsnprintf(p_msg_str, sizeof(p_msg_str), p_fmt, args);
-            va_end(args);
+    config_synchronize(PLOG_ADD(&g_config_epoch, 1));
 
-            strncat(p_entry_str, p_msg_str, PLOG_MSG_LEN);
-            strcat(p_entry_str, "\n");
+    if (p_old != &g_config_initial)
+    {
+        p_old->p_retired = p_logger->p_retired;
+        p_logger->p_retired = p_old;
+    }
 
-            // Locks the appender
-            if (NULL != gp_appenders[i].p_lock)
-            {
-                gp_appenders[i].p_lock(true, gp_appenders[i].p_lock_udata);
-            }
-   
-            gp_appenders[i].p_appender(p_entry_str, gp_appenders[i].p_udata);
-            
-            // Unlocks the appender
-            if (NULL != gp_appenders[i].p_lock)
-            {
-                gp_appenders[i].p_lock(false, gp_appenders[i].p_lock_udata);
-            }
+    // The calling thread may still be iterating a retired snapshot if it
+    // changes the configuration from inside an appender
+    thread_state_t* p_state = gp_thread_state;
+
+    if (NULL == p_state || 0 == p_state->read_depth)
+    {
+        while (NULL != p_logger->p_retired)
+        {
+            config_t* p_next = p_logger->p_retired->p_retired;
+            PLOG_FREE(p_logger->p_retired);
+            p_logger->p_retired = p_next;
         }
     }
+
+#ifdef PLOG_THREADS
+    pthread_mutex_unlock(&p_logger->mutex);
+#endif
+}
+
+/*
+ * Returns a monotonic time in nanoseconds, or zero where unsupported.
+ */
+static uint64_t
+clock_ns (void)
+{
+#ifdef PLOG_THREADS
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Returns clock_ns() for the appender timing statistics, or zero if they are
+ * compiled out.
+ */
+static uint64_t
+stats_ns (void)
+{
+#ifdef PLOG_NO_STATS
+    return 0;
+#else
+    return clock_ns();
+#endif
+}
+
+/*
+ * Sampling threshold for keeping `keep` out of every `of` entries: an entry
+ * is kept if the top 32 bits of its random number are below it. Since the
+ * comparison is monotonic, an entry kept at some rate is kept at every
+ * higher rate, which keeps hash-based decisions consistent across appenders.
+ */
+static uint64_t
+sample_threshold (uint32_t keep, uint32_t of)
+{
+    return (keep >= of) ? PLOG_SAMPLE_ALL : ((uint64_t)keep << 32) / of;
+}
+
+/*
+ * Sampling stages. With a sample key, each stage decides from its own hash of
+ * the key, so the call site and appender decisions are independent and the
+ * kept fraction is the product of their rates, as the rate tag reports. All
+ * appenders share a stage, so their decisions stay consistent.
+ */
+#define PLOG_SAMPLE_SITE     UINT64_C(0)
+#define PLOG_SAMPLE_APPENDER UINT64_C(0x9E3779B97F4A7C15)
+
+/*
+ * 64-bit finalizer (MurmurHash3), spreading every input bit over the output.
+ */
+static uint64_t
+sample_mix (uint64_t hash)
+{
+    hash ^= hash >> 33;
+    hash *= UINT64_C(0xFF51AFD7ED558CCD);
+    hash ^= hash >> 33;
+    hash *= UINT64_C(0xC4CEB9FE1A85EC53);
+    hash ^= hash >> 33;
+
+    return hash;
+}
+
+/*
+ * Returns the random number behind a sampling decision: the hash of the
+ * thread's sample key, salted with the stage, if set, otherwise the next
+ * xorshift64* output.
+ */
+static uint64_t
+sample_random (thread_state_t* p_state, uint64_t stage)
+{
+    if (p_state->b_sample_key)
+    {
+        return sample_mix(p_state->sample_hash ^ stage);
+    }
+
+    uint64_t x = p_state->rng;
+
+    // Seed on first use; the state must never be zero
+    if (0 == x)
+    {
+        x = (uint64_t)(uintptr_t)p_state ^ clock_ns() ^ UINT64_C(0x9E3779B97F4A7C15);
+        x = (0 == x) ? 1 : x;
+    }
+
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+
+    p_state->rng = x;
+
+    return x * UINT64_C(0x2545F4914F6CDD1D);
+}
+
+static bool
+sample_keep (thread_state_t* p_state, uint64_t stage, uint64_t threshold)
+{
+    return PLOG_SAMPLE_ALL == threshold ||
+           (sample_random(p_state, stage) >> 32) < threshold;
+}
+
+/*
+ * Combined call site and appender sampling rate of an entry.
+ */
+static void
+sample_rate (const appender_info_t* p_info, const log_entry_t* p_log,
+             uint64_t* p_keep, uint64_t* p_of)
+{
+    *p_keep = p_log->sample_keep;
+    *p_of   = p_log->sample_of;
+
+    if (PLOG_SAMPLE_ALL != p_info->sample_threshold[p_log->level])
+    {
+        *p_keep *= p_info->sample_keep[p_log->level];
+        *p_of   *= p_info->sample_of[p_log->level];
+    }
+}
+
+#ifndef PLOG_NO_STATS
+
+/*
+ * Maps a duration to its log-linear histogram bucket: two buckets per power
+ * of two.
+ */
+static size_t
+hist_bucket (uint64_t ns)
+{
+    if (ns < 2)
+    {
+        return (size_t)ns;
+    }
+
+    size_t msb = 0;
+
+    while ((ns >> (msb + 1)) != 0)
+    {
+        msb++;
+    }
+
+    size_t bucket = 2 * msb + (size_t)((ns >> (msb - 1)) & 1);
+
+    return (bucket < PLOG_HIST_BUCKETS) ? bucket : PLOG_HIST_BUCKETS - 1;
+}
+
+#endif
+
+uint64_t
+plog_hist_bucket_ns (size_t bucket)
+{
+    PLOG_ASSERT(bucket < PLOG_HIST_BUCKETS);
+
+    if (bucket < 2)
+    {
+        return bucket;
+    }
+
+    size_t msb = bucket / 2;
+
+    return ((uint64_t)1 << msb) | ((uint64_t)(bucket & 1) << (msb - 1));
+}
+
+/*
+ * Adds the counters of `p_src` to `p_dst`. `sign` is 1 or -1.
+ */
+static void
+appender_stats_add (plog_appender_stats_t* p_dst,
+                    const plog_appender_stats_t* p_src, int sign)
+{
+    uint64_t s = (uint64_t)(int64_t)sign;
+
+    p_dst->written      += s * PLOG_LOAD_RELAXED(&p_src->written);
+    p_dst->filtered     += s * PLOG_LOAD_RELAXED(&p_src->filtered);
+    p_dst->bytes        += s * PLOG_LOAD_RELAXED(&p_src->bytes);
+    p_dst->drops        += s * PLOG_LOAD_RELAXED(&p_src->drops);
+    p_dst->sampled      += s * PLOG_LOAD_RELAXED(&p_src->sampled);
+    p_dst->truncations  += s * PLOG_LOAD_RELAXED(&p_src->truncations);
+    p_dst->lock_wait_ns += s * PLOG_LOAD_RELAXED(&p_src->lock_wait_ns);
+    p_dst->write_ns     += s * PLOG_LOAD_RELAXED(&p_src->write_ns);
+
+    for (size_t i = 0; i < PLOG_LEVEL_COUNT; i++)
+    {
+        p_dst->suppressed[i] += s * PLOG_LOAD_RELAXED(&p_src->suppressed[i]);
+    }
+
+    for (size_t i = 0; i < PLOG_HIST_BUCKETS; i++)
+    {
+        p_dst->hist[i] += s * PLOG_LOAD_RELAXED(&p_src->hist[i]);
+    }
+}
+
+/*
+ * Sums the counters of an appender over all threads.
+ */
+static void
+appender_stats_sum (plog_id_t id, plog_appender_stats_t* p_stats)
+{
+    memset(p_stats, 0, sizeof(plog_appender_stats_t));
+
+    for (thread_state_t* p_state = PLOG_LOAD(&gp_thread_states);
+         NULL != p_state; p_state = p_state->p_next)
+    {
+        appender_stats_add(p_stats, &p_state->appender_stats[id], 1);
+    }
+}
+
+bool plog_str_level(const char* str, plog_level_t* level)
+{
+    if (!level)
+        return false;
+
+    for (size_t i = 0; level_str[i]; i++)
+    {
+        if (0 == strcmp(str, level_str[i]))
+        {
+            *level = (plog_level_t)i;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Enables or disables an instance, keeping its threshold in line.
+ */
+static void
+set_enabled (plog_logger_t* p_logger, bool b_enabled)
+{
+    // Logger must not be NULL
+    PLOG_ASSERT(NULL != p_logger);
+
+#ifdef PLOG_THREADS
+    pthread_mutex_lock(&p_logger->mutex);
+#endif
+
+    PLOG_STORE(&p_logger->b_enabled, b_enabled);
+    PLOG_STORE_RELAXED(p_logger->p_threshold,
+                       config_threshold(p_logger, p_logger->p_config));
+
+#ifdef PLOG_THREADS
+    pthread_mutex_unlock(&p_logger->mutex);
+#endif
+}
+
+void
+plog_enable (void)
+{
+    set_enabled(&g_logger, true);
+}
+
+void
+plog_disable (void)
+{
+    set_enabled(&g_logger, false);
+}
+
+void
+plog_logger_enable (plog_logger_t* p_logger)
+{
+    set_enabled(p_logger, true);
+}
+
+void
+plog_logger_disable (plog_logger_t* p_logger)
+{
+    set_enabled(p_logger, false);
+}
+
+bool
+plog_logger_is_enabled (plog_logger_t* p_logger, plog_level_t level)
+{
+    // Logger must not be NULL
+    PLOG_ASSERT(NULL != p_logger);
+
+    return (int)level >= PLOG_LOAD_RELAXED(p_logger->p_threshold);
+}
+
+plog_logger_t*
+plog_default (void)
+{
+    return &g_logger;
+}
+
+
+/*
+ * Begins a configuration change of a registered appender. Returns NULL if the
+ * change cannot be made.
+ */
+static config_t*
+config_begin_appender (plog_id_t id)
+{
+    // Ensure the ID has been handed out
+    PLOG_ASSERT(id < PLOG_MAX_APPENDERS);
+
+    plog_logger_t* p_logger = (id < PLOG_MAX_APPENDERS)
+                            ? PLOG_LOAD(&gp_owners[id]) : NULL;
+
+    PLOG_ASSERT(NULL != p_logger);
+
+    if (NULL == p_logger)
+    {
+        return NULL;
+    }
+
+    config_t* p_config = config_begin(p_logger);
+
+    if (NULL == p_config)
+    {
+        return NULL;
+    }
+
+    // Ensure appender is registered (with the same instance)
+    PLOG_ASSERT(appender_exists(p_config, id));
+
+    if (!appender_exists(p_config, id))
+    {
+        config_abort(p_config);
+        return NULL;
+    }
+
+    return p_config;
+}
+
+/*
+ * Registers either kind of appender.
+ */
+static plog_id_t
+add_appender (plog_logger_t* p_logger, plog_appender_fn p_appender,
+              plog_entry_fn p_entry_fn, plog_level_t level, void* p_udata)
+{
+    // Logger must not be NULL
+    PLOG_ASSERT(NULL != p_logger);
+
+    // Ensure level is valid
+    PLOG_ASSERT(level >= 0 && level < PLOG_LEVEL_COUNT);
+
+    config_t* p_config = config_begin(p_logger);
+
+    if (NULL == p_config)
+    {
+        return 0;
+    }
+
+    // Claim a free ID; IDs are shared by all instances
+    for (int i = 0; i < PLOG_MAX_APPENDERS; i++)
+    {
+        appender_info_t* p_info = &p_config->appenders[i];
+        plog_logger_t*   p_free = NULL;
+
+        if (PLOG_CAS(&gp_owners[i], &p_free, p_logger))
+        {
+            // Store and enable appender
+            p_info->p_appender   = p_appender;
+            p_info->p_entry_fn   = p_entry_fn;
+            p_info->level        = level;
+            p_info->p_udata      = p_udata;
+            p_info->b_enabled    = true;
+            p_info->b_colors     = false;
+            p_info->b_level      = true;
+            p_info->b_timestamp  = false;
+            p_info->b_file       = false;
+            p_info->b_func       = false;
+            p_info->b_ctx        = false;
+            p_info->p_lock       = NULL;
+            p_info->p_lock_udata = NULL;
+            p_info->p_flush      = NULL;
+            p_info->p_pattern[0] = '\0';
+
+            for (int lvl = 0; lvl < PLOG_LEVEL_COUNT; lvl++)
+            {
+                p_info->sample_keep[lvl]      = 1;
+                p_info->sample_of[lvl]        = 1;
+                p_info->sample_threshold[lvl] = PLOG_SAMPLE_ALL;
+            }
+
+            p_info->degrade_max        = PLOG_LEVEL_TRACE;
+            p_info->degrade_latency_ns = 0;
+            p_info->degrade_depth      = 0;
+
+            strncpy(p_info->p_time_fmt, PLOG_TIME_FMT, PLOG_TIME_FMT_LEN);
+
+            p_config->appender_count++;
+
+            // Statistics start from zero
+#ifdef PLOG_THREADS
+            pthread_mutex_lock(&g_loggers_mutex);
+#endif
+
+            appender_stats_sum((plog_id_t)i, &gp_stats_base[i]);
+
+#ifdef PLOG_THREADS
+            pthread_mutex_unlock(&g_loggers_mutex);
+#endif
+
+            // So does degradation: a previous appender with this ID left its
+            // last tick and counters behind. No thread sees the ID until the
+            // commit, as removing the previous appender waited for readers
+            memset(&gp_degrade[i], 0, sizeof(degrade_t));
+
+            config_commit(p_config);
+
+            return (plog_id_t)i;
+        }
+    }
+
+    // Check if there is space for a new appender
+    PLOG_ASSERT(false);
+
+    config_abort(p_config);
+
+    return 0;
+}
+
+plog_id_t
+plog_add_appender (plog_appender_fn p_appender,
+                   plog_level_t level,
+                   void* p_udata)
+{
+    return plog_logger_add_appender(&g_logger, p_appender, level, p_udata);
+}
+
+plog_id_t
+plog_logger_add_appender (plog_logger_t* p_logger,
+                          plog_appender_fn p_appender,
+                          plog_level_t level,
+                          void* p_udata)
+{
+    // Appender must not be NULL
+    PLOG_ASSERT(NULL != p_appender);
+
+    return add_appender(p_logger, p_appender, NULL, level, p_udata);
+}
+
+plog_id_t
+plog_add_entry_appender (plog_entry_fn p_entry_fn,
+                         plog_level_t level,
+                         void* p_udata)
+{
+    return plog_logger_add_entry_appender(&g_logger, p_entry_fn, level,
+                                          p_udata);
+}
+
+plog_id_t
+plog_logger_add_entry_appender (plog_logger_t* p_logger,
+                                plog_entry_fn p_entry_fn,
+                                plog_level_t level,
+                                void* p_udata)
+{
+    // Appender must not be NULL
+    PLOG_ASSERT(NULL != p_entry_fn);
+
+    return add_appender(p_logger, NULL, p_entry_fn, level, p_udata);
+}
+
+static void
+stream_appender (const char* p_entry, void* p_udata)
+{
+    FILE* stream = (FILE*)p_udata;
+    fprintf(stream, "%s", p_entry);
+    fflush(stream);
+}
+
+plog_id_t
+plog_add_stream (FILE* stream, plog_level_t level)
+{
+    return plog_logger_add_stream(&g_logger, stream, level);
+}
+
+plog_id_t
+plog_logger_add_stream (plog_logger_t* p_logger, FILE* stream,
+                        plog_level_t level)
+{
+    // Stream must not be NULL
+    PLOG_ASSERT(NULL != stream);
+
+    return plog_logger_add_appender(p_logger, stream_appender, level, stream);
+}
+
+void
+plog_remove_appender (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Reset appender with given ID
+        p_config->appenders[id].p_appender = NULL;
+        p_config->appenders[id].p_entry_fn = NULL;
+        p_config->appender_count--;
+
+        config_commit(p_config);
+
+        // The appender is gone from every thread's view; the ID may be reused
+        PLOG_STORE(&gp_owners[id], NULL);
+    }
+}
+
+void
+plog_enable_appender (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Enable appender
+        p_config->appenders[id].b_enabled = true;
+        config_commit(p_config);
+    }
+}
+
+void
+plog_disable_appender (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Disable appender
+        p_config->appenders[id].b_enabled = false;
+        config_commit(p_config);
+    }
+}
+
+void plog_set_lock(plog_id_t id, plog_lock_fn p_lock, void* p_udata)
+{
+    // Ensure lock function is initialized
+    PLOG_ASSERT(NULL != p_lock);
+
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        p_config->appenders[id].p_lock       = p_lock;
+        p_config->appenders[id].p_lock_udata = p_udata;
+        config_commit(p_config);
+    }
+}
+
+void
+plog_set_flush (plog_id_t id, plog_flush_fn p_flush)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        p_config->appenders[id].p_flush = p_flush;
+        config_commit(p_config);
+    }
+}
+
+
+void
+plog_set_level (plog_id_t id, plog_level_t level)
+{
+    // Ensure level is valid
+    PLOG_ASSERT(level >= 0 && level < PLOG_LEVEL_COUNT);
+
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Set the level
+        p_config->appenders[id].level = level;
+        config_commit(p_config);
+    }
+}
+
+void
+plog_set_sampling (plog_id_t id, plog_level_t level, uint32_t keep, uint32_t of)
+{
+    // Ensure level and rate are valid
+    PLOG_ASSERT(level >= 0 && level < PLOG_LEVEL_COUNT);
+    PLOG_ASSERT(0 != of);
+
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        appender_info_t* p_info = &p_config->appenders[id];
+
+        p_info->sample_keep[level]      = (keep < of) ? keep : 1;
+        p_info->sample_of[level]        = (keep < of) ? of : 1;
+        p_info->sample_threshold[level] = sample_threshold(keep, of);
+
+        config_commit(p_config);
+    }
+}
+
+void
+plog_set_degrade (plog_id_t id, plog_level_t max_level, uint64_t latency_ns,
+                  size_t queue_depth)
+{
+    // Ensure level is valid
+    PLOG_ASSERT(max_level >= 0 && max_level < PLOG_LEVEL_COUNT);
+
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        appender_info_t* p_info = &p_config->appenders[id];
+
+        p_info->degrade_max        = max_level;
+        p_info->degrade_latency_ns = latency_ns;
+        p_info->degrade_depth      = queue_depth;
+
+        config_commit(p_config);
+    }
+}
+
+bool
+plog_set_src_root (const char* root)
+{
+    size_t len = (NULL == root) ? 0 : strlen(root);
+
+    if (len >= PLOG_SRC_ROOT_LEN)
+    {
+        return false;
+    }
+
+    config_t* p_config = config_begin(&g_logger);
+
+    if (NULL == p_config)
+    {
+        return false;
+    }
+
+    memcpy(p_config->src_root, (NULL == root) ? "" : root, len + 1);
+
+    p_config->src_root_len = len;
+    p_config->src_root_gen++;
+
+    config_commit(p_config);
+
+    return true;
+}
+
+void
+plog_set_sample_key (const char* key)
+{
+    thread_state_t* p_state = thread_state();
+
+    if (NULL == p_state)
+    {
+        return;
+    }
+
+    if (NULL == key)
+    {
+        p_state->b_sample_key = false;
+        return;
+    }
+
+    // FNV-1a, then a finalizer so that similar keys spread over all bits
+    uint64_t hash = UINT64_C(0xCBF29CE484222325);
+
+    for (const char* p = key; '\0' != *p; p++)
+    {
+        hash ^= (unsigned char)*p;
+        hash *= UINT64_C(0x100000001B3);
+    }
+
+    p_state->sample_hash  = sample_mix(hash);
+    p_state->b_sample_key = true;
+}
+
+/*
+ * Renders the context prefix, "[key=value key=value] ".
+ */
+static void
+ctx_render (ctx_t* p_ctx)
+{
+    if (0 == p_ctx->count)
+    {
+        p_ctx->prefix_len = 0;
+        p_ctx->prefix[0]  = '\0';
+        return;
+    }
+
+    char* p = p_ctx->prefix;
+
+    *p++ = '[';
+
+    for (size_t i = 0; i < p_ctx->count; i++)
+    {
+        const char* p_key     = p_ctx->pool + p_ctx->offsets[i];
+        size_t      key_len   = strlen(p_key);
+        const char* p_value   = p_key + key_len + 1;
+        size_t      value_len = strlen(p_value);
+
+        memcpy(p, p_key, key_len);
+        p += key_len;
+        *p++ = '=';
+        memcpy(p, p_value, value_len);
+        p += value_len;
+        *p++ = (i + 1 < p_ctx->count) ? ' ' : ']';
+    }
+
+    *p++ = ' ';
+    *p   = '\0';
+
+    p_ctx->prefix_len = (size_t)(p - p_ctx->prefix);
+}
+
+bool
+plog_ctx_push (const char* key, const char* value)
+{
+    PLOG_ASSERT(NULL != key);
+    PLOG_ASSERT(NULL != value);
+
+    thread_state_t* p_state = thread_state();
+
+    if (NULL == p_state)
+    {
+        return false;
+    }
+
+    ctx_t* p_ctx     = &p_state->ctx;
+    size_t key_len   = strlen(key);
+    size_t value_len = strlen(value);
+
+    if (p_ctx->count >= PLOG_CTX_MAX_FIELDS ||
+        p_ctx->pool_len + key_len + value_len + 2 > PLOG_CTX_LEN)
+    {
+        return false;
+    }
+
+    char* p = p_ctx->pool + p_ctx->pool_len;
+
+    memcpy(p, key, key_len + 1);
+    memcpy(p + key_len + 1, value, value_len + 1);
+
+    p_ctx->offsets[p_ctx->count++] = p_ctx->pool_len;
+    p_ctx->pool_len += key_len + value_len + 2;
+
+    ctx_render(p_ctx);
+
+    return true;
+}
+
+void
+plog_ctx_pop (void)
+{
+    thread_state_t* p_state = thread_state();
+
+    if (NULL == p_state || 0 == p_state->ctx.count)
+    {
+        return;
+    }
+
+    ctx_t* p_ctx = &p_state->ctx;
+
+    p_ctx->pool_len = p_ctx->offsets[--p_ctx->count];
+
+    ctx_render(p_ctx);
+}
+
+void
+plog_ctx_clear (void)
+{
+    thread_state_t* p_state = thread_state();
+
+    if (NULL == p_state)
+    {
+        return;
+    }
+
+    p_state->ctx.count    = 0;
+    p_state->ctx.pool_len = 0;
+
+    ctx_render(&p_state->ctx);
+}
+
+void
+plog_set_time_fmt (plog_id_t id, const char* fmt)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Copy the time string
+        strncpy(p_config->appenders[id].p_time_fmt, fmt, PLOG_TIME_FMT_LEN);
+        config_commit(p_config);
+    }
+}
+
+void
+plog_colors_on (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Turn colors on
+        p_config->appenders[id].b_colors = true;
+        config_commit(p_config);
+    }
+}
+
+void
+plog_colors_off (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Turn colors off
+        p_config->appenders[id].b_colors = false;
+        config_commit(p_config);
+    }
+}
+
+void
+plog_timestamp_on (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Turn timestamp on
+        p_config->appenders[id].b_timestamp = true;
+        config_commit(p_config);
+    }
+}
+
+void
+plog_timestamp_off (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Turn timestamp off
+        p_config->appenders[id].b_timestamp = false;
+        config_commit(p_config);
+    }
+}
+
+void
+plog_level_on (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Turn level reporting on
+        p_config->appenders[id].b_level = true;
+        config_commit(p_config);
+    }
+}
+
+void
+plog_level_off (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Turn level reporting off
+        p_config->appenders[id].b_level = false;
+        config_commit(p_config);
+    }
+}
+
+void
+plog_file_on (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Turn file reporting on
+        p_config->appenders[id].b_file = true;
+        config_commit(p_config);
+    }
+}
+
+void
+plog_file_off (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Turn file reporting off
+        p_config->appenders[id].b_file = false;
+        config_commit(p_config);
+    }
+}
+
+void
+plog_func_on (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Turn function reporting on
+        p_config->appenders[id].b_func = true;
+        config_commit(p_config);
+    }
+}
+
+void
+plog_func_off (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Turn function reporting off
+        p_config->appenders[id].b_func = false;
+        config_commit(p_config);
+    }
+}
+
+void
+plog_ctx_on (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Turn context reporting on
+        p_config->appenders[id].b_ctx = true;
+        config_commit(p_config);
+    }
+}
+
+void
+plog_ctx_off (plog_id_t id)
+{
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL != p_config)
+    {
+        // Turn context reporting off
+        p_config->appenders[id].b_ctx = false;
+        config_commit(p_config);
+    }
+}
+
+bool
+plog_set_layout (plog_id_t id, const char* pattern)
+{
+    // Validate the pattern before touching the configuration
+    if (NULL != pattern)
+    {
+        layout_t layout;
+        memset(&layout, 0, sizeof(layout));
+
+        if (strlen(pattern) >= PLOG_LAYOUT_LEN ||
+            !layout_compile_pattern(&layout, pattern, false))
+        {
+            return false;
+        }
+    }
+
+    config_t* p_config = config_begin_appender(id);
+
+    if (NULL == p_config)
+    {
+        return false;
+    }
+
+    // An empty pattern selects the flag layout
+    strcpy(p_config->appenders[id].p_pattern, pattern ? pattern : "");
+    config_commit(p_config);
+
+    return true;
+}
+
+/*
+ * Strips leading and trailing whitespace in place.
+ */
+static char*
+config_trim (char* p_str)
+{
+    while (isspace((unsigned char)*p_str))
+    {
+        p_str++;
+    }
+
+    size_t len = strlen(p_str);
+
+    while (len > 0 && isspace((unsigned char)p_str[len - 1]))
+    {
+        p_str[--len] = '\0';
+    }
+
+    return p_str;
+}
+
+static bool
+config_bool (const char* p_value, bool* p_flag)
+{
+    if (0 == strcmp(p_value, "on") || 0 == strcmp(p_value, "true") ||
+        0 == strcmp(p_value, "yes"))
+    {
+        *p_flag = true;
+        return true;
+    }
+
+    if (0 == strcmp(p_value, "off") || 0 == strcmp(p_value, "false") ||
+        0 == strcmp(p_value, "no"))
+    {
+        *p_flag = false;
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * Parses a decimal number that fits in 32 bits and is followed by `end`.
+ */
+static bool
+config_uint32 (const char* p_str, char end, const char** pp_end,
+               uint32_t* p_value)
+{
+    char*         p_end = NULL;
+    unsigned long value = 0;
+
+    if (!isdigit((unsigned char)*p_str))
+    {
+        return false;
+    }
+
+    value = strtoul(p_str, &p_end, 10);
+
+    if (*p_end != end || value > UINT32_MAX)
+    {
+        return false;
+    }
+
+    *p_value = (uint32_t)value;
+    *pp_end  = p_end;
+
+    return true;
+}
+
+/*
+ * Applies a `sampling = LEVEL keep/of` value.
+ */
+static bool
+config_sampling (appender_info_t* p_info, char* p_value)
+{
+    char* p_rate = p_value;
+
+    while ('\0' != *p_rate && !isspace((unsigned char)*p_rate))
+    {
+        p_rate++;
+    }
+
+    if ('\0' == *p_rate)
+    {
+        return false;
+    }
+
+    *p_rate++ = '\0';
+    p_rate = config_trim(p_rate);
+
+    plog_level_t level;
+    uint32_t     keep, of;
+    const char*  p_end;
+
+    if (!plog_str_level(p_value, &level) ||
+        !config_uint32(p_rate, '/', &p_end, &keep) ||
+        !config_uint32(p_end + 1, '\0', &p_end, &of) || 0 == of)
+    {
+        return false;
+    }
+
+    p_info->sample_keep[level]      = (keep < of) ? keep : 1;
+    p_info->sample_of[level]        = (keep < of) ? of : 1;
+    p_info->sample_threshold[level] = sample_threshold(keep, of);
+
+    return true;
+}
+
+/*
+ * Applies an appender setting of a configuration file.
+ */
+static bool
+config_apply (appender_info_t* p_info, const char* p_key, char* p_value)
+{
+    if (0 == strcmp(p_key, "level"))
+    {
+        return plog_str_level(p_value, &p_info->level);
+    }
+
+    if (0 == strcmp(p_key, "time_fmt"))
+    {
+        if (strlen(p_value) >= PLOG_TIME_FMT_LEN)
+        {
+            return false;
+        }
+
+        strcpy(p_info->p_time_fmt, p_value);
+        return true;
+    }
+
+    if (0 == strcmp(p_key, "layout"))
+    {
+        layout_t layout;
+        memset(&layout, 0, sizeof(layout));
+
+        // An empty pattern selects the flag layout
+        if (strlen(p_value) >= PLOG_LAYOUT_LEN ||
+            ('\0' != p_value[0] &&
+             !layout_compile_pattern(&layout, p_value, false)))
+        {
+            return false;
+        }
+
+        strcpy(p_info->p_pattern, p_value);
+        return true;
+    }
+
+    if (0 == strcmp(p_key, "sampling"))
+    {
+        return config_sampling(p_info, p_value);
+    }
+
+    static const struct
+    {
+        const char* p_key;
+        size_t      offset;
+    } flags[] =
+    {
+        { "enabled",    offsetof(appender_info_t, b_enabled)   },
+        { "colors",     offsetof(appender_info_t, b_colors)    },
+        { "timestamp",  offsetof(appender_info_t, b_timestamp) },
+        { "show_level", offsetof(appender_info_t, b_level)     },
+        { "file",       offsetof(appender_info_t, b_file)      },
+        { "func",       offsetof(appender_info_t, b_func)      },
+        { "ctx",        offsetof(appender_info_t, b_ctx)       }
+    };
+
+    for (size_t i = 0; i < sizeof(flags) / sizeof(flags[0]); i++)
+    {
+        if (0 == strcmp(p_key, flags[i].p_key))
+        {
+            return config_bool(p_value, (bool*)((char*)p_info + flags[i].offset));
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Applies a setting that precedes the first section.
+ */
+static bool
+config_apply_global (config_t* p_config, const char* p_key,
+                     const char* p_value)
+{
+    if (0 == strcmp(p_key, "src_root"))
+    {
+        size_t len = strlen(p_value);
+
+        if (len >= PLOG_SRC_ROOT_LEN)
+        {
+            return false;
+        }
+
+        // Call sites only need resolving again if the root changed
+        if (0 != strcmp(p_config->src_root, p_value))
+        {
+            memcpy(p_config->src_root, p_value, len + 1);
+            p_config->src_root_len = len;
+            p_config->src_root_gen++;
+        }
+
+        return true;
+    }
+
+    return false;
+}
+
+/*
+ * Parses a "[id]" or "[*]" section header. Sets `*p_id` to
+ * PLOG_MAX_APPENDERS for "[*]".
+ */
+static bool
+config_section (const config_t* p_config, char* p_line, plog_id_t* p_id)
+{
+    size_t len = strlen(p_line);
+
+    if (len < 3 || ']' != p_line[len - 1])
+    {
+        return false;
+    }
+
+    p_line[len - 1] = '\0';
+
+    char* p_name = config_trim(p_line + 1);
+
+    if (0 == strcmp(p_name, "*"))
+    {
+        *p_id = PLOG_MAX_APPENDERS;
+        return true;
+    }
+
+    uint32_t    id;
+    const char* p_end;
+
+    if (!config_uint32(p_name, '\0', &p_end, &id) || id >= PLOG_MAX_APPENDERS ||
+        !appender_exists(p_config, (plog_id_t)id))
+    {
+        return false;
+    }
+
+    *p_id = (plog_id_t)id;
+
+    return true;
+}
+
+/*
+ * Loads a configuration file into one snapshot. On failure nothing is
+ * applied and `*p_line` is the offending line, or 0 if the file could not be
+ * read.
+ */
+static bool
+config_load (const char* path, unsigned* p_line)
+{
+    *p_line = 0;
+
+    FILE* p_file = fopen(path, "r");
+
+    if (NULL == p_file)
+    {
+        return false;
+    }
+
+    config_t* p_config = config_begin(&g_logger);
+
+    if (NULL == p_config)
+    {
+        fclose(p_file);
+        return false;
+    }
+
+    char      line[PLOG_CONFIG_LINE_LEN];
+    bool      b_ok      = true;
+    bool      b_section = false;  // False until the first section header
+    plog_id_t id        = 0;
+
+    while (b_ok && NULL != fgets(line, sizeof(line), p_file))
+    {
+        (*p_line)++;
+
+        size_t len = strlen(line);
+
+        // Reject lines that do not fit
+        if (len + 1 == sizeof(line) && '\n' != line[len - 1] && !feof(p_file))
+        {
+            b_ok = false;
+            break;
+        }
+
+        char* p_str = config_trim(line);
+
+        if ('\0' == *p_str || '#' == *p_str || ';' == *p_str)
+        {
+            continue;
+        }
+
+        if ('[' == *p_str)
+        {
+            b_section = true;
+            b_ok = config_section(p_config, p_str, &id);
+            continue;
+        }
+
+        char* p_eq = strchr(p_str, '=');
+
+        if (NULL == p_eq)
+        {
+            b_ok = false;
+            break;
+        }
+
+        *p_eq = '\0';
+
+        char* p_key   = config_trim(p_str);
+        char* p_value = config_trim(p_eq + 1);
+
+        if (!b_section)
+        {
+            b_ok = config_apply_global(p_config, p_key, p_value);
+        }
+        else if (PLOG_MAX_APPENDERS != id)
+        {
+            b_ok = config_apply(&p_config->appenders[id], p_key, p_value);
+        }
+        else
+        {
+            // Values may be modified by parsing, so each appender gets a copy
+            char value[PLOG_CONFIG_LINE_LEN];
+
+            for (plog_id_t i = 0; i < PLOG_MAX_APPENDERS && b_ok; i++)
+            {
+                if (appender_exists(p_config, i))
+                {
+                    strcpy(value, p_value);
+                    b_ok = config_apply(&p_config->appenders[i], p_key, value);
+                }
+            }
+        }
+    }
+
+    if (b_ok && ferror(p_file))
+    {
+        *p_line = 0;
+        b_ok = false;
+    }
+
+    fclose(p_file);
+
+    if (!b_ok)
+    {
+        config_abort(p_config);
+        return false;
+    }
+
+    config_commit(p_config);
+
+    return true;
+}
+
+bool
+plog_load_config (const char* path)
+{
+    // Path must not be NULL
+    PLOG_ASSERT(NULL != path);
+
+    unsigned line;
+
+    return config_load(path, &line);
+}
+
+/*
+ * Formats the current time as as string.
+ */
+static char*
+time_str (const char* p_time_fmt, time_t now, char* p_str, size_t len)
+{
+    struct tm tm_now;
+
+#ifdef PLOG_THREADS
+    localtime_r(&now, &tm_now);
+#else
+    tm_now = *localtime(&now);
+#endif
+
+    size_t ret = strftime(p_str, len, p_time_fmt, &tm_now);
+
+    PLOG_ASSERT(ret > 0);
+
+    return p_str;
+}
+
+/*
+ * Log entry under construction. Starts out in a stack buffer and moves to the
+ * thread's spill buffer when it outgrows it.
+ */
+typedef struct
+{
+    char*        p_str;   // Current storage
+    size_t       len;     // Length excluding the null terminator
+    size_t       cap;     // Capacity of p_str
+    spill_buf_t* p_spill; // Spill buffer (NULL if unavailable)
+    bool         b_full;  // True if an append was cut short
+} entry_buf_t;
+
+static void
+entry_init (entry_buf_t* p_buf, char* p_stack, size_t cap, spill_buf_t* p_spill)
+{
+    p_buf->p_str    = p_stack;
+    p_buf->p_str[0] = '\0';
+    p_buf->len      = 0;
+    p_buf->cap      = cap;
+    p_buf->p_spill  = p_spill;
+    p_buf->b_full   = false;
+}
+
+static void
+entry_append (entry_buf_t* p_buf, const char* p_str, size_t len)
+{
+    // Grow into the spill buffer if the entry does not fit
+    if (p_buf->len + len + 1 > p_buf->cap && NULL != p_buf->p_spill)
+    {
+        bool  b_stack = (p_buf->p_str != p_buf->p_spill->p_str);
+        char* p_new   = spill_reserve(p_buf->p_spill, p_buf->len + len + 1);
+
+        if (NULL != p_new)
+        {
+            if (b_stack)
+            {
+                memcpy(p_new, p_buf->p_str, p_buf->len + 1);
+            }
+
+            p_buf->p_str = p_new;
+            p_buf->cap   = p_buf->p_spill->cap;
+        }
+    }
+
+    if (p_buf->len + len + 1 > p_buf->cap)
+    {
+        len = p_buf->cap - p_buf->len - 1;
+        p_buf->b_full = true;
+    }
+
+    memcpy(p_buf->p_str + p_buf->len, p_str, len);
+    p_buf->len += len;
+    p_buf->p_str[p_buf->len] = '\0';
+}
+
+/*
+ * Appends an unsigned number without going through printf.
+ */
+static void
+entry_append_uint (entry_buf_t* p_buf, uint64_t value)
+{
+    char  p_str[PLOG_UINT_LEN];
+    char* p = p_str + sizeof(p_str);
+
+    do
+    {
+        *--p  = (char)('0' + value % 10);
+        value /= 10;
+    } while (0 != value);
+
+    entry_append(p_buf, p, (size_t)(p_str + sizeof(p_str) - p));
+}
+
+/*
+ * Appends the entry's timestamp, reusing the string rendered for the same
+ * second.
+ */
+static void
+entry_append_time (entry_buf_t* p_buf, time_cache_t* p_cache,
+                   const appender_info_t* p_info, time_t now)
+{
+    if (p_cache->time != now || p_cache->gen != p_info->gen)
+    {
+        time_str(p_info->p_time_fmt, now, p_cache->str, sizeof(p_cache->str));
+
+        p_cache->time = now;
+        p_cache->gen  = p_info->gen;
+        p_cache->len  = strlen(p_cache->str);
+    }
+
+    entry_append(p_buf, p_cache->str, p_cache->len);
+}
+
+/*
+ * Renders an entry through the appender's compiled layout.
+ */
+static void
+entry_render (entry_buf_t* p_buf, time_cache_t* p_cache,
+              const appender_info_t* p_info, const log_entry_t* p_log)
+{
+    const layout_t* p_layout = &p_info->layout;
+
+    for (size_t i = 0; i < p_layout->n_ops; i++)
+    {
+        const layout_op_t* p_op = &p_layout->ops[i];
+
+        switch ((layout_op_type_t)p_op->type)
+        {
+            case LAYOUT_TEXT:
+                entry_append(p_buf, p_layout->text + p_op->offset, p_op->len);
+                break;
+
+            case LAYOUT_TIME:
+                entry_append_time(p_buf, p_cache, p_info, p_log->time);
+                break;
+
+            case LAYOUT_LEVEL:
+                entry_append(p_buf, p_layout->levels[p_log->level],
+                             p_layout->level_len[p_log->level]);
+                break;
+
+            case LAYOUT_FILE:
+                entry_append(p_buf, p_log->file, p_log->file_len);
+                break;
+
+            case LAYOUT_LINE:
+                entry_append_uint(p_buf, p_log->line);
+                break;
+
+            case LAYOUT_FUNC:
+                entry_append(p_buf, p_log->func, p_log->func_len);
+                break;
+
+            case LAYOUT_MSG:
+                entry_append(p_buf, p_log->p_msg, p_log->msg_len);
+                break;
+
+            case LAYOUT_RATE:
+            case LAYOUT_RATE_TAG:
+            {
+                uint64_t keep, of;
+                sample_rate(p_info, p_log, &keep, &of);
+
+                if (LAYOUT_RATE == p_op->type || keep != of)
+                {
+                    bool b_tag = (LAYOUT_RATE_TAG == p_op->type);
+
+                    entry_append(p_buf, "[", b_tag ? 1 : 0);
+                    entry_append_uint(p_buf, keep);
+                    entry_append(p_buf, "/", 1);
+                    entry_append_uint(p_buf, of);
+                    entry_append(p_buf, "] ", b_tag ? 2 : 0);
+                }
+
+                break;
+            }
+
+            case LAYOUT_CTX:
+                // Strip the brackets and trailing space
+                if (p_log->ctx_len > 0)
+                {
+                    entry_append(p_buf, p_log->p_ctx + 1, p_log->ctx_len - 3);
+                }
+
+                break;
+
+            case LAYOUT_CTX_TAG:
+                entry_append(p_buf, p_log->p_ctx, p_log->ctx_len);
+                break;
+        }
+    }
+}
+
+/*
+ * Renders the flag layout (see layout_compile_flags) with the flags as
+ * constants. Each combination is instantiated below, so the decorations are
+ * chosen once, when the layout is compiled, rather than for every entry.
+ */
+static PLOG_ALWAYS_INLINE void
+entry_render_flags (entry_buf_t* p_buf, time_cache_t* p_cache,
+                    const appender_info_t* p_info, const log_entry_t* p_log,
+                    bool b_timestamp, bool b_level, bool b_file, bool b_func,
+                    bool b_ctx, bool b_colors)
+{
+    // Terminal codes, as emitted by layout_code
+    static const char gray[]  = "\033" PLOG_TERM_GRAY;
+    static const char reset[] = "\033" PLOG_TERM_RESET;
+
+    if (b_timestamp)
+    {
+        entry_append_time(p_buf, p_cache, p_info, p_log->time);
+        entry_append(p_buf, " ", 1);
+    }
+
+    if (b_level)
+    {
+        entry_append(p_buf, p_info->layout.levels[p_log->level],
+                     p_info->layout.level_len[p_log->level]);
+    }
+
+    if (b_file)
+    {
+        if (b_colors)
+        {
+            entry_append(p_buf, gray, sizeof(gray) - 1);
+        }
+
+        entry_append(p_buf, p_log->file, p_log->file_len);
+        entry_append(p_buf, ":", 1);
+        entry_append_uint(p_buf, p_log->line);
+
+        if (b_colors)
+        {
+            entry_append(p_buf, reset, sizeof(reset) - 1);
+        }
+
+        entry_append(p_buf, " ", 1);
+    }
+
+    if (b_func)
+    {
+        if (b_colors)
+        {
+            entry_append(p_buf, gray, sizeof(gray) - 1);
+        }
+
+        entry_append(p_buf, "[", 1);
+        entry_append(p_buf, p_log->func, p_log->func_len);
+        entry_append(p_buf, "] ", 2);
+
+        if (b_colors)
+        {
+            entry_append(p_buf, reset, sizeof(reset) - 1);
+        }
+    }
+
+    if (b_ctx)
+    {
+        entry_append(p_buf, p_log->p_ctx, p_log->ctx_len);
+    }
+
+    uint64_t keep, of;
+    sample_rate(p_info, p_log, &keep, &of);
+
+    if (keep != of)
+    {
+        entry_append(p_buf, "[", 1);
+        entry_append_uint(p_buf, keep);
+        entry_append(p_buf, "/", 1);
+        entry_append_uint(p_buf, of);
+        entry_append(p_buf, "] ", 2);
+    }
+
+    entry_append(p_buf, p_log->p_msg, p_log->msg_len);
+}
+
+/*
+ * Expands V(timestamp, level, file, func, ctx, colors) for each of the 64
+ * flag combinations, in the order of their render index.
+ */
+#define PLOG_RENDER_B1(V, a, b, c, d, e) V(a, b, c, d, e, 0) V(a, b, c, d, e, 1)
+#define PLOG_RENDER_B2(V, a, b, c, d) \
+        PLOG_RENDER_B1(V, a, b, c, d, 0) PLOG_RENDER_B1(V, a, b, c, d, 1)
+#define PLOG_RENDER_B3(V, a, b, c) \
+        PLOG_RENDER_B2(V, a, b, c, 0) PLOG_RENDER_B2(V, a, b, c, 1)
+#define PLOG_RENDER_B4(V, a, b) \
+        PLOG_RENDER_B3(V, a, b, 0) PLOG_RENDER_B3(V, a, b, 1)
+#define PLOG_RENDER_B5(V, a) \
+        PLOG_RENDER_B4(V, a, 0) PLOG_RENDER_B4(V, a, 1)
+#define PLOG_RENDER_VARIANTS(V) \
+        PLOG_RENDER_B5(V, 0) PLOG_RENDER_B5(V, 1)
+
+#define PLOG_RENDER_DEFINE(t, l, f, fn, x, c) \
+        static void \
+        entry_render_##t##l##f##fn##x##c (entry_buf_t* p_buf, \
+                                          time_cache_t* p_cache, \
+                                          const appender_info_t* p_info, \
+                                          const log_entry_t* p_log) \
+        { \
+            entry_render_flags(p_buf, p_cache, p_info, p_log, \
+                               t, l, f, fn, x, c); \
+        }
+
+#define PLOG_RENDER_ENTRY(t, l, f, fn, x, c) entry_render_##t##l##f##fn##x##c,
+
+PLOG_RENDER_VARIANTS(PLOG_RENDER_DEFINE)
+
+typedef void (*render_fn)(entry_buf_t* p_buf, time_cache_t* p_cache,
+                          const appender_info_t* p_info,
+                          const log_entry_t* p_log);
+
+/*
+ * Renderers indexed by appender_info_t.render.
+ */
+static const render_fn g_renderers[PLOG_RENDER_LAYOUT + 1] =
+{
+    PLOG_RENDER_VARIANTS(PLOG_RENDER_ENTRY)
+    entry_render
+};
+
+/*
+ * printf arguments for format_va.
+ */
+typedef struct
+{
+    const char* p_fmt;
+    va_list     args;
+} va_fmt_t;
+
+/*
+ * plog_format_fn of the printf-style functions. The arguments are copied so
+ * the message can be formatted twice.
+ */
+static size_t
+format_va (char* p_buf, size_t cap, void* p_udata)
+{
+    va_fmt_t* p_va = (va_fmt_t*)p_udata;
+
+    va_list args;
+    va_copy(args, p_va->args);
+
+    int ret = vsnprintf(p_buf, cap, p_va->p_fmt, args);
+
+    va_end(args);
+
+    // Treat encoding errors as an empty message
+    if (ret < 0)
+    {
+        p_buf[0] = '\0';
+        return 0;
+    }
+
+    return (size_t)ret;
+}
+
+/*
+ * Formats the message into `p_stack`, spilling into the thread's message
+ * buffer if it does not fit, and stores it in the entry.
+ */
+static void
+format_msg (thread_state_t* p_state, char* p_stack, size_t stack_len,
+            log_entry_t* p_entry, plog_format_fn p_format, void* p_udata)
+{
+    bool b_truncated = false;
+
+    size_t len = p_format(p_stack, stack_len, p_udata);
+
+    const char* p_msg = p_stack;
+
+    if (len >= stack_len)
+    {
+        size_t want = len;
+
+#if PLOG_MAX_MSG_LENGTH > 0
+        if (want > PLOG_MAX_MSG_LENGTH)
+        {
+            want = PLOG_MAX_MSG_LENGTH;
+        }
+#endif
+
+        char* p_spill = NULL;
+
+        if (want >= stack_len && NULL != p_state)
+        {
+            p_spill = spill_reserve(&p_state->msg_spill, want + 1);
+        }
+
+        if (NULL != p_spill)
+        {
+            p_format(p_spill, want + 1, p_udata);
+            p_msg = p_spill;
+
+            PLOG_COUNT(&p_state->msg_spills, 1);
+        }
+        else
+        {
+            // Keep what fits on the stack
+            want = stack_len - 1;
+        }
+
+        if (want < len)
+        {
+            len = want;
+            b_truncated = true;
+
+            if (NULL != p_state)
+            {
+                PLOG_COUNT(&p_state->msg_truncations, 1);
+            }
+        }
+    }
+#if PLOG_MAX_MSG_LENGTH > 0
+    else if (len > PLOG_MAX_MSG_LENGTH)
+    {
+        len = PLOG_MAX_MSG_LENGTH;
+        p_stack[len] = '\0';
+        b_truncated = true;
+
+        if (NULL != p_state)
+        {
+            PLOG_COUNT(&p_state->msg_truncations, 1);
+        }
+    }
+#endif
+
+    p_entry->p_msg       = p_msg;
+    p_entry->msg_len     = len;
+    p_entry->b_truncated = b_truncated;
+}
+
+void
+plog_get_stats (plog_stats_t* p_stats)
+{
+    PLOG_ASSERT(NULL != p_stats);
+
+    memset(p_stats, 0, sizeof(plog_stats_t));
+
+    for (thread_state_t* p_state = PLOG_LOAD(&gp_thread_states);
+         NULL != p_state; p_state = p_state->p_next)
+    {
+        p_stats->msg_spills      += PLOG_LOAD_RELAXED(&p_state->msg_spills);
+        p_stats->msg_truncations += PLOG_LOAD_RELAXED(&p_state->msg_truncations);
+        p_stats->async_drops     += PLOG_LOAD_RELAXED(&p_state->async_drops);
+        p_stats->filtered        += PLOG_LOAD_RELAXED(&p_state->filtered);
+        p_stats->sampled         += PLOG_LOAD_RELAXED(&p_state->sampled);
+    }
+
+#ifdef PLOG_THREADS
+    pthread_mutex_lock(&g_loggers_mutex);
+#endif
+
+    for (plog_id_t i = 0; i < PLOG_MAX_APPENDERS; i++)
+    {
+        appender_stats_sum(i, &p_stats->appenders[i]);
+        appender_stats_add(&p_stats->appenders[i], &gp_stats_base[i], -1);
+    }
+
+#ifdef PLOG_THREADS
+    pthread_mutex_unlock(&g_loggers_mutex);
+#endif
+
+    thread_state_t* p_state = thread_state();
+
+    if (NULL == p_state)
+    {
+        return;
+    }
+
+    // Effective levels; the read section keeps the instances alive while the
+    // registry is walked
+    read_enter(p_state);
+
+    for (plog_logger_t* p_logger = PLOG_LOAD(&gp_loggers); NULL != p_logger;
+         p_logger = PLOG_LOAD(&p_logger->p_next))
+    {
+        const config_t* p_config = PLOG_LOAD_SEQ(&p_logger->p_config);
+
+        for (plog_id_t i = 0; i < PLOG_MAX_APPENDERS; i++)
+        {
+            if (appender_exists(p_config, i))
+            {
+                p_stats->appenders[i].level = appender_level(p_config, i);
+            }
+        }
+    }
+
+    read_exit(p_state);
+}
+
+/*
+ * Formats the entry for each appender accepting its level and calls it.
+ * Appender times run from one clock reading to the next: one reading is
+ * taken for the entry, then one per appender (two more with a lock), each
+ * ending one appender's time and starting the next one's. Returns the last
+ * reading, 0 with PLOG_NO_STATS.
+ */
+static uint64_t
+write_entry (thread_state_t* p_state, const config_t* p_config,
+             const log_entry_t* p_log)
+{
+    uint64_t now = stats_ns();
+
+    for (plog_id_t i = 0; i < PLOG_MAX_APPENDERS; i++)
+    {
+        if (!appender_enabled(p_config, i))
+        {
+            continue;
+        }
+
+        const appender_info_t* p_info  = &p_config->appenders[i];
+        plog_appender_stats_t* p_stats = &p_state->appender_stats[i];
+
+        if (p_info->level > p_log->level)
+        {
+            PLOG_COUNT(&p_stats->filtered, 1);
+
+            continue;
+        }
+
+        // Sampled out or suppressed (and counted) by plog_write
+        if (p_log->skipped & (UINT64_C(1) << i))
+        {
+            continue;
+        }
+
+        char        p_entry_str[PLOG_ENTRY_STACK_LEN];
+        entry_buf_t entry;
+
+        entry_init(&entry, p_entry_str, sizeof(p_entry_str),
+                   &p_state->entry_spill);
+
+        // Render the decorations and message, then terminate the line
+        g_renderers[p_info->render](&entry, &p_state->time_cache[i], p_info,
+                                    p_log);
+        entry_append(&entry, "\n", 1);
+
+        // Without a spill buffer the newline may have been dropped
+        if (entry.b_full)
+        {
+            entry.p_str[entry.len - 1] = '\n';
+        }
+
+        uint64_t wait_ns  = 0;
+        uint64_t write_ns = 0;
+
+        // Locks the appender
+        if (NULL != p_info->p_lock)
+        {
+            uint64_t lock_ns = stats_ns();
+
+            p_info->p_lock(true, p_info->p_lock_udata);
+
+            write_ns = lock_ns - now;
+            now      = stats_ns();
+            wait_ns  = now - lock_ns;
+        }
+
+        if (NULL != p_info->p_appender)
+        {
+            p_info->p_appender(entry.p_str, p_info->p_udata);
+        }
+        else
+        {
+            plog_field_t fields[PLOG_CTX_MAX_FIELDS];
+            const char*  p_field = p_log->p_ctx_pool;
+
+            for (size_t f = 0; f < p_log->ctx_count; f++)
+            {
+                fields[f].key   = p_field;
+                fields[f].value = p_field + strlen(p_field) + 1;
+                p_field         = fields[f].value + strlen(fields[f].value) + 1;
+            }
+
+            plog_entry_t pub_entry =
+            {
+                p_log->level, p_log->file, p_log->line, p_log->func,
+                p_log->time, p_log->p_msg, p_log->msg_len,
+                entry.p_str, entry.len, 1, 1, fields, p_log->ctx_count
+            };
+
+            sample_rate(p_info, p_log, &pub_entry.sample_keep,
+                        &pub_entry.sample_of);
+
+            p_info->p_entry_fn(&pub_entry, p_info->p_udata);
+        }
+
+        uint64_t done_ns = stats_ns();
+
+        write_ns += done_ns - now;
+        now       = done_ns;
+
+        // Unlocks the appender
+        if (NULL != p_info->p_lock)
+        {
+            p_info->p_lock(false, p_info->p_lock_udata);
+        }
+
+        PLOG_COUNT(&p_stats->written, 1);
+        PLOG_COUNT(&p_stats->bytes, entry.len);
+
+#ifndef PLOG_NO_STATS
+        PLOG_COUNT(&p_stats->lock_wait_ns, wait_ns);
+        PLOG_COUNT(&p_stats->write_ns, write_ns);
+        PLOG_COUNT(&p_stats->hist[hist_bucket(write_ns)], 1);
+#else
+        (void)wait_ns;
+        (void)write_ns;
+#endif
+
+        if (p_log->b_truncated || entry.b_full)
+        {
+            PLOG_COUNT(&p_stats->truncations, 1);
+        }
+    }
+
+    spill_trim(&p_state->entry_spill);
+
+    return now;
+}
+
+#ifdef PLOG_THREADS
+
+/*
+ * Async mode state. Producers push records onto a lock-free stack; the
+ * writer thread takes the whole stack at once and reverses it into FIFO
+ * order. In sharded mode producers queue records in their own rings instead,
+ * which the writer merges by stamp. The mutex/condition pair is only used to
+ * put the writer to sleep and to wait for flushes.
+ */
+static record_t*       gp_async_head    = NULL;  // Pending records (LIFO)
+static record_t*       gp_async_taken   = NULL;  // Rest of the writer's batch
+static bool            gb_async_running = false; // True while in async mode
+static bool            gb_async_sharded = false; // Records go through rings
+static bool            gb_async_stop    = false; // Asks the writer to exit
+static int             g_async_sleeping = 0;     // Writer is (about to be) idle
+static size_t          g_ring_count     = 0;     // Rings allocated
+static uint64_t        g_ring_horizon   = 0;     // Stamp the writer merges to
+static int             g_async_pushing  = 0;     // Producers queueing a record
+static bool            gb_async_halting = false; // plog_async_stop is draining
+static pthread_t       g_async_thread;
+static pthread_mutex_t g_async_mutex    = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_async_drain    = PTHREAD_MUTEX_INITIALIZER;
+
+static PLOG_TLS bool gb_async_draining = false; // Calling thread delivers
+static pthread_cond_t  g_async_wake     = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t  g_async_flush    = PTHREAD_COND_INITIALIZER;
+
+#define PLOG_ASYNC_IDLE_MS 100
+
+/*
+ * Ring merge state, owned by the writer thread.
+ */
+typedef struct
+{
+    uint64_t stamp; // Stamp of the record at `head`
+    ring_t*  p_ring;
+    size_t   head;
+    size_t   tail;
+} merge_t;
+
+static merge_t* gp_merge    = NULL;
+static size_t   g_merge_cap = 0;
+
+/*
+ * Wakes the writer if it is going to sleep. The record was published with a
+ * sequentially consistent operation, as are the store/load pair in
+ * async_wait, so either the writer sees the record or we see it sleeping.
+ * Only the producer that clears the flag signals.
+ */
+static void
+async_wake (void)
+{
+    int sleeping = 1;
+
+    if (PLOG_LOAD_SEQ(&g_async_sleeping) &&
+        PLOG_CAS(&g_async_sleeping, &sleeping, 0))
+    {
+        pthread_mutex_lock(&g_async_mutex);
+        pthread_cond_signal(&g_async_wake);
+        pthread_mutex_unlock(&g_async_mutex);
+    }
+}
+
+/*
+ * Flush markers are records without a block.
+ */
+static void
+async_push (record_t* p_record)
+{
+    p_record->p_next = PLOG_LOAD_RELAXED(&gp_async_head);
+
+    while (!PLOG_CAS(&gp_async_head, &p_record->p_next, p_record))
+    {
+    }
+
+    async_wake();
+}
+
+/*
+ * Returns the calling thread's ring, allocating it on first use.
+ */
+static ring_t*
+ring_get (thread_state_t* p_state)
+{
+    ring_t* p_ring = p_state->p_ring;
+
+    if (NULL == p_ring)
+    {
+        p_ring = (ring_t*)PLOG_MALLOC(sizeof(ring_t));
+
+        if (NULL == p_ring)
+        {
+            return NULL;
+        }
+
+        memset(p_ring, 0, sizeof(ring_t));
+
+        // Sequentially consistent, so a writer that misses the ring is seen
+        // by the first ring_push (see there)
+        PLOG_STORE_SEQ(&p_state->p_ring, p_ring);
+        PLOG_ADD(&g_ring_count, 1);
+    }
+
+    return p_ring;
+}
+
+static bool
+ring_full (ring_t* p_ring)
+{
+    return p_ring->tail - PLOG_LOAD(&p_ring->head) >= PLOG_RING_SIZE;
+}
+
+/*
+ * Stamps a record and queues it; the ring must not be full. The stamp is
+ * announced in `pending` before the record is queued. If the writer already
+ * merged past it (it published a later horizon) the record is stamped again,
+ * so the writer either sees the pending stamp and stops short of it, or the
+ * record gets a stamp past everything merged so far.
+ */
+static void
+ring_push (ring_t* p_ring, record_t* p_record)
+{
+    uint64_t stamp = clock_ns();
+
+    PLOG_STORE_SEQ(&p_ring->pending, stamp);
+
+    while (PLOG_LOAD_SEQ(&g_ring_horizon) > stamp)
+    {
+        stamp = clock_ns();
+        PLOG_STORE_SEQ(&p_ring->pending, stamp);
+    }
+
+    p_record->stamp = stamp;
+
+    size_t tail = p_ring->tail;
+
+    p_ring->slots[tail & (PLOG_RING_SIZE - 1)] = p_record;
+
+    PLOG_STORE(&p_ring->tail, tail + 1);
+    PLOG_STORE(&p_ring->pending, 0);
+
+    async_wake();
+}
+
+/*
+ * Returns true if any record is queued.
+ */
+static bool
+async_pending (void)
+{
+    if (NULL != PLOG_LOAD_SEQ(&gp_async_head))
+    {
+        return true;
+    }
+
+    if (0 == PLOG_LOAD(&g_ring_count))
+    {
+        return false;
+    }
+
+    for (thread_state_t* p_state = PLOG_LOAD(&gp_thread_states);
+         NULL != p_state; p_state = p_state->p_next)
+    {
+        ring_t* p_ring = PLOG_LOAD_SEQ(&p_state->p_ring);
+
+        if (NULL != p_ring &&
+            PLOG_LOAD_SEQ(&p_ring->tail) != PLOG_LOAD_RELAXED(&p_ring->head))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Puts the writer to sleep until records arrive, or a timeout passes.
+ */
+static void
+async_wait (void)
+{
+    pthread_mutex_lock(&g_async_mutex);
+
+    PLOG_STORE_SEQ(&g_async_sleeping, 1);
+
+    if (!async_pending() && !PLOG_LOAD_SEQ(&gb_async_stop))
+    {
+        struct timespec deadline;
+
+        clock_gettime(CLOCK_REALTIME, &deadline);
+
+        deadline.tv_nsec += PLOG_ASYNC_IDLE_MS * 1000000L;
+
+        if (deadline.tv_nsec >= 1000000000L)
+        {
+            deadline.tv_sec  += 1;
+            deadline.tv_nsec -= 1000000000L;
+        }
+
+        pthread_cond_timedwait(&g_async_wake, &g_async_mutex, &deadline);
+    }
+
+    PLOG_STORE_RELAXED(&g_async_sleeping, 0);
+
+    pthread_mutex_unlock(&g_async_mutex);
+}
+
+/*
+ * Delivers one record. Records are released to their arena in per-block
+ * batches; `pp_block` and `p_count` track the current batch.
+ */
+static void
+async_deliver (thread_state_t* p_state, record_t* p_record,
+               arena_block_t** pp_block, int* p_count)
+{
+    // Flush marker; the flushing thread may return as soon as b_done is set,
+    // so the marker must not be touched afterwards
+    if (NULL == p_record->p_block)
+    {
+        pthread_mutex_lock(&g_async_mutex);
+        p_record->b_done = true;
+        pthread_cond_broadcast(&g_async_flush);
+        pthread_mutex_unlock(&g_async_mutex);
+        return;
+    }
+
+    write_entry(p_state, config_enter(p_state, p_record->p_logger),
+                &p_record->entry);
+    config_exit(p_state);
+
+    PLOG_COUNT(&p_state->async_delivered, 1);
+
+    if (p_record->p_block != *pp_block)
+    {
+        if (NULL != *pp_block)
+        {
+            arena_block_put(*pp_block, *p_count);
+        }
+
+        *pp_block = p_record->p_block;
+        *p_count  = 0;
+    }
+
+    (*p_count)++;
+}
+
+/*
+ * Delivers the records on the shared stack. Returns false if there were none.
+ */
+static bool
+async_drain_stack (thread_state_t* p_state)
+{
+    record_t* p_list = PLOG_XCHG(&gp_async_head, NULL);
+
+    if (NULL == p_list)
+    {
+        return false;
+    }
+
+    // Reverse into FIFO order
+    record_t* p_fifo = NULL;
+
+    while (NULL != p_list)
+    {
+        record_t* p_next = p_list->p_next;
+        p_list->p_next = p_fifo;
+        p_fifo = p_list;
+        p_list = p_next;
+    }
+
+    arena_block_t* p_block = NULL; // Block of the previous records
+    int            count   = 0;    // Records of p_block delivered
+
+    // The batch stays published so a crash handler can take what is left;
+    // records are claimed one at a time
+    PLOG_STORE_SEQ(&gp_async_taken, p_fifo);
+
+    for (;;)
+    {
+        record_t* p_record = PLOG_LOAD(&gp_async_taken);
+
+        if (NULL == p_record ||
+            !PLOG_CAS(&gp_async_taken, &p_record, p_record->p_next))
+        {
+            break;
+        }
+
+        async_deliver(p_state, p_record, &p_block, &count);
+    }
+
+    if (NULL != p_block)
+    {
+        arena_block_put(p_block, count);
+    }
+
+    return true;
+}
+
+/*
+ * Restores the heap property below `i` (min-heap on stamps).
+ */
+static void
+merge_sift (merge_t* p_heap, size_t count, size_t i)
+{
+    merge_t item = p_heap[i];
+
+    for (;;)
+    {
+        size_t child = 2 * i + 1;
+
+        if (child >= count)
+        {
+            break;
+        }
+
+        if (child + 1 < count && p_heap[child + 1].stamp < p_heap[child].stamp)
+        {
+            child++;
+        }
+
+        if (item.stamp <= p_heap[child].stamp)
+        {
+            break;
+        }
+
+        p_heap[i] = p_heap[child];
+        i = child;
+    }
+
+    p_heap[i] = item;
+}
+
+/*
+ * Delivers the ring records stamped before the horizon: the current time, or
+ * the stamp of a record still being queued if that is earlier. Every record
+ * queued later is stamped at or past the horizon (see ring_push), so merging
+ * the rings by stamp up to it keeps the output in order. `b_all` ignores the
+ * horizon, for the last drain when stopping. Returns false if nothing was
+ * delivered.
+ */
+static bool
+async_drain_rings (thread_state_t* p_state, bool b_all)
+{
+    if (0 == PLOG_LOAD(&g_ring_count))
+    {
+        return false;
+    }
+
+    uint64_t horizon = clock_ns();
+
+    PLOG_STORE_SEQ(&g_ring_horizon, horizon);
+
+    // Snapshot the rings and lower the horizon to any pending stamp
+    size_t count = 0;
+
+    for (thread_state_t* p_state_i = PLOG_LOAD(&gp_thread_states);
+         NULL != p_state_i; p_state_i = p_state_i->p_next)
+    {
+        ring_t* p_ring = PLOG_LOAD_SEQ(&p_state_i->p_ring);
+
+        if (NULL == p_ring)
+        {
+            continue;
+        }
+
+        uint64_t pending = PLOG_LOAD_SEQ(&p_ring->pending);
+
+        if (0 != pending && pending < horizon)
+        {
+            horizon = pending;
+        }
+
+        size_t head = PLOG_LOAD_RELAXED(&p_ring->head);
+        size_t tail = PLOG_LOAD(&p_ring->tail);
+
+        if (head == tail)
+        {
+            continue;
+        }
+
+        if (count == g_merge_cap)
+        {
+            size_t   cap      = g_merge_cap ? 2 * g_merge_cap : 16;
+            merge_t* p_merge  = (merge_t*)PLOG_MALLOC(cap * sizeof(merge_t));
+
+            // Try again later
+            if (NULL == p_merge)
+            {
+                return false;
+            }
+
+            if (count > 0)
+            {
+                memcpy(p_merge, gp_merge, count * sizeof(merge_t));
+            }
+
+            PLOG_FREE(gp_merge);
+
+            gp_merge    = p_merge;
+            g_merge_cap = cap;
+        }
+
+        merge_t* p_item = &gp_merge[count++];
+
+        p_item->stamp  = p_ring->slots[head & (PLOG_RING_SIZE - 1)]->stamp;
+        p_item->p_ring = p_ring;
+        p_item->head   = head;
+        p_item->tail   = tail;
+    }
+
+    for (size_t i = count / 2; i-- > 0;)
+    {
+        merge_sift(gp_merge, count, i);
+    }
+
+    arena_block_t* p_block = NULL;
+    int            n_block = 0;
+    bool           b_any   = false;
+
+    if (b_all)
+    {
+        horizon = UINT64_MAX;
+    }
+
+    // K-way merge
+    while (count > 0 && gp_merge[0].stamp < horizon)
+    {
+        merge_t*  p_top    = &gp_merge[0];
+        ring_t*   p_ring   = p_top->p_ring;
+        record_t* p_record = p_ring->slots[p_top->head & (PLOG_RING_SIZE - 1)];
+
+        // Free the slot before delivering; the record stays valid. A crash
+        // handler may claim slots too.
+        size_t head = p_top->head;
+
+        if (!PLOG_CAS(&p_ring->head, &head, head + 1))
+        {
+            break;
+        }
+
+        p_top->head++;
+
+        async_deliver(p_state, p_record, &p_block, &n_block);
+        b_any = true;
+
+        if (p_top->head == p_top->tail)
+        {
+            gp_merge[0] = gp_merge[--count];
+        }
+        else
+        {
+            size_t slot = p_top->head & (PLOG_RING_SIZE - 1);
+
+            p_top->stamp = p_ring->slots[slot]->stamp;
+        }
+
+        merge_sift(gp_merge, count, 0);
+    }
+
+    if (NULL != p_block)
+    {
+        arena_block_put(p_block, n_block);
+    }
+
+    return b_any;
+}
+
+/*
+ * Delivers pending records. Returns false if there were none.
+ */
+static bool
+async_drain (thread_state_t* p_state, bool b_all)
+{
+    // The writer normally drains alone, but plog_async_stop and async_flush
+    // drain once it is gone
+    pthread_mutex_lock(&g_async_drain);
+    gb_async_draining = true;
+
+    // Both queues are drained in either mode: producers may briefly keep
+    // using the previous mode's queue after a restart
+    bool b_stack = async_drain_stack(p_state);
+    bool b_rings = async_drain_rings(p_state, b_all);
+
+    gb_async_draining = false;
+    pthread_mutex_unlock(&g_async_drain);
+
+    return b_stack || b_rings;
+}
+
+static void*
+async_thread (void* p_arg)
+{
+    (void)p_arg;
+
+    thread_state_t* p_state = thread_state();
+
+    // Wait for memory rather than lose the queue
+    while (NULL == p_state)
+    {
+        sched_yield();
+        p_state = thread_state();
+    }
+
+    // Poll for a while before sleeping, so bursts are picked up without a
+    // wakeup
+    unsigned idle = 0;
+
+    while (!PLOG_LOAD(&gb_async_stop))
+    {
+        if (async_drain(p_state, false))
+        {
+            idle = 0;
+        }
+        else if (idle < PLOG_ASYNC_SPIN)
+        {
+            idle++;
+            PLOG_CPU_RELAX();
+        }
+        else
+        {
+            async_wait();
+            idle = 0;
+        }
+    }
+
+    // Deliver whatever is left
+    while (async_drain(p_state, true))
+    {
+    }
+
+    return NULL;
+}
+
+/*
+ * Counts an entry dropped by async mode against the appenders it was meant
+ * for.
+ */
+static void
+async_drop (thread_state_t* p_state, const config_t* p_config,
+            const log_entry_t* p_log)
+{
+    PLOG_COUNT(&p_state->async_drops, 1);
+
+    for (plog_id_t i = 0; i < PLOG_MAX_APPENDERS; i++)
+    {
+        if (appender_enabled(p_config, i) &&
+            p_config->appenders[i].level <= p_log->level &&
+            !(p_log->skipped & (UINT64_C(1) << i)))
+        {
+            PLOG_COUNT(&p_state->appender_stats[i].drops, 1);
+        }
+    }
+}
+
+/*
+ * Announces a producer about to queue a record. Returns false, and withdraws
+ * the announcement, if async mode is not running. Both sides use sequentially
+ * consistent operations, so either the producer sees the mode stopped or
+ * plog_async_stop sees the producer and waits for async_push_end before its
+ * final drain; no record is left behind.
+ */
+static bool
+async_push_begin (void)
+{
+    PLOG_ADD(&g_async_pushing, 1);
+
+    if (!PLOG_LOAD_SEQ(&gb_async_running))
+    {
+        PLOG_ADD(&g_async_pushing, -1);
+        return false;
+    }
+
+    return true;
+}
+
+static void
+async_push_end (void)
+{
+    PLOG_ADD(&g_async_pushing, -1);
+}
+
+/*
+ * Waits for plog_async_stop to deliver what is still queued, so entries this
+ * thread queued before the stop come out before the ones it writes
+ * synchronously after it. Appenders logging while records are delivered
+ * cannot wait for that.
+ */
+static void
+async_halt_wait (void)
+{
+    while (PLOG_LOAD(&gb_async_halting) && !gb_async_draining)
+    {
+        sched_yield();
+    }
+}
+
+/*
+ * Copies the entry into the calling thread's arena and queues it; async
+ * mode must be running (see async_write).
+ */
+static void
+async_queue (thread_state_t* p_state, plog_logger_t* p_logger,
+             const config_t* p_config, const log_entry_t* p_log)
+{
+    ring_t* p_ring = NULL;
+
+    if (PLOG_LOAD_RELAXED(&gb_async_sharded))
+    {
+        p_ring = ring_get(p_state);
+
+        if (NULL == p_ring || ring_full(p_ring))
+        {
+            async_drop(p_state, p_config, p_log);
+            return;
+        }
+    }
+
+    // The context is copied after the message
+    size_t    ctx_len  = p_log->ctx_len + p_log->ctx_pool_len;
+    record_t* p_record = arena_alloc(&p_state->arena, p_log->msg_len + ctx_len);
+
+    if (NULL == p_record)
+    {
+        async_drop(p_state, p_config, p_log);
+        return;
+    }
+
+    p_record->p_logger    = p_logger;
+    p_record->entry       = *p_log;
+    p_record->entry.p_msg = p_record->p_msg;
+
+    memcpy(p_record->p_msg, p_log->p_msg, p_log->msg_len);
+    p_record->p_msg[p_log->msg_len] = '\0';
+
+    if (ctx_len > 0)
+    {
+        char* p_ctx = p_record->p_msg + p_log->msg_len + 1;
+
+        memcpy(p_ctx, p_log->p_ctx, p_log->ctx_len);
+        memcpy(p_ctx + p_log->ctx_len, p_log->p_ctx_pool, p_log->ctx_pool_len);
+
+        p_record->entry.p_ctx      = p_ctx;
+        p_record->entry.p_ctx_pool = p_ctx + p_log->ctx_len;
+    }
+
+    // Counted first, so the queue depth never looks negative
+    PLOG_COUNT(&p_state->async_queued, 1);
+
+    if (NULL != p_ring)
+    {
+        ring_push(p_ring, p_record);
+    }
+    else
+    {
+        async_push(p_record);
+    }
+}
+
+/*
+ * Queues the entry for the writer thread. Returns false if the entry has to
+ * be written synchronously instead.
+ */
+static bool
+async_write (thread_state_t* p_state, plog_logger_t* p_logger,
+             const config_t* p_config, const log_entry_t* p_log)
+{
+    if (!PLOG_LOAD(&gb_async_running) || !async_push_begin())
+    {
+        async_halt_wait();
+        return false;
+    }
+
+    async_queue(p_state, p_logger, p_config, p_log);
+    async_push_end();
+
+    return true;
+}
+
+static void
+async_atexit (void)
+{
+    plog_async_stop();
+}
+
+static bool
+async_start (bool b_sharded)
+{
+    static bool b_atexit = false;
+
+    pthread_mutex_lock(&g_async_mutex);
+
+    bool b_ok = gb_async_running;
+
+    if (b_ok)
+    {
+        // Already running; the mode cannot change until stopped
+        b_ok = (b_sharded == PLOG_LOAD_RELAXED(&gb_async_sharded));
+    }
+    else
+    {
+        PLOG_STORE(&gb_async_stop, false);
+        PLOG_STORE(&gb_async_sharded, b_sharded);
+
+        b_ok = (0 == pthread_create(&g_async_thread, NULL, async_thread, NULL));
+
+        PLOG_STORE(&gb_async_running, b_ok);
+    }
+
+    // Make sure queued entries are delivered on normal exit
+    if (b_ok && !b_atexit)
+    {
+        b_atexit = (0 == atexit(async_atexit));
+    }
+
+    pthread_mutex_unlock(&g_async_mutex);
+
+    return b_ok;
+}
+
+bool
+plog_async_start (void)
+{
+    return async_start(false);
+}
+
+bool
+plog_async_start_sharded (void)
+{
+    return async_start(true);
+}
+
+void
+plog_async_stop (void)
+{
+    pthread_mutex_lock(&g_async_mutex);
+
+    if (!gb_async_running)
+    {
+        pthread_mutex_unlock(&g_async_mutex);
+        return;
+    }
+
+    // New entries are written synchronously from here on, once the queued
+    // ones are delivered
+    PLOG_STORE(&gb_async_halting, true);
+    PLOG_STORE(&gb_async_running, false);
+    PLOG_STORE_SEQ(&gb_async_stop, true);
+
+    pthread_mutex_unlock(&g_async_mutex);
+
+    async_wake();
+
+    pthread_join(g_async_thread, NULL);
+
+    // Producers that saw the mode running finish queueing first
+    while (0 != PLOG_LOAD_SEQ(&g_async_pushing))
+    {
+        sched_yield();
+    }
+
+    // Entries queued by threads that raced with the stop
+    thread_state_t* p_state = thread_state();
+
+    if (NULL != p_state)
+    {
+        while (async_drain(p_state, true))
+        {
+        }
+    }
+
+    PLOG_STORE(&gb_async_halting, false);
+}
+
+/*
+ * Waits until the entries this thread queued so far have been delivered.
+ */
+static void
+async_flush (void)
+{
+    // A thread delivering records (an appender writing a FATAL entry, say)
+    // would wait for itself; what it delivers is in order anyway
+    if (gb_async_draining)
+    {
+        return;
+    }
+
+    thread_state_t* p_state = thread_state();
+
+    // Without a state nothing of this thread can be queued either
+    if (NULL == p_state || !PLOG_LOAD(&gb_async_running) ||
+        !async_push_begin())
+    {
+        async_halt_wait();
+        return;
+    }
+
+    // Records are delivered in order, so once the marker is reached all
+    // entries queued before it have been written
+    record_t marker;
+    memset(&marker, 0, sizeof(marker));
+
+    if (PLOG_LOAD(&gb_async_sharded))
+    {
+        ring_t* p_ring = ring_get(p_state);
+
+        // Without a ring nothing of this thread can be queued either
+        if (NULL == p_ring)
+        {
+            async_push_end();
+            return;
+        }
+
+        while (ring_full(p_ring))
+        {
+            // The writer is gone; plog_async_stop delivers the ring instead
+            if (!PLOG_LOAD(&gb_async_running))
+            {
+                async_push_end();
+                async_halt_wait();
+                return;
+            }
+
+            async_wake();
+            sched_yield();
+        }
+
+        ring_push(p_ring, &marker);
+    }
+    else
+    {
+        async_push(&marker);
+    }
+
+    async_push_end();
+
+    pthread_mutex_lock(&g_async_mutex);
+
+    while (!marker.b_done)
+    {
+        if (PLOG_LOAD(&gb_async_running))
+        {
+            pthread_cond_wait(&g_async_flush, &g_async_mutex);
+            continue;
+        }
+
+        // Stopped: deliver the marker here rather than rely on a writer
+        // that may be gone
+        pthread_mutex_unlock(&g_async_mutex);
+
+        while (async_drain(p_state, true))
+        {
+        }
+
+        pthread_mutex_lock(&g_async_mutex);
+    }
+
+    pthread_mutex_unlock(&g_async_mutex);
+}
+
+/*
+ * Crash handling. The handler sticks to async-signal-safe calls: it claims
+ * whatever records are still queued, the same way the writer thread claims
+ * them, and writes them out with writev. The record the writer is delivering
+ * at the time of the crash is left to the writer.
+ */
+#define PLOG_CRASH_SIGNALS 4
+#define PLOG_CRASH_FRAMES  64
+#define PLOG_CRASH_RINGS   64 // Rings merged by stamp; the rest follow
+
+static const int         g_crash_signals[PLOG_CRASH_SIGNALS] =
+{
+    SIGSEGV, SIGABRT, SIGBUS, SIGFPE
+};
+
+static const char* const g_crash_names[PLOG_CRASH_SIGNALS] =
+{
+    "SIGSEGV", "SIGABRT", "SIGBUS", "SIGFPE"
+};
+
+static struct sigaction  g_crash_old[PLOG_CRASH_SIGNALS]; // Previous handlers
+
+static PLOG_TLS bool gb_crash_reporting = false; // Calling thread reports
+static bool              gb_crash_installed = false;
+static int               g_crash_fd         = -1;
+static int               g_crash_state      = 0; // 1 reporting, 2 reported
+static pthread_mutex_t   g_crash_mutex      = PTHREAD_MUTEX_INITIALIZER;
+
+static void
+crash_write (int fd, const char* p_str, size_t len)
+{
+    while (len > 0)
+    {
+        ssize_t ret = write(fd, p_str, len);
+
+        if (ret <= 0)
+        {
+            return;
+        }
+
+        p_str += ret;
+        len   -= (size_t)ret;
+    }
+}
+
+/*
+ * Formats a number into the end of `p_str` and returns its first digit.
+ */
+static const char*
+crash_uint (char p_str[PLOG_UINT_LEN], uint64_t value)
+{
+    char* p = p_str + PLOG_UINT_LEN;
+
+    do
+    {
+        *--p = (char)('0' + value % 10);
+        value /= 10;
+    } while (0 != value);
+
+    return p;
+}
+
+/*
+ * Points an iovec at read-only data; writev never writes through it.
+ */
+static void
+crash_iov (struct iovec* p_iov, const void* p_data, size_t len)
+{
+    p_iov->iov_base = (void*)(uintptr_t)p_data;
+    p_iov->iov_len  = len;
+}
+
+/*
+ * Writes a record as "LEVEL file:line [context] message".
+ */
+static void
+crash_write_record (int fd, const record_t* p_record)
+{
+    // Flush markers
+    if (NULL == p_record->p_block)
+    {
+        return;
+    }
+
+    const log_entry_t* p_log = &p_record->entry;
+
+    char        p_num[PLOG_UINT_LEN];
+    const char* p_line = crash_uint(p_num, p_log->line);
+
+    struct iovec iov[8];
+
+    crash_iov(&iov[0], level_str[p_log->level], strlen(level_str[p_log->level]));
+    crash_iov(&iov[1], " ", 1);
+    crash_iov(&iov[2], p_log->file, p_log->file_len);
+    crash_iov(&iov[3], ":", 1);
+    crash_iov(&iov[4], p_line, (size_t)(p_num + PLOG_UINT_LEN - p_line));
+    crash_iov(&iov[5], " ", 1);
+    crash_iov(&iov[6], p_log->p_ctx, p_log->ctx_len);
+    crash_iov(&iov[7], p_log->p_msg, p_log->msg_len);
+
+    if (writev(fd, iov, 8) < 0)
+    {
+        return;
+    }
+
+    crash_write(fd, "\n", 1);
+}
+
+/*
+ * Claims the record at the head of a ring, racing with the writer thread.
+ * Returns NULL if the ring is empty. The slot is read before the claim but
+ * only dereferenced after it: a successful CAS means the head never moved,
+ * so the slot still holds the same record.
+ */
+static record_t*
+crash_claim (ring_t* p_ring)
+{
+    size_t head = PLOG_LOAD(&p_ring->head);
+
+    while (head != PLOG_LOAD(&p_ring->tail))
+    {
+        record_t* p_record = p_ring->slots[head & (PLOG_RING_SIZE - 1)];
+
+        // On failure the CAS reloads the head, lost to the writer thread
+        if (PLOG_CAS(&p_ring->head, &head, head + 1))
+        {
+            return p_record;
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Writes the records still queued, in the order the writer thread would
+ * have delivered them. Ring records stamped after `now` are left alone, so
+ * threads that keep logging cannot hold the handler up.
+ */
+static void
+crash_drain (int fd, uint64_t now)
+{
+    // The rest of the writer's batch comes before anything on the stack
+    for (record_t* p = PLOG_XCHG(&gp_async_taken, NULL); NULL != p;
+         p = p->p_next)
+    {
+        crash_write_record(fd, p);
+    }
+
+    record_t* p_list = PLOG_XCHG(&gp_async_head, NULL);
+    record_t* p_fifo = NULL;
+
+    while (NULL != p_list)
+    {
+        record_t* p_next = p_list->p_next;
+        p_list->p_next = p_fifo;
+        p_fifo = p_list;
+        p_list = p_next;
+    }
+
+    for (record_t* p = p_fifo; NULL != p; p = p->p_next)
+    {
+        crash_write_record(fd, p);
+    }
+
+    // Merge the rings by stamp. Each ring's next record is claimed before it
+    // is looked at; until then the writer may deliver and recycle it
+    ring_t*   p_rings[PLOG_CRASH_RINGS];
+    record_t* p_heads[PLOG_CRASH_RINGS]; // Claimed, not yet written
+    size_t    n_rings = 0;
+
+    for (thread_state_t* p_state = PLOG_LOAD(&gp_thread_states);
+         NULL != p_state && n_rings < PLOG_CRASH_RINGS;
+         p_state = p_state->p_next)
+    {
+        ring_t* p_ring = PLOG_LOAD(&p_state->p_ring);
+
+        if (NULL != p_ring)
+        {
+            p_rings[n_rings] = p_ring;
+            p_heads[n_rings] = crash_claim(p_ring);
+            n_rings++;
+        }
+    }
+
+    for (;;)
+    {
+        size_t min = n_rings;
+
+        for (size_t i = 0; i < n_rings; i++)
+        {
+            if (NULL != p_heads[i] &&
+                (min == n_rings || p_heads[i]->stamp < p_heads[min]->stamp))
+            {
+                min = i;
+            }
+        }
+
+        if (min == n_rings)
+        {
+            break;
+        }
+
+        record_t* p_record = p_heads[min];
+
+        crash_write_record(fd, p_record);
+
+        // Records queued after the crash are left alone
+        p_heads[min] = (p_record->stamp <= now) ? crash_claim(p_rings[min])
+                                                 : NULL;
+    }
+
+    // Rings beyond the merge limit are written one after the other
+    size_t index = 0;
+
+    for (thread_state_t* p_state = PLOG_LOAD(&gp_thread_states);
+         NULL != p_state; p_state = p_state->p_next)
+    {
+        ring_t* p_ring = PLOG_LOAD(&p_state->p_ring);
+
+        if (NULL == p_ring || index++ < n_rings)
+        {
+            continue;
+        }
+
+        record_t* p_record = crash_claim(p_ring);
+
+        while (NULL != p_record)
+        {
+            crash_write_record(fd, p_record);
+
+            p_record = (p_record->stamp <= now) ? crash_claim(p_ring) : NULL;
+        }
+    }
+}
+
+static void
+crash_report (int fd, size_t signal)
+{
+    char        p_num[PLOG_UINT_LEN];
+    const char* p_sig = crash_uint(p_num, (uint64_t)g_crash_signals[signal]);
+
+    crash_write(fd, "FATAL caught ", 13);
+    crash_write(fd, g_crash_names[signal], strlen(g_crash_names[signal]));
+    crash_write(fd, " (signal ", 9);
+    crash_write(fd, p_sig, (size_t)(p_num + PLOG_UINT_LEN - p_sig));
+    crash_write(fd, ")\n", 2);
+
+    crash_drain(fd, clock_ns());
+
+#ifdef PLOG_BACKTRACE
+    void* frames[PLOG_CRASH_FRAMES];
+    int   count = backtrace(frames, PLOG_CRASH_FRAMES);
+
+    crash_write(fd, "backtrace:\n", 11);
+    backtrace_symbols_fd(frames, count, fd);
+#endif
+}
+
+static void
+crash_handler (int sig)
+{
+    size_t signal = 0;
+
+    while (signal < PLOG_CRASH_SIGNALS - 1 && g_crash_signals[signal] != sig)
+    {
+        signal++;
+    }
+
+    // A fault while reporting would otherwise wait for its own report
+    if (gb_crash_reporting)
+    {
+        struct sigaction action;
+
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = SIG_DFL;
+
+        sigaction(sig, &action, NULL);
+        raise(sig);
+        return;
+    }
+
+    int state = 0;
+
+    if (PLOG_CAS(&g_crash_state, &state, 1))
+    {
+        gb_crash_reporting = true;
+        crash_report(PLOG_LOAD(&g_crash_fd), signal);
+        PLOG_STORE(&g_crash_state, 2);
+    }
+    else
+    {
+        // Let the first crashing thread finish its report
+        struct timespec delay = { 0, 10000000L };
+
+        while (1 == PLOG_LOAD(&g_crash_state))
+        {
+            nanosleep(&delay, NULL);
+        }
+    }
+
+    // Hand the signal to the previous handler (or the default action) once
+    // this handler returns
+    sigaction(sig, &g_crash_old[signal], NULL);
+    raise(sig);
+}
+
+bool
+plog_crash_install (int fd)
+{
+    // Ensure valid descriptor
+    PLOG_ASSERT(fd >= 0);
+
+    pthread_mutex_lock(&g_crash_mutex);
+
+#ifdef PLOG_BACKTRACE
+    // The first call may load libgcc, which must not happen in the handler
+    void* frame;
+    backtrace(&frame, 1);
+#endif
+
+    PLOG_STORE(&g_crash_fd, fd);
+
+    bool b_ok = true;
+
+    if (!gb_crash_installed)
+    {
+        struct sigaction action;
+
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = crash_handler;
+        sigemptyset(&action.sa_mask);
+
+        for (size_t i = 0; i < PLOG_CRASH_SIGNALS && b_ok; i++)
+        {
+            if (0 != sigaction(g_crash_signals[i], &action, &g_crash_old[i]))
+            {
+                // Undo the handlers installed so far
+                while (i-- > 0)
+                {
+                    sigaction(g_crash_signals[i], &g_crash_old[i], NULL);
+                }
+
+                b_ok = false;
+            }
+        }
+
+        gb_crash_installed = b_ok;
+    }
+
+    pthread_mutex_unlock(&g_crash_mutex);
+
+    return b_ok;
+}
+
+void
+plog_crash_uninstall (void)
+{
+    pthread_mutex_lock(&g_crash_mutex);
+
+    if (gb_crash_installed)
+    {
+        for (size_t i = 0; i < PLOG_CRASH_SIGNALS; i++)
+        {
+            sigaction(g_crash_signals[i], &g_crash_old[i], NULL);
+        }
+
+        gb_crash_installed = false;
+    }
+
+    pthread_mutex_unlock(&g_crash_mutex);
+}
+
+#else
+
+static bool
+async_write (thread_state_t* p_state, plog_logger_t* p_logger,
+             const config_t* p_config, const log_entry_t* p_log)
+{
+    (void)p_state;
+    (void)p_logger;
+    (void)p_config;
+    (void)p_log;
+
+    return false;
+}
+
+bool
+plog_async_start (void)
+{
+    return false;
+}
+
+bool
+plog_async_start_sharded (void)
+{
+    return false;
+}
+
+void
+plog_async_stop (void)
+{
+}
+
+static void
+async_flush (void)
+{
+}
+
+bool
+plog_crash_install (int fd)
+{
+    (void)fd;
+
+    return false;
+}
+
+void
+plog_crash_uninstall (void)
+{
+}
+
+#endif
+
+#ifdef PLOG_INOTIFY
+
+static pthread_mutex_t g_watch_mutex   = PTHREAD_MUTEX_INITIALIZER;
+static pthread_t       g_watch_thread;
+static bool            gb_watching     = false;
+static int             g_watch_fd      = -1;         // inotify instance
+static int             g_watch_stop[2] = { -1, -1 }; // Closed to stop
+static char*           gp_watch_path   = NULL;
+static const char*     gp_watch_name   = NULL; // File name in gp_watch_path
+
+/*
+ * Reloads the configuration file whenever it is written or replaced.
+ */
+static void*
+watch_thread (void* p_arg)
+{
+    (void)p_arg;
+
+    char          buf[4096];
+    struct pollfd fds[2] =
+    {
+        { g_watch_fd,      POLLIN, 0 },
+        { g_watch_stop[0], POLLIN, 0 }
+    };
+
+    for (;;)
+    {
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        // The write end was closed by watch_stop
+        if (0 != fds[1].revents)
+        {
+            break;
+        }
+
+        ssize_t len = read(g_watch_fd, buf, sizeof(buf));
+
+        if (len < 0)
+        {
+            if (EINTR == errno)
+            {
+                continue;
+            }
+
+            break;
+        }
+
+        // Events are for the whole directory, so editors that replace the
+        // file by renaming are covered; a batch triggers one reload
+        bool   b_changed = false;
+        size_t offset    = 0;
+
+        while (offset + sizeof(struct inotify_event) <= (size_t)len)
+        {
+            struct inotify_event event;
+            memcpy(&event, buf + offset, sizeof(event));
+
+            if (event.len > 0 &&
+                0 == strcmp(buf + offset + sizeof(event), gp_watch_name))
+            {
+                b_changed = true;
+            }
+
+            offset += sizeof(event) + event.len;
+        }
+
+        unsigned line;
+
+        if (b_changed && !config_load(gp_watch_path, &line))
+        {
+            if (0 == line)
+            {
+                plog_error("Cannot read %s, configuration unchanged",
+                           gp_watch_path);
+            }
+            else
+            {
+                plog_error("Invalid setting at %s:%u, configuration unchanged",
+                           gp_watch_path, line);
+            }
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Stops the watcher thread, if any. Called with the watch lock held.
+ */
+static void
+watch_stop (void)
+{
+    if (!gb_watching)
+    {
+        return;
+    }
+
+    close(g_watch_stop[1]);
+    pthread_join(g_watch_thread, NULL);
+
+    close(g_watch_stop[0]);
+    close(g_watch_fd);
+    PLOG_FREE(gp_watch_path);
+
+    gp_watch_path = NULL;
+    gb_watching   = false;
+}
+
+/*
+ * Starts watching the directory of `path`. Called with the watch lock held.
+ */
+static bool
+watch_start (const char* path)
+{
+    size_t len = strlen(path);
+
+    // The path, then its directory
+    char* p_path = (char*)PLOG_MALLOC(2 * (len + 1));
+
+    if (NULL == p_path)
+    {
+        return false;
+    }
+
+    char* p_dir = p_path + len + 1;
+
+    memcpy(p_path, path, len + 1);
+    memcpy(p_dir, path, len + 1);
+
+    char* p_slash = strrchr(p_dir, '/');
+
+    if (NULL == p_slash)
+    {
+        gp_watch_name = p_path;
+        strcpy(p_dir, ".");
+    }
+    else
+    {
+        gp_watch_name = p_path + (p_slash - p_dir) + 1;
+
+        // Keep "/" for files in the root directory
+        if (p_slash == p_dir)
+        {
+            p_slash++;
+        }
+
+        *p_slash = '\0';
+    }
+
+    g_watch_fd = inotify_init1(IN_CLOEXEC);
+
+    if (g_watch_fd < 0)
+    {
+        PLOG_FREE(p_path);
+        return false;
+    }
+
+    if (inotify_add_watch(g_watch_fd, p_dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0 ||
+        0 != pipe(g_watch_stop))
+    {
+        close(g_watch_fd);
+        PLOG_FREE(p_path);
+        return false;
+    }
+
+    gp_watch_path = p_path;
+
+    if (0 != pthread_create(&g_watch_thread, NULL, watch_thread, NULL))
+    {
+        close(g_watch_stop[0]);
+        close(g_watch_stop[1]);
+        close(g_watch_fd);
+        PLOG_FREE(p_path);
+        gp_watch_path = NULL;
+        return false;
+    }
+
+    gb_watching = true;
+
+    return true;
+}
+
+bool
+plog_watch_config (const char* path)
+{
+    // Path must not be NULL
+    PLOG_ASSERT(NULL != path);
+
+    pthread_mutex_lock(&g_watch_mutex);
+
+    watch_stop();
+
+    bool b_ok = plog_load_config(path) && watch_start(path);
+
+    pthread_mutex_unlock(&g_watch_mutex);
+
+    return b_ok;
+}
+
+void
+plog_unwatch_config (void)
+{
+    pthread_mutex_lock(&g_watch_mutex);
+    watch_stop();
+    pthread_mutex_unlock(&g_watch_mutex);
+}
+
+#else
+
+bool
+plog_watch_config (const char* path)
+{
+    (void)path;
+
+    return false;
+}
+
+void
+plog_unwatch_config (void)
+{
+}
+
+#endif
+
+/*
+ * Calls the flush function of every enabled appender of an instance, under
+ * its lock.
+ */
+static void
+appenders_flush (plog_logger_t* p_logger)
+{
+    thread_state_t* p_state = thread_state();
+
+    if (NULL == p_state)
+    {
+        return;
+    }
+
+    const config_t* p_config = config_enter(p_state, p_logger);
+
+    for (plog_id_t i = 0; i < PLOG_MAX_APPENDERS; i++)
+    {
+        const appender_info_t* p_info = &p_config->appenders[i];
+
+        if (!appender_enabled(p_config, i) || NULL == p_info->p_flush)
+        {
+            continue;
+        }
+
+        if (NULL != p_info->p_lock)
+        {
+            p_info->p_lock(true, p_info->p_lock_udata);
+        }
+
+        p_info->p_flush(p_info->p_udata);
+
+        if (NULL != p_info->p_lock)
+        {
+            p_info->p_lock(false, p_info->p_lock_udata);
+        }
+    }
+
+    config_exit(p_state);
+}
+
+void
+plog_flush (void)
+{
+    async_flush();
+
+    thread_state_t* p_state = thread_state();
+
+    if (NULL == p_state)
+    {
+        return;
+    }
+
+    // The read section keeps the instances alive while the registry is walked
+    read_enter(p_state);
+
+    for (plog_logger_t* p_logger = PLOG_LOAD(&gp_loggers); NULL != p_logger;
+         p_logger = PLOG_LOAD(&p_logger->p_next))
+    {
+        appenders_flush(p_logger);
+    }
+
+    read_exit(p_state);
+}
+
+plog_logger_t*
+plog_create (void)
+{
+    plog_logger_t* p_logger = (plog_logger_t*)PLOG_MALLOC(sizeof(plog_logger_t));
+
+    if (NULL == p_logger)
+    {
+        return NULL;
+    }
+
+    config_t* p_config = (config_t*)PLOG_MALLOC(sizeof(config_t));
+
+    if (NULL == p_config)
+    {
+        PLOG_FREE(p_logger);
+        return NULL;
+    }
+
+    memset(p_logger, 0, sizeof(plog_logger_t));
+    memset(p_config, 0, sizeof(config_t));
+
+#ifdef PLOG_THREADS
+    if (0 != pthread_mutex_init(&p_logger->mutex, NULL))
+    {
+        PLOG_FREE(p_logger);
+        PLOG_FREE(p_config);
+        return NULL;
+    }
+
+    // Start with the default instance's source root
+    pthread_mutex_lock(&g_logger.mutex);
+#endif
+
+    memcpy(p_config->src_root, g_logger.p_config->src_root, PLOG_SRC_ROOT_LEN);
+
+    p_config->src_root_len = g_logger.p_config->src_root_len;
+    p_config->src_root_gen = g_logger.p_config->src_root_gen;
+
+#ifdef PLOG_THREADS
+    pthread_mutex_unlock(&g_logger.mutex);
+#endif
+
+    p_config->p_logger    = p_logger;
+    p_logger->p_config    = p_config;
+    p_logger->b_enabled   = true;
+    p_logger->threshold   = PLOG_LEVEL_COUNT;
+    p_logger->p_threshold = &p_logger->threshold;
+
+    // Publish the instance; plog_flush walks the registry without locking
+#ifdef PLOG_THREADS
+    pthread_mutex_lock(&g_loggers_mutex);
+#endif
+
+    p_logger->p_next = gp_loggers;
+    PLOG_STORE(&gp_loggers, p_logger);
+
+#ifdef PLOG_THREADS
+    pthread_mutex_unlock(&g_loggers_mutex);
+#endif
+
+    return p_logger;
+}
+
+void
+plog_destroy (plog_logger_t* p_logger)
+{
+    // The default instance lives as long as the process
+    PLOG_ASSERT(NULL != p_logger && &g_logger != p_logger);
+
+    if (NULL == p_logger || &g_logger == p_logger)
+    {
+        return;
+    }
+
+    // Deliver the entries still queued for the instance
+    async_flush();
+
+#ifdef PLOG_THREADS
+    pthread_mutex_lock(&g_loggers_mutex);
+#endif
+
+    plog_logger_t** pp_link = &gp_loggers;
+
+    while (*pp_link != p_logger)
+    {
+        pp_link = &(*pp_link)->p_next;
+    }
+
+    PLOG_STORE(pp_link, p_logger->p_next);
+
+#ifdef PLOG_THREADS
+    pthread_mutex_unlock(&g_loggers_mutex);
+#endif
+
+    // Wait for readers that may still see the instance
+    config_synchronize(PLOG_ADD(&g_config_epoch, 1));
+
+    for (plog_id_t i = 0; i < PLOG_MAX_APPENDERS; i++)
+    {
+        if (PLOG_LOAD(&gp_owners[i]) == p_logger)
+        {
+            PLOG_STORE(&gp_owners[i], NULL);
+        }
+    }
+
+    while (NULL != p_logger->p_retired)
+    {
+        config_t* p_next = p_logger->p_retired->p_retired;
+        PLOG_FREE(p_logger->p_retired);
+        p_logger->p_retired = p_next;
+    }
+
+#ifdef PLOG_THREADS
+    pthread_mutex_destroy(&p_logger->mutex);
+#endif
+
+    PLOG_FREE(p_logger->p_config);
+    PLOG_FREE(p_logger);
+}
+
+void
+plog_set_fatal_flush (bool b_flush)
+{
+    PLOG_STORE(&gb_fatal_flush, b_flush);
+}
+
+/*
+ * Fills in the entry's file and function from the call site, measuring them
+ * and checking the source root only the first time (or after the root
+ * changes). Several threads may fill the caches at once; they store the same
+ * values, and the stripped length and root generation share one word so they
+ * are always consistent.
+ */
+static void
+site_resolve (plog_site_t* p_site, const config_t* p_config, log_entry_t* p_log)
+{
+    uint64_t root = PLOG_LOAD_RELAXED(&p_site->root);
+
+    if ((root >> 16) != p_config->src_root_gen)
+    {
+        size_t strip = 0;
+
+        if (p_config->src_root_len > 0 &&
+            0 == strncmp(p_site->file, p_config->src_root,
+                         p_config->src_root_len))
+        {
+            strip = p_config->src_root_len;
+        }
+
+        root = (p_config->src_root_gen << 16) | strip;
+
+        PLOG_STORE_RELAXED(&p_site->root, root);
+    }
+
+    size_t file_len = PLOG_LOAD_RELAXED(&p_site->file_len);
+    size_t func_len = PLOG_LOAD_RELAXED(&p_site->func_len);
+
+    if (0 == file_len)
+    {
+        file_len = strlen(p_site->file);
+        PLOG_STORE_RELAXED(&p_site->file_len, file_len);
+    }
+
+    if (0 == func_len)
+    {
+        func_len = strlen(p_site->func);
+        PLOG_STORE_RELAXED(&p_site->func_len, func_len);
+    }
+
+    size_t strip = (size_t)(root & 0xFFFF);
+
+    p_log->file     = p_site->file + strip;
+    p_log->file_len = file_len - strip;
+    p_log->line     = p_site->line;
+    p_log->func     = p_site->func;
+    p_log->func_len = func_len;
+}
+
+/*
+ * Moves an appender's level one step according to the pressure measured over
+ * the last window. Returns true if the level is back where it was set, in
+ * which case `p_suppressed` receives what was suppressed meanwhile and
+ * `p_ms` how long it lasted.
+ */
+static bool
+degrade_update (const config_t* p_config, plog_id_t id, uint64_t now,
+                uint64_t depth, bool b_dropped, uint64_t* p_suppressed,
+                uint64_t* p_ms)
+{
+    const appender_info_t* p_info = &p_config->appenders[id];
+    degrade_t*             p_deg  = &gp_degrade[id];
+
+    plog_appender_stats_t stats;
+    appender_stats_sum(id, &stats);
+
+    uint64_t written = stats.written - p_deg->written;
+    uint64_t busy_ns = stats.lock_wait_ns + stats.write_ns - p_deg->busy_ns;
+    bool     b_first = (0 == p_deg->tick);
+
+    p_deg->tick    = now;
+    p_deg->written = stats.written;
+    p_deg->busy_ns = stats.lock_wait_ns + stats.write_ns;
+
+    // The counters only cover a window from the second tick on
+    if (b_first)
+    {
+        return false;
+    }
+
+    uint64_t latency_ns = (written > 0) ? busy_ns / written : 0;
+    uint64_t max_ns     = p_info->degrade_latency_ns;
+    uint64_t max_depth  = p_info->degrade_depth;
+
+    bool b_hot  = (0 != max_ns && latency_ns > max_ns) ||
+                  (0 != max_depth && (depth > max_depth || b_dropped));
+    bool b_cool = (0 == max_ns || latency_ns <= max_ns / 2) &&
+                  (0 == max_depth || (depth <= max_depth / 2 && !b_dropped));
+
+    int shift = PLOG_LOAD_RELAXED(&p_deg->shift);
+
+    p_deg->calm = b_cool ? p_deg->calm + 1 : 0;
+
+    if (b_hot && (int)p_info->level + shift < (int)p_info->degrade_max)
+    {
+        if (0 == shift)
+        {
+            p_deg->since = now;
+            memcpy(p_deg->suppressed, stats.suppressed,
+                   sizeof(p_deg->suppressed));
+        }
+
+        PLOG_STORE_RELAXED(&p_deg->shift, shift + 1);
+    }
+    else if (shift > 0 && p_deg->calm >= PLOG_DEGRADE_HOLD)
+    {
+        p_deg->calm = 0;
+
+        PLOG_STORE_RELAXED(&p_deg->shift, shift - 1);
+
+        if (1 == shift)
+        {
+            for (int level = 0; level < PLOG_LEVEL_COUNT; level++)
+            {
+                p_suppressed[level] = stats.suppressed[level] -
+                                      p_deg->suppressed[level];
+            }
+
+            *p_ms = (now - p_deg->since) / 1000000u;
+
+            return true;
+        }
+    }
+
+    return false;
+}
+
+/*
+ * Reports what an appender suppressed while it was degraded.
+ */
+static void
+degrade_report (plog_logger_t* p_logger, plog_id_t id,
+                const uint64_t* p_suppressed, uint64_t ms)
+{
+    char   p_counts[PLOG_LEVEL_COUNT * (PLOG_UINT_LEN + 8)];
+    size_t len = 0;
+
+    for (int level = 0; level < PLOG_LEVEL_COUNT; level++)
+    {
+        if (0 != p_suppressed[level])
+        {
+            len += (size_t)snprintf(p_counts + len, sizeof(p_counts) - len,
+                                    "%s%llu %s", (0 == len) ? "" : ", ",
+                                    (unsigned long long)p_suppressed[level],
+                                    level_str[level]);
+        }
+    }
+
+    plog_logger_write(p_logger, PLOG_LEVEL_WARN,
+                      "Appender %zu level restored after %llu ms, "
+                      "suppressed %s", id, (unsigned long long)ms,
+                      (0 == len) ? "nothing" : p_counts);
+}
+
+/*
+ * Runs the degradation of an instance's appenders at most once per window.
+ * The queue depth is that of the async mode queue, shared by all instances.
+ * `now` is a clock reading already taken for the entry, or 0.
+ */
+static void
+degrade_tick (thread_state_t* p_state, plog_logger_t* p_logger, uint64_t now)
+{
+    if (0 == now)
+    {
+        now = clock_ns();
+    }
+
+    uint64_t next = PLOG_LOAD_RELAXED(&p_logger->degrade_next);
+
+    // The winner holds off every other thread (and its own report) until done
+    if (now < next || !PLOG_CAS(&p_logger->degrade_next, &next, UINT64_MAX))
+    {
+        return;
+    }
+
+    uint64_t delivered = 0;
+    uint64_t queued    = 0;
+    uint64_t drops     = 0;
+
+    // Delivered records are read first, so they never outnumber queued ones
+    for (thread_state_t* p_st = PLOG_LOAD(&gp_thread_states); NULL != p_st;
+         p_st = p_st->p_next)
+    {
+        delivered += PLOG_LOAD_RELAXED(&p_st->async_delivered);
+    }
+
+    for (thread_state_t* p_st = PLOG_LOAD(&gp_thread_states); NULL != p_st;
+         p_st = p_st->p_next)
+    {
+        queued += PLOG_LOAD_RELAXED(&p_st->async_queued);
+        drops  += PLOG_LOAD_RELAXED(&p_st->async_drops);
+    }
+
+    uint64_t depth     = (queued > delivered) ? queued - delivered : 0;
+    bool     b_dropped = (drops != p_logger->degrade_drops);
+
+    p_logger->degrade_drops = drops;
+
+    uint64_t restored = 0; // Appenders whose level was restored, by ID
+    uint64_t suppressed[PLOG_MAX_APPENDERS][PLOG_LEVEL_COUNT];
+    uint64_t ms[PLOG_MAX_APPENDERS];
+
+    const config_t* p_config = config_enter(p_state, p_logger);
+
+    for (plog_id_t i = 0; i < PLOG_MAX_APPENDERS; i++)
+    {
+        if (appender_enabled(p_config, i) &&
+            degrade_on(&p_config->appenders[i]) &&
+            degrade_update(p_config, i, now, depth, b_dropped,
+                           suppressed[i], &ms[i]))
+        {
+            restored |= UINT64_C(1) << i;
+        }
+    }
+
+    config_exit(p_state);
+
+    for (plog_id_t i = 0; i < PLOG_MAX_APPENDERS; i++)
+    {
+        if (restored & (UINT64_C(1) << i))
+        {
+            degrade_report(p_logger, i, suppressed[i], ms[i]);
+        }
+    }
+
+    PLOG_STORE_RELAXED(&p_logger->degrade_next, now + PLOG_DEGRADE_WINDOW_NS);
+}
+
+/*
+ * Common path of the plog_write functions.
+ */
+static void
+write_msg (plog_logger_t* p_logger, plog_site_t* p_site, plog_level_t level,
+           uint32_t keep, uint32_t of, plog_format_fn p_format, void* p_udata)
+{
+    // Logger must not be NULL
+    PLOG_ASSERT(NULL != p_logger);
+
+    // Only write entry if the logger is enabled
+    if (!PLOG_LOAD_RELAXED(&p_logger->b_enabled))
+    {
+        return;
+    }
+
+    // Ensure valid log level
+    PLOG_ASSERT(level < PLOG_LEVEL_COUNT);
+
+    thread_state_t* p_state = thread_state();
+
+    // Logging is impossible without per-thread state (out of memory)
+    if (NULL == p_state)
+    {
+        return;
+    }
+
+    // No appender accepts the level, so the configuration is not needed
+    if ((int)level < PLOG_LOAD_RELAXED(p_logger->p_threshold))
+    {
+        PLOG_COUNT(&p_state->filtered, 1);
+        return;
+    }
+
+    // Call site sampling
+    if (keep < of && !sample_keep(p_state, PLOG_SAMPLE_SITE,
+                                  sample_threshold(keep, of)))
+    {
+        PLOG_COUNT(&p_state->sampled, 1);
+        return;
+    }
+
+    // Fatal entries may be written synchronously, after everything queued
+    // before them; this must happen outside of the read section
+    bool b_sync = (PLOG_LEVEL_FATAL == level &&
+                   PLOG_LOAD_RELAXED(&gb_fatal_flush));
+
+    if (b_sync)
+    {
+        async_flush();
+    }
+
+    const config_t* p_config  = config_enter(p_state, p_logger);
+    bool            b_degrade = p_config->b_degrade;
+
+    // Skip formatting entirely if no appender accepts this level; sampling
+    // and degradation are decided here too, before anything is formatted
+    bool     b_wanted = false;
+    uint64_t skipped  = 0;
+
+    for (plog_id_t i = 0; i < PLOG_MAX_APPENDERS; i++)
+    {
+        if (!appender_enabled(p_config, i) ||
+            p_config->appenders[i].level > level)
+        {
+            continue;
+        }
+
+        if (b_degrade && appender_level(p_config, i) > level)
+        {
+            PLOG_COUNT(&p_state->appender_stats[i].suppressed[level], 1);
+            skipped |= UINT64_C(1) << i;
+            continue;
+        }
+
+        if (!sample_keep(p_state, PLOG_SAMPLE_APPENDER,
+                         p_config->appenders[i].sample_threshold[level]))
+        {
+            PLOG_COUNT(&p_state->appender_stats[i].sampled, 1);
+            skipped |= UINT64_C(1) << i;
+            continue;
+        }
+
+        b_wanted = true;
+    }
+
+    if (!b_wanted)
+    {
+        // Sampled and suppressed entries are counted per appender
+        if (0 == skipped)
+        {
+            PLOG_COUNT(&p_state->filtered, 1);
+        }
+
+        config_exit(p_state);
+
+        if (b_degrade)
+        {
+            degrade_tick(p_state, p_logger, 0);
+        }
+
+        return;
+    }
+
+    log_entry_t log;
+
+    log.level       = level;
+    log.time        = time(0);
+
+    site_resolve(p_site, p_config, &log);
+
+    log.sample_keep = (keep < of) ? keep : 1;
+    log.sample_of   = (keep < of) ? of : 1;
+    log.skipped     = skipped;
+
+    log.p_ctx        = p_state->ctx.prefix;
+    log.ctx_len      = p_state->ctx.prefix_len;
+    log.p_ctx_pool   = p_state->ctx.pool;
+    log.ctx_pool_len = p_state->ctx.pool_len;
+    log.ctx_count    = p_state->ctx.count;
+
+    // Format the message once for all appenders
+    char p_msg_str[PLOG_MSG_STACK_LEN];
+
+    format_msg(p_state, p_msg_str, sizeof(p_msg_str), &log, p_format, p_udata);
+
+    // The entry's last clock reading, reused by degradation
+    uint64_t now = 0;
+
+    if (b_sync || !async_write(p_state, p_logger, p_config, &log))
+    {
+        now = write_entry(p_state, p_config, &log);
+    }
+
+    config_exit(p_state);
+
+    if (b_sync)
+    {
+        appenders_flush(p_logger);
+    }
+
+    spill_trim(&p_state->msg_spill);
+
+    if (b_degrade)
+    {
+        degrade_tick(p_state, p_logger, now);
+    }
+}
+
+void
+plog_write (plog_level_t level, const char* file, unsigned line,
+                                const char* func, const char* p_fmt, ...)
+{
+    // A throwaway call site; nothing is cached between calls
+    plog_site_t site = { file, func, line, 0, 0, 0 };
+
+    va_fmt_t va;
+    va.p_fmt = p_fmt;
+
+    va_start(va.args, p_fmt);
+    write_msg(&g_logger, &site, level, 1, 1, format_va, &va);
+    va_end(va.args);
+}
+
+void
+plog_write_site (plog_site_t* p_site, plog_level_t level,
+                 const char* p_fmt, ...)
+{
+    va_fmt_t va;
+    va.p_fmt = p_fmt;
+
+    va_start(va.args, p_fmt);
+    write_msg(&g_logger, p_site, level, 1, 1, format_va, &va);
+    va_end(va.args);
+}
+
+void
+plog_logger_write_site (plog_logger_t* p_logger, plog_site_t* p_site,
+                        plog_level_t level, const char* p_fmt, ...)
+{
+    va_fmt_t va;
+    va.p_fmt = p_fmt;
+
+    va_start(va.args, p_fmt);
+    write_msg(p_logger, p_site, level, 1, 1, format_va, &va);
+    va_end(va.args);
+}
+
+void
+plog_write_sampled (plog_site_t* p_site, plog_level_t level, uint32_t keep,
+                    uint32_t of, const char* p_fmt, ...)
+{
+    // Rate must be valid
+    PLOG_ASSERT(0 != of);
+
+    va_fmt_t va;
+    va.p_fmt = p_fmt;
+
+    va_start(va.args, p_fmt);
+    write_msg(&g_logger, p_site, level, keep, of, format_va, &va);
+    va_end(va.args);
+}
+
+void
+plog_write_fmt (plog_site_t* p_site, plog_level_t level,
+                plog_format_fn p_format, void* p_udata)
+{
+    PLOG_ASSERT(NULL != p_format);
+
+    write_msg(&g_logger, p_site, level, 1, 1, p_format, p_udata);
+}
+
+void
+plog_logger_write_fmt (plog_logger_t* p_logger, plog_site_t* p_site,
+                       plog_level_t level, plog_format_fn p_format,
+                       void* p_udata)
+{
+    PLOG_ASSERT(NULL != p_logger);
+    PLOG_ASSERT(NULL != p_format);
+
+    write_msg(p_logger, p_site, level, 1, 1, p_format, p_udata);
+}
+
+/*
+ * Hex dumps
+ */
+
+#define PLOG_HEX_ROW       16 // Bytes per row
+#define PLOG_HEX_ROW_MAX   80 // Row buffer size
+
+// Length of a row of n bytes, including the leading newline
+#define PLOG_HEX_ROW_LEN(n) (63 + (n))
+
+typedef struct
+{
+    const uint8_t* p_data;
+    size_t         len;
+} hexdump_t;
+
+/*
+ * Converts a full row of 16 bytes into 32 lowercase hex digits and 16
+ * printable characters ('.' for the rest).
+ */
+static void
+hex_convert (const uint8_t* p_in, char* p_hex, char* p_ascii)
+{
+#ifdef __SSE2__
+    __m128i v;
+    memcpy(&v, p_in, sizeof(v));
+
+    // Split the nibbles, then interleave them so high comes before low
+    const __m128i nibble = _mm_set1_epi8(0x0f);
+    __m128i hi = _mm_and_si128(_mm_srli_epi16(v, 4), nibble);
+    __m128i lo = _mm_and_si128(v, nibble);
+
+    __m128i digits[2] = { _mm_unpacklo_epi8(hi, lo),
+                          _mm_unpackhi_epi8(hi, lo) };
+
+    for (int i = 0; i < 2; i++)
+    {
+        // '0' + d, plus the distance to 'a' for d > 9
+        __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(digits[i],
+                                                     _mm_set1_epi8(9)),
+                                      _mm_set1_epi8('a' - '0' - 10));
+
+        digits[i] = _mm_add_epi8(_mm_add_epi8(digits[i], _mm_set1_epi8('0')),
+                                 alpha);
+    }
+
+    memcpy(p_hex, digits, sizeof(digits));
+
+    // Signed compares, so bytes from 0x80 up are not printable either
+    __m128i printable = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8(0x1f)),
+                                      _mm_cmplt_epi8(v, _mm_set1_epi8(0x7f)));
+
+    __m128i ascii = _mm_or_si128(_mm_and_si128(printable, v),
+                                 _mm_andnot_si128(printable,
+                                                  _mm_set1_epi8('.')));
+
+    memcpy(p_ascii, &ascii, sizeof(ascii));
+#else
+    static const char digits[] = "0123456789abcdef";
+
+    for (size_t i = 0; i < PLOG_HEX_ROW; i++)
+    {
+        p_hex[2 * i]     = digits[p_in[i] >> 4];
+        p_hex[2 * i + 1] = digits[p_in[i] & 0x0f];
+        p_ascii[i]       = (p_in[i] >= 0x20 && p_in[i] < 0x7f) ? (char)p_in[i]
+                                                               : '.';
+    }
+#endif
+}
+
+/*
+ * Formats a row of up to 16 bytes, preceded by a newline.
+ */
+static void
+hex_row (char* p_row, const uint8_t* p_data, size_t offset, size_t n)
+{
+    static const char digits[] = "0123456789abcdef";
+
+    uint8_t in[PLOG_HEX_ROW] = { 0 };
+    char    hex[PLOG_HEX_ROW * 2];
+    char    ascii[PLOG_HEX_ROW];
+
+    memcpy(in, p_data, n);
+    hex_convert(in, hex, ascii);
+
+    size_t len = 0;
+
+    p_row[len++] = '\n';
+
+    for (int shift = 28; shift >= 0; shift -= 4)
+    {
+        p_row[len++] = digits[(offset >> shift) & 0x0f];
+    }
+
+    p_row[len++] = ' ';
+
+    for (size_t i = 0; i < PLOG_HEX_ROW; i++)
+    {
+        p_row[len++] = ' ';
+
+        if (PLOG_HEX_ROW / 2 == i)
+        {
+            p_row[len++] = ' ';
+        }
+
+        p_row[len++] = (i < n) ? hex[2 * i]     : ' ';
+        p_row[len++] = (i < n) ? hex[2 * i + 1] : ' ';
+    }
+
+    p_row[len++] = ' ';
+    p_row[len++] = ' ';
+    p_row[len++] = '|';
+
+    memcpy(p_row + len, ascii, n);
+    len += n;
+
+    p_row[len] = '|';
+}
+
+/*
+ * Formatter of plog_write_hexdump.
+ */
+static size_t
+format_hexdump (char* p_buf, size_t cap, void* p_udata)
+{
+    const hexdump_t* p_dump = (const hexdump_t*)p_udata;
+
+    char   row[PLOG_HEX_ROW_MAX];
+    int    hdr = snprintf(row, sizeof(row), "%zu bytes", p_dump->len);
+    size_t len = (hdr > 0) ? (size_t)hdr : 0;
+    size_t out = (len < cap) ? len : (cap ? cap - 1 : 0);
+
+    memcpy(p_buf, row, out);
+
+    for (size_t offset = 0; offset < p_dump->len; offset += PLOG_HEX_ROW)
+    {
+        size_t n = p_dump->len - offset;
+
+        if (n > PLOG_HEX_ROW)
+        {
+            n = PLOG_HEX_ROW;
+        }
+
+        size_t row_len = PLOG_HEX_ROW_LEN(n);
+
+        if (len + row_len < cap)
+        {
+            hex_row(p_buf + len, p_dump->p_data + offset, offset, n);
+            out = len + row_len;
+        }
+        else if (len < cap)
+        {
+            // Keep the part of the row that fits
+            hex_row(row, p_dump->p_data + offset, offset, n);
+            memcpy(p_buf + len, row, cap - 1 - len);
+            out = cap - 1;
+        }
+
+        len += row_len;
+    }
+
+    if (cap > 0)
+    {
+        p_buf[out] = '\0';
+    }
+
+    return len;
+}
+
+void
+plog_write_hexdump (plog_site_t* p_site, plog_level_t level,
+                    const void* p_data, size_t len)
+{
+    PLOG_ASSERT(NULL != p_data || 0 == len);
+
+    hexdump_t dump = { (const uint8_t*)p_data, len };
+
+    write_msg(&g_logger, p_site, level, 1, 1, format_hexdump, &dump);
 }
 
 /* EoF */
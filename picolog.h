@@ -33,10 +33,16 @@
 #include <assert.h>  // assert
 #endif
 
+#ifndef PLOG_MALLOC
+#include <stdlib.h>  // malloc, free
+#endif
+
 #include <stdarg.h>  // ...
 #include <stdbool.h> // bool, true, false
 #include <stddef.h>  // NULL, size_t
+#include <stdint.h>  // uint64_t
 #include <stdio.h>   // FILE
+#include <time.h>    // time_t
 
 #ifdef __cplusplus
 extern "C" {
@@ -49,14 +55,130 @@ extern "C" {
 #define PLOG_MAX_APPENDERS 16
 #endif
 
+/*
+ * Per-thread context limits: number of fields and bytes of keys and values
+ * (each including a terminator).
+ */
+#ifndef PLOG_CTX_MAX_FIELDS
+#define PLOG_CTX_MAX_FIELDS 8
+#endif
+
+#ifndef PLOG_CTX_LEN
+#define PLOG_CTX_LEN 256
+#endif
+
+/*
+ * Maximum length of the source root set with plog_set_src_root.
+ */
+#ifndef PLOG_SRC_ROOT_LEN
+#define PLOG_SRC_ROOT_LEN 256
+#endif
+
+/*
+ * Source file name recorded by the logging macros. By default this is
+ * __FILE__. Define PLOG_FILE_BASENAME to record only the file name (where the
+ * compiler provides __FILE_NAME__), or PLOG_SRC_PREFIX_LEN to strip that many
+ * leading characters (e.g. the length of the build root including the final
+ * '/') at compile time. Paths no longer than the prefix are left alone.
+ */
+#ifndef PLOG_FILE
+#if defined(PLOG_FILE_BASENAME) && defined(__FILE_NAME__)
+#define PLOG_FILE __FILE_NAME__
+#elif defined(PLOG_SRC_PREFIX_LEN)
+#define PLOG_FILE \
+        (__FILE__ + (sizeof(__FILE__) > (PLOG_SRC_PREFIX_LEN) + 1 ? \
+                     (PLOG_SRC_PREFIX_LEN) : 0))
+#else
+#define PLOG_FILE __FILE__
+#endif
+#endif
+
+#if PLOG_MAX_APPENDERS > 64
+#error "PLOG_MAX_APPENDERS must not exceed 64"
+#endif
+
+#if PLOG_SRC_ROOT_LEN > 65536
+#error "PLOG_SRC_ROOT_LEN must not exceed 65536"
+#endif
+
+/*
+ * Maximum length of a formatted message. Longer messages are truncated and
+ * counted in plog_stats_t. Zero (the default) means no limit.
+ */
 #ifndef PLOG_MAX_MSG_LENGTH
-#define PLOG_MAX_MSG_LENGTH 1024
+#define PLOG_MAX_MSG_LENGTH 0
 #endif
 
 #ifndef PLOG_ASSERT
 #define PLOG_ASSERT(expr)   assert(expr)
 #endif
 
+/*
+ * Allocator hooks. Must be thread safe when async mode is used. Define both
+ * or neither.
+ */
+#ifndef PLOG_MALLOC
+#define PLOG_MALLOC(size)   malloc(size)
+#define PLOG_FREE(ptr)      free(ptr)
+#endif
+
+/*
+ * Async mode arena tuning. Each producing thread carves entry records out of
+ * blocks of PLOG_ARENA_BLOCK_SIZE bytes and holds at most
+ * PLOG_ARENA_MAX_BLOCKS of them in flight; entries beyond that are dropped.
+ * Up to PLOG_ARENA_KEEP_BLOCKS recycled blocks are cached per thread.
+ */
+#ifndef PLOG_ARENA_BLOCK_SIZE
+#define PLOG_ARENA_BLOCK_SIZE (64 * 1024)
+#endif
+
+#ifndef PLOG_ARENA_MAX_BLOCKS
+#define PLOG_ARENA_MAX_BLOCKS 64
+#endif
+
+#ifndef PLOG_ARENA_KEEP_BLOCKS
+#define PLOG_ARENA_KEEP_BLOCKS 4
+#endif
+
+/*
+ * Sharded async mode tuning. Each producing thread queues up to
+ * PLOG_RING_SIZE entries (a power of two) in its own ring; entries beyond
+ * that are dropped. An idle writer thread polls PLOG_ASYNC_SPIN times before
+ * it goes to sleep (both async modes).
+ */
+#ifndef PLOG_RING_SIZE
+#define PLOG_RING_SIZE 4096
+#endif
+
+#ifndef PLOG_ASYNC_SPIN
+#define PLOG_ASYNC_SPIN 1000
+#endif
+
+/*
+ * Length of the window over which level degradation measures pressure (see
+ * plog_set_degrade), in milliseconds.
+ */
+#ifndef PLOG_DEGRADE_WINDOW_MS
+#define PLOG_DEGRADE_WINDOW_MS 100
+#endif
+
+/*
+ * Number of windows in a row without pressure before a degraded level is
+ * lowered by one step.
+ */
+#ifndef PLOG_DEGRADE_HOLD
+#define PLOG_DEGRADE_HOLD 10
+#endif
+
+#if 0 != (PLOG_RING_SIZE & (PLOG_RING_SIZE - 1))
+#error "PLOG_RING_SIZE must be a power of two"
+#endif
+
+/*
+ * Number of buckets in the appender latency histograms.
+ */
+#define PLOG_HIST_BUCKETS 64
+
 /**
  * These codes allow different layers of granularity when logging. See the
  * documentation of the `plog_set_level` function for more information.
@@ -78,17 +200,136 @@ typedef enum
  */
 typedef void (*plog_appender_fn)(const char* p_entry, void* p_udata);
 
+/**
+ * A context field (see `plog_ctx_push`).
+ */
+typedef struct
+{
+    const char* key;
+    const char* value;
+} plog_field_t;
+
+/**
+ * A log entry as passed to an entry appender. The strings are only valid for
+ * the duration of the call.
+ */
+typedef struct
+{
+    plog_level_t level;
+    const char*  file;      // Source file
+    unsigned     line;      // Source line
+    const char*  func;      // Function name
+    time_t       time;      // Time the entry was written
+    const char*  msg;       // Formatted message (no newline)
+    size_t       msg_len;
+    const char*  entry;     // Entry rendered with the appender's layout
+    size_t       entry_len; // Including the trailing newline
+    uint64_t     sample_keep; // Sampling rate: `sample_keep` out of every
+    uint64_t     sample_of;   // `sample_of` entries were kept (1/1 if none)
+    const plog_field_t* fields; // Context of the writing thread
+    size_t       field_count;
+} plog_entry_t;
+
+/**
+ * Entry appender function definition. Like `plog_appender_fn`, but receives
+ * the entry's fields as well as the rendered text, for appenders that need
+ * the level or source location (syslog, structured output, ...).
+ */
+typedef void (*plog_entry_fn)(const plog_entry_t* p_entry, void* p_udata);
+
 /**
  *  Lock function definition. This is called during plog_write. Adapted
     from https://github.com/rxi/log.c/blob/master/src/log.h
  */
 typedef void (*plog_lock_fn)(bool lock, void *p_udata);
 
+/**
+ * Message formatter definition. Writes the message into `p_buf`, truncating
+ * it to `cap - 1` characters plus a terminator, and returns its full length
+ * like snprintf. It is only called if an appender accepts the entry, and is
+ * called a second time with a larger buffer if the message did not fit.
+ */
+typedef size_t (*plog_format_fn)(char* p_buf, size_t cap, void* p_udata);
+
+/**
+ * Appender flush function definition. Called by plog_flush with the
+ * appender's user data, to push out anything the appender buffers.
+ */
+typedef void (*plog_flush_fn)(void* p_udata);
+
 /**
  * Identifies a registered appender.
  */
 typedef size_t plog_id_t;
 
+/**
+ * A logger instance: its own appenders, levels and configuration lock. The
+ * functions without a logger argument operate on the default instance, which
+ * always exists. Appender IDs are unique across instances, so the functions
+ * taking an ID (plog_set_level, plog_remove_appender, ...) apply to whichever
+ * instance registered the appender.
+ */
+typedef struct plog_logger_s plog_logger_t;
+
+/**
+ * A logging call site. The logging macros keep one in static storage per call
+ * site so the file and function names are measured, and the source root
+ * stripped, once rather than on every entry. Fields after `line` are caches
+ * owned by the logger.
+ */
+typedef struct
+{
+    const char* file;
+    const char* func;
+    unsigned    line;
+    size_t      file_len;  // 0 until measured
+    size_t      func_len;  // 0 until measured
+    uint64_t    root;      // Source root generation << 16 | stripped length
+} plog_site_t;
+
+/**
+ * Per appender statistics. Counters start at zero when the appender is
+ * registered.
+ *
+ * `hist` is a log-linear histogram of `write_ns` per entry, in nanoseconds.
+ * Each power of two is split into two buckets; use `plog_hist_bucket_ns` to
+ * get the lower bound of a bucket. The times and `hist` stay zero in a build
+ * with PLOG_NO_STATS, which leaves out the clock readings they need.
+ *
+ * `level` is not a counter: it is the level the appender currently accepts,
+ * which is above the one set by `plog_set_level` while the appender is
+ * degraded (see `plog_set_degrade`).
+ */
+typedef struct
+{
+    uint64_t written;      // Entries passed to the appender
+    uint64_t filtered;     // Entries below the appender's level
+    uint64_t bytes;        // Bytes passed to the appender
+    uint64_t drops;        // Entries dropped before reaching the appender
+    uint64_t sampled;      // Entries skipped by the appender's sampling
+    uint64_t truncations;  // Entries written with a truncated message
+    uint64_t lock_wait_ns; // Time spent acquiring the appender lock
+    uint64_t write_ns;     // Time spent rendering the entry and inside the
+                           // appender function
+    uint64_t suppressed[PLOG_LEVEL_COUNT]; // Entries suppressed by level
+                                           // degradation, by level
+    uint64_t hist[PLOG_HIST_BUCKETS];
+    plog_level_t level;    // Effective level
+} plog_appender_stats_t;
+
+/**
+ * Logger statistics. Counters are kept per thread and summed when read.
+ */
+typedef struct
+{
+    uint64_t msg_spills;      // Messages too long for the stack buffer
+    uint64_t msg_truncations; // Messages cut short (length limit/no memory)
+    uint64_t async_drops;     // Entries dropped because the arena was full
+    uint64_t filtered;        // Entries no appender accepted
+    uint64_t sampled;         // Entries skipped by call site sampling
+    plog_appender_stats_t appenders[PLOG_MAX_APPENDERS]; // Indexed by ID
+} plog_stats_t;
+
 /**
   * Converts a string to the corresponding log level
   */
@@ -104,6 +345,67 @@ void plog_enable(void);
  */
 void plog_disable(void);
 
+/**
+ * Creates a logger instance. It starts enabled, without appenders, and with
+ * the default instance's source root.
+ *
+ * @return The instance, or NULL if memory is exhausted
+ */
+plog_logger_t* plog_create(void);
+
+/**
+ * Destroys a logger instance, unregistering its appenders. Entries queued in
+ * async mode are delivered first. The instance must not be written to, nor
+ * its appender IDs used, during or after this call.
+ *
+ * @param p_logger The instance (not the default instance)
+ */
+void plog_destroy(plog_logger_t* p_logger);
+
+/**
+ * Returns the default logger instance.
+ */
+plog_logger_t* plog_default(void);
+
+/**
+ * Enables logging on an instance. NOTE: Instances are enabled on creation.
+ */
+void plog_logger_enable(plog_logger_t* p_logger);
+
+/**
+ * Disables logging on an instance.
+ */
+void plog_logger_disable(plog_logger_t* p_logger);
+
+/**
+ * Returns true if at least one enabled appender of the instance accepts
+ * messages at `level` (see plog_is_enabled).
+ */
+bool plog_logger_is_enabled(plog_logger_t* p_logger, plog_level_t level);
+
+/**
+ * Registers an appender with an instance (see plog_add_appender).
+ */
+plog_id_t plog_logger_add_appender(plog_logger_t* p_logger,
+                                   plog_appender_fn p_appender,
+                                   plog_level_t level,
+                                   void* p_udata);
+
+/**
+ * Registers an entry appender with an instance (see plog_add_entry_appender).
+ */
+plog_id_t plog_logger_add_entry_appender(plog_logger_t* p_logger,
+                                         plog_entry_fn p_entry_fn,
+                                         plog_level_t level,
+                                         void* p_udata);
+
+/**
+ * Registers an output stream appender with an instance (see plog_add_stream).
+ */
+plog_id_t plog_logger_add_stream(plog_logger_t* p_logger,
+                                 FILE* p_stream,
+                                 plog_level_t level);
+
 /**
  * Registers (adds appender to logger) and enables the specified appender. An
  * appender writes a log entry to an output stream. This could be a console,
@@ -126,6 +428,22 @@ plog_id_t plog_add_appender(plog_appender_fn p_appender,
                             plog_level_t level,
                             void* p_udata);
 
+/**
+ * Registers an entry appender. Entry appenders behave exactly like appenders
+ * registered with `plog_add_appender` (levels, layouts, locks, statistics)
+ * but receive a `plog_entry_t`.
+ *
+ * @param p_entry_fn The entry appender function
+ * @param level      The appender's log level
+ * @param p_udata    A pointer supplied to the appender function
+ *
+ * @return           An identifier for the appender. This ID is valid until the
+ *                   appender is unregistered.
+ */
+plog_id_t plog_add_entry_appender(plog_entry_fn p_entry_fn,
+                                  plog_level_t level,
+                                  void* p_udata);
+
 /**
  * Registers an output stream appender.
  *
@@ -138,7 +456,13 @@ plog_id_t plog_add_appender(plog_appender_fn p_appender,
 plog_id_t plog_add_stream(FILE* p_stream, plog_level_t level);
 
 /**
- * Unregisters appender (removes the appender from the logger).
+ * Unregisters appender (removes the appender from the logger). Once this
+ * returns the appender is no longer called, so its user data may be freed.
+ *
+ * Configuration functions (plog_add_appender, plog_set_level, ...) may be
+ * called concurrently with logging. Each change is published atomically; it
+ * waits for writes already in progress, so it must not be made from inside an
+ * appender while another thread is changing the configuration.
  *
  * @param id The appender to unregister
  */
@@ -164,14 +488,52 @@ void plog_disable_appender(plog_id_t id);
  */
 void plog_set_lock(plog_id_t id, plog_lock_fn p_lock, void* p_udata);
 
+/**
+ * Sets the function plog_flush calls to flush the appender's buffers. It is
+ * called with the appender's user data, under the appender's lock.
+ *
+ * @param id      The appender id
+ * @param p_flush The flush function, or NULL for none
+ */
+void plog_set_flush(plog_id_t id, plog_flush_fn p_flush);
+
 /**
  * Sets the logging level. Only those messages of equal or higher priority
- * (severity) than this value will be logged.
+ * (severity) than this value will be logged. Level degradation (see
+ * plog_set_degrade) may temporarily raise the effective level above it.
  *
  * @param level The new appender logging threshold.
  */
 void plog_set_level(plog_id_t id, plog_level_t level);
 
+/**
+ * Turns on adaptive level degradation. While the appender is under pressure,
+ * its effective level is raised by one step every PLOG_DEGRADE_WINDOW_MS, up
+ * to `max_level`, so e.g. DEBUG entries and then INFO entries are suppressed
+ * before they are formatted. Once the pressure is gone for PLOG_DEGRADE_HOLD
+ * windows in a row, the level is lowered by one step, and so on; a window in
+ * which the appender received nothing counts as one without pressure. When
+ * the level is back where plog_set_level put it, a single WARN entry reports
+ * how many entries were suppressed at each level.
+ *
+ * The appender is under pressure when, over a window, the time spent per
+ * entry waiting for its lock and inside the appender function averages more
+ * than `latency_ns`, or when more than `queue_depth` async mode records are
+ * waiting for the writer thread or records were dropped. The pressure is
+ * gone once both are below half their limits. The effective level is
+ * reported in the `level` field of the appender statistics. Degradation
+ * needs a monotonic clock, i.e. a build with threads, and `latency_ns` has no
+ * effect with PLOG_NO_STATS.
+ *
+ * @param id          The appender id
+ * @param max_level   Highest effective level; degradation is off while it is
+ *                    not above the appender's level
+ * @param latency_ns  Mean latency limit in nanoseconds, 0 for none
+ * @param queue_depth Queue depth limit in records, 0 for none
+ */
+void plog_set_degrade(plog_id_t id, plog_level_t max_level,
+                      uint64_t latency_ns, size_t queue_depth);
+
 /**
  * Sets the appender timestamp format according to:
  * https://man7.org/linux/man-pages/man3/strftime.3.html
@@ -257,52 +619,352 @@ void plog_func_on(plog_id_t id);
  */
 void plog_func_off(plog_id_t id);
 
+/**
+ * Turns context reporting on for the specified appender: the writing
+ * thread's context is added before the message as "[key=value ...] ".
+ * NOTE: Off by default.
+ *
+ * @param id The appender id
+ */
+void plog_ctx_on(plog_id_t id);
+
+/**
+ * Turns context reporting off for the specified appender.
+ *
+ * @param id The appender id
+ */
+void plog_ctx_off(plog_id_t id);
+
+/**
+ * Sets a layout pattern for the specified appender, replacing the layout
+ * implied by the timestamp/level/file/function flags. The pattern is compiled
+ * once, so writing an entry only copies pre-rendered pieces. Supported
+ * fields:
+ *
+ *   %T  Timestamp (see plog_set_time_fmt)
+ *   %L  Level (colored if colors are on)
+ *   %F  Filename
+ *   %l  Line number
+ *   %f  Function name
+ *   %m  Message
+ *   %C  Context of the writing thread, "key=value ..."
+ *   %r  Sampling rate, e.g. "1/100" ("1/1" if the entry was not sampled)
+ *   %%  A literal '%'
+ *
+ * A newline is appended to every entry.
+ *
+ * @param id      The appender id
+ * @param pattern The layout pattern, e.g. "%T %L %F:%l %m", or NULL to go
+ *                back to the flag layout
+ *
+ * @return False if the pattern is too long
+ */
+bool plog_set_layout(plog_id_t id, const char* pattern);
+
+/**
+ * Samples entries of a level: only `keep` out of every `of` entries at that
+ * level are written to the appender (1, 100 keeps 1 in 100; 5, 100 keeps
+ * 5%). The decision is made before the message is formatted, from a
+ * per-thread random number, or from the thread's sample key if one is set.
+ * Entries that are written carry the rate (see `%r` and `plog_entry_t`);
+ * the flag layout prefixes the message with it, e.g. "[1/100] ".
+ *
+ * @param id    The appender id
+ * @param level The level to sample
+ * @param keep  Entries kept out of every `of`; `keep >= of` turns sampling off
+ * @param of    Must not be zero
+ */
+void plog_set_sampling(plog_id_t id, plog_level_t level,
+                       uint32_t keep, uint32_t of);
+
+/**
+ * Sets a source root prefix to strip from file names, e.g. the absolute path
+ * of the source tree including the final '/'. File names that do not start
+ * with it are left alone. Each call site checks the prefix once, not on every
+ * entry.
+ *
+ * @param root The prefix, or NULL to stop stripping
+ *
+ * @return False if the prefix is PLOG_SRC_ROOT_LEN characters or longer
+ */
+bool plog_set_src_root(const char* root);
+
+/**
+ * Loads settings from a configuration file and applies them all at once, as
+ * a single configuration change: logging threads see either none or all of
+ * them. Settings not in the file keep their current values. The format is
+ * (text on the right of the settings describes them, it is not part of the
+ * format):
+ *
+ *   # Comment (also ';')
+ *   src_root = /home/build/project/
+ *
+ *   [*]                       Every registered appender
+ *   level = INFO
+ *
+ *   [1]                       Appender ID 1
+ *   level      = DEBUG        TRACE, DEBUG, INFO, WARN, ERROR or FATAL
+ *   enabled    = on           on/off, true/false or yes/no
+ *   colors     = off
+ *   timestamp  = on
+ *   show_level = on           See plog_level_on
+ *   file       = on
+ *   func       = off
+ *   ctx        = on
+ *   time_fmt   = %H:%M:%S
+ *   layout     = %T %L %m     Empty for the flag layout
+ *   sampling   = DEBUG 1/100  Level, keep/of (see plog_set_sampling)
+ *
+ * @param path The file path
+ *
+ * @return False if the file cannot be read or contains an invalid line (an
+ *         unknown key, an invalid value, or an unregistered appender); the
+ *         configuration is then left unchanged
+ */
+bool plog_load_config(const char* path);
+
+/**
+ * Loads a configuration file (see plog_load_config), then starts a thread
+ * that reloads it whenever it is written or replaced. A reload that fails is
+ * reported as an ERROR entry and leaves the configuration unchanged. Calling
+ * it again watches the new path instead.
+ *
+ * @param path The file path
+ *
+ * @return False if the file could not be loaded, or watching is unavailable
+ *         (Linux only, built with threads)
+ */
+bool plog_watch_config(const char* path);
+
+/**
+ * Stops the thread started by plog_watch_config.
+ */
+void plog_unwatch_config(void);
+
+/**
+ * Sets the calling thread's sample key, e.g. a request ID. While a key is
+ * set, sampling decisions on the thread are derived from a hash of the key
+ * instead of random numbers, so a request's entries are either all kept or
+ * all skipped at a given rate, in every process using the same key. Call
+ * site and appender sampling hash the key separately, so combined rates
+ * multiply as with random sampling.
+ *
+ * @param key The key, or NULL to go back to random sampling
+ */
+void plog_set_sample_key(const char* key);
+
+/**
+ * Pushes a field onto the calling thread's context (mapped diagnostic
+ * context). The key and value are copied. The context is rendered once per
+ * change, so appenders with context reporting on only copy it; entry
+ * appenders receive it as fields.
+ *
+ * @param key   The field name
+ * @param value The field value
+ *
+ * @return False if the context is full (PLOG_CTX_MAX_FIELDS fields or
+ *         PLOG_CTX_LEN bytes)
+ */
+bool plog_ctx_push(const char* key, const char* value);
+
+/**
+ * Pops the most recently pushed field off the calling thread's context.
+ */
+void plog_ctx_pop(void);
+
+/**
+ * Clears the calling thread's context.
+ */
+void plog_ctx_clear(void);
+
+/**
+ * Starts async mode. Entries are copied into per-thread arenas and handed to
+ * a writer thread, which formats them and calls the appenders. Appenders are
+ * then only ever called from the writer thread.
+ *
+ * @return False if async mode is unavailable (built without threads) or the
+ *         writer thread could not be started.
+ */
+bool plog_async_start(void);
+
+/**
+ * Starts async mode with per-thread queues. Each thread queues its entries in
+ * its own single producer ring, stamped with a monotonic time, so producers
+ * never contend with each other. The writer thread merges the rings by time,
+ * so entries are still delivered in the order they were written.
+ *
+ * @return False if async mode is unavailable, the writer thread could not be
+ *         started, or async mode is already running with a shared queue.
+ */
+bool plog_async_start_sharded(void);
+
+/**
+ * Stops async mode. Entries queued before the call are delivered first, also
+ * by threads writing concurrently, which then continue synchronously.
+ */
+void plog_async_stop(void);
+
+/**
+ * Blocks until all entries queued by this thread before the call have been
+ * delivered, then calls the appenders' flush functions.
+ */
+void plog_flush(void);
+
+/**
+ * When on, FATAL entries are written synchronously: entries queued in async
+ * mode are delivered first, and the appenders are flushed before the logging
+ * call returns. Off by default.
+ */
+void plog_set_fatal_flush(bool b_flush);
+
+/**
+ * Installs handlers for SIGSEGV, SIGABRT, SIGBUS and SIGFPE. On a crash the
+ * handler writes the entries still queued in async mode to `fd`, oldest
+ * first, followed by a backtrace (glibc only), then passes the signal on to
+ * the previous handler or default action. Only async-signal-safe calls are
+ * used, so appenders are bypassed; entries already handed to an appender
+ * that buffers them are not recovered. Calling it again changes `fd`.
+ *
+ * @param fd Descriptor to write to, e.g. STDERR_FILENO or an open log file
+ *
+ * @return False if unavailable (built without threads) or a handler could
+ *         not be installed
+ */
+bool plog_crash_install(int fd);
+
+/**
+ * Restores the signal handlers replaced by plog_crash_install.
+ */
+void plog_crash_uninstall(void);
+
+/**
+ * Retrieves a snapshot of the logger statistics.
+ *
+ * @param p_stats Receives the statistics
+ */
+void plog_get_stats(plog_stats_t* p_stats);
+
+/**
+ * Returns the lower bound, in nanoseconds, of a latency histogram bucket.
+ *
+ * @param bucket The bucket index (less than PLOG_HIST_BUCKETS)
+ */
+uint64_t plog_hist_bucket_ns(size_t bucket);
+
+/**
+ * Writes a message through a call site kept in static storage. The logging
+ * macros below expand to a statement, not an expression; call plog_write
+ * where an expression is needed.
+ */
+#define PLOG_WRITE_SITE(level, ...) \
+        do \
+        { \
+            static plog_site_t plog_site_ = { PLOG_FILE, __func__, __LINE__, \
+                                              0, 0, 0 }; \
+            plog_write_site(&plog_site_, level, __VA_ARGS__); \
+        } while (0)
+
 /**
  * Writes a TRACE level message to the log. Usage is similar to printf (i.e.
  * PLOG_TRACE(format, args...))
  */
-#define plog_trace(...) \
-        plog_write(PLOG_LEVEL_TRACE, __FILE__, __LINE__, __func__, __VA_ARGS__)
+#define plog_trace(...) PLOG_WRITE_SITE(PLOG_LEVEL_TRACE, __VA_ARGS__)
 
 /**
  * Writes a DEBUG level message to the log. Usage is similar to printf (i.e.
  * PLOG_DEBUG(format, args...))
  */
-#define plog_debug(...) \
-        plog_write(PLOG_LEVEL_DEBUG, __FILE__, __LINE__, __func__, __VA_ARGS__)
+#define plog_debug(...) PLOG_WRITE_SITE(PLOG_LEVEL_DEBUG, __VA_ARGS__)
 
 /**
  * Writes an INFO level message to the log. Usage is similar to printf (i.e.
  * PLOG_INFO(format, args...))
  */
-#define plog_info(...) \
-        plog_write(PLOG_LEVEL_INFO,  __FILE__, __LINE__, __func__, __VA_ARGS__)
+#define plog_info(...)  PLOG_WRITE_SITE(PLOG_LEVEL_INFO,  __VA_ARGS__)
 
 /**
  * Writes a WARN level message to the log. Usage is similar to printf (i.e.
  * PLOG_WARN(format, args...))
  */
-#define plog_warn(...) \
-        plog_write(PLOG_LEVEL_WARN,  __FILE__, __LINE__, __func__, __VA_ARGS__)
+#define plog_warn(...)  PLOG_WRITE_SITE(PLOG_LEVEL_WARN,  __VA_ARGS__)
 
 /**
  * Writes a ERROR level message to the log. Usage is similar to printf (i.e.
  * PLOG_ERROR(format, args...))
  */
-#define plog_error(...) \
-        plog_write(PLOG_LEVEL_ERROR, __FILE__, __LINE__, __func__, __VA_ARGS__)
+#define plog_error(...) PLOG_WRITE_SITE(PLOG_LEVEL_ERROR, __VA_ARGS__)
 
 /**
  * Writes a FATAL level message to the log.. Usage is similar to printf (i.e.
  * PLOG_FATAL(format, args...))
  */
-#define plog_fatal(...) \
-        plog_write(PLOG_LEVEL_FATAL, __FILE__, __LINE__, __func__, __VA_ARGS__)
+#define plog_fatal(...) PLOG_WRITE_SITE(PLOG_LEVEL_FATAL, __VA_ARGS__)
+
+/**
+ * Writes a message to a logger instance. Usage is similar to printf (i.e.
+ * plog_logger_write(p_logger, PLOG_LEVEL_INFO, format, args...))
+ */
+#define plog_logger_write(p_logger, level, ...) \
+        do \
+        { \
+            static plog_site_t plog_site_ = { PLOG_FILE, __func__, __LINE__, \
+                                              0, 0, 0 }; \
+            plog_logger_write_site(p_logger, &plog_site_, level, __VA_ARGS__); \
+        } while (0)
+
+/**
+ * Writes a message at `level`, keeping only `keep` out of every `of` calls
+ * (call site sampling). Skipped calls cost a random number and are never
+ * formatted. Usage: plog_sampled(PLOG_LEVEL_DEBUG, 1, 100, format, args...)
+ */
+#define plog_sampled(level, keep, of, ...) \
+        do \
+        { \
+            static plog_site_t plog_site_ = { PLOG_FILE, __func__, __LINE__, \
+                                              0, 0, 0 }; \
+            plog_write_sampled(&plog_site_, level, keep, of, __VA_ARGS__); \
+        } while (0)
 
+/**
+ * Internal. Lowest level accepted by an enabled appender of the default
+ * instance (PLOG_LEVEL_COUNT if none). Use plog_is_enabled instead.
+ */
+extern int plog_threshold_;
+
+/**
+ * Returns true if at least one enabled appender of the default instance
+ * accepts messages at `level`. This is a single relaxed load, cheap enough to
+ * guard expensive argument preparation at the call site.
+ *
+ * @param level The log level
+ */
+static inline bool
+plog_is_enabled (plog_level_t level)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    return (int)level >= __atomic_load_n(&plog_threshold_, __ATOMIC_RELAXED);
+#else
+    return (int)level >= plog_threshold_;
+#endif
+}
+
+/**
+ * Writes `len` bytes at `p_data` as a hex dump in the style of `hexdump -C`:
+ * a "<len> bytes" line followed by one line per 16 bytes. Nothing is
+ * formatted unless the level is enabled.
+ */
+#define plog_hexdump(level, p_data, len) \
+        do \
+        { \
+            static plog_site_t plog_site_ = { PLOG_FILE, __func__, __LINE__, \
+                                              0, 0, 0 }; \
+            plog_write_hexdump(&plog_site_, level, p_data, len); \
+        } while (0)
 
 /**
  * WARNING: It is inadvisable to call this function directly. Use the macros
- * instead.
+ * instead. Unlike the macros, this measures the file and function names and
+ * strips the source root on every call.
  */
 void plog_write(plog_level_t level,
                 const char* file,
@@ -310,6 +972,60 @@ void plog_write(plog_level_t level,
                 const char* func,
                 const char* p_fmt, ...);
 
+/**
+ * WARNING: It is inadvisable to call this function directly. Use the macros
+ * instead.
+ */
+void plog_write_site(plog_site_t* p_site,
+                     plog_level_t level,
+                     const char* p_fmt, ...);
+
+/**
+ * WARNING: It is inadvisable to call this function directly. Use the
+ * plog_logger_write macro instead.
+ */
+void plog_logger_write_site(plog_logger_t* p_logger,
+                            plog_site_t* p_site,
+                            plog_level_t level,
+                            const char* p_fmt, ...);
+
+/**
+ * WARNING: It is inadvisable to call this function directly. Use the
+ * plog_sampled macro instead.
+ */
+void plog_write_sampled(plog_site_t* p_site,
+                        plog_level_t level,
+                        uint32_t keep,
+                        uint32_t of,
+                        const char* p_fmt, ...);
+
+/**
+ * WARNING: It is inadvisable to call this function directly. It is the entry
+ * point of front-ends that format messages themselves (see picolog.hpp).
+ */
+void plog_write_fmt(plog_site_t* p_site,
+                    plog_level_t level,
+                    plog_format_fn p_format,
+                    void* p_udata);
+
+/**
+ * WARNING: It is inadvisable to call this function directly. It is
+ * `plog_write_fmt` for a logger instance.
+ */
+void plog_logger_write_fmt(plog_logger_t* p_logger,
+                           plog_site_t* p_site,
+                           plog_level_t level,
+                           plog_format_fn p_format,
+                           void* p_udata);
+
+/**
+ * WARNING: It is inadvisable to call this function directly. Use the
+ * plog_hexdump macro instead.
+ */
+void plog_write_hexdump(plog_site_t* p_site,
+                        plog_level_t level,
+                        const void* p_data,
+                        size_t len);
 
 #ifdef __cplusplus
 }
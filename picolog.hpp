@@ -0,0 +1,526 @@
+/** @file picolog.hpp
+ * Type-safe C++20 front-end for picolog.
+ */
+
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+#ifndef PICOLOG_HPP
+#define PICOLOG_HPP
+
+#if __cplusplus < 202002L
+#error "picolog.hpp requires C++20"
+#endif
+
+#include "picolog.h"
+
+#include <charconv>        // std::to_chars
+#include <concepts>        // std::convertible_to
+#include <cstdint>         // uintptr_t
+#include <cstring>         // std::memcpy
+#include <source_location> // std::source_location
+#include <string_view>     // std::string_view
+#include <type_traits>     // std::type_identity_t, ...
+
+/*
+ * Usage:
+ *
+ *     plog::info("x={} y={}", x, y);
+ *
+ * Messages go through the C core, so C and C++ code share appenders, levels,
+ * sampling, context and async mode. The format string is checked at compile
+ * time: `{}` is replaced by the next argument, `{{` and `}}` are literal
+ * braces, and the number of `{}` must match the number of arguments.
+ * Arguments are formatted by type, only if an appender accepts the entry.
+ */
+namespace plog
+{
+
+/**
+ * Bounded message writer passed to formatters. Writes what fits and counts
+ * the full length, like snprintf.
+ */
+class writer
+{
+public:
+    writer (char* p_buf, size_t cap) noexcept
+        : mp_buf(p_buf), m_cap(cap), m_len(0)
+    {
+    }
+
+    void put (const char* p_str, size_t len) noexcept
+    {
+        if (m_len + 1 < m_cap)
+        {
+            size_t room = m_cap - 1 - m_len;
+
+            std::memcpy(mp_buf + m_len, p_str, (len < room) ? len : room);
+        }
+
+        m_len += len;
+    }
+
+    void put (std::string_view str) noexcept
+    {
+        put(str.data(), str.size());
+    }
+
+    void put (char c) noexcept
+    {
+        put(&c, 1);
+    }
+
+    /**
+     * Terminates the buffer and returns the full message length.
+     */
+    size_t finish () noexcept
+    {
+        mp_buf[(m_len < m_cap) ? m_len : m_cap - 1] = '\0';
+
+        return m_len;
+    }
+
+private:
+    char*  mp_buf;
+    size_t m_cap;
+    size_t m_len;
+};
+
+/**
+ * Formatter for user types. Specialize with
+ *
+ *     static void format(plog::writer& w, const T& value);
+ */
+template <typename T>
+struct formatter;
+
+namespace detail
+{
+
+template <typename T>
+concept has_formatter = requires (writer& w, const T& value)
+{
+    formatter<T>::format(w, value);
+};
+
+template <typename T>
+void
+put_chars (writer& w, T value) noexcept
+{
+    char p_str[64];
+
+    auto res = std::to_chars(p_str, p_str + sizeof(p_str), value);
+
+    w.put(p_str, (size_t)(res.ptr - p_str));
+}
+
+template <typename T>
+void
+format_arg (writer& w, const T& value)
+{
+    if constexpr (std::is_same_v<T, bool>)
+    {
+        w.put(value ? std::string_view("true") : std::string_view("false"));
+    }
+    else if constexpr (std::is_same_v<T, char>)
+    {
+        w.put(value);
+    }
+    else if constexpr (std::is_integral_v<T> || std::is_floating_point_v<T>)
+    {
+        put_chars(w, value);
+    }
+    else if constexpr (std::is_enum_v<T>)
+    {
+        put_chars(w, static_cast<std::underlying_type_t<T>>(value));
+    }
+    else if constexpr (std::is_null_pointer_v<T>)
+    {
+        w.put("0x0", 3);
+    }
+    else if constexpr (std::is_same_v<T, const char*> ||
+                       std::is_same_v<T, char*>)
+    {
+        w.put((nullptr == value) ? std::string_view("(null)")
+                                 : std::string_view(value));
+    }
+    else if constexpr (std::is_convertible_v<const T&, std::string_view>)
+    {
+        w.put(std::string_view(value));
+    }
+    else if constexpr (std::is_pointer_v<T>)
+    {
+        w.put("0x", 2);
+
+        char p_str[2 * sizeof(void*)];
+
+        auto res = std::to_chars(p_str, p_str + sizeof(p_str),
+                                 reinterpret_cast<uintptr_t>(value), 16);
+
+        w.put(p_str, (size_t)(res.ptr - p_str));
+    }
+    else if constexpr (has_formatter<T>)
+    {
+        formatter<T>::format(w, value);
+    }
+    else
+    {
+        static_assert(sizeof(T) == 0, "no plog::formatter for argument type");
+    }
+}
+
+/*
+ * A type-erased argument.
+ */
+struct arg
+{
+    const void* p_value;
+    void      (*p_format)(writer& w, const void* p_value);
+};
+
+template <typename T>
+arg
+make_arg (const T& value) noexcept
+{
+    return { &value, [] (writer& w, const void* p_value)
+             {
+                 format_arg(w, *static_cast<const T*>(p_value));
+             } };
+}
+
+/*
+ * plog_format_fn user data.
+ */
+struct message
+{
+    std::string_view fmt;
+    const arg*       p_args;
+};
+
+inline size_t
+format (char* p_buf, size_t cap, void* p_udata)
+{
+    const message* p_msg = static_cast<const message*>(p_udata);
+
+    writer      w(p_buf, cap);
+    const arg*  p_arg = p_msg->p_args;
+    const char* p     = p_msg->fmt.data();
+    const char* p_end = p + p_msg->fmt.size();
+
+    // The format was validated at compile time
+    while (p < p_end)
+    {
+        const char* p_text = p;
+
+        while (p < p_end && '{' != *p && '}' != *p)
+        {
+            p++;
+        }
+
+        w.put(p_text, (size_t)(p - p_text));
+
+        if (p == p_end)
+        {
+            break;
+        }
+
+        if (p[0] == p[1])
+        {
+            w.put(p[0]); // {{ or }}
+        }
+        else
+        {
+            p_arg->p_format(w, p_arg->p_value);
+            p_arg++;
+        }
+
+        p += 2;
+    }
+
+    return w.finish();
+}
+
+/*
+ * Not constexpr, so calling it while checking a format string is a compile
+ * error that shows the message.
+ */
+inline void
+format_error (const char* p_reason)
+{
+    (void)p_reason;
+}
+
+consteval size_t
+count_args (std::string_view fmt)
+{
+    size_t count = 0;
+
+    for (size_t i = 0; i < fmt.size(); i++)
+    {
+        if ('{' == fmt[i])
+        {
+            if (i + 1 < fmt.size() && '{' == fmt[i + 1])
+            {
+                i++;
+            }
+            else if (i + 1 < fmt.size() && '}' == fmt[i + 1])
+            {
+                i++;
+                count++;
+            }
+            else
+            {
+                format_error("only {} placeholders are supported");
+            }
+        }
+        else if ('}' == fmt[i])
+        {
+            if (i + 1 < fmt.size() && '}' == fmt[i + 1])
+            {
+                i++;
+            }
+            else
+            {
+                format_error("unmatched } in format string");
+            }
+        }
+    }
+
+    return count;
+}
+
+/*
+ * Offset of the part of `file` recorded in entries: the file name with
+ * PLOG_FILE_BASENAME, or past PLOG_SRC_PREFIX_LEN characters.
+ */
+consteval size_t
+file_offset (std::string_view file)
+{
+#if defined(PLOG_FILE_BASENAME)
+    size_t slash = file.find_last_of("/\\");
+
+    return (std::string_view::npos == slash) ? 0 : slash + 1;
+#elif defined(PLOG_SRC_PREFIX_LEN)
+    return (file.size() > (PLOG_SRC_PREFIX_LEN)) ? (PLOG_SRC_PREFIX_LEN) : 0;
+#else
+    (void)file;
+
+    return 0;
+#endif
+}
+
+} // namespace detail
+
+/**
+ * A format string checked against its arguments at compile time. Also
+ * records the call site, measured at compile time.
+ */
+template <typename... Args>
+class basic_format_string
+{
+public:
+    template <typename S>
+        requires std::convertible_to<const S&, std::string_view>
+    consteval basic_format_string (const S& fmt,
+                                   std::source_location loc =
+                                       std::source_location::current())
+        : m_fmt(fmt)
+        , m_site()
+    {
+        if (detail::count_args(m_fmt) != sizeof...(Args))
+        {
+            detail::format_error("wrong number of arguments for format string");
+        }
+
+        std::string_view file = loc.file_name();
+        std::string_view func = loc.function_name();
+        size_t           skip = detail::file_offset(file);
+
+        m_site.file     = loc.file_name() + skip;
+        m_site.func     = loc.function_name();
+        m_site.line     = loc.line();
+        m_site.file_len = file.size() - skip;
+        m_site.func_len = func.size();
+        m_site.root     = 0;
+    }
+
+    std::string_view get () const noexcept
+    {
+        return m_fmt;
+    }
+
+    const plog_site_t& site () const noexcept
+    {
+        return m_site;
+    }
+
+private:
+    std::string_view m_fmt;
+    plog_site_t      m_site;
+};
+
+template <typename... Args>
+using format_string = basic_format_string<std::type_identity_t<Args>...>;
+
+namespace detail
+{
+
+/*
+ * Writes through a static plog_site_t, so the core fills its caches (the
+ * source root in particular) once rather than on every call. `Site` is a
+ * type unique to each call site: the default template argument
+ * `decltype([]{})` of the functions below is a new closure type wherever it
+ * is used.
+ */
+template <typename Site, typename... Args>
+void
+write_site (plog_logger_t* p_logger, plog_level_t level,
+            const format_string<Args...>& fmt, const Args&... args)
+{
+    static plog_site_t site = fmt.site();
+
+    const arg p_args[sizeof...(Args) + 1] = { make_arg(args)..., {} };
+    message   msg = { fmt.get(), p_args };
+
+    plog_logger_write_fmt(p_logger, &site, level, format, &msg);
+}
+
+} // namespace detail
+
+/**
+ * Writes a message at `level` to a logger instance.
+ */
+template <typename... Args, typename Site = decltype([]{})>
+void
+write (plog_logger_t* p_logger, plog_level_t level, format_string<Args...> fmt,
+       const Args&... args)
+{
+    detail::write_site<Site, Args...>(p_logger, level, fmt, args...);
+}
+
+/**
+ * Writes a message at `level`.
+ */
+template <typename... Args, typename Site = decltype([]{})>
+void
+write (plog_level_t level, format_string<Args...> fmt, const Args&... args)
+{
+    detail::write_site<Site, Args...>(plog_default(), level, fmt, args...);
+}
+
+template <typename... Args, typename Site = decltype([]{})>
+void
+trace (format_string<Args...> fmt, const Args&... args)
+{
+    detail::write_site<Site, Args...>(plog_default(), PLOG_LEVEL_TRACE, fmt,
+                                      args...);
+}
+
+template <typename... Args, typename Site = decltype([]{})>
+void
+trace (plog_logger_t* p_logger, format_string<Args...> fmt, const Args&... args)
+{
+    detail::write_site<Site, Args...>(p_logger, PLOG_LEVEL_TRACE, fmt, args...);
+}
+
+template <typename... Args, typename Site = decltype([]{})>
+void
+debug (format_string<Args...> fmt, const Args&... args)
+{
+    detail::write_site<Site, Args...>(plog_default(), PLOG_LEVEL_DEBUG, fmt,
+                                      args...);
+}
+
+template <typename... Args, typename Site = decltype([]{})>
+void
+debug (plog_logger_t* p_logger, format_string<Args...> fmt, const Args&... args)
+{
+    detail::write_site<Site, Args...>(p_logger, PLOG_LEVEL_DEBUG, fmt, args...);
+}
+
+template <typename... Args, typename Site = decltype([]{})>
+void
+info (format_string<Args...> fmt, const Args&... args)
+{
+    detail::write_site<Site, Args...>(plog_default(), PLOG_LEVEL_INFO, fmt,
+                                      args...);
+}
+
+template <typename... Args, typename Site = decltype([]{})>
+void
+info (plog_logger_t* p_logger, format_string<Args...> fmt, const Args&... args)
+{
+    detail::write_site<Site, Args...>(p_logger, PLOG_LEVEL_INFO, fmt, args...);
+}
+
+template <typename... Args, typename Site = decltype([]{})>
+void
+warn (format_string<Args...> fmt, const Args&... args)
+{
+    detail::write_site<Site, Args...>(plog_default(), PLOG_LEVEL_WARN, fmt,
+                                      args...);
+}
+
+template <typename... Args, typename Site = decltype([]{})>
+void
+warn (plog_logger_t* p_logger, format_string<Args...> fmt, const Args&... args)
+{
+    detail::write_site<Site, Args...>(p_logger, PLOG_LEVEL_WARN, fmt, args...);
+}
+
+template <typename... Args, typename Site = decltype([]{})>
+void
+error (format_string<Args...> fmt, const Args&... args)
+{
+    detail::write_site<Site, Args...>(plog_default(), PLOG_LEVEL_ERROR, fmt,
+                                      args...);
+}
+
+template <typename... Args, typename Site = decltype([]{})>
+void
+error (plog_logger_t* p_logger, format_string<Args...> fmt, const Args&... args)
+{
+    detail::write_site<Site, Args...>(p_logger, PLOG_LEVEL_ERROR, fmt, args...);
+}
+
+template <typename... Args, typename Site = decltype([]{})>
+void
+fatal (format_string<Args...> fmt, const Args&... args)
+{
+    detail::write_site<Site, Args...>(plog_default(), PLOG_LEVEL_FATAL, fmt,
+                                      args...);
+}
+
+template <typename... Args, typename Site = decltype([]{})>
+void
+fatal (plog_logger_t* p_logger, format_string<Args...> fmt, const Args&... args)
+{
+    detail::write_site<Site, Args...>(p_logger, PLOG_LEVEL_FATAL, fmt, args...);
+}
+
+} // namespace plog
+
+#endif /* PICOLOG_HPP */
+
+/* EoF */
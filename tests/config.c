@@ -0,0 +1,350 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Configuration file test. Checks that every setting is applied, that a file
+ * with an invalid line changes nothing, and that the watcher picks up files
+ * written in place or replaced by a rename, reports invalid ones and stops
+ * when asked.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <picolog.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CONFIG_WAIT_MS 5000
+#define LONG           "0123456789012345678901234567890123456789"
+
+static pthread_mutex_t g_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char            g_last[1024];   // Last entry of appender 0
+static char            g_report[1024]; // Last reload failure of appender 0
+static size_t          g_count[2];     // Entries seen per appender
+static size_t          g_errors = 0;
+static char            g_dir[]  = "/tmp/plog_config_XXXXXX";
+static char            g_path[64];
+
+static void
+sleep_ms (long ms)
+{
+    struct timespec delay = { 0, ms * 1000000L };
+    nanosleep(&delay, NULL);
+}
+
+static void
+lock (bool lock, void* p_udata)
+{
+    (void)p_udata;
+
+    if (lock)
+    {
+        pthread_mutex_lock(&g_mutex);
+    }
+    else
+    {
+        pthread_mutex_unlock(&g_mutex);
+    }
+}
+
+static void
+appender (const char* p_entry, void* p_udata)
+{
+    size_t id = (size_t)p_udata;
+
+    g_count[id]++;
+
+    if (0 == id)
+    {
+        bool b_report = NULL != strstr(p_entry, "configuration unchanged");
+
+        strncpy(b_report ? g_report : g_last, p_entry, sizeof(g_last) - 1);
+    }
+}
+
+/*
+ * Writes an INFO entry and returns what appender 0 rendered.
+ */
+static void
+render (char* p_out, size_t len)
+{
+    plog_info("msg");
+
+    pthread_mutex_lock(&g_mutex);
+    snprintf(p_out, len, "%s", g_last);
+    g_last[0] = '\0';
+    pthread_mutex_unlock(&g_mutex);
+}
+
+static void
+expect (const char* p_name, bool b_ok)
+{
+    if (!b_ok)
+    {
+        printf("%s: failed\n", p_name);
+        g_errors++;
+    }
+}
+
+static void
+expect_render (const char* p_name, const char* p_expected)
+{
+    char p_actual[1024];
+
+    render(p_actual, sizeof(p_actual));
+
+    if (0 != strcmp(p_actual, p_expected))
+    {
+        printf("%s: got '%s', expected '%s'\n", p_name, p_actual, p_expected);
+        g_errors++;
+    }
+}
+
+/*
+ * Writes `p_text` to `path`, either in place or through a rename.
+ */
+static void
+write_file (const char* p_text, bool b_rename)
+{
+    char p_tmp[96];
+
+    snprintf(p_tmp, sizeof(p_tmp), "%s/tmp", g_dir);
+
+    FILE* p_file = fopen(b_rename ? p_tmp : g_path, "w");
+
+    if (NULL == p_file)
+    {
+        perror("fopen");
+        exit(EXIT_FAILURE);
+    }
+
+    fputs(p_text, p_file);
+    fclose(p_file);
+
+    if (b_rename && 0 != rename(p_tmp, g_path))
+    {
+        perror("rename");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Waits for the watcher to apply a change.
+ */
+static bool
+wait_render (const char* p_expected)
+{
+    char p_actual[1024];
+
+    for (long ms = 0; ms < CONFIG_WAIT_MS; ms += 10)
+    {
+        render(p_actual, sizeof(p_actual));
+
+        if (0 == strcmp(p_actual, p_expected))
+        {
+            return true;
+        }
+
+        sleep_ms(10);
+    }
+
+    printf("watch: got '%s', expected '%s'\n", p_actual, p_expected);
+
+    return false;
+}
+
+static bool
+wait_error (const char* p_expected)
+{
+    for (long ms = 0; ms < CONFIG_WAIT_MS; ms += 10)
+    {
+        pthread_mutex_lock(&g_mutex);
+        bool b_found = NULL != strstr(g_report, p_expected);
+        pthread_mutex_unlock(&g_mutex);
+
+        if (b_found)
+        {
+            return true;
+        }
+
+        sleep_ms(10);
+    }
+
+    return false;
+}
+
+static void
+test_load (void)
+{
+    write_file("# Comment\n"
+               "; Comment\n"
+               "\n"
+               "src_root = /src/\n"
+               "[*]\n"
+               "level = WARN\n"
+               "[ 0 ]\n"
+               "  level = DEBUG  \n"
+               "layout = %L|%m\n", false);
+
+    expect("load", plog_load_config(g_path));
+    expect_render("layout", "INFO|msg\n");
+
+    g_count[1] = 0;
+    plog_info("msg");
+    expect("[*] level", 0 == g_count[1]);
+
+    // Flags
+    write_file("[0]\n"
+               "layout =\n"
+               "timestamp = off\n"
+               "show_level = no\n"
+               "colors = false\n"
+               "file = off\n"
+               "func = off\n"
+               "ctx = off\n", false);
+
+    expect("flags", plog_load_config(g_path));
+    expect_render("flags", "msg\n");
+
+    write_file("[0]\n"
+               "show_level = on\n"
+               "time_fmt = [%Y]\n"
+               "layout = %T %m\n", false);
+
+    expect("time_fmt", plog_load_config(g_path));
+
+    char p_actual[1024];
+    render(p_actual, sizeof(p_actual));
+    expect("time_fmt", '[' == p_actual[0] && ']' == p_actual[5] &&
+                       0 == strcmp(p_actual + 6, " msg\n"));
+
+    // Sampling: keep none of the INFO entries
+    write_file("[0]\n"
+               "layout = %L %m\n"
+               "sampling = INFO 0/1\n", false);
+
+    expect("sampling", plog_load_config(g_path));
+    expect_render("sampling", "");
+
+    write_file("[0]\n"
+               "sampling = INFO 1/1\n", false);
+
+    expect("sampling off", plog_load_config(g_path));
+    expect_render("sampling off", "INFO msg\n");
+
+    // Files with an invalid line change nothing
+    static const char* const invalid[] =
+    {
+        "[0]\nlayout = %m\nlevel = VERBOSE\n",
+        "[0]\nlayout = %m\ncolors = maybe\n",
+        "[0]\nlayout = %m\nunknown = 1\n",
+        "[0]\nlayout = %m\nlayout = " LONG LONG LONG LONG "\n",
+        "[0]\nlayout = %m\nsampling = INFO 1/0\n",
+        "[0]\nlayout = %m\nsampling = INFO\n",
+        "[0]\nlayout = %m\n[7]\n",
+        "[0]\nlayout = %m\n[x]\n",
+        "[0]\nlayout = %m\nno equals sign\n",
+        "level = INFO\n",
+        "[0]\nlayout = %m\ntime_fmt = " LONG "\n",
+    };
+
+    for (size_t i = 0; i < sizeof(invalid) / sizeof(invalid[0]); i++)
+    {
+        write_file(invalid[i], false);
+        expect(invalid[i], !plog_load_config(g_path));
+        expect_render(invalid[i], "INFO msg\n");
+    }
+
+    char p_missing[96];
+    snprintf(p_missing, sizeof(p_missing), "%s/missing", g_dir);
+    expect("missing", !plog_load_config(p_missing));
+}
+
+static void
+test_watch (void)
+{
+    write_file("[0]\nlayout = a %m\n", false);
+
+    if (!plog_watch_config(g_path))
+    {
+        printf("watch: unavailable\n");
+        g_errors++;
+        return;
+    }
+
+    expect_render("watch load", "a msg\n");
+
+    write_file("[0]\nlayout = b %m\n", true);
+    expect("watch rename", wait_render("b msg\n"));
+
+    write_file("[0]\nlayout = c %m\n", false);
+    expect("watch write", wait_render("c msg\n"));
+
+    // Reported as an ERROR entry
+    write_file("[0]\nlayout = %L %m\nlevel = LOUD\n", false);
+    expect("watch invalid", wait_error("Invalid setting at"));
+    expect_render("watch unchanged", "c msg\n");
+
+    plog_unwatch_config();
+
+    write_file("[0]\nlayout = d %m\n", false);
+    sleep_ms(200);
+    expect_render("unwatch", "c msg\n");
+}
+
+int
+main (void)
+{
+    if (NULL == mkdtemp(g_dir))
+    {
+        perror("mkdtemp");
+        return EXIT_FAILURE;
+    }
+
+    snprintf(g_path, sizeof(g_path), "%s/plog.conf", g_dir);
+
+    plog_id_t id0 = plog_add_appender(appender, PLOG_LEVEL_INFO, (void*)0);
+    plog_id_t id1 = plog_add_appender(appender, PLOG_LEVEL_INFO, (void*)1);
+
+    plog_set_lock(id0, lock, NULL);
+    plog_set_lock(id1, lock, NULL);
+
+    test_load();
+    test_watch();
+
+    char p_tmp[96];
+    snprintf(p_tmp, sizeof(p_tmp), "%s/tmp", g_dir);
+    remove(p_tmp);
+    remove(g_path);
+    rmdir(g_dir);
+
+    printf("config: %zu errors\n", g_errors);
+
+    return g_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,378 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Console appender test. Entries are logged to a pipe whose reader is slower
+ * than the producer. Logging must not stall, every entry must either arrive
+ * intact and in order or be counted as dropped.
+ *
+ * Usage: console [-n entries] [-b | -d | -f]
+ *
+ *   -n  Number of entries (default 20000)
+ *   -b  Use the block policy instead of dropping
+ *   -d  Use the block policy with a short timeout and long entries, against
+ *       a reader that frees space in small steps; no call may wait past the
+ *       timeout however often the space grows
+ *   -f  Call plog_flush every few entries, with no reader running; after each
+ *       flush every entry logged so far must already be in the pipe
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <picolog.h>
+#include <appenders/plog_console.h>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CONSOLE_BUFFER_SIZE 4096
+#define CONSOLE_READ_SIZE   512
+#define CONSOLE_MAX_CALL_NS 50000000ull // No single call may take this long
+#define CONSOLE_BLOCK_US    60000         // Timeout of the -d mode
+#define CONSOLE_PAD_LEN     30000         // Entry padding of the -d mode
+#define CONSOLE_STEP_SIZE   4096          // Reads of the -d mode (a pipe page)
+#define CONSOLE_STEP_NS     15000000      // Pause between reads of the -d mode
+#define CONSOLE_SLACK_NS    25000000ull   // Scheduler slack of the -d mode
+#define CONSOLE_FLUSH_EVERY 10            // Entries between flushes in -f mode
+
+static size_t g_entries = 20000;
+static bool   gb_block    = false;
+static bool   gb_deadline = false;
+static bool   gb_flush    = false;
+
+static char*  gp_out    = NULL;
+static size_t g_out_len = 0;
+
+static uint64_t
+now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Makes room for one more read in gp_out.
+ */
+static void
+reserve (void)
+{
+    static size_t cap = 0;
+
+    if (g_out_len + CONSOLE_STEP_SIZE > cap)
+    {
+        cap = (cap + CONSOLE_STEP_SIZE) * 2;
+        gp_out = (char*)realloc(gp_out, cap);
+
+        if (NULL == gp_out)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+}
+
+/*
+ * Reads whatever the (non-blocking) pipe holds, in -f mode.
+ */
+static void
+drain (int fd)
+{
+    for (;;)
+    {
+        reserve();
+
+        ssize_t ret = read(fd, gp_out + g_out_len, CONSOLE_STEP_SIZE);
+
+        if (ret <= 0)
+        {
+            break;
+        }
+
+        g_out_len += (size_t)ret;
+    }
+}
+
+/*
+ * Slow reader: small reads with a pause in between, until EOF.
+ */
+static void*
+reader (void* p_arg)
+{
+    int fd = (int)(size_t)p_arg;
+
+    for (;;)
+    {
+        reserve();
+
+        ssize_t ret = read(fd, gp_out + g_out_len,
+                           gb_deadline ? CONSOLE_STEP_SIZE : CONSOLE_READ_SIZE);
+
+        if (ret <= 0)
+        {
+            break;
+        }
+
+        g_out_len += (size_t)ret;
+
+        struct timespec pause = { 0, gb_deadline ? CONSOLE_STEP_NS : 200000 };
+        nanosleep(&pause, NULL);
+    }
+
+    return NULL;
+}
+
+/*
+ * Checks the output. Returns the number of errors.
+ */
+static size_t
+verify (uint64_t drops)
+{
+    size_t   torn  = 0;
+    size_t   dup   = 0;
+    size_t   lines = 0;
+    size_t   next  = 0;
+    uint64_t noted = 0;
+
+    char* p_line = gp_out;
+    char* p_end  = gp_out + g_out_len;
+
+    while (p_line < p_end)
+    {
+        char* p_nl = memchr(p_line, '\n', (size_t)(p_end - p_line));
+
+        if (NULL == p_nl)
+        {
+            torn++;
+            break;
+        }
+
+        *p_nl = '\0';
+
+        size_t             seq;
+        unsigned long long count;
+        int                offset = 0;
+
+        if (1 == sscanf(p_line, "plog: %llu entries dropped%n", &count, &offset) &&
+            '\0' == p_line[offset])
+        {
+            noted += count;
+        }
+        else if (1 == sscanf(p_line, "INFO console seq=%zu %n", &seq, &offset) &&
+                 0 == strcmp(p_line + offset + strspn(p_line + offset, "x "),
+                             "end"))
+        {
+            lines++;
+
+            if (seq < next)
+            {
+                dup++;
+            }
+
+            next = seq + 1;
+        }
+        else
+        {
+            torn++;
+        }
+
+        p_line = p_nl + 1;
+    }
+
+    size_t lost = g_entries - lines - (size_t)drops;
+
+    printf("%s: %zu lines, %zu torn, %zu duplicated/reordered, %zu lost, "
+           "%llu dropped (%llu noted)\n", gb_block ? "block" : "drop", lines,
+           torn, dup, lost, (unsigned long long)drops,
+           (unsigned long long)noted);
+
+    return torn + dup + lost + ((noted != drops) ? 1 : 0) +
+           ((gb_block && !gb_deadline && drops) ? 1 : 0);
+}
+
+int
+main (int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            g_entries = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "-b"))
+        {
+            gb_block = true;
+        }
+        else if (0 == strcmp(argv[i], "-d"))
+        {
+            gb_block    = true;
+            gb_deadline = true;
+        }
+        else if (0 == strcmp(argv[i], "-f"))
+        {
+            gb_flush = true;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-n entries] [-b | -d | -f]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    int fds[2];
+
+    if (0 != pipe(fds))
+    {
+        return EXIT_FAILURE;
+    }
+
+    plog_console_cfg_t cfg;
+    plog_console_defaults(&cfg);
+
+    cfg.fd          = fds[1];
+    cfg.buffer_size = gb_deadline ? 8 * CONSOLE_BUFFER_SIZE : CONSOLE_BUFFER_SIZE;
+    cfg.colors      = 0;
+
+    if (gb_block)
+    {
+        cfg.policy   = PLOG_CONSOLE_BLOCK;
+        cfg.block_us = gb_deadline ? CONSOLE_BLOCK_US
+                                   : 10000000; // Far longer than the reader needs
+    }
+
+    plog_console_t* p_console = plog_console_open(&cfg);
+
+    if (NULL == p_console)
+    {
+        fprintf(stderr, "Failed to open console\n");
+        return EXIT_FAILURE;
+    }
+
+    pthread_t thread;
+
+    if (gb_flush)
+    {
+        fcntl(fds[0], F_SETFL, fcntl(fds[0], F_GETFL) | O_NONBLOCK);
+    }
+    else
+    {
+        pthread_create(&thread, NULL, reader, (void*)(size_t)fds[0]);
+    }
+
+    plog_id_t id = plog_add_console(p_console, PLOG_LEVEL_INFO);
+    plog_set_layout(id, "%L %m");
+
+    // Entries fill most of the buffer in -d mode, so the reader frees the
+    // space for one in several steps
+    static char pad[CONSOLE_PAD_LEN + 2] = "";
+
+    if (gb_deadline)
+    {
+        memset(pad, 'x', CONSOLE_PAD_LEN);
+        pad[CONSOLE_PAD_LEN] = ' ';
+    }
+
+    uint64_t max_ns     = 0;
+    size_t   incomplete = 0;
+
+    for (size_t seq = 0; seq < g_entries; seq++)
+    {
+        uint64_t start = now_ns();
+
+        plog_info("console seq=%zu %send", seq, pad);
+
+        uint64_t elapsed = now_ns() - start;
+
+        if (elapsed > max_ns)
+        {
+            max_ns = elapsed;
+        }
+
+        if (gb_flush && 0 == (seq + 1) % CONSOLE_FLUSH_EVERY)
+        {
+            plog_flush();
+            drain(fds[0]);
+
+            size_t lines = 0;
+
+            for (size_t i = 0; i < g_out_len; i++)
+            {
+                lines += ('\n' == gp_out[i]);
+            }
+
+            if (lines != seq + 1 || '\n' != gp_out[g_out_len - 1])
+            {
+                incomplete++;
+            }
+        }
+    }
+
+    plog_remove_appender(id);
+
+    uint64_t drops = plog_console_drops(p_console);
+
+    plog_console_close(p_console);
+    close(fds[1]);
+
+    if (gb_flush)
+    {
+        drain(fds[0]);
+    }
+    else
+    {
+        pthread_join(thread, NULL);
+    }
+
+    close(fds[0]);
+
+    size_t errors = verify(drops) + incomplete;
+
+    if (gb_flush)
+    {
+        printf("flush: %zu incomplete\n", incomplete);
+    }
+
+    printf("slowest call: %llu us\n", (unsigned long long)(max_ns / 1000));
+
+    if (!gb_block && max_ns > CONSOLE_MAX_CALL_NS)
+    {
+        errors++;
+    }
+
+    // Some slack for the scheduler; a deadline restarted by each step of the
+    // reader would wait for several steps past the timeout
+    if (gb_deadline && max_ns > CONSOLE_BLOCK_US * 1000ull + CONSOLE_SLACK_NS)
+    {
+        errors++;
+    }
+
+    free(gp_out);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,168 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Context (MDC) test. Checks the rendered prefix with the flag layout and
+ * %C, push/pop/clear, the size limits, the fields passed to entry appenders,
+ * and that async mode delivers the context as it was when the entry was
+ * written.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <picolog.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char   g_last[1024];       // Last rendered entry
+static char   g_fields[1024];     // Last fields, "key=value;..."
+static size_t g_errors = 0;
+
+static void
+last_appender (const char* p_entry, void* p_udata)
+{
+    (void)p_udata;
+
+    strncpy(g_last, p_entry, sizeof(g_last) - 1);
+}
+
+static void
+fields_appender (const plog_entry_t* p_entry, void* p_udata)
+{
+    (void)p_udata;
+
+    g_fields[0] = '\0';
+
+    for (size_t i = 0; i < p_entry->field_count; i++)
+    {
+        size_t len = strlen(g_fields);
+
+        snprintf(g_fields + len, sizeof(g_fields) - len, "%s=%s;",
+                 p_entry->fields[i].key, p_entry->fields[i].value);
+    }
+}
+
+static void
+expect (const char* p_name, const char* p_actual, const char* p_expected)
+{
+    if (0 != strcmp(p_actual, p_expected))
+    {
+        printf("%s: got '%s', expected '%s'\n", p_name, p_actual, p_expected);
+        g_errors++;
+    }
+}
+
+int
+main (void)
+{
+    plog_id_t id        = plog_add_appender(last_appender, PLOG_LEVEL_INFO, NULL);
+    plog_id_t fields_id = plog_add_entry_appender(fields_appender,
+                                                  PLOG_LEVEL_INFO, NULL);
+
+    // Off by default
+    plog_ctx_push("req", "42");
+    plog_info("msg");
+    expect("off", g_last, "INFO msg\n");
+
+    plog_ctx_on(id);
+    plog_ctx_push("user", "bob");
+    plog_info("msg");
+    expect("flags", g_last, "INFO [req=42 user=bob] msg\n");
+    expect("fields", g_fields, "req=42;user=bob;");
+
+    plog_set_layout(id, "%C | %m");
+    plog_info("msg");
+    expect("pattern", g_last, "req=42 user=bob | msg\n");
+
+    plog_ctx_pop();
+    plog_info("msg");
+    expect("pop", g_last, "req=42 | msg\n");
+
+    plog_ctx_clear();
+    plog_info("msg");
+    expect("clear pattern", g_last, " | msg\n");
+    expect("clear fields", g_fields, "");
+
+    plog_set_layout(id, NULL);
+    plog_info("msg");
+    expect("clear flags", g_last, "INFO msg\n");
+
+    // Limits
+    char p_key[16];
+    size_t pushed = 0;
+
+    while (pushed < PLOG_CTX_MAX_FIELDS + 1)
+    {
+        snprintf(p_key, sizeof(p_key), "k%zu", pushed);
+
+        if (!plog_ctx_push(p_key, "v"))
+        {
+            break;
+        }
+
+        pushed++;
+    }
+
+    if (PLOG_CTX_MAX_FIELDS != pushed)
+    {
+        printf("pushed %zu fields\n", pushed);
+        g_errors++;
+    }
+
+    plog_ctx_clear();
+
+    char p_value[PLOG_CTX_LEN];
+    memset(p_value, 'x', sizeof(p_value) - 1);
+    p_value[sizeof(p_value) - 1] = '\0';
+
+    if (plog_ctx_push("big", p_value))
+    {
+        printf("oversized field accepted\n");
+        g_errors++;
+    }
+
+    // Async mode copies the context with the entry
+    if (plog_async_start())
+    {
+        plog_ctx_push("req", "a");
+        plog_info("async");
+        plog_ctx_pop();
+        plog_ctx_push("req", "b");
+        plog_flush();
+
+        expect("async", g_last, "INFO [req=a] async\n");
+        expect("async fields", g_fields, "req=a;");
+
+        plog_async_stop();
+    }
+
+    plog_remove_appender(fields_id);
+    plog_remove_appender(id);
+
+    printf("context: %zu errors\n", g_errors);
+
+    return g_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
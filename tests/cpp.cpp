@@ -0,0 +1,208 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * C++ front-end test. Built from ../tests/cpp.cpp with PLOG_FILE_BASENAME.
+ * Checks formatting of each argument type, escapes, the call site, long
+ * messages, that filtered entries are never formatted, mixing C and C++
+ * calls, logger instances, and async mode. Building with CPP_BAD_COUNT,
+ * CPP_BAD_BRACE or CPP_BAD_TYPE must fail.
+ */
+
+#include <picolog.hpp>
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+static char   g_last[4096]; // Last rendered entry
+static size_t g_errors  = 0;
+static size_t g_formats = 0; // Calls of the point formatter
+
+struct point
+{
+    int x;
+    int y;
+};
+
+template <>
+struct plog::formatter<point>
+{
+    static void format (plog::writer& w, const point& value)
+    {
+        g_formats++;
+
+        w.put('(');
+        plog::detail::format_arg(w, value.x);
+        w.put(',');
+        plog::detail::format_arg(w, value.y);
+        w.put(')');
+    }
+};
+
+enum class color { red = 1, green = 2 };
+
+static void
+last_appender (const char* p_entry, void* p_udata)
+{
+    (void)p_udata;
+
+    std::strncpy(g_last, p_entry, sizeof(g_last) - 1);
+}
+
+static void
+expect (const char* p_name, const char* p_actual, const char* p_expected)
+{
+    if (0 != std::strcmp(p_actual, p_expected))
+    {
+        std::printf("%s: got '%s', expected '%s'\n", p_name, p_actual,
+                    p_expected);
+        g_errors++;
+    }
+}
+
+int
+main ()
+{
+    plog_id_t id = plog_add_appender(last_appender, PLOG_LEVEL_INFO, NULL);
+
+    plog::info("x={} y={}", 1, "two");
+    expect("basic", g_last, "INFO x=1 y=two\n");
+
+    plog::info("no args");
+    expect("no args", g_last, "INFO no args\n");
+
+    plog::warn("{{}} {{{}}}", 5);
+    expect("escapes", g_last, "WARN {} {5}\n");
+
+    std::string      str  = "str";
+    std::string_view view = "view";
+    const char*      null = nullptr;
+
+    plog::info("{} {} {} {} {}", str, view, null, 'c', true);
+    expect("strings", g_last, "INFO str view (null) c true\n");
+
+    plog::info("{} {} {} {}", -42, 18446744073709551615ull, 0.5, color::green);
+    expect("numbers", g_last, "INFO -42 18446744073709551615 0.5 2\n");
+
+    plog::info("{} {}", (void*)0x1234, nullptr);
+    expect("pointers", g_last, "INFO 0x1234 0x0\n");
+
+    plog::info("{}", point{ 3, -4 });
+    expect("formatter", g_last, "INFO (3,-4)\n");
+
+    // Filtered entries are not formatted
+    size_t formats = g_formats;
+    plog::debug("{}", point{ 0, 0 });
+
+    if (formats != g_formats)
+    {
+        std::printf("filtered entry was formatted\n");
+        g_errors++;
+    }
+
+    // Longer than the stack buffer, formatted a second time
+    std::string big(3000, 'x');
+    plog::info("{}!", big);
+    expect("long", g_last, ("INFO " + big + "!\n").c_str());
+
+    // Call site
+    char p_expected[64];
+
+    plog_set_layout(id, "%F:%l %m");
+    unsigned line = __LINE__; plog::info("site");
+    std::snprintf(p_expected, sizeof(p_expected), "cpp.cpp:%u site\n", line);
+    expect("site", g_last, p_expected);
+
+    // C and C++ share the pipeline
+    line = __LINE__; plog_info("c %d", 1);
+    std::snprintf(p_expected, sizeof(p_expected), "cpp.cpp:%u c 1\n", line);
+    expect("c", g_last, p_expected);
+
+    // Each call site has its own site, also with the same argument types
+    for (int i = 0; i < 2; i++)
+    {
+        line = __LINE__; plog::info("site {}", i);
+        std::snprintf(p_expected, sizeof(p_expected), "cpp.cpp:%u site %d\n",
+                      line, i);
+        expect("loop site", g_last, p_expected);
+    }
+
+    line = __LINE__; plog::info("site {}", 2);
+    std::snprintf(p_expected, sizeof(p_expected), "cpp.cpp:%u site 2\n", line);
+    expect("other site", g_last, p_expected);
+
+    plog_set_layout(id, NULL);
+
+    // Logger instances
+    plog_logger_t* p_logger = plog_create();
+
+    plog_logger_add_appender(p_logger, last_appender, PLOG_LEVEL_INFO, NULL);
+
+    plog::info(p_logger, "instance {}", 1);
+    expect("instance", g_last, "INFO instance 1\n");
+
+    plog::write(p_logger, PLOG_LEVEL_WARN, "instance {}", 2);
+    expect("instance write", g_last, "WARN instance 2\n");
+
+    formats = g_formats;
+    plog::debug(p_logger, "{}", point{ 0, 0 });
+
+    if (formats != g_formats)
+    {
+        std::printf("filtered instance entry was formatted\n");
+        g_errors++;
+    }
+
+    plog_destroy(p_logger);
+
+    // Async mode copies the formatted message
+    if (plog_async_start())
+    {
+        {
+            std::string tmp = "async";
+            plog::info("{} {}", tmp, 1);
+        }
+
+        plog_flush();
+        expect("async", g_last, "INFO async 1\n");
+
+        plog_async_stop();
+    }
+
+#if defined(CPP_BAD_COUNT)
+    plog::info("{} {}", 1);
+#elif defined(CPP_BAD_BRACE)
+    plog::info("{0}", 1);
+#elif defined(CPP_BAD_TYPE)
+    plog::info("{}", std::div_t{});
+#endif
+
+    plog_remove_appender(id);
+
+    std::printf("cpp: %zu errors\n", g_errors);
+
+    return g_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,318 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Crash handling test. A child process queues entries in async mode while
+ * its writer thread is stuck inside an appender, then crashes; the entries
+ * must show up in order in the crash output, followed by a backtrace, and
+ * the child must still die of SIGSEGV. Then checks that with fatal flush on,
+ * a FATAL entry returns only once everything before it has been delivered
+ * and the appenders were flushed, and that an appender writing a FATAL entry
+ * from the writer thread does not wait for itself.
+ *
+ * Usage: crash [-s]
+ *
+ *   -s  Use sharded async mode
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <picolog.h>
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CRASH_ENTRIES 100
+
+static bool   gb_sharded = false;
+static size_t g_errors   = 0;
+static size_t g_written  = 0; // Entries seen by count_appender
+static size_t g_flushes  = 0; // Calls of count_flush
+static char   g_last[256];
+
+static void
+sleep_ms (long ms)
+{
+    struct timespec delay = { 0, ms * 1000000L };
+    nanosleep(&delay, NULL);
+}
+
+static bool
+start_async (void)
+{
+    return gb_sharded ? plog_async_start_sharded() : plog_async_start();
+}
+
+/*
+ * Never returns from the "block" entry, so the writer thread is stuck.
+ */
+static void
+block_appender (const char* p_entry, void* p_udata)
+{
+    (void)p_udata;
+
+    while (NULL != strstr(p_entry, "block"))
+    {
+        pause();
+    }
+}
+
+static void
+count_appender (const char* p_entry, void* p_udata)
+{
+    (void)p_udata;
+
+    sleep_ms(1); // Keep entries queued
+    strncpy(g_last, p_entry, sizeof(g_last) - 1);
+    g_written++;
+}
+
+/*
+ * Writes a FATAL entry from the writer thread.
+ */
+static void
+fatal_appender (const char* p_entry, void* p_udata)
+{
+    (void)p_udata;
+
+    if (NULL != strstr(p_entry, "trigger"))
+    {
+        plog_fatal("from appender");
+    }
+
+    strncpy(g_last, p_entry, sizeof(g_last) - 1);
+    g_written++;
+}
+
+static void
+count_flush (void* p_udata)
+{
+    (void)p_udata;
+
+    g_flushes++;
+}
+
+static void
+crash_child (int fd)
+{
+    plog_add_appender(block_appender, PLOG_LEVEL_INFO, NULL);
+
+    if (!plog_crash_install(fd) || !start_async())
+    {
+        _exit(EXIT_FAILURE);
+    }
+
+    plog_info("block");
+    sleep_ms(50);
+
+    for (int i = 0; i < CRASH_ENTRIES; i++)
+    {
+        plog_info("entry %d", i);
+    }
+
+    volatile int* volatile p_null = NULL;
+    *p_null = 1;
+
+    _exit(EXIT_SUCCESS);
+}
+
+static void
+test_crash (void)
+{
+    int fds[2];
+
+    if (0 != pipe(fds))
+    {
+        perror("pipe");
+        exit(EXIT_FAILURE);
+    }
+
+    pid_t pid = fork();
+
+    if (0 == pid)
+    {
+        close(fds[0]);
+        crash_child(fds[1]);
+    }
+
+    close(fds[1]);
+
+    static char p_out[64 * 1024];
+    size_t      len = 0;
+    ssize_t     ret;
+
+    while ((ret = read(fds[0], p_out + len, sizeof(p_out) - 1 - len)) > 0)
+    {
+        len += (size_t)ret;
+    }
+
+    p_out[len] = '\0';
+    close(fds[0]);
+
+    int status = 0;
+    waitpid(pid, &status, 0);
+
+    if (!WIFSIGNALED(status) || SIGSEGV != WTERMSIG(status))
+    {
+        printf("child did not die of SIGSEGV (status %d)\n", status);
+        g_errors++;
+    }
+
+    char* p_line = strtok(p_out, "\n");
+
+    if (NULL == p_line ||
+        0 != strcmp(p_line, "FATAL caught SIGSEGV (signal 11)"))
+    {
+        printf("bad header '%s'\n", p_line ? p_line : "");
+        g_errors++;
+    }
+
+    int  next        = 0;
+    bool b_backtrace = false;
+
+    while (NULL != (p_line = strtok(NULL, "\n")))
+    {
+        int  i;
+        char p_file[64];
+
+        if (0 == strcmp(p_line, "backtrace:"))
+        {
+            b_backtrace = true;
+            break;
+        }
+
+        if (2 != sscanf(p_line, "INFO %63s entry %d", p_file, &i) ||
+            0 != strncmp(p_file, "crash.c:", 8) || i != next)
+        {
+            printf("unexpected line '%s'\n", p_line);
+            g_errors++;
+            break;
+        }
+
+        next++;
+    }
+
+    if (CRASH_ENTRIES != next)
+    {
+        printf("%d of %d entries recovered\n", next, CRASH_ENTRIES);
+        g_errors++;
+    }
+
+#ifdef __GLIBC__
+    if (!b_backtrace)
+    {
+        printf("no backtrace\n");
+        g_errors++;
+    }
+#else
+    (void)b_backtrace;
+#endif
+}
+
+static void
+test_fatal_flush (void)
+{
+    plog_id_t id = plog_add_appender(count_appender, PLOG_LEVEL_INFO, NULL);
+
+    plog_set_flush(id, count_flush);
+    plog_set_fatal_flush(true);
+
+    if (!start_async())
+    {
+        printf("async mode unavailable\n");
+        g_errors++;
+        return;
+    }
+
+    for (int i = 0; i < 20; i++)
+    {
+        plog_info("entry %d", i);
+    }
+
+    plog_fatal("fatal");
+
+    if (21 != g_written || 1 != g_flushes ||
+        0 != strcmp(g_last, "FATAL fatal\n"))
+    {
+        printf("fatal: %zu written, %zu flushes, last '%s'\n", g_written,
+               g_flushes, g_last);
+        g_errors++;
+    }
+
+    plog_async_stop();
+    plog_remove_appender(id);
+}
+
+static void
+test_writer_fatal (void)
+{
+    g_written = 0;
+
+    plog_id_t id = plog_add_appender(fatal_appender, PLOG_LEVEL_INFO, NULL);
+
+    plog_set_fatal_flush(true);
+
+    if (!start_async())
+    {
+        printf("async mode unavailable\n");
+        g_errors++;
+        return;
+    }
+
+    // Dies of SIGALRM if the writer thread waits for itself
+    alarm(10);
+
+    plog_info("trigger");
+    plog_flush();
+
+    alarm(0);
+
+    if (2 != g_written || 0 != strcmp(g_last, "INFO trigger\n"))
+    {
+        printf("writer fatal: %zu written, last '%s'\n", g_written, g_last);
+        g_errors++;
+    }
+
+    plog_async_stop();
+    plog_remove_appender(id);
+}
+
+int
+main (int argc, char** argv)
+{
+    gb_sharded = (argc > 1 && 0 == strcmp(argv[1], "-s"));
+
+    test_crash();
+    test_fatal_flush();
+    test_writer_fatal();
+
+    printf("crash%s: %zu errors\n", gb_sharded ? " (sharded)" : "", g_errors);
+
+    return g_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,236 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Level degradation test. A slow appender is degraded step by step up to its
+ * maximum level while it is under pressure, and restored once the pressure
+ * is gone, with a single entry summing up what was suppressed. An appender
+ * without degradation receives every entry throughout. Built with a short
+ * degradation window so it runs quickly.
+ *
+ * Usage: degrade [-a]
+ *
+ *   -a  Measure the async mode queue depth instead of the appender latency
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <picolog.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define DEGRADE_TIMEOUT_NS (5 * UINT64_C(1000000000))
+#define DEGRADE_SUMMARY    "level restored"
+
+static size_t   g_errors    = 0;
+static uint64_t g_slow_ns   = 0; // Time the slow appender takes per entry
+static size_t   g_received  = 0; // Entries received by the fast appender
+static size_t   g_summaries = 0;
+static char     g_summary[512];
+
+static void
+expect (const char* p_name, bool b_ok)
+{
+    if (!b_ok)
+    {
+        printf("%s: failed\n", p_name);
+        g_errors++;
+    }
+}
+
+static uint64_t
+now_ns (void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000u + (uint64_t)ts.tv_nsec;
+}
+
+static void
+sleep_ns (uint64_t ns)
+{
+    struct timespec ts = { (time_t)(ns / 1000000000u),
+                           (long)(ns % 1000000000u) };
+    nanosleep(&ts, NULL);
+}
+
+static void
+slow_appender (const char* p_entry, void* p_udata)
+{
+    (void)p_entry;
+    (void)p_udata;
+
+    uint64_t ns = __atomic_load_n(&g_slow_ns, __ATOMIC_RELAXED);
+
+    if (ns > 0)
+    {
+        sleep_ns(ns);
+    }
+}
+
+/*
+ * Only called by one thread at a time (the test thread, or the async writer
+ * thread).
+ */
+static void
+fast_appender (const char* p_entry, void* p_udata)
+{
+    (void)p_udata;
+
+    __atomic_add_fetch(&g_received, 1, __ATOMIC_RELAXED);
+
+    if (NULL != strstr(p_entry, DEGRADE_SUMMARY))
+    {
+        strncpy(g_summary, p_entry, sizeof(g_summary) - 1);
+        __atomic_add_fetch(&g_summaries, 1, __ATOMIC_RELEASE);
+    }
+}
+
+static plog_level_t
+effective_level (plog_id_t id, plog_stats_t* p_stats)
+{
+    plog_get_stats(p_stats);
+    return p_stats->appenders[id].level;
+}
+
+int
+main (int argc, char** argv)
+{
+    bool b_async = (argc > 1 && 0 == strcmp(argv[1], "-a"));
+
+    plog_id_t slow = plog_add_appender(slow_appender, PLOG_LEVEL_DEBUG, NULL);
+    plog_id_t fast = plog_add_appender(fast_appender, PLOG_LEVEL_DEBUG, NULL);
+
+    if (b_async)
+    {
+        if (!plog_async_start())
+        {
+            printf("Async mode unavailable\n");
+            return EXIT_FAILURE;
+        }
+
+        // Depth only: the writer thread falls behind a fast producer
+        plog_set_degrade(slow, PLOG_LEVEL_WARN, 0, 64);
+        g_slow_ns = 200000;
+    }
+    else
+    {
+        plog_set_degrade(slow, PLOG_LEVEL_WARN, 500000, 0);
+        g_slow_ns = 2000000;
+    }
+
+    plog_stats_t stats;
+
+    expect("initial level", PLOG_LEVEL_DEBUG == effective_level(slow, &stats));
+
+    // Overload: the level climbs one step at a time, up to the maximum only
+    size_t   written  = 0;
+    size_t   steps    = 0;
+    uint64_t start    = now_ns();
+    uint64_t top      = 0; // Time the maximum was reached
+    int      previous = PLOG_LEVEL_DEBUG;
+
+    while (now_ns() - start < DEGRADE_TIMEOUT_NS)
+    {
+        plog_debug("debug %zu", written);
+        plog_info("info %zu", written);
+        written += 2;
+
+        int level = (int)effective_level(slow, &stats);
+
+        expect("one step", level == previous || level == previous + 1);
+        steps   += (level != previous) ? 1 : 0;
+        previous = level;
+
+        if (PLOG_LEVEL_WARN == level && 0 == top)
+        {
+            top = now_ns();
+        }
+
+        // Stay a few windows at the top
+        if (0 != top && now_ns() - top > 5 * PLOG_DEGRADE_WINDOW_MS * 1000000u)
+        {
+            break;
+        }
+    }
+
+    expect("degraded", PLOG_LEVEL_WARN == previous && 2 == steps);
+    expect("suppressed", stats.appenders[slow].suppressed[PLOG_LEVEL_DEBUG] > 0 &&
+                         stats.appenders[slow].suppressed[PLOG_LEVEL_INFO] > 0);
+    expect("not suppressed", 0 == stats.appenders[fast].suppressed[PLOG_LEVEL_DEBUG]);
+    expect("no summary yet", 0 == __atomic_load_n(&g_summaries, __ATOMIC_ACQUIRE));
+
+    // Pressure gone: the level comes back down and one summary is written
+    __atomic_store_n(&g_slow_ns, 0, __ATOMIC_RELAXED);
+
+    start = now_ns();
+
+    while (now_ns() - start < DEGRADE_TIMEOUT_NS &&
+           PLOG_LEVEL_DEBUG != effective_level(slow, &stats))
+    {
+        plog_debug("calm %zu", written);
+        written++;
+
+        sleep_ns(100000);
+    }
+
+    plog_flush();
+    plog_get_stats(&stats);
+
+    plog_appender_stats_t* p_slow = &stats.appenders[slow];
+    plog_appender_stats_t* p_fast = &stats.appenders[fast];
+
+    expect("restored", PLOG_LEVEL_DEBUG == p_slow->level);
+    expect("one summary", 1 == __atomic_load_n(&g_summaries, __ATOMIC_ACQUIRE));
+
+    // The summary counts what the statistics counted
+    char counts[128];
+
+    snprintf(counts, sizeof(counts), "%llu DEBUG, %llu INFO",
+             (unsigned long long)p_slow->suppressed[PLOG_LEVEL_DEBUG],
+             (unsigned long long)p_slow->suppressed[PLOG_LEVEL_INFO]);
+
+    expect("summary counts", NULL != strstr(g_summary, counts));
+
+    // Every entry (and the summary) reached one of the slow appender's ends,
+    // and all of them reached the fast appender, bar async mode drops
+    uint64_t suppressed = p_slow->suppressed[PLOG_LEVEL_DEBUG] +
+                          p_slow->suppressed[PLOG_LEVEL_INFO];
+
+    expect("slow accounted", written + 1 == p_slow->written + suppressed +
+                                            p_slow->drops);
+    expect("fast complete", written + 1 == g_received + p_fast->drops &&
+                            p_fast->written == g_received);
+
+    plog_async_stop();
+
+    printf("%s: %zu entries, %llu suppressed, %zu errors\n%s",
+           b_async ? "async" : "sync", written,
+           (unsigned long long)suppressed, g_errors, g_summary);
+
+    return g_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
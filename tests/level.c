@@ -0,0 +1,222 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Level check and hex dump test. Checks that plog_is_enabled follows appender
+ * changes and the global switch, that disabled levels never reach the
+ * formatter, and that hex dumps match a byte-at-a-time reference (including
+ * truncated ones).
+ */
+
+#include <picolog.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char   g_last[4096]; // Last entry
+static size_t g_calls  = 0; // Formatter calls
+static size_t g_errors = 0;
+
+static void
+appender (const char* p_entry, void* p_udata)
+{
+    (void)p_udata;
+
+    snprintf(g_last, sizeof(g_last), "%s", p_entry);
+}
+
+static size_t
+formatter (char* p_buf, size_t cap, void* p_udata)
+{
+    (void)p_udata;
+
+    g_calls++;
+
+    return (size_t)snprintf(p_buf, cap, "formatted");
+}
+
+static void
+expect (const char* p_name, bool b_ok)
+{
+    if (!b_ok)
+    {
+        printf("%s: failed\n", p_name);
+        g_errors++;
+    }
+}
+
+/*
+ * Checks that exactly the levels from `lowest` up are enabled.
+ */
+static void
+expect_threshold (const char* p_name, int lowest)
+{
+    for (int level = 0; level < PLOG_LEVEL_COUNT; level++)
+    {
+        if (plog_is_enabled((plog_level_t)level) != (level >= lowest))
+        {
+            printf("%s: level %d %s\n", p_name, level,
+                   (level >= lowest) ? "disabled" : "enabled");
+            g_errors++;
+        }
+    }
+}
+
+/*
+ * Reference hex dump, in the format of `hexdump -C`, as rendered by "%m".
+ */
+static void
+reference (char* p_out, const unsigned char* p_data, size_t len)
+{
+    p_out += sprintf(p_out, "%zu bytes", len);
+
+    for (size_t offset = 0; offset < len; offset += 16)
+    {
+        size_t n = (len - offset < 16) ? len - offset : 16;
+
+        p_out += sprintf(p_out, "\n%08zx ", offset);
+
+        for (size_t i = 0; i < 16; i++)
+        {
+            p_out += sprintf(p_out, (8 == i) ? "  " : " ");
+            p_out += (i < n) ? sprintf(p_out, "%02x", p_data[offset + i])
+                             : sprintf(p_out, "  ");
+        }
+
+        p_out += sprintf(p_out, "  |");
+
+        for (size_t i = 0; i < n; i++)
+        {
+            unsigned char c = p_data[offset + i];
+            *p_out++ = (c >= 0x20 && c < 0x7f) ? (char)c : '.';
+        }
+
+        p_out += sprintf(p_out, "|");
+    }
+
+    sprintf(p_out, "\n");
+}
+
+static void
+test_threshold (void)
+{
+    expect_threshold("no appenders", PLOG_LEVEL_COUNT);
+
+    plog_id_t a = plog_add_appender(appender, PLOG_LEVEL_WARN, NULL);
+    expect_threshold("add WARN", PLOG_LEVEL_WARN);
+
+    plog_id_t b = plog_add_appender(appender, PLOG_LEVEL_DEBUG, NULL);
+    expect_threshold("add DEBUG", PLOG_LEVEL_DEBUG);
+
+    plog_set_level(a, PLOG_LEVEL_TRACE);
+    expect_threshold("set TRACE", PLOG_LEVEL_TRACE);
+
+    plog_disable_appender(a);
+    expect_threshold("disable appender", PLOG_LEVEL_DEBUG);
+
+    plog_disable();
+    expect_threshold("disable logger", PLOG_LEVEL_COUNT);
+
+    plog_enable();
+    expect_threshold("enable logger", PLOG_LEVEL_DEBUG);
+
+    plog_enable_appender(a);
+    expect_threshold("enable appender", PLOG_LEVEL_TRACE);
+
+    plog_remove_appender(a);
+    expect_threshold("remove appender", PLOG_LEVEL_DEBUG);
+
+    plog_remove_appender(b);
+    expect_threshold("remove all", PLOG_LEVEL_COUNT);
+}
+
+static void
+test_filtered (void)
+{
+    plog_id_t id = plog_add_appender(appender, PLOG_LEVEL_INFO, NULL);
+
+    plog_site_t site = { "level.c", "test_filtered", 1, 0, 0, 0 };
+
+    plog_write_fmt(&site, PLOG_LEVEL_DEBUG, formatter, NULL);
+    expect("filtered not formatted", 0 == g_calls);
+
+    plog_write_fmt(&site, PLOG_LEVEL_INFO, formatter, NULL);
+    expect("accepted formatted", 1 == g_calls);
+
+    unsigned char byte = 0;
+    g_last[0] = '\0';
+
+    plog_hexdump(PLOG_LEVEL_DEBUG, &byte, 1);
+    expect("filtered hex dump", '\0' == g_last[0]);
+
+    plog_remove_appender(id);
+}
+
+static void
+test_hexdump (void)
+{
+    static const size_t sizes[] = { 0, 1, 7, 8, 15, 16, 17, 31, 32, 100, 256 };
+
+    unsigned char data[256];
+    char          expected[sizeof(g_last)];
+
+    for (size_t i = 0; i < sizeof(data); i++)
+    {
+        data[i] = (unsigned char)(i * 37 + 11);
+    }
+
+    plog_id_t id = plog_add_appender(appender, PLOG_LEVEL_TRACE, NULL);
+    plog_set_layout(id, "%m");
+
+    for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+    {
+        reference(expected, data, sizes[i]);
+        plog_hexdump(PLOG_LEVEL_INFO, data, sizes[i]);
+
+        if (0 != strcmp(expected, g_last))
+        {
+            printf("hex dump of %zu bytes:\n%s\nexpected:\n%s\n", sizes[i],
+                   g_last, expected);
+            g_errors++;
+        }
+    }
+
+    plog_remove_appender(id);
+}
+
+int
+main (void)
+{
+    test_threshold();
+    test_filtered();
+    test_hexdump();
+
+    if (0 == g_errors)
+    {
+        printf("level: ok\n");
+    }
+
+    return g_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,282 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Logger instance test. Checks that instances keep their appenders, levels
+ * and enabled state apart from each other and from the default instance, that
+ * appender IDs are unique across instances, and that worker threads writing
+ * to their own instances (synchronously and in async mode) only reach their
+ * own appenders. Destroying an instance delivers what it still has queued and
+ * frees its IDs.
+ *
+ * Usage: logger [-a]
+ *
+ *   -a  Run the worker threads in async mode
+ */
+
+#include <picolog.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define LOGGER_WORKERS 4
+#define LOGGER_ENTRIES 5000
+
+typedef struct
+{
+    size_t         index;   // Worker index
+    plog_logger_t* p_logger;
+    size_t         entries; // Entries received
+    size_t         foreign; // Entries of another worker
+} worker_t;
+
+static size_t g_errors = 0;
+
+static void
+expect (const char* p_name, bool b_ok)
+{
+    if (!b_ok)
+    {
+        printf("%s: failed\n", p_name);
+        g_errors++;
+    }
+}
+
+static void
+count_appender (const char* p_entry, void* p_udata)
+{
+    (void)p_entry;
+
+    (*(size_t*)p_udata)++;
+}
+
+/*
+ * Only called by its worker's instance (from the worker, or the async writer
+ * thread), so the counters need no lock.
+ */
+static void
+worker_appender (const char* p_entry, void* p_udata)
+{
+    worker_t* p_worker = (worker_t*)p_udata;
+    size_t    index    = 0;
+
+    if (1 != sscanf(p_entry, "INFO worker %zu", &index) ||
+        index != p_worker->index)
+    {
+        p_worker->foreign++;
+    }
+
+    p_worker->entries++;
+}
+
+static void*
+worker (void* p_arg)
+{
+    worker_t* p_worker = (worker_t*)p_arg;
+
+    for (size_t i = 0; i < LOGGER_ENTRIES; i++)
+    {
+        plog_logger_write(p_worker->p_logger, PLOG_LEVEL_INFO, "worker %zu %zu",
+                          p_worker->index, i);
+
+        // Filtered by the instance's level
+        plog_logger_write(p_worker->p_logger, PLOG_LEVEL_DEBUG, "worker %zu",
+                          p_worker->index);
+    }
+
+    return NULL;
+}
+
+static void
+test_isolation (void)
+{
+    size_t n_default = 0;
+    size_t n_a       = 0;
+    size_t n_b       = 0;
+
+    plog_logger_t* p_a = plog_create();
+    plog_logger_t* p_b = plog_create();
+
+    expect("create", NULL != p_a && NULL != p_b && p_a != p_b);
+    expect("default", plog_default() != p_a && plog_default() != p_b);
+
+    plog_id_t def = plog_add_appender(count_appender, PLOG_LEVEL_INFO,
+                                      &n_default);
+    plog_id_t a   = plog_logger_add_appender(p_a, count_appender,
+                                             PLOG_LEVEL_DEBUG, &n_a);
+    plog_id_t b   = plog_logger_add_appender(p_b, count_appender,
+                                             PLOG_LEVEL_WARN, &n_b);
+
+    expect("unique IDs", def != a && def != b && a != b);
+
+    expect("default threshold", plog_is_enabled(PLOG_LEVEL_INFO) &&
+                                !plog_is_enabled(PLOG_LEVEL_DEBUG));
+    expect("a threshold", plog_logger_is_enabled(p_a, PLOG_LEVEL_DEBUG) &&
+                          !plog_logger_is_enabled(p_a, PLOG_LEVEL_TRACE));
+    expect("b threshold", plog_logger_is_enabled(p_b, PLOG_LEVEL_WARN) &&
+                          !plog_logger_is_enabled(p_b, PLOG_LEVEL_INFO));
+
+    plog_info("default");
+    plog_logger_write(p_a, PLOG_LEVEL_DEBUG, "a");
+    plog_logger_write(p_b, PLOG_LEVEL_INFO, "b filtered");
+    plog_logger_write(p_b, PLOG_LEVEL_ERROR, "b");
+
+    expect("separate appenders", 1 == n_default && 1 == n_a && 1 == n_b);
+
+    // ID based functions apply to the owning instance
+    plog_set_level(b, PLOG_LEVEL_TRACE);
+    expect("set level", plog_logger_is_enabled(p_b, PLOG_LEVEL_TRACE) &&
+                        !plog_is_enabled(PLOG_LEVEL_TRACE) &&
+                        !plog_logger_is_enabled(p_a, PLOG_LEVEL_TRACE));
+
+    plog_logger_write(p_b, PLOG_LEVEL_TRACE, "b");
+    expect("set level write", 1 == n_a && 2 == n_b);
+
+    // Disabling one instance leaves the others alone
+    plog_logger_disable(p_a);
+    plog_logger_write(p_a, PLOG_LEVEL_ERROR, "a disabled");
+    plog_info("default");
+    expect("disable", 1 == n_a && 2 == n_default &&
+                      !plog_logger_is_enabled(p_a, PLOG_LEVEL_FATAL));
+
+    plog_disable();
+    plog_logger_enable(p_a);
+    plog_logger_write(p_a, PLOG_LEVEL_ERROR, "a");
+    plog_info("default disabled");
+    expect("disable default", 2 == n_a && 2 == n_default);
+    plog_enable();
+
+    plog_remove_appender(a);
+    expect("remove", !plog_logger_is_enabled(p_a, PLOG_LEVEL_FATAL));
+
+    // Every ID still free can be claimed once the instances are gone
+    plog_destroy(p_a);
+    plog_destroy(p_b);
+    plog_remove_appender(def);
+
+    plog_logger_t* p_c = plog_create();
+    size_t         n_c = 0;
+    size_t         ids = 0;
+
+    for (size_t i = 0; i < PLOG_MAX_APPENDERS; i++)
+    {
+        plog_id_t id = plog_logger_add_appender(p_c, count_appender,
+                                                PLOG_LEVEL_INFO, &n_c);
+        ids |= (size_t)1 << id;
+    }
+
+    expect("IDs released", ((size_t)1 << PLOG_MAX_APPENDERS) - 1 == ids);
+
+    plog_logger_write(p_c, PLOG_LEVEL_INFO, "c");
+    expect("all appenders", PLOG_MAX_APPENDERS == n_c);
+
+    plog_destroy(p_c);
+}
+
+static void
+test_workers (bool b_async)
+{
+    worker_t  workers[LOGGER_WORKERS];
+    pthread_t threads[LOGGER_WORKERS];
+    size_t    n_default = 0;
+
+    plog_id_t def = plog_add_appender(count_appender, PLOG_LEVEL_TRACE,
+                                      &n_default);
+
+    for (size_t i = 0; i < LOGGER_WORKERS; i++)
+    {
+        workers[i].index    = i;
+        workers[i].entries  = 0;
+        workers[i].foreign  = 0;
+        workers[i].p_logger = plog_create();
+
+        plog_id_t id = plog_logger_add_appender(workers[i].p_logger,
+                                                worker_appender,
+                                                PLOG_LEVEL_INFO, &workers[i]);
+        plog_set_layout(id, "%L %m\n");
+    }
+
+    if (b_async && !plog_async_start())
+    {
+        printf("async mode unavailable\n");
+        g_errors++;
+    }
+
+    for (size_t i = 0; i < LOGGER_WORKERS; i++)
+    {
+        pthread_create(&threads[i], NULL, worker, &workers[i]);
+    }
+
+    for (size_t i = 0; i < LOGGER_WORKERS; i++)
+    {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Destroying delivers the queued entries first
+    size_t entries = 0;
+    size_t foreign = 0;
+
+    for (size_t i = 0; i < LOGGER_WORKERS; i++)
+    {
+        plog_destroy(workers[i].p_logger);
+
+        entries += workers[i].entries;
+        foreign += workers[i].foreign;
+
+        expect("worker entries", LOGGER_ENTRIES == workers[i].entries);
+    }
+
+    plog_async_stop();
+
+    plog_stats_t stats;
+    plog_get_stats(&stats);
+
+    printf("%s: %zu entries, %zu foreign, %zu default, %llu dropped\n",
+           b_async ? "async" : "sync", entries, foreign, n_default,
+           (unsigned long long)stats.async_drops);
+
+    expect("no foreign entries", 0 == foreign);
+    expect("default untouched", 0 == n_default);
+    expect("no drops", 0 == stats.async_drops);
+
+    plog_remove_appender(def);
+}
+
+int
+main (int argc, char** argv)
+{
+    bool b_async = argc > 1 && 0 == strcmp(argv[1], "-a");
+
+    test_isolation();
+    test_workers(b_async);
+
+    if (0 == g_errors)
+    {
+        printf("logger: ok\n");
+    }
+
+    return g_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
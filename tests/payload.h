@@ -0,0 +1,193 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Sequence-numbered entries shared by the file appender tests. Producer
+ * threads log entries of varying length, some larger than an appender buffer,
+ * to a file that starts with other content; the lines read back are checked
+ * for torn, lost, duplicated and reordered entries.
+ */
+
+#ifndef PLOG_TEST_PAYLOAD_H
+#define PLOG_TEST_PAYLOAD_H
+
+#include <picolog.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define PAYLOAD_MAX      6000 // Exceeds a buffer (or frame) to force spanning
+#define PAYLOAD_LINE_MAX (PAYLOAD_MAX + 256)
+#define PAYLOAD_HEADER   "existing content\n"
+
+/*
+ * Line check state. `p_next` is the next sequence number expected from each
+ * producer.
+ */
+typedef struct
+{
+    const char* p_name;
+    size_t      producers;
+    size_t*     p_next;
+    size_t      lines;
+    size_t      torn;
+    size_t      dup;
+    size_t      gaps;
+} payload_check_t;
+
+static size_t
+payload_len (size_t thread, size_t seq)
+{
+    // Mostly short entries with an occasional large one
+    return (0 == seq % 997) ? PAYLOAD_MAX : (seq * 7 + thread * 13) % 200;
+}
+
+static char
+payload_char (size_t thread, size_t seq)
+{
+    return (char)('a' + (thread + seq) % 26);
+}
+
+/*
+ * Logs `entries` entries as producer `thread`, with layout "%L %m" expected.
+ */
+static void
+payload_log (const char* p_name, size_t thread, size_t entries)
+{
+    char payload[PAYLOAD_MAX + 1];
+
+    for (size_t seq = 0; seq < entries; seq++)
+    {
+        size_t len = payload_len(thread, seq);
+
+        memset(payload, payload_char(thread, seq), len);
+        payload[len] = '\0';
+
+        plog_info("%s t=%zu seq=%zu len=%zu %s", p_name, thread, seq, len,
+                  payload);
+    }
+}
+
+/*
+ * Creates a temporary file from the mkstemp template `path`, holding
+ * PAYLOAD_HEADER. Returns false on failure.
+ */
+static bool
+payload_create (char* path)
+{
+    int  fd   = mkstemp(path);
+    bool b_ok = fd >= 0 && (ssize_t)strlen(PAYLOAD_HEADER) ==
+                           write(fd, PAYLOAD_HEADER, strlen(PAYLOAD_HEADER));
+
+    if (fd >= 0)
+    {
+        close(fd);
+    }
+
+    return b_ok;
+}
+
+static void
+payload_check_init (payload_check_t* p_check, const char* p_name,
+                    size_t producers)
+{
+    memset(p_check, 0, sizeof(payload_check_t));
+
+    p_check->p_name    = p_name;
+    p_check->producers = producers;
+    p_check->p_next    = (size_t*)calloc(producers, sizeof(size_t));
+
+    if (NULL == p_check->p_next)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+}
+
+/*
+ * Checks one line, without its newline.
+ */
+static void
+payload_check_line (payload_check_t* p_check, const char* p_line)
+{
+    char   format[64];
+    size_t thread, seq, len;
+    int    offset = 0;
+
+    p_check->lines++;
+
+    snprintf(format, sizeof(format), "INFO %s t=%%zu seq=%%zu len=%%zu %%n",
+             p_check->p_name);
+
+    if (3 != sscanf(p_line, format, &thread, &seq, &len, &offset) ||
+        0 == offset || thread >= p_check->producers ||
+        len != payload_len(thread, seq) || strlen(p_line + offset) != len)
+    {
+        p_check->torn++;
+        return;
+    }
+
+    char c = payload_char(thread, seq);
+
+    for (size_t i = 0; i < len; i++)
+    {
+        if (p_line[offset + i] != c)
+        {
+            p_check->torn++;
+            return;
+        }
+    }
+
+    if (seq < p_check->p_next[thread])
+    {
+        p_check->dup++;
+    }
+    else
+    {
+        p_check->gaps          += seq - p_check->p_next[thread];
+        p_check->p_next[thread] = seq + 1;
+    }
+}
+
+/*
+ * Counts the entries missing from the end of each producer's sequence of
+ * `entries`. Returns the number of errors.
+ */
+static size_t
+payload_check_end (payload_check_t* p_check, size_t entries)
+{
+    for (size_t i = 0; i < p_check->producers; i++)
+    {
+        p_check->gaps += entries - p_check->p_next[i];
+    }
+
+    free(p_check->p_next);
+    p_check->p_next = NULL;
+
+    return p_check->torn + p_check->dup + p_check->gaps;
+}
+
+#endif /* PLOG_TEST_PAYLOAD_H */
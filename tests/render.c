@@ -0,0 +1,182 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Flag layout rendering test. Renders an entry for every combination of
+ * decoration flags, at every level, with and without a sampling tag, and
+ * compares the result with a reference built here. The test is also built
+ * with PLOG_NO_RENDER_VARIANTS, so the specialized renderers and the layout
+ * interpreter are held to the same output.
+ */
+
+#include <picolog.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RENDER_FLAGS 6 // timestamp, level, file, func, ctx, colors
+
+// Padded when colored, as the flag layout has always done
+static const char* const g_levels[] =
+{
+    "TRACE", "DEBUG", "INFO", "WARN", "ERROR", "FATAL"
+};
+
+static const char* const g_levels_padded[] =
+{
+    "TRACE", "DEBUG", "INFO ", "WARN ", "ERROR", "FATAL"
+};
+
+static const char* const g_colors[] =
+{
+    "\033[94m", "\033[36m", "\033[32m", "\033[33m", "\033[31m", "\033[35m"
+};
+
+static char   g_last[1024]; // Last entry
+static size_t g_count  = 0; // Entries received
+static size_t g_errors = 0;
+
+static void
+appender (const char* p_entry, void* p_udata)
+{
+    (void)p_udata;
+
+    snprintf(g_last, sizeof(g_last), "%s", p_entry);
+    g_count++;
+}
+
+/*
+ * Builds the entry the flag layout renders for the combination `flags`
+ * (bit 5 timestamp down to bit 0 colors).
+ */
+static void
+reference (char* p_out, size_t len, unsigned flags, int level, bool b_sampled)
+{
+    const char* p_gray  = (flags & 1) ? "\033[90m" : "";
+    const char* p_reset = (flags & 1) ? "\033[0m"  : "";
+
+    size_t n = 0;
+
+    if (flags & 32)
+    {
+        n += (size_t)snprintf(p_out + n, len - n, "T ");
+    }
+
+    if (flags & 16)
+    {
+        n += (flags & 1)
+           ? (size_t)snprintf(p_out + n, len - n, "%s%s \033[0m",
+                              g_colors[level], g_levels_padded[level])
+           : (size_t)snprintf(p_out + n, len - n, "%s ", g_levels[level]);
+    }
+
+    if (flags & 8)
+    {
+        n += (size_t)snprintf(p_out + n, len - n, "%srender.c:42%s ", p_gray,
+                              p_reset);
+    }
+
+    if (flags & 4)
+    {
+        n += (size_t)snprintf(p_out + n, len - n, "%s[func] %s", p_gray,
+                              p_reset);
+    }
+
+    if (flags & 2)
+    {
+        n += (size_t)snprintf(p_out + n, len - n, "[k=v] ");
+    }
+
+    snprintf(p_out + n, len - n, "%smsg %d\n", b_sampled ? "[1/2] " : "",
+             level);
+}
+
+static void
+configure (plog_id_t id, unsigned flags)
+{
+    (flags & 32) ? plog_timestamp_on(id) : plog_timestamp_off(id);
+    (flags & 16) ? plog_level_on(id)     : plog_level_off(id);
+    (flags & 8)  ? plog_file_on(id)      : plog_file_off(id);
+    (flags & 4)  ? plog_func_on(id)      : plog_func_off(id);
+    (flags & 2)  ? plog_ctx_on(id)       : plog_ctx_off(id);
+    (flags & 1)  ? plog_colors_on(id)    : plog_colors_off(id);
+}
+
+static void
+check (unsigned flags, int level, bool b_sampled)
+{
+    char expected[1024];
+
+    reference(expected, sizeof(expected), flags, level, b_sampled);
+
+    // A sampled entry is kept one time in two; retry until one arrives
+    size_t count = g_count;
+
+    for (int i = 0; i < 64 && count == g_count; i++)
+    {
+        plog_write((plog_level_t)level, "render.c", 42, "func", "msg %d",
+                   level);
+    }
+
+    if (count == g_count || 0 != strcmp(expected, g_last))
+    {
+        printf("flags %02x, level %d%s:\n%sexpected:\n%s", flags, level,
+               b_sampled ? ", sampled" : "", g_last, expected);
+        g_errors++;
+    }
+}
+
+int
+main (void)
+{
+    plog_id_t id = plog_add_appender(appender, PLOG_LEVEL_TRACE, NULL);
+
+    plog_set_time_fmt(id, "T");
+    plog_ctx_push("k", "v");
+
+    for (unsigned flags = 0; flags < (1u << RENDER_FLAGS); flags++)
+    {
+        configure(id, flags);
+
+        for (int level = 0; level < PLOG_LEVEL_COUNT; level++)
+        {
+            plog_set_sampling(id, (plog_level_t)level, 1, 1);
+            check(flags, level, false);
+
+            plog_set_sampling(id, (plog_level_t)level, 1, 2);
+            check(flags, level, true);
+            plog_set_sampling(id, (plog_level_t)level, 1, 1);
+        }
+    }
+
+    plog_remove_appender(id);
+
+    if (0 == g_errors)
+    {
+        printf("render: ok\n");
+    }
+
+    return g_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
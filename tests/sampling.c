@@ -0,0 +1,275 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Sampling test. Checks appender and call site sampling rates, the rate
+ * carried by written entries, request key sampling and that sampled out
+ * entries are never formatted.
+ *
+ * Usage: sampling [-n entries]
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <picolog.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SAMPLING_KEYS      10000
+#define SAMPLING_PER_KEY   10
+#define SAMPLING_LONG_MSG  1000 // Exceeds the stack buffer, so spills
+
+static size_t g_entries = 100000;
+
+static size_t   g_lines        = 0;
+static size_t   g_bad          = 0;
+static char     g_tag[32]      = ""; // Expected rate tag
+static size_t   g_entries_seen = 0;  // Calls of the entry appender
+static uint64_t g_keep         = 0;  // Rate seen by the entry appender
+static uint64_t g_of           = 0;
+
+static void
+count_appender (const char* p_entry, void* p_udata)
+{
+    (void)p_udata;
+
+    g_lines++;
+
+    if (NULL == strstr(p_entry, g_tag))
+    {
+        g_bad++;
+    }
+}
+
+static void
+rate_appender (const plog_entry_t* p_entry, void* p_udata)
+{
+    (void)p_udata;
+
+    g_entries_seen++;
+    g_keep = p_entry->sample_keep;
+    g_of   = p_entry->sample_of;
+}
+
+/*
+ * Returns the number of errors if `count` is not within 10% of `expected`.
+ */
+static size_t
+check_rate (const char* p_name, size_t count, size_t expected)
+{
+    bool b_ok = count >= expected * 9 / 10 && count <= expected * 11 / 10;
+
+    printf("%s: %zu written, %zu expected%s\n", p_name, count, expected,
+           b_ok ? "" : " (FAILED)");
+
+    return b_ok ? 0 : 1;
+}
+
+int
+main (int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            g_entries = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-n entries]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    size_t errors = 0;
+
+    plog_id_t id = plog_add_appender(count_appender, PLOG_LEVEL_INFO, NULL);
+    plog_set_level(id, PLOG_LEVEL_DEBUG);
+
+    // Appender sampling: 1 in 10 DEBUG entries, INFO untouched
+    plog_set_sampling(id, PLOG_LEVEL_DEBUG, 1, 10);
+    strcpy(g_tag, "DEBUG [1/10] ");
+
+    for (size_t i = 0; i < g_entries; i++)
+    {
+        plog_debug("debug %zu", i);
+    }
+
+    errors += check_rate("appender 1/10", g_lines, g_entries / 10);
+
+    g_lines = 0;
+    strcpy(g_tag, "INFO info");
+
+    for (size_t i = 0; i < 100; i++)
+    {
+        plog_info("info %zu", i);
+    }
+
+    errors += (100 == g_lines) ? 0 : 1;
+
+    // Call site sampling, alone and combined with the appender's
+    g_lines = 0;
+    strcpy(g_tag, "INFO [1/4] ");
+
+    for (size_t i = 0; i < g_entries; i++)
+    {
+        plog_sampled(PLOG_LEVEL_INFO, 1, 4, "site %zu", i);
+    }
+
+    errors += check_rate("call site 1/4", g_lines, g_entries / 4);
+
+    g_lines = 0;
+    strcpy(g_tag, "DEBUG [5/200] ");
+
+    for (size_t i = 0; i < g_entries; i++)
+    {
+        plog_sampled(PLOG_LEVEL_DEBUG, 5, 20, "combined %zu", i);
+    }
+
+    errors += check_rate("combined 5/200", g_lines, g_entries / 40);
+
+    // Pattern layout
+    plog_set_layout(id, "%r %m");
+
+    g_lines = 0;
+    strcpy(g_tag, "1/1 pattern");
+    plog_info("pattern");
+
+    strcpy(g_tag, "1/10 pattern");
+
+    while (g_lines < 2)
+    {
+        plog_debug("pattern");
+    }
+
+    plog_set_layout(id, NULL);
+
+    // Sample keys: a key's entries are all kept or all skipped, and the same
+    // key always gives the same decision
+    size_t kept_keys = 0;
+
+    strcpy(g_tag, "DEBUG [1/10] ");
+
+    for (size_t pass = 0; pass < 2; pass++)
+    {
+        size_t pass_kept = 0;
+
+        for (size_t key = 0; key < SAMPLING_KEYS; key++)
+        {
+            char p_key[32];
+            snprintf(p_key, sizeof(p_key), "request-%zu", key);
+
+            plog_set_sample_key(p_key);
+            g_lines = 0;
+
+            for (size_t i = 0; i < SAMPLING_PER_KEY; i++)
+            {
+                plog_debug("key %zu entry %zu", key, i);
+            }
+
+            if (0 != g_lines && SAMPLING_PER_KEY != g_lines)
+            {
+                g_bad++;
+            }
+
+            pass_kept += (0 != g_lines) ? 1 : 0;
+        }
+
+        if (0 == pass)
+        {
+            kept_keys = pass_kept;
+        }
+        else if (pass_kept != kept_keys)
+        {
+            errors++;
+        }
+    }
+
+    plog_set_sample_key(NULL);
+
+    errors += check_rate("keys 1/10", kept_keys * 10, SAMPLING_KEYS);
+
+    // With a key, the call site and appender decisions are still independent:
+    // the entries kept are the fraction the rate tag reports
+    g_lines = 0;
+    strcpy(g_tag, "DEBUG [1/40] ");
+
+    for (size_t key = 0; key < SAMPLING_KEYS * 4; key++)
+    {
+        char p_key[32];
+        snprintf(p_key, sizeof(p_key), "request-%zu", key);
+
+        plog_set_sample_key(p_key);
+        plog_sampled(PLOG_LEVEL_DEBUG, 1, 4, "key %zu", key);
+    }
+
+    plog_set_sample_key(NULL);
+
+    errors += check_rate("keys combined 1/40", g_lines, SAMPLING_KEYS / 10);
+
+    // Entry appenders receive the rate
+    plog_id_t rate_id = plog_add_entry_appender(rate_appender, PLOG_LEVEL_INFO,
+                                                NULL);
+
+    plog_set_level(rate_id, PLOG_LEVEL_DEBUG);
+    plog_set_sampling(rate_id, PLOG_LEVEL_DEBUG, 1, 2);
+    plog_set_sampling(id, PLOG_LEVEL_DEBUG, 0, 1);
+
+    while (0 == g_entries_seen)
+    {
+        plog_sampled(PLOG_LEVEL_DEBUG, 1, 3, "rate");
+    }
+
+    errors += (1 == g_keep && 6 == g_of) ? 0 : 1;
+
+    plog_remove_appender(rate_id);
+
+    // Sampled out entries are never formatted
+    char p_long[SAMPLING_LONG_MSG + 1];
+
+    memset(p_long, 'x', SAMPLING_LONG_MSG);
+    p_long[SAMPLING_LONG_MSG] = '\0';
+
+    plog_stats_t before, after;
+    plog_get_stats(&before);
+
+    for (size_t i = 0; i < 1000; i++)
+    {
+        plog_debug("%s", p_long);
+        plog_sampled(PLOG_LEVEL_INFO, 0, 1, "%s", p_long);
+    }
+
+    plog_get_stats(&after);
+
+    errors += (after.msg_spills == before.msg_spills) ? 0 : 1;
+    errors += (after.sampled - before.sampled == 1000) ? 0 : 1;
+    errors += (after.appenders[id].sampled - before.appenders[id].sampled == 1000)
+              ? 0 : 1;
+
+    printf("%zu bad lines, %zu errors\n", g_bad, errors);
+
+    return (errors + g_bad) ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,117 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Call site test. Built from ../tests/site.c with PLOG_SRC_PREFIX_LEN set to
+ * strip the "../tests/" prefix at compile time. Checks the runtime source
+ * root, that a cached site picks up a root change, and that long function
+ * names are not truncated.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <picolog.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static char   g_last[1024]; // Last rendered entry
+static size_t g_errors = 0;
+
+static void
+last_appender (const char* p_entry, void* p_udata)
+{
+    (void)p_udata;
+
+    strncpy(g_last, p_entry, sizeof(g_last) - 1);
+}
+
+static void
+expect (const char* p_name, const char* p_actual, const char* p_expected)
+{
+    if (0 != strcmp(p_actual, p_expected))
+    {
+        printf("%s: got '%s', expected '%s'\n", p_name, p_actual, p_expected);
+        g_errors++;
+    }
+}
+
+static void
+log_from_a_function_with_a_rather_long_name_well_past_thirty_two_chars (void)
+{
+    plog_info("msg");
+}
+
+int
+main (void)
+{
+    plog_id_t id = plog_add_appender(last_appender, PLOG_LEVEL_INFO, NULL);
+
+    plog_set_layout(id, "%F %m");
+
+    // Compile-time prefix
+    plog_info("msg");
+    expect("prefix", g_last, "site.c msg\n");
+
+    // Runtime root, applied to a site that already cached its lengths
+    for (int i = 0; i < 2; i++)
+    {
+        plog_set_src_root(0 == i ? NULL : "si");
+        plog_info("msg");
+        expect("root", g_last, 0 == i ? "site.c msg\n" : "te.c msg\n");
+    }
+
+    plog_set_src_root("no/match/");
+    plog_info("msg");
+    expect("no match", g_last, "site.c msg\n");
+
+    plog_set_src_root("/build/");
+    plog_write(PLOG_LEVEL_INFO, "/build/src/a.c", 1, "f", "msg");
+    expect("direct", g_last, "src/a.c msg\n");
+
+    char p_root[PLOG_SRC_ROOT_LEN + 1];
+    memset(p_root, 'x', PLOG_SRC_ROOT_LEN);
+    p_root[PLOG_SRC_ROOT_LEN] = '\0';
+
+    if (plog_set_src_root(p_root))
+    {
+        printf("oversized root accepted\n");
+        g_errors++;
+    }
+
+    plog_set_src_root(NULL);
+
+    // Function names are rendered in full
+    plog_set_layout(id, "%f");
+    log_from_a_function_with_a_rather_long_name_well_past_thirty_two_chars();
+    expect("func", g_last,
+           "log_from_a_function_with_a_rather_long_name_well_past_thirty_two_chars\n");
+
+    plog_remove_appender(id);
+
+    printf("site: %zu errors\n", g_errors);
+
+    return g_errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
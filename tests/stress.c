@@ -0,0 +1,441 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Multi-threaded stress test. Producer threads log sequence-numbered entries
+ * while churn threads change levels, enable/disable appenders and add/remove
+ * appenders. The output is then checked for torn, lost, duplicated and
+ * reordered lines.
+ *
+ * Usage: stress [-t producers] [-n entries] [-a | -s] [-o] [-x]
+ *
+ *   -t  Number of producer threads (default 8)
+ *   -n  Entries per producer (default 20000)
+ *   -a  Deliver through async mode
+ *   -s  Deliver through sharded async mode
+ *   -o  Serialize the producers and check that the output is globally ordered
+ *   -x  Stop async mode while the producers are still writing and flushing
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <picolog.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define STRESS_MAGIC       0x51AB1E5u
+#define STRESS_CHURNERS    2
+#define STRESS_MAX_PAYLOAD 600 // Exceeds the stack buffers to force spills
+
+static size_t    g_producers = 8;
+static size_t    g_entries   = 20000;
+static bool      gb_async    = false;
+static bool      gb_sharded  = false;
+static bool      gb_ordered  = false;
+static bool      gb_stop     = false; // Stop async mode mid-run
+static size_t    g_order     = 0;   // Global sequence (ordered mode)
+static plog_id_t g_checked;         // Appender whose output is verified
+static int       g_done      = 0;   // Producers finished
+
+/*
+ * Output of the checked appender.
+ */
+static pthread_mutex_t g_out_mutex   = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t g_order_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char*           gp_out      = NULL;
+static size_t          g_out_len   = 0;
+static size_t          g_out_cap   = 0;
+
+/*
+ * Context of a short-lived churn appender. Cleared and freed right after the
+ * appender is removed, so a late call is detected.
+ */
+typedef struct
+{
+    unsigned magic;
+    size_t   calls;
+} churn_ctx_t;
+
+static size_t
+payload_len (size_t thread, size_t seq)
+{
+    return (seq * 7 + thread * 13) % STRESS_MAX_PAYLOAD;
+}
+
+static char
+payload_char (size_t thread, size_t seq)
+{
+    return (char)('a' + (thread + seq) % 26);
+}
+
+static void
+out_lock (bool lock, void* p_udata)
+{
+    if (lock)
+    {
+        pthread_mutex_lock((pthread_mutex_t*)p_udata);
+    }
+    else
+    {
+        pthread_mutex_unlock((pthread_mutex_t*)p_udata);
+    }
+}
+
+/*
+ * Appends the entry in two halves so that a missing lock shows up as torn
+ * lines.
+ */
+static void
+out_appender (const char* p_entry, void* p_udata)
+{
+    (void)p_udata;
+
+    size_t len = strlen(p_entry);
+
+    if (g_out_len + len > g_out_cap)
+    {
+        g_out_cap = (g_out_cap + len) * 2;
+        gp_out = (char*)realloc(gp_out, g_out_cap);
+
+        if (NULL == gp_out)
+        {
+            fprintf(stderr, "Out of memory\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    size_t half = len / 2;
+
+    memcpy(gp_out + g_out_len, p_entry, half);
+    memcpy(gp_out + g_out_len + half, p_entry + half, len - half);
+
+    g_out_len += len;
+}
+
+static void
+churn_appender (const char* p_entry, void* p_udata)
+{
+    (void)p_entry;
+
+    churn_ctx_t* p_ctx = (churn_ctx_t*)p_udata;
+
+    if (STRESS_MAGIC != p_ctx->magic)
+    {
+        fprintf(stderr, "Removed appender was called\n");
+        abort();
+    }
+
+    __atomic_add_fetch(&p_ctx->calls, 1, __ATOMIC_RELAXED);
+}
+
+static void*
+producer (void* p_arg)
+{
+    size_t thread = (size_t)p_arg;
+    char   payload[STRESS_MAX_PAYLOAD + 1];
+
+    for (size_t seq = 0; seq < g_entries; seq++)
+    {
+        size_t len = payload_len(thread, seq);
+
+        memset(payload, payload_char(thread, seq), len);
+        payload[len] = '\0';
+
+        if (gb_ordered)
+        {
+            // Entries written in this order must come out in this order
+            pthread_mutex_lock(&g_order_mutex);
+            plog_info("stress t=%zu seq=%zu g=%zu len=%zu %s", thread, seq,
+                      g_order++, len, payload);
+            pthread_mutex_unlock(&g_order_mutex);
+        }
+        else
+        {
+            plog_info("stress t=%zu seq=%zu g=0 len=%zu %s", thread, seq, len,
+                      payload);
+        }
+
+        // Flushes racing with the stop must neither hang nor lose entries
+        if (gb_stop && 0 == seq % 1000)
+        {
+            plog_flush();
+        }
+    }
+
+    return NULL;
+}
+
+static void*
+churner (void* p_arg)
+{
+    unsigned seed = (unsigned)(size_t)p_arg;
+
+    while (!__atomic_load_n(&g_done, __ATOMIC_ACQUIRE))
+    {
+        seed = seed * 1103515245u + 12345u;
+
+        // Producers log at INFO, so these never filter checked entries
+        plog_set_level(g_checked, (plog_level_t)((seed >> 16) % 3));
+        plog_enable_appender(g_checked);
+
+        churn_ctx_t* p_ctx = (churn_ctx_t*)malloc(sizeof(churn_ctx_t));
+
+        if (NULL == p_ctx)
+        {
+            continue;
+        }
+
+        p_ctx->magic = STRESS_MAGIC;
+        p_ctx->calls = 0;
+
+        plog_id_t id = plog_add_appender(churn_appender, PLOG_LEVEL_INFO, p_ctx);
+
+        plog_set_level(id, PLOG_LEVEL_TRACE);
+        plog_disable_appender(id);
+        plog_enable_appender(id);
+        plog_remove_appender(id);
+
+        p_ctx->magic = 0;
+        free(p_ctx);
+    }
+
+    return NULL;
+}
+
+/*
+ * Checks the output. Returns the number of errors.
+ */
+static size_t
+verify (uint64_t drops)
+{
+    size_t* p_next  = (size_t*)calloc(g_producers, sizeof(size_t));
+    size_t  torn    = 0;
+    size_t  dup     = 0;
+    size_t  gaps    = 0;
+    size_t  lines   = 0;
+    size_t  order   = 0; // Lines out of global order
+    size_t  last_g  = 0;
+
+    if (NULL == p_next)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    char* p_line = gp_out;
+    char* p_end  = gp_out + g_out_len;
+
+    while (p_line < p_end)
+    {
+        char* p_nl = memchr(p_line, '\n', (size_t)(p_end - p_line));
+
+        if (NULL == p_nl)
+        {
+            torn++;
+            break;
+        }
+
+        *p_nl = '\0';
+        lines++;
+
+        size_t thread, seq, g, len;
+        int    offset = 0;
+
+        if (4 != sscanf(p_line, "INFO stress t=%zu seq=%zu g=%zu len=%zu %n",
+                        &thread, &seq, &g, &len, &offset) ||
+            0 == offset || thread >= g_producers ||
+            len != payload_len(thread, seq) ||
+            strlen(p_line + offset) != len)
+        {
+            torn++;
+        }
+        else
+        {
+            char c = payload_char(thread, seq);
+
+            if (gb_ordered && lines > 1 && g <= last_g)
+            {
+                order++;
+            }
+
+            last_g = g;
+
+            for (size_t i = 0; i < len; i++)
+            {
+                if (p_line[offset + i] != c)
+                {
+                    torn++;
+                    break;
+                }
+            }
+
+            if (seq < p_next[thread])
+            {
+                dup++; // Duplicated or out of order
+            }
+            else
+            {
+                gaps += seq - p_next[thread];
+                p_next[thread] = seq + 1;
+            }
+        }
+
+        p_line = p_nl + 1;
+    }
+
+    // Entries missing at the end
+    for (size_t i = 0; i < g_producers; i++)
+    {
+        gaps += g_entries - p_next[i];
+    }
+
+    free(p_next);
+
+    // Async mode may drop entries when the arenas are full; those are
+    // counted, anything else missing is lost
+    size_t lost = (gaps > drops) ? (size_t)(gaps - drops) : 0;
+
+    printf("%s%s: %zu lines, %zu torn, %zu duplicated/reordered, %zu lost, "
+           "%llu dropped", gb_sharded ? "sharded" : gb_async ? "async" : "sync",
+           gb_ordered ? " ordered" : "", lines, torn, dup, lost,
+           (unsigned long long)drops);
+
+    if (gb_ordered)
+    {
+        printf(", %zu out of order", order);
+    }
+
+    printf("\n");
+
+    return torn + dup + lost + order + ((gaps < drops) ? 1 : 0);
+}
+
+int
+main (int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-t") && i + 1 < argc)
+        {
+            g_producers = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            g_entries = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "-a"))
+        {
+            gb_async = true;
+        }
+        else if (0 == strcmp(argv[i], "-s"))
+        {
+            gb_async   = true;
+            gb_sharded = true;
+        }
+        else if (0 == strcmp(argv[i], "-o"))
+        {
+            gb_ordered = true;
+        }
+        else if (0 == strcmp(argv[i], "-x"))
+        {
+            gb_stop = true;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-t producers] [-n entries] [-a | -s] "
+                    "[-o] [-x]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (0 == g_producers)
+    {
+        return EXIT_FAILURE;
+    }
+
+    g_checked = plog_add_appender(out_appender, PLOG_LEVEL_INFO, NULL);
+    plog_set_lock(g_checked, out_lock, &g_out_mutex);
+
+    if (gb_async && !(gb_sharded ? plog_async_start_sharded()
+                                 : plog_async_start()))
+    {
+        fprintf(stderr, "Async mode unavailable\n");
+        return EXIT_FAILURE;
+    }
+
+    pthread_t* p_producers = (pthread_t*)calloc(g_producers, sizeof(pthread_t));
+    pthread_t  churners[STRESS_CHURNERS];
+
+    if (NULL == p_producers)
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < STRESS_CHURNERS; i++)
+    {
+        pthread_create(&churners[i], NULL, churner, (void*)(i + 1));
+    }
+
+    for (size_t i = 0; i < g_producers; i++)
+    {
+        pthread_create(&p_producers[i], NULL, producer, (void*)i);
+    }
+
+    if (gb_stop)
+    {
+        // Producers still running switch to synchronous writes
+        struct timespec delay = { 0, 2000000 };
+
+        nanosleep(&delay, NULL);
+        plog_async_stop();
+    }
+
+    for (size_t i = 0; i < g_producers; i++)
+    {
+        pthread_join(p_producers[i], NULL);
+    }
+
+    __atomic_store_n(&g_done, 1, __ATOMIC_RELEASE);
+
+    for (size_t i = 0; i < STRESS_CHURNERS; i++)
+    {
+        pthread_join(churners[i], NULL);
+    }
+
+    plog_async_stop();
+
+    plog_stats_t stats;
+    plog_get_stats(&stats);
+
+    size_t errors = verify(stats.appenders[g_checked].drops);
+
+    free(p_producers);
+    free(gp_out);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
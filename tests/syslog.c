@@ -0,0 +1,528 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Syslog appender test. A local listener on a Unix datagram socket (or UDP
+ * on 127.0.0.1) receives the frames, which are checked against RFC 5424 and
+ * the level to severity mapping, and for STRUCTURED-DATA that stays well-formed
+ * when it does not fit. Producer threads then log in bulk, flushing often
+ * enough for the listener to keep up; every entry must arrive intact and in
+ * order. On the Unix socket the listener is also restarted at the same path,
+ * and the appender must reconnect without dropping the next frame.
+ *
+ * Usage: syslog [-n entries] [-u]
+ *
+ *   -n  Entries per producer (default 20000)
+ *   -u  Use UDP instead of a Unix datagram socket
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <picolog.h>
+#include <appenders/plog_syslog.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define SYSLOG_PRODUCERS 2
+#define SYSLOG_MAX_FRAME 512
+#define SYSLOG_PACE      64  // Bulk entries per producer between flushes
+#define SYSLOG_LONG_LEN  240 // Context value too long for a frame once escaped
+
+static size_t         g_entries  = 20000;
+static bool           gb_udp     = false;
+static plog_syslog_t* gp_syslog  = NULL;
+
+/*
+ * Frames received by the listener.
+ */
+static pthread_mutex_t g_rx_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char            g_rx_last[SYSLOG_MAX_FRAME + 1];
+static size_t          g_rx_count = 0;
+static size_t          g_rx_bad   = 0;
+static size_t*         gp_rx_next = NULL; // Next expected seq per producer
+static size_t          g_rx_gaps  = 0;
+
+static void*
+listener (void* p_arg)
+{
+    int  fd = (int)(size_t)p_arg;
+    char frame[SYSLOG_MAX_FRAME + 1];
+
+    for (;;)
+    {
+        ssize_t len = recv(fd, frame, SYSLOG_MAX_FRAME, 0);
+
+        if (len <= 0)
+        {
+            break; // Receive timeout or shutdown: the test is over
+        }
+
+        frame[len] = '\0';
+
+        pthread_mutex_lock(&g_rx_mutex);
+
+        memcpy(g_rx_last, frame, (size_t)len + 1);
+        g_rx_count++;
+
+        // Bulk entries: <14>1 TIMESTAMP HOST test PID - - bulk t=N seq=N
+        size_t thread, seq;
+        char*  p_msg = strstr(frame, " - - bulk ");
+
+        if (NULL != p_msg)
+        {
+            char  expected[64];
+            char  timestamp[32], host[256], app[64];
+            long  pid;
+            int   pri;
+            int   offset = 0;
+
+            if (2 != sscanf(p_msg, " - - bulk t=%zu seq=%zu", &thread,
+                            &seq) ||
+                thread >= SYSLOG_PRODUCERS)
+            {
+                thread = SYSLOG_PRODUCERS;
+            }
+            else
+            {
+                snprintf(expected, sizeof(expected), "bulk t=%zu seq=%zu",
+                         thread, seq);
+            }
+
+            if (SYSLOG_PRODUCERS == thread ||
+                5 != sscanf(frame, "<%d>1 %31s %255s %63s %ld - - %n", &pri,
+                            timestamp, host, app, &pid, &offset) ||
+                14 != pri || 20 != strlen(timestamp) ||
+                0 != strcmp(app, "test") || pid != (long)getpid() ||
+                0 == offset || 0 != strcmp(frame + offset, expected) ||
+                NULL != strstr(frame, "  ") ||
+                seq < gp_rx_next[thread])
+            {
+                g_rx_bad++;
+            }
+            else
+            {
+                g_rx_gaps += seq - gp_rx_next[thread];
+                gp_rx_next[thread] = seq + 1;
+            }
+        }
+
+        pthread_mutex_unlock(&g_rx_mutex);
+    }
+
+    return NULL;
+}
+
+/*
+ * Binds a Unix datagram socket at `path`. Returns -1 on failure.
+ */
+static int
+unix_listener (const char* path)
+{
+    struct sockaddr_un addr;
+
+    unlink(path);
+
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strcpy(addr.sun_path, path);
+
+    int fd = socket(AF_UNIX, SOCK_DGRAM, 0);
+
+    if (fd >= 0 && 0 != bind(fd, (struct sockaddr*)&addr, sizeof(addr)))
+    {
+        close(fd);
+        fd = -1;
+    }
+
+    return fd;
+}
+
+/*
+ * Starts the listener thread on `fd`.
+ */
+static void
+start_listener (int fd, pthread_t* p_thread)
+{
+    struct timeval timeout = { 0, 500000 };
+    int            rcvbuf  = 4 * 1024 * 1024;
+
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+
+    pthread_create(p_thread, NULL, listener, (void*)(size_t)fd);
+}
+
+static void*
+producer (void* p_arg)
+{
+    size_t thread = (size_t)p_arg;
+
+    for (size_t seq = 0; seq < g_entries; seq++)
+    {
+        plog_info("bulk t=%zu seq=%zu", thread, seq);
+
+        // Stay well short of the slots, so nothing is dropped
+        if (0 == (seq + 1) % SYSLOG_PACE)
+        {
+            plog_syslog_flush(gp_syslog);
+        }
+    }
+
+    return NULL;
+}
+
+/*
+ * Waits for the listener to receive more than `count` frames and copies the
+ * last one. Returns false on timeout.
+ */
+static bool
+receive (size_t count, char* p_frame)
+{
+    for (int i = 0; i < 1000; i++)
+    {
+        pthread_mutex_lock(&g_rx_mutex);
+        bool b_received = g_rx_count > count;
+        memcpy(p_frame, g_rx_last, SYSLOG_MAX_FRAME + 1);
+        pthread_mutex_unlock(&g_rx_mutex);
+
+        if (b_received)
+        {
+            return true;
+        }
+
+        struct timespec pause = { 0, 1000000 };
+        nanosleep(&pause, NULL);
+    }
+
+    return false;
+}
+
+static size_t
+rx_count (void)
+{
+    pthread_mutex_lock(&g_rx_mutex);
+    size_t count = g_rx_count;
+    pthread_mutex_unlock(&g_rx_mutex);
+
+    return count;
+}
+
+/*
+ * Logs one entry at `level` and checks the frame that arrives.
+ */
+static size_t
+check_level (plog_syslog_t* p_syslog, plog_level_t level, int pri)
+{
+    char expected[64];
+    char frame[SYSLOG_MAX_FRAME + 1];
+    int  rx_pri;
+    char timestamp[32], host[256], app[64], msgid[8], sd[8];
+    long pid;
+    int  offset = 0;
+
+    size_t count = rx_count();
+
+    switch (level)
+    {
+        case PLOG_LEVEL_TRACE: plog_trace("level %d", (int)level); break;
+        case PLOG_LEVEL_DEBUG: plog_debug("level %d", (int)level); break;
+        case PLOG_LEVEL_INFO:  plog_info("level %d", (int)level);  break;
+        case PLOG_LEVEL_WARN:  plog_warn("level %d", (int)level);  break;
+        case PLOG_LEVEL_ERROR: plog_error("level %d", (int)level); break;
+        default:               plog_fatal("level %d", (int)level); break;
+    }
+
+    plog_syslog_flush(p_syslog);
+
+    if (receive(count, frame))
+    {
+        snprintf(expected, sizeof(expected), "level %d", (int)level);
+
+        if (7 == sscanf(frame, "<%d>1 %31s %255s %63s %ld %7s %7s %n",
+                        &rx_pri, timestamp, host, app, &pid, msgid, sd,
+                        &offset) &&
+            rx_pri == pri && 20 == strlen(timestamp) &&
+            'T' == timestamp[10] && 'Z' == timestamp[19] &&
+            0 == strcmp(app, "test") && pid == (long)getpid() &&
+            0 == strcmp(msgid, "-") && 0 == strcmp(sd, "-") &&
+            0 == strcmp(frame + offset, expected))
+        {
+            return 0;
+        }
+
+        printf("bad frame: %s\n", frame);
+        return 1;
+    }
+
+    printf("no frame for level %d\n", (int)level);
+    return 1;
+}
+
+/*
+ * Checks a frame whose STRUCTURED-DATA filled it: an escaped run of ']'
+ * closed by '"] ', then as much of the message as fits.
+ */
+static bool
+check_truncated (const char* p_frame)
+{
+    const char* p_sd = strstr(p_frame, " - [ctx@32473 long=\"");
+
+    if (NULL == p_sd || SYSLOG_MAX_FRAME != strlen(p_frame))
+    {
+        return false;
+    }
+
+    p_sd += strlen(" - [ctx@32473 long=\"");
+
+    size_t pairs = 0;
+
+    for (; '\\' == p_sd[0] && ']' == p_sd[1]; p_sd += 2)
+    {
+        pairs++;
+    }
+
+    return pairs > 0 && pairs < SYSLOG_LONG_LEN &&
+           0 == strncmp(p_sd, "\"] ", 3) &&
+           0 == strncmp(p_sd + 3, "truncated", strlen(p_sd + 3));
+}
+
+int
+main (int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            g_entries = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "-u"))
+        {
+            gb_udp = true;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-n entries] [-u]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    gp_rx_next = (size_t*)calloc(SYSLOG_PRODUCERS, sizeof(size_t));
+
+    if (NULL == gp_rx_next)
+    {
+        return EXIT_FAILURE;
+    }
+
+    // Local listener
+    plog_syslog_cfg_t cfg;
+    plog_syslog_defaults(&cfg);
+
+    char path[64];
+    int  fd;
+
+    if (gb_udp)
+    {
+        struct sockaddr_in addr;
+        socklen_t          addr_len = sizeof(addr);
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family      = AF_INET;
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+        fd = socket(AF_INET, SOCK_DGRAM, 0);
+
+        if (fd < 0 || 0 != bind(fd, (struct sockaddr*)&addr, sizeof(addr)) ||
+            0 != getsockname(fd, (struct sockaddr*)&addr, &addr_len))
+        {
+            return EXIT_FAILURE;
+        }
+
+        cfg.path = NULL;
+        cfg.port = ntohs(addr.sin_port);
+    }
+    else
+    {
+        snprintf(path, sizeof(path), "/tmp/plog_syslog_%ld", (long)getpid());
+
+        fd = unix_listener(path);
+
+        if (fd < 0)
+        {
+            return EXIT_FAILURE;
+        }
+
+        cfg.path = path;
+    }
+
+    pthread_t thread;
+    start_listener(fd, &thread);
+
+    cfg.app_name  = "test";
+    cfg.max_frame = SYSLOG_MAX_FRAME;
+
+    plog_syslog_t* p_syslog = plog_syslog_open(&cfg);
+
+    gp_syslog = p_syslog;
+
+    if (NULL == p_syslog)
+    {
+        fprintf(stderr, "Failed to open syslog appender\n");
+        return EXIT_FAILURE;
+    }
+
+    plog_id_t id = plog_add_syslog(p_syslog, PLOG_LEVEL_INFO);
+    plog_set_level(id, PLOG_LEVEL_TRACE);
+
+    // Facility USER (1): PRI = 8 + severity
+    size_t errors = 0;
+
+    errors += check_level(p_syslog, PLOG_LEVEL_TRACE, 15);
+    errors += check_level(p_syslog, PLOG_LEVEL_DEBUG, 15);
+    errors += check_level(p_syslog, PLOG_LEVEL_INFO,  14);
+    errors += check_level(p_syslog, PLOG_LEVEL_WARN,  12);
+    errors += check_level(p_syslog, PLOG_LEVEL_ERROR, 11);
+    errors += check_level(p_syslog, PLOG_LEVEL_FATAL, 10);
+
+    // Context fields become STRUCTURED-DATA, with PARAM-VALUE escaping
+    char   frame[SYSLOG_MAX_FRAME + 1];
+    size_t count = rx_count();
+
+    plog_ctx_push("req", "a\"b]");
+    plog_info("sd");
+    plog_ctx_pop();
+    plog_syslog_flush(p_syslog);
+
+    if (!receive(count, frame) ||
+        NULL == strstr(frame, " - [ctx@32473 req=\"a\\\"b\\]\"] sd"))
+    {
+        printf("bad structured data: %s\n", frame);
+        errors++;
+    }
+
+    // A value that does not fit is truncated, and the element still closed
+    char long_value[SYSLOG_LONG_LEN + 1];
+
+    memset(long_value, ']', SYSLOG_LONG_LEN);
+    long_value[SYSLOG_LONG_LEN] = '\0';
+
+    count = rx_count();
+
+    plog_ctx_push("long", long_value);
+    plog_ctx_push("next", "x");
+    plog_info("truncated");
+    plog_ctx_pop();
+    plog_ctx_pop();
+    plog_syslog_flush(p_syslog);
+
+    if (!receive(count, frame) || !check_truncated(frame))
+    {
+        printf("bad truncated structured data: %s\n", frame);
+        errors++;
+    }
+
+    // A restarted listener binds a new socket at the same path; sends to the
+    // old one are refused until the appender reconnects
+    if (!gb_udp)
+    {
+        shutdown(fd, SHUT_RDWR);
+        pthread_join(thread, NULL);
+        close(fd);
+
+        fd = unix_listener(path);
+
+        if (fd < 0)
+        {
+            return EXIT_FAILURE;
+        }
+
+        start_listener(fd, &thread);
+
+        count = rx_count();
+
+        plog_info("restarted");
+        plog_syslog_flush(p_syslog);
+
+        if (!receive(count, frame) || NULL == strstr(frame, " - - restarted"))
+        {
+            printf("no frame after the listener restarted: %s\n", frame);
+            errors++;
+        }
+    }
+
+    // Bulk
+    pthread_t producers[SYSLOG_PRODUCERS];
+
+    for (size_t i = 0; i < SYSLOG_PRODUCERS; i++)
+    {
+        pthread_create(&producers[i], NULL, producer, (void*)i);
+    }
+
+    for (size_t i = 0; i < SYSLOG_PRODUCERS; i++)
+    {
+        pthread_join(producers[i], NULL);
+    }
+
+    plog_syslog_flush(p_syslog);
+    plog_remove_appender(id);
+
+    uint64_t drops = plog_syslog_drops(p_syslog);
+
+    plog_syslog_close(p_syslog);
+
+    pthread_join(thread, NULL);
+    close(fd);
+
+    if (!gb_udp)
+    {
+        unlink(path);
+    }
+
+    for (size_t i = 0; i < SYSLOG_PRODUCERS; i++)
+    {
+        g_rx_gaps += g_entries - gp_rx_next[i];
+    }
+
+    // UDP may also lose datagrams in the kernel, which cannot be counted
+    size_t lost = (g_rx_gaps > drops) ? (size_t)(g_rx_gaps - drops) : 0;
+
+    printf("%s: %zu frames, %zu bad, %zu lost, %llu dropped\n",
+           gb_udp ? "udp" : "unix", g_rx_count, g_rx_bad, lost,
+           (unsigned long long)drops);
+
+    errors += g_rx_bad + drops + (gb_udp ? 0 : lost);
+
+    free(gp_rx_next);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,206 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * io_uring file appender test. Producer threads log sequence-numbered entries
+ * of varying length (some larger than a buffer) to a file that already has
+ * content. The file is then checked for torn, lost, duplicated and reordered
+ * lines.
+ *
+ * Usage: uring [-t producers] [-n entries] [-w]
+ *
+ *   -t  Number of producer threads (default 4)
+ *   -n  Entries per producer (default 20000)
+ *   -w  Force the writev fallback
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "payload.h"
+
+#include <appenders/plog_uring.h>
+
+#include <pthread.h>
+
+#define URING_BUFFER_SIZE 4096
+
+static size_t g_producers = 4;
+static size_t g_entries   = 20000;
+static bool   gb_writev   = false;
+
+static void*
+producer (void* p_arg)
+{
+    payload_log("uring", (size_t)p_arg, g_entries);
+
+    return NULL;
+}
+
+/*
+ * Checks the file. Returns the number of errors.
+ */
+static size_t
+verify (const char* path)
+{
+    FILE* p_file = fopen(path, "rb");
+
+    if (NULL == p_file)
+    {
+        return 1;
+    }
+
+    payload_check_t check;
+    payload_check_init(&check, "uring", g_producers);
+
+    char* p_line = (char*)malloc(PAYLOAD_LINE_MAX);
+
+    if (NULL == p_line)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    if (NULL == fgets(p_line, PAYLOAD_LINE_MAX, p_file) ||
+        0 != strcmp(p_line, PAYLOAD_HEADER))
+    {
+        check.torn++; // Existing content was overwritten
+    }
+
+    while (NULL != fgets(p_line, PAYLOAD_LINE_MAX, p_file))
+    {
+        size_t line_len = strlen(p_line);
+
+        if (0 == line_len || '\n' != p_line[line_len - 1])
+        {
+            check.lines++;
+            check.torn++;
+            continue;
+        }
+
+        p_line[line_len - 1] = '\0';
+        payload_check_line(&check, p_line);
+    }
+
+    fclose(p_file);
+    free(p_line);
+
+    size_t errors = payload_check_end(&check, g_entries);
+
+    printf("%s: %zu lines, %zu torn, %zu duplicated/reordered, %zu lost\n",
+           gb_writev ? "writev" : "io_uring", check.lines, check.torn,
+           check.dup, check.gaps);
+
+    return errors;
+}
+
+int
+main (int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-t") && i + 1 < argc)
+        {
+            g_producers = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            g_entries = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "-w"))
+        {
+            gb_writev = true;
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-t producers] [-n entries] [-w]\n",
+                    argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (0 == g_producers)
+    {
+        return EXIT_FAILURE;
+    }
+
+    char path[] = "/tmp/plog_uring_XXXXXX";
+
+    if (!payload_create(path))
+    {
+        return EXIT_FAILURE;
+    }
+
+    plog_uring_cfg_t cfg;
+    plog_uring_defaults(&cfg);
+
+    cfg.buffer_size = URING_BUFFER_SIZE;
+    cfg.b_use_uring = !gb_writev;
+
+    plog_uring_t* p_uring = plog_uring_open(path, &cfg);
+
+    if (NULL == p_uring)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        return EXIT_FAILURE;
+    }
+
+    if (!gb_writev && !plog_uring_active(p_uring))
+    {
+        printf("io_uring unavailable, using writev\n");
+    }
+
+    plog_id_t id = plog_add_uring(p_uring, PLOG_LEVEL_INFO);
+    plog_set_layout(id, "%L %m");
+
+    pthread_t* p_producers = (pthread_t*)calloc(g_producers, sizeof(pthread_t));
+
+    if (NULL == p_producers)
+    {
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < g_producers; i++)
+    {
+        pthread_create(&p_producers[i], NULL, producer, (void*)i);
+    }
+
+    for (size_t i = 0; i < g_producers; i++)
+    {
+        pthread_join(p_producers[i], NULL);
+    }
+
+    plog_uring_flush(p_uring);
+    plog_remove_appender(id);
+
+    size_t errors = plog_uring_errors(p_uring) ? 1 : 0;
+
+    plog_uring_close(p_uring);
+
+    errors += verify(path);
+
+    unlink(path);
+    free(p_producers);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
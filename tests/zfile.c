@@ -0,0 +1,694 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Compressing file appender test. Producer threads log sequence-numbered
+ * entries of varying length (some larger than a frame) to a file that starts
+ * with uncompressed content; a frame cut short is appended, then a second
+ * session logs more entries. The file is decoded with the reader and checked
+ * for torn, lost, duplicated and reordered lines, and for the damaged data
+ * being skipped. Then checks that a partly filled frame is written after
+ * `flush_ms`, and that frames of known content start and end where expected
+ * and decode (also with plog_zcat) around a corrupt byte, a corrupt header and
+ * a frame cut short.
+ *
+ * Usage: zfile [-t producers] [-n entries] [-c none] [-z plog_zcat]
+ *
+ *   -t  Number of producer threads (default 4)
+ *   -n  Entries per producer (default 20000)
+ *   -c  Store frames uncompressed
+ *   -z  Also decode the damaged files with this plog_zcat
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include "payload.h"
+
+#include <appenders/plog_zfile.h>
+
+#include <pthread.h>
+#include <time.h>
+
+#define ZFILE_FRAME_SIZE    4096
+#define ZFILE_SHORT_FRAMES  4 // Damage test: frames holding one short entry
+#define ZFILE_LARGE_LEN     (2 * ZFILE_FRAME_SIZE + 99) // Then one spanning 3
+#define ZFILE_DAMAGE_FRAMES (ZFILE_SHORT_FRAMES + 3)
+#define ZFILE_DAMAGE_LEN    (ZFILE_SHORT_FRAMES * 16 + ZFILE_LARGE_LEN + 1)
+
+static size_t g_producers = 4;
+static size_t g_entries   = 20000;
+static bool   gb_store    = false;
+static char*  gp_zcat     = NULL; // plog_zcat to check, if given
+
+static void
+sleep_ms (long ms)
+{
+    struct timespec delay = { 0, ms * 1000000L };
+    nanosleep(&delay, NULL);
+}
+
+static void*
+producer (void* p_arg)
+{
+    payload_log("zfile", (size_t)p_arg, g_entries);
+
+    return NULL;
+}
+
+static plog_zfile_t*
+open_zfile (const char* path, unsigned flush_ms)
+{
+    plog_zfile_cfg_t cfg;
+    plog_zfile_defaults(&cfg);
+
+    cfg.frame_size = ZFILE_FRAME_SIZE;
+    cfg.flush_ms   = flush_ms;
+
+    if (gb_store)
+    {
+        cfg.p_codec = plog_codec_find(PLOG_CODEC_NONE);
+    }
+
+    plog_zfile_t* p_zfile = plog_zfile_open(path, &cfg);
+
+    if (NULL == p_zfile)
+    {
+        fprintf(stderr, "Failed to open %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    return p_zfile;
+}
+
+/*
+ * Runs `producers` threads numbered from `first`, then closes the file.
+ * Returns the number of errors.
+ */
+static size_t
+session (const char* path, size_t first, size_t producers)
+{
+    plog_zfile_t* p_zfile = open_zfile(path, 1000);
+
+    plog_id_t id = plog_add_zfile(p_zfile, PLOG_LEVEL_INFO);
+    plog_set_layout(id, "%L %m");
+
+    pthread_t* p_producers = (pthread_t*)calloc(producers, sizeof(pthread_t));
+
+    if (NULL == p_producers)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    for (size_t i = 0; i < producers; i++)
+    {
+        pthread_create(&p_producers[i], NULL, producer, (void*)(first + i));
+    }
+
+    for (size_t i = 0; i < producers; i++)
+    {
+        pthread_join(p_producers[i], NULL);
+    }
+
+    plog_flush();
+    plog_remove_appender(id);
+
+    uint64_t raw, written;
+    plog_zfile_totals(p_zfile, &raw, &written);
+
+    printf("%s: %llu bytes logged, %llu written (%.1fx)\n",
+           gb_store ? "none" : "zlib", (unsigned long long)raw,
+           (unsigned long long)written, (double)raw / (double)written);
+
+    size_t errors = plog_zfile_errors(p_zfile) ? 1 : 0;
+
+    // The payloads are runs of one character, so anything short of this
+    // means frames were not compressed
+    if (!gb_store && written * 4 > raw)
+    {
+        errors++;
+    }
+
+    plog_zfile_close(p_zfile);
+    free(p_producers);
+
+    return errors;
+}
+
+/*
+ * Decodes the whole file into memory. Returns NULL on a read error.
+ */
+static char*
+decode (const char* path, size_t* p_len, size_t* p_skipped)
+{
+    plog_zread_t* p_zread = plog_zread_open(path);
+    char*         p_out   = NULL;
+    size_t        cap     = 0;
+
+    *p_len     = 0;
+    *p_skipped = 0;
+
+    if (NULL == p_zread)
+    {
+        return NULL;
+    }
+
+    for (;;)
+    {
+        const char*         p_data;
+        size_t              len;
+        plog_zread_result_t result = plog_zread_next(p_zread, &p_data, &len);
+
+        if (PLOG_ZREAD_SKIPPED == result)
+        {
+            (*p_skipped)++;
+            continue;
+        }
+
+        if (PLOG_ZREAD_FRAME != result)
+        {
+            if (PLOG_ZREAD_ERROR == result)
+            {
+                free(p_out);
+                p_out = NULL;
+            }
+
+            break;
+        }
+
+        if (*p_len + len + 1 > cap)
+        {
+            cap   = (*p_len + len + 1) * 2;
+            p_out = (char*)realloc(p_out, cap);
+
+            if (NULL == p_out)
+            {
+                fprintf(stderr, "Out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        memcpy(p_out + *p_len, p_data, len);
+        *p_len += len;
+        p_out[*p_len] = '\0';
+    }
+
+    plog_zread_close(p_zread);
+
+    return p_out;
+}
+
+/*
+ * Checks the decoded file. Returns the number of errors.
+ */
+static size_t
+verify (const char* path, size_t producers)
+{
+    size_t len, skipped;
+    char*  p_out = decode(path, &len, &skipped);
+
+    if (NULL == p_out)
+    {
+        printf("decode failed\n");
+        return 1;
+    }
+
+    payload_check_t check;
+    payload_check_init(&check, "zfile", producers);
+
+    char* p_line = p_out;
+    char* p_end  = p_out + len;
+
+    while (p_line < p_end)
+    {
+        char* p_nl = memchr(p_line, '\n', (size_t)(p_end - p_line));
+
+        if (NULL == p_nl)
+        {
+            check.lines++;
+            check.torn++;
+            break;
+        }
+
+        *p_nl = '\0';
+        payload_check_line(&check, p_line);
+
+        p_line = p_nl + 1;
+    }
+
+    free(p_out);
+
+    size_t errors = payload_check_end(&check, g_entries);
+
+    // The uncompressed header and the frame cut short
+    printf("%s: %zu lines, %zu torn, %zu duplicated/reordered, %zu lost, "
+           "%zu skipped\n", gb_store ? "none" : "zlib", check.lines,
+           check.torn, check.dup, check.gaps, skipped);
+
+    return errors + ((2 != skipped) ? 1 : 0);
+}
+
+/*
+ * Appends the start of a frame whose data never made it to the file.
+ */
+static void
+append_torn (const char* path)
+{
+    FILE* p_file = fopen(path, "ab");
+
+    if (NULL == p_file)
+    {
+        exit(EXIT_FAILURE);
+    }
+
+    static const char torn[] = PLOG_ZFILE_MAGIC "\1\0\0\0\0\20\0\0\0\4\0\0xx";
+
+    fwrite(torn, 1, sizeof(torn) - 1, p_file);
+    fclose(p_file);
+}
+
+/*
+ * A partly filled frame must reach the file within `flush_ms`.
+ */
+static size_t
+test_timer (const char* path)
+{
+    plog_zfile_t* p_zfile = open_zfile(path, 20);
+
+    plog_id_t id = plog_add_zfile(p_zfile, PLOG_LEVEL_INFO);
+    plog_set_layout(id, "%m");
+
+    plog_info("timer");
+
+    size_t len     = 0;
+    size_t skipped = 0;
+    char*  p_out   = NULL;
+
+    for (int i = 0; i < 500 && 0 == len; i++)
+    {
+        sleep_ms(10);
+        free(p_out);
+        p_out = decode(path, &len, &skipped);
+    }
+
+    bool b_ok = NULL != p_out && 0 == strcmp(p_out, "timer\n");
+
+    printf("timer: %s\n", b_ok ? "ok" : "not written");
+
+    free(p_out);
+    plog_remove_appender(id);
+    plog_zfile_close(p_zfile);
+
+    return b_ok ? 0 : 1;
+}
+
+/*
+ * Reads the whole file into memory. Returns NULL on failure.
+ */
+static char*
+read_file (const char* path, size_t* p_len)
+{
+    FILE* p_file = fopen(path, "rb");
+
+    *p_len = 0;
+
+    if (NULL == p_file)
+    {
+        return NULL;
+    }
+
+    char*  p_data = NULL;
+    size_t cap    = 0;
+    size_t n;
+
+    do
+    {
+        if (*p_len + 4096 > cap)
+        {
+            cap    = (*p_len + 4096) * 2;
+            p_data = (char*)realloc(p_data, cap);
+
+            if (NULL == p_data)
+            {
+                fprintf(stderr, "Out of memory\n");
+                exit(EXIT_FAILURE);
+            }
+        }
+
+        n       = fread(p_data + *p_len, 1, 4096, p_file);
+        *p_len += n;
+    } while (n > 0);
+
+    fclose(p_file);
+
+    return p_data;
+}
+
+static void
+write_file (const char* path, const char* p_mode, const char* p_data,
+            size_t len)
+{
+    FILE* p_file = fopen(path, p_mode);
+
+    if (NULL == p_file || len != fwrite(p_data, 1, len, p_file))
+    {
+        fprintf(stderr, "Failed to write %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+
+    fclose(p_file);
+}
+
+/*
+ * Decodes the file with plog_zcat and checks its output. Returns the number
+ * of errors.
+ */
+static size_t
+check_zcat (const char* p_zcat, const char* path, const char* p_expect,
+            size_t expect_len)
+{
+    if (NULL == p_zcat)
+    {
+        return 0;
+    }
+
+    char command[256];
+
+    snprintf(command, sizeof(command), "%s %s 2>/dev/null", p_zcat, path);
+
+    FILE* p_pipe = popen(command, "r");
+
+    if (NULL == p_pipe)
+    {
+        return 1;
+    }
+
+    char*  p_out = (char*)malloc(expect_len + 1);
+    size_t len   = 0;
+    size_t n;
+
+    if (NULL == p_out)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // One byte more than expected shows up as a mismatch
+    while (len <= expect_len &&
+           (n = fread(p_out + len, 1, expect_len + 1 - len, p_pipe)) > 0)
+    {
+        len += n;
+    }
+
+    bool b_ok = 0 == pclose(p_pipe) && len == expect_len &&
+                0 == memcmp(p_out, p_expect, len);
+
+    free(p_out);
+
+    return b_ok ? 0 : 1;
+}
+
+/*
+ * Checks that decoding `path` gives `p_expect`, skipping damaged data
+ * `skipped` times, with the reader and with plog_zcat. Returns the number of
+ * errors.
+ */
+static size_t
+check_decode (const char* p_name, const char* p_zcat, const char* path,
+              const char* p_expect, size_t expect_len, size_t skipped)
+{
+    size_t len, found;
+    char*  p_out = decode(path, &len, &found);
+    bool   b_ok  = NULL != p_out && len == expect_len && found == skipped &&
+                   0 == memcmp(p_out, p_expect, len);
+
+    free(p_out);
+
+    size_t errors = (b_ok ? 0 : 1) +
+                    check_zcat(p_zcat, path, p_expect, expect_len);
+
+    printf("damage %s: %s\n", p_name, errors ? "failed" : "ok");
+
+    return errors;
+}
+
+/*
+ * Writes frames of known content: one short entry each, then one entry that
+ * spans several. Checks where the frames start and end, then that damaged
+ * copies of the file decode to the intact frames: a corrupt byte fails the
+ * frame checksum, a frame cut short ends the data until the rest is written,
+ * and the reader then picks it up.
+ */
+static size_t
+test_damage (const char* path, const char* p_zcat)
+{
+    plog_zfile_t* p_zfile = open_zfile(path, 1000);
+
+    plog_id_t id = plog_add_zfile(p_zfile, PLOG_LEVEL_INFO);
+    plog_set_layout(id, "%m");
+
+    static char expect[ZFILE_DAMAGE_LEN];
+    static char large[ZFILE_LARGE_LEN + 1];
+    size_t      expect_len = 0;
+    size_t      frame_len[ZFILE_DAMAGE_FRAMES];
+    size_t      frames = 0;
+
+    for (int i = 0; i < ZFILE_SHORT_FRAMES; i++)
+    {
+        frame_len[frames++] = (size_t)sprintf(expect + expect_len,
+                                              "frame %d\n", i);
+
+        plog_info("frame %d", i);
+        plog_zfile_flush(p_zfile);
+
+        expect_len += frame_len[frames - 1];
+    }
+
+    memset(large, 'z', ZFILE_LARGE_LEN);
+    plog_info("%s", large);
+    plog_zfile_flush(p_zfile);
+
+    memcpy(expect + expect_len, large, ZFILE_LARGE_LEN);
+    expect[expect_len + ZFILE_LARGE_LEN] = '\n';
+
+    for (size_t left = ZFILE_LARGE_LEN + 1; left > 0; )
+    {
+        frame_len[frames] = left < ZFILE_FRAME_SIZE ? left : ZFILE_FRAME_SIZE;
+        left             -= frame_len[frames++];
+    }
+
+    expect_len += ZFILE_LARGE_LEN + 1;
+
+    plog_remove_appender(id);
+    plog_zfile_close(p_zfile);
+
+    // Frame boundaries: every frame is where the one before it ends, holds
+    // what was flushed (or a full frame), and the last one ends the file
+    size_t len;
+    char*  p_file = read_file(path, &len);
+    size_t start[ZFILE_DAMAGE_FRAMES];
+    size_t offset = 0;
+    size_t errors = 0;
+
+    for (size_t i = 0; i < frames; i++)
+    {
+        if (NULL == p_file || offset + PLOG_ZFILE_HEADER_LEN > len ||
+            0 != memcmp(p_file + offset, PLOG_ZFILE_MAGIC, 4))
+        {
+            errors++;
+            break;
+        }
+
+        const unsigned char* p_header = (const unsigned char*)p_file + offset;
+
+        size_t raw_len  = p_header[8] | (size_t)p_header[9] << 8 |
+                          (size_t)p_header[10] << 16 |
+                          (size_t)p_header[11] << 24;
+        size_t data_len = p_header[12] | (size_t)p_header[13] << 8 |
+                          (size_t)p_header[14] << 16 |
+                          (size_t)p_header[15] << 24;
+
+        errors += (raw_len != frame_len[i]) ? 1 : 0;
+        start[i] = offset;
+        offset  += PLOG_ZFILE_HEADER_LEN + data_len;
+    }
+
+    errors += (offset != len) ? 1 : 0;
+
+    printf("damage boundaries: %s\n", errors ? "failed" : "ok");
+
+    if (0 != errors)
+    {
+        free(p_file);
+        return errors;
+    }
+
+    errors += check_decode("intact", p_zcat, path, expect, expect_len, 0);
+
+    // A corrupt byte in the second frame's data
+    char* p_copy = (char*)malloc(len);
+
+    if (NULL == p_copy)
+    {
+        fprintf(stderr, "Out of memory\n");
+        exit(EXIT_FAILURE);
+    }
+
+    memcpy(p_copy, p_file, len);
+    p_copy[start[1] + PLOG_ZFILE_HEADER_LEN] ^= 0x55;
+    write_file(path, "wb", p_copy, len);
+
+    char   without[ZFILE_DAMAGE_LEN];
+    size_t without_len = expect_len - frame_len[1];
+
+    memcpy(without, expect, frame_len[0]);
+    memcpy(without + frame_len[0], expect + frame_len[0] + frame_len[1],
+           without_len - frame_len[0]);
+
+    errors += check_decode("checksum", p_zcat, path, without, without_len, 1);
+
+    // A corrupt header in the middle of the spanning entry
+    memcpy(p_copy, p_file, len);
+    p_copy[start[ZFILE_SHORT_FRAMES + 1] + 8] ^= 0x55;
+    write_file(path, "wb", p_copy, len);
+
+    size_t cut = 0;
+
+    for (size_t i = 0; i <= ZFILE_SHORT_FRAMES; i++)
+    {
+        cut += frame_len[i];
+    }
+
+    memcpy(without, expect, cut);
+    memcpy(without + cut, expect + cut + ZFILE_FRAME_SIZE,
+           expect_len - cut - ZFILE_FRAME_SIZE);
+
+    errors += check_decode("header", p_zcat, path, without,
+                           expect_len - ZFILE_FRAME_SIZE, 1);
+
+    // The last frame cut short: the data ends before it, and the reader
+    // decodes it once the rest is written
+    size_t last = start[frames - 1] + PLOG_ZFILE_HEADER_LEN / 2;
+
+    write_file(path, "wb", p_file, last);
+
+    errors += check_decode("truncated", p_zcat, path, expect,
+                           expect_len - frame_len[frames - 1], 0);
+
+    plog_zread_t* p_zread = plog_zread_open(path);
+    const char*   p_data  = NULL;
+    size_t        data_len;
+
+    while (NULL != p_zread &&
+           PLOG_ZREAD_FRAME == plog_zread_next(p_zread, &p_data, &data_len))
+    {
+    }
+
+    write_file(path, "ab", p_file + last, len - last);
+
+    bool b_ok = NULL != p_zread &&
+                PLOG_ZREAD_FRAME == plog_zread_next(p_zread, &p_data,
+                                                    &data_len) &&
+                data_len == frame_len[frames - 1] &&
+                0 == memcmp(p_data, expect + expect_len - data_len, data_len) &&
+                PLOG_ZREAD_END == plog_zread_next(p_zread, &p_data, &data_len);
+
+    printf("damage completed: %s\n", b_ok ? "ok" : "failed");
+
+    errors += b_ok ? 0 : 1;
+
+    plog_zread_close(p_zread);
+    free(p_copy);
+    free(p_file);
+
+    return errors;
+}
+
+int
+main (int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-t") && i + 1 < argc)
+        {
+            g_producers = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            g_entries = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (0 == strcmp(argv[i], "-c") && i + 1 < argc &&
+                 0 == strcmp(argv[i + 1], "none"))
+        {
+            gb_store = true;
+            i++;
+        }
+        else if (0 == strcmp(argv[i], "-z") && i + 1 < argc)
+        {
+            gp_zcat = argv[++i];
+        }
+        else
+        {
+            fprintf(stderr, "Usage: %s [-t producers] [-n entries] "
+                    "[-c none] [-z plog_zcat]\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (0 == g_producers)
+    {
+        return EXIT_FAILURE;
+    }
+
+    char path[] = "/tmp/plog_zfile_XXXXXX";
+
+    if (!payload_create(path))
+    {
+        return EXIT_FAILURE;
+    }
+
+    size_t errors = session(path, 0, g_producers);
+
+    append_torn(path);
+
+    errors += session(path, g_producers, 1);
+    errors += verify(path, g_producers + 1);
+
+    unlink(path);
+
+    int fd = mkstemp(path);
+    close(fd);
+
+    errors += test_timer(path);
+
+    unlink(path);
+
+    fd = mkstemp(path);
+    close(fd);
+
+    errors += test_damage(path, gp_zcat);
+
+    unlink(path);
+
+    return errors ? EXIT_FAILURE : EXIT_SUCCESS;
+}
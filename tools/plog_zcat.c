@@ -0,0 +1,258 @@
+/*=============================================================================
+ * MIT License
+ *
+ * Copyright (c) 2020 James McLean
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the "Software"), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+ * IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+ * FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+ * AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+ * LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+ * FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS
+ * IN THE SOFTWARE.
+=============================================================================*/
+
+/*
+ * Decompresses log files written by the plog_zfile appender.
+ *
+ * Usage: plog_zcat [-f] [-n lines] file
+ *
+ *   -f  Keep reading as the file grows, like tail -f
+ *   -n  Only print the last `lines` lines (the file is read from near its end)
+ *
+ * Damaged data, e.g. a frame cut short by a crash, is skipped with a warning.
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <plog_zfile.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#define ZCAT_WINDOW    (256 * 1024) // Initial compressed bytes read for -n
+#define ZCAT_FOLLOW_MS 200          // Poll interval for -f
+
+static void
+sleep_ms (long ms)
+{
+    struct timespec delay = { ms / 1000, (ms % 1000) * 1000000L };
+    nanosleep(&delay, NULL);
+}
+
+/*
+ * Decodes the next frame, reporting damage. Returns false at the end of the
+ * data, or on an error (with `*p_error` set).
+ */
+static bool
+zcat_next (plog_zread_t* p_zread, const char* path, const char** pp_data,
+           size_t* p_len, bool* p_error)
+{
+    for (;;)
+    {
+        switch (plog_zread_next(p_zread, pp_data, p_len))
+        {
+            case PLOG_ZREAD_FRAME:
+                return true;
+
+            case PLOG_ZREAD_END:
+                return false;
+
+            case PLOG_ZREAD_SKIPPED:
+                fprintf(stderr, "%s: skipped damaged data\n", path);
+                break;
+
+            case PLOG_ZREAD_ERROR:
+            default:
+                fprintf(stderr, "%s: read error or unknown codec at offset "
+                        "%llu\n", path,
+                        (unsigned long long)plog_zread_offset(p_zread));
+                *p_error = true;
+                return false;
+        }
+    }
+}
+
+/*
+ * Prints the last `lines` lines. Frames do not start at line boundaries, so
+ * a window that does not start at the beginning of the file needs one extra
+ * line, which may be partial.
+ */
+static bool
+zcat_tail (plog_zread_t* p_zread, const char* path, uint64_t size,
+           size_t lines)
+{
+    uint64_t window = ZCAT_WINDOW;
+    char*    p_buf  = NULL;
+    size_t   len    = 0;
+    bool     b_error = false;
+
+    for (;;)
+    {
+        uint64_t start = (size > window) ? size - window : 0;
+        size_t   cap   = 0;
+
+        len = 0;
+        plog_zread_seek(p_zread, start);
+
+        const char* p_data;
+        size_t      data_len;
+
+        while (zcat_next(p_zread, path, &p_data, &data_len, &b_error))
+        {
+            if (len + data_len > cap)
+            {
+                cap   = (len + data_len) * 2;
+                p_buf = (char*)realloc(p_buf, cap);
+
+                if (NULL == p_buf)
+                {
+                    fprintf(stderr, "Out of memory\n");
+                    return false;
+                }
+            }
+
+            memcpy(p_buf + len, p_data, data_len);
+            len += data_len;
+        }
+
+        if (b_error)
+        {
+            free(p_buf);
+            return false;
+        }
+
+        // Find the start of the last `lines` lines
+        size_t found = 0;
+        size_t pos   = len;
+
+        if (pos > 0 && '\n' == p_buf[pos - 1])
+        {
+            pos--;
+        }
+
+        while (pos > 0 && found < lines)
+        {
+            if ('\n' == p_buf[--pos])
+            {
+                found++;
+            }
+        }
+
+        if (found == lines || 0 == start)
+        {
+            size_t from = (found == lines) ? pos + 1 : 0;
+
+            // A tail of zero lines is empty
+            if (0 == lines)
+            {
+                from = len;
+            }
+
+            fwrite(p_buf + from, 1, len - from, stdout);
+            free(p_buf);
+            return true;
+        }
+
+        window *= 2;
+    }
+}
+
+int
+main (int argc, char** argv)
+{
+    bool        b_follow = false;
+    bool        b_tail   = false;
+    size_t      lines    = 0;
+    const char* path     = NULL;
+
+    for (int i = 1; i < argc; i++)
+    {
+        if (0 == strcmp(argv[i], "-f"))
+        {
+            b_follow = true;
+        }
+        else if (0 == strcmp(argv[i], "-n") && i + 1 < argc)
+        {
+            b_tail = true;
+            lines  = (size_t)strtoul(argv[++i], NULL, 10);
+        }
+        else if (NULL == path && '-' != argv[i][0])
+        {
+            path = argv[i];
+        }
+        else
+        {
+            path = NULL;
+            break;
+        }
+    }
+
+    if (NULL == path)
+    {
+        fprintf(stderr, "Usage: %s [-f] [-n lines] file\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    plog_zread_t* p_zread = plog_zread_open(path);
+
+    if (NULL == p_zread)
+    {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    const char* p_data;
+    size_t      len;
+    bool        b_error = false;
+    struct stat st;
+
+    if (b_tail)
+    {
+        if (0 != stat(path, &st) ||
+            !zcat_tail(p_zread, path, (uint64_t)st.st_size, lines))
+        {
+            plog_zread_close(p_zread);
+            return EXIT_FAILURE;
+        }
+    }
+
+    do
+    {
+        while (zcat_next(p_zread, path, &p_data, &len, &b_error))
+        {
+            fwrite(p_data, 1, len, stdout);
+        }
+
+        fflush(stdout);
+
+        if (b_follow && !b_error)
+        {
+            sleep_ms(ZCAT_FOLLOW_MS);
+        }
+    } while (b_follow && !b_error);
+
+    // Anything after the last frame is a frame that was cut short
+    if (!b_error && 0 == stat(path, &st) &&
+        (uint64_t)st.st_size > plog_zread_offset(p_zread))
+    {
+        fprintf(stderr, "%s: incomplete frame at the end\n", path);
+    }
+
+    plog_zread_close(p_zread);
+
+    return b_error ? EXIT_FAILURE : EXIT_SUCCESS;
+}